@@ -0,0 +1,354 @@
+/**
+ * @file        ArchiveFormat.cpp
+ * @brief       The implementation of the archive format functions and the ArchiveReader class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "ArchiveFormat.h"
+
+#define ARCHIVE_WRITE_BLOCK 4096    //!< Number of pressure values converted and written at once.
+
+/**
+ * Creates the index entry of a session from the header of its recording.
+ * @param header The header of the recording.
+ * @param timestamp The start of the recording in seconds since the epoch.
+ * @param name The name of the recording, cut to ARCHIVE_NAME_SIZE - 1 characters.
+ * @param results The results of the algorithm.
+ * @return The entry, the session identifier and the columns are set when it is appended.
+ */
+ArchiveEntry makeArchiveEntry(const RecordHeader &header, int64_t timestamp, const std::string &name,
+                              const ArchiveResults &results) {
+    ArchiveEntry entry{};
+    entry.timestamp = timestamp;
+    std::strncpy(entry.name, name.c_str(), sizeof(entry.name) - 1);
+    entry.samplingRate = header.samplingRate;
+    entry.ambientVoltage = header.ambientVoltage;
+    entry.corrFactor = header.corrFactor;
+    entry.fcLP = header.fcLP;
+    entry.fcHP = header.fcHP;
+    entry.filterOrder = header.filterOrder;
+    entry.results = results;
+    return entry;
+}
+
+/**
+ * Writes zeros up to the next multiple of 8 bytes at the end of the file.
+ * @param file The archive.
+ * @return The offset after the padding.
+ */
+static uint64_t alignEnd(FILE *file) {
+    std::fseek(file, 0, SEEK_END);
+    const uint64_t end = std::ftell(file);
+    const uint64_t aligned = (end + 7) & ~uint64_t(7);
+    const char zeros[8] = {};
+    std::fwrite(zeros, 1, aligned - end, file);
+    return aligned;
+}
+
+/**
+ * Writes an empty index block at the end of the file.
+ * @param file The archive.
+ * @return The offset of the new block.
+ */
+static uint64_t appendIndexBlock(FILE *file) {
+    const uint64_t offset = alignEnd(file);
+    auto block = std::make_unique<ArchiveIndexBlock>();
+    std::strncpy(block->magic, ARCHIVE_INDEX_MAGIC, sizeof(block->magic));
+    block->capacity = ARCHIVE_INDEX_ENTRIES;
+    std::fwrite(block.get(), sizeof(ArchiveIndexBlock), 1, file);
+    return offset;
+}
+
+/**
+ * Appends a session to an archive, the archive is created if it does not exist.
+ *
+ * The voltage samples are stored as they are, and converted to mmHg with the calibration in the entry. They are
+ * taken block by block from readBlock, once for each column.
+ * @param fileName The name of the archive.
+ * @param entry The index entry of the session, as created by makeArchiveEntry.
+ * @param nSamples The number of samples of the session.
+ * @param readBlock Returns up to ARCHIVE_WRITE_BLOCK samples from the given one, empty if they can't be read.
+ * @return True if the session was appended.
+ */
+template<typename ReadBlock>
+static bool appendSession(const std::string &fileName, ArchiveEntry entry, uint64_t nSamples, ReadBlock readBlock) {
+    FILE *file = std::fopen(fileName.c_str(), "r+b");
+    ArchiveHeader header{};
+    if (file) {
+        if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+            std::strncmp(header.magic, ARCHIVE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version > ARCHIVE_VERSION) {
+            PLOG_ERROR << "Not a valid archive: " << fileName;
+            std::fclose(file);
+            return false;
+        }
+    } else {
+        file = std::fopen(fileName.c_str(), "w+b");
+        if (!file) {
+            PLOG_ERROR << "Could not create archive " << fileName;
+            return false;
+        }
+        std::strncpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+        header.version = ARCHIVE_VERSION;
+        header.headerSize = sizeof(ArchiveHeader);
+        std::fwrite(&header, sizeof(header), 1, file);
+        header.firstIndexBlock = appendIndexBlock(file);
+        std::fseek(file, offsetof(ArchiveHeader, firstIndexBlock), SEEK_SET);
+        std::fwrite(&header.firstIndexBlock, sizeof(header.firstIndexBlock), 1, file);
+    }
+
+    /**
+     * The sessions are counted on the way to the last index block, the new one gets the next number.
+     */
+    uint64_t blockOffset = header.firstIndexBlock;
+    uint64_t nSessions = 0;
+    ArchiveIndexBlock block{};
+    const size_t blockHeaderSize = offsetof(ArchiveIndexBlock, entries);
+    while (true) {
+        std::fseek(file, (long) blockOffset, SEEK_SET);
+        if (std::fread(&block, blockHeaderSize, 1, file) != 1 ||
+            std::strncmp(block.magic, ARCHIVE_INDEX_MAGIC, sizeof(block.magic)) != 0) {
+            PLOG_ERROR << "Invalid index in archive " << fileName;
+            std::fclose(file);
+            return false;
+        }
+        nSessions += block.count;
+        if (block.nextBlock == 0) {
+            break;
+        }
+        blockOffset = block.nextBlock;
+    }
+
+    /**
+     * The columns are written first, the entry only after they are complete.
+     */
+    entry.sessionId = nSessions + 1;
+    entry.nSamples = nSamples;
+    entry.voltageOffset = alignEnd(file);
+    bool bOk = true;
+    for (uint64_t first = 0; bOk && first < nSamples;) {
+        const std::span<const double> voltage = readBlock(first);
+        bOk = !voltage.empty() && std::fwrite(voltage.data(), sizeof(double), voltage.size(), file) == voltage.size();
+        first += voltage.size();
+    }
+    entry.pressureOffset = entry.voltageOffset + nSamples * sizeof(double);
+    float pressure[ARCHIVE_WRITE_BLOCK];
+    for (uint64_t first = 0; bOk && first < nSamples;) {
+        const std::span<const double> voltage = readBlock(first);
+        for (size_t i = 0; i < voltage.size(); i++) {
+            pressure[i] = (float) voltageToMmHg(voltage[i], entry.ambientVoltage, entry.corrFactor);
+        }
+        bOk = !voltage.empty() && std::fwrite(pressure, sizeof(float), voltage.size(), file) == voltage.size();
+        first += voltage.size();
+    }
+
+    if (bOk && block.count >= block.capacity) {
+        const uint64_t newBlock = appendIndexBlock(file);
+        std::fseek(file, (long) (blockOffset + offsetof(ArchiveIndexBlock, nextBlock)), SEEK_SET);
+        std::fwrite(&newBlock, sizeof(newBlock), 1, file);
+        blockOffset = newBlock;
+        block.count = 0;
+    }
+    if (bOk) {
+        std::fseek(file, (long) (blockOffset + blockHeaderSize + block.count * sizeof(ArchiveEntry)), SEEK_SET);
+        bOk = std::fwrite(&entry, sizeof(entry), 1, file) == 1 && std::fflush(file) == 0;
+    }
+    if (bOk) {
+        block.count++;
+        std::fseek(file, (long) (blockOffset + offsetof(ArchiveIndexBlock, count)), SEEK_SET);
+        bOk = std::fwrite(&block.count, sizeof(block.count), 1, file) == 1;
+    }
+    bOk = std::fclose(file) == 0 && bOk;
+    if (!bOk) {
+        PLOG_ERROR << "Could not write to archive " << fileName;
+    }
+    return bOk;
+}
+
+/**
+ * Appends a session to an archive, the archive is created if it does not exist.
+ *
+ * The voltage samples are stored as they are, and converted to mmHg with the calibration in the entry.
+ * @param fileName The name of the archive.
+ * @param entry The index entry of the session, as created by makeArchiveEntry.
+ * @param voltage The raw voltage samples of the session.
+ * @return True if the session was appended.
+ */
+bool appendArchiveSession(const std::string &fileName, ArchiveEntry entry, std::span<const double> voltage) {
+    return appendSession(fileName, entry, voltage.size(), [voltage](uint64_t first) {
+        return voltage.subspan(first, std::min<uint64_t>(ARCHIVE_WRITE_BLOCK, voltage.size() - first));
+    });
+}
+
+/**
+ * Appends a binary recording to an archive as a session, the archive is created if it does not exist. The
+ * recording is read one block at a time.
+ * @param fileName The name of the archive.
+ * @param entry The index entry of the session, as created by makeArchiveEntry.
+ * @param record The open recording.
+ * @return True if the session was appended.
+ */
+bool appendArchiveSession(const std::string &fileName, ArchiveEntry entry, RecordReader &record) {
+    static_assert(RECORD_READ_BLOCK <= ARCHIVE_WRITE_BLOCK, "a block of the recording has to fit the pressure block");
+    return appendSession(fileName, entry, record.getNumSamples(), [&record](uint64_t first) {
+        return record.read(first);
+    });
+}
+
+/**
+ * Destructor of the ArchiveReader, closes the archive.
+ */
+ArchiveReader::~ArchiveReader() {
+    close();
+}
+
+/**
+ * Maps an archive into memory and collects the entries of its index.
+ * @param fileName The name of the archive.
+ * @return True if the archive is valid.
+ */
+bool ArchiveReader::open(const std::string &fileName) {
+    close();
+    const int fd = ::open(fileName.c_str(), O_RDONLY);
+    struct stat fileStat{};
+    if (fd < 0 || fstat(fd, &fileStat) != 0 || (size_t) fileStat.st_size < sizeof(ArchiveHeader)) {
+        PLOG_ERROR << "Could not open archive " << fileName;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    size = fileStat.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        PLOG_ERROR << "Could not map archive " << fileName;
+        size = 0;
+        return false;
+    }
+    data = static_cast<const uint8_t *>(mapping);
+
+    const auto *header = reinterpret_cast<const ArchiveHeader *>(data);
+    bool bOk = std::strncmp(header->magic, ARCHIVE_MAGIC, sizeof(header->magic)) == 0 &&
+               header->version <= ARCHIVE_VERSION;
+
+    /**
+     * Entries and columns outside the file are never returned, the file might have been cut off.
+     */
+    uint64_t blockOffset = bOk ? header->firstIndexBlock : 0;
+    while (bOk && blockOffset != 0) {
+        if (blockOffset % 8 != 0 || blockOffset + sizeof(ArchiveIndexBlock) > size) {
+            bOk = false;
+            break;
+        }
+        const auto *block = reinterpret_cast<const ArchiveIndexBlock *>(data + blockOffset);
+        bOk = std::strncmp(block->magic, ARCHIVE_INDEX_MAGIC, sizeof(block->magic)) == 0 &&
+              block->count <= ARCHIVE_INDEX_ENTRIES;
+        for (uint32_t i = 0; bOk && i < block->count; i++) {
+            const ArchiveEntry &entry = block->entries[i];
+            if (entry.voltageOffset + entry.nSamples * sizeof(double) <= size &&
+                entry.pressureOffset + entry.nSamples * sizeof(float) <= size) {
+                entries.push_back(&entry);
+            }
+        }
+        blockOffset = block->nextBlock;
+    }
+
+    if (!bOk) {
+        PLOG_ERROR << "Not a valid archive: " << fileName;
+        close();
+    }
+    return bOk;
+}
+
+/**
+ * Unmaps the archive, all spans returned before are invalid afterwards.
+ */
+void ArchiveReader::close() {
+    if (data) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    entries.clear();
+}
+
+/**
+ * Returns the number of sessions in the archive.
+ * @return The number of sessions.
+ */
+size_t ArchiveReader::getNumSessions() const {
+    return entries.size();
+}
+
+/**
+ * Returns the index entry of a session.
+ * @param session The position of the session in the archive, less than getNumSessions().
+ * @return The entry.
+ */
+const ArchiveEntry &ArchiveReader::getEntry(size_t session) const {
+    return *entries[session];
+}
+
+/**
+ * Finds a session by its identifier.
+ * @param sessionId The identifier of the session.
+ * @return The entry, nullptr if there is no such session.
+ */
+const ArchiveEntry *ArchiveReader::findSession(uint64_t sessionId) const {
+    // The identifiers are the positions in the archive, unless sessions were cut off.
+    if (sessionId > 0 && sessionId <= entries.size() && entries[sessionId - 1]->sessionId == sessionId) {
+        return entries[sessionId - 1];
+    }
+    auto found = std::find_if(entries.begin(), entries.end(),
+                              [sessionId](const ArchiveEntry *entry) { return entry->sessionId == sessionId; });
+    return found != entries.end() ? *found : nullptr;
+}
+
+/**
+ * Returns the voltage column of a session.
+ * @param session The position of the session in the archive.
+ * @return The raw voltage samples.
+ */
+std::span<const double> ArchiveReader::getVoltage(size_t session) const {
+    const ArchiveEntry &entry = *entries[session];
+    return {reinterpret_cast<const double *>(data + entry.voltageOffset), entry.nSamples};
+}
+
+/**
+ * Returns the pressure column of a session.
+ * @param session The position of the session in the archive.
+ * @return The pressure samples in mmHg.
+ */
+std::span<const float> ArchiveReader::getPressure(size_t session) const {
+    const ArchiveEntry &entry = *entries[session];
+    return {reinterpret_cast<const float *>(data + entry.pressureOffset), entry.nSamples};
+}
+
+/**
+ * Returns a time range of the pressure column of a session.
+ * @param session The position of the session in the archive.
+ * @param fromSeconds The start of the range in seconds after the start of the session.
+ * @param toSeconds The end of the range in seconds after the start of the session, exclusive.
+ * @return The pressure samples in mmHg in the range, cut to the length of the session.
+ */
+std::span<const float> ArchiveReader::getPressure(size_t session, double fromSeconds, double toSeconds) const {
+    const std::span<const float> pressure = getPressure(session);
+    const double fs = entries[session]->samplingRate;
+    const auto first = (size_t) std::clamp(fromSeconds * fs, 0.0, (double) pressure.size());
+    const auto last = (size_t) std::clamp(toSeconds * fs, (double) first, (double) pressure.size());
+    return pressure.subspan(first, last - first);
+}
@@ -0,0 +1,120 @@
+/**
+ * @file        ArchiveFormat.h
+ * @brief       The header file of the archive format.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the structures of the archive format, the function to append a session and the ArchiveReader class.
+ *
+ * An archive holds many measurements (sessions) in a single file. It starts with an ArchiveHeader, followed by
+ * index blocks and the sample columns of the sessions, in the order they were appended. Each index block has room
+ * for ARCHIVE_INDEX_ENTRIES entries and points to the next one, the first block follows the header. An entry
+ * contains everything known about a session, the settings of the recording, the results and the byte offsets of its
+ * columns. Every session has two columns of nSamples values each: the raw voltage as doubles, and the pressure in
+ * mmHg as floats. All values are in the byte order of the writing machine and aligned to 8 bytes, so the file can
+ * be mapped into memory and the columns used directly.
+ *
+ * A session is appended by writing its columns to the end of the file first and its entry last, the entry only
+ * counts once the count of its index block is incremented. A writer that fails in between leaves unused bytes,
+ * but never an invalid entry.
+ */
+#ifndef OBP_ARCHIVEFORMAT_H
+#define OBP_ARCHIVEFORMAT_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "RecordFormat.h"
+
+#define ARCHIVE_MAGIC           "OBPARC"    //!< Identifies an archive file, padded with zeros to 8 bytes.
+#define ARCHIVE_INDEX_MAGIC     "OBPIDX"    //!< Identifies an index block, padded with zeros to 8 bytes.
+#define ARCHIVE_VERSION         1           //!< The current version of the archive format.
+#define ARCHIVE_EXTENSION       ".obpa"     //!< File extension of archives.
+#define ARCHIVE_INDEX_ENTRIES   256         //!< Number of entries in an index block.
+#define ARCHIVE_NAME_SIZE       48          //!< Size of the name of a session, including the terminating zero.
+
+//! The header at the start of an archive.
+struct ArchiveHeader {
+    char magic[8];              //!< ARCHIVE_MAGIC, padded with zeros.
+    uint32_t version;           //!< ARCHIVE_VERSION of the writer.
+    uint32_t headerSize;        //!< The size of the header in bytes.
+    uint64_t firstIndexBlock;   //!< The byte offset of the first index block.
+    uint64_t reserved;          //!< Unused, 0.
+};
+
+//! The results of the algorithm for a session, 0 if not known.
+struct ArchiveResults {
+    double map;                 //!< The mean arterial pressure.
+    double sbp;                 //!< The systolic blood pressure.
+    double dbp;                 //!< The diastolic blood pressure.
+    double hr;                  //!< The average heart rate.
+};
+
+//! The index entry of a session.
+struct ArchiveEntry {
+    uint64_t sessionId;         //!< The number of the session in the archive, starting at 1.
+    int64_t timestamp;          //!< The start of the recording in seconds since the epoch.
+    char name[ARCHIVE_NAME_SIZE];   //!< The name of the recording the session was created from.
+    double samplingRate;        //!< The sampling rate in Hz.
+    double ambientVoltage;      //!< The voltage at ambient pressure.
+    double corrFactor;          //!< The correction factor of the voltage divider.
+    double fcLP;                //!< The cutoff frequency of the low-pass filter in Hz.
+    double fcHP;                //!< The cutoff frequency of the high-pass filter in Hz.
+    uint32_t filterOrder;       //!< The order of the IIR filters.
+    uint32_t reserved;          //!< Unused, 0.
+    ArchiveResults results;     //!< The results of the algorithm.
+    uint64_t nSamples;          //!< The number of samples in each column.
+    uint64_t voltageOffset;     //!< The byte offset of the voltage column (doubles).
+    uint64_t pressureOffset;    //!< The byte offset of the pressure column in mmHg (floats).
+};
+
+//! A block of the index.
+struct ArchiveIndexBlock {
+    char magic[8];              //!< ARCHIVE_INDEX_MAGIC, padded with zeros.
+    uint64_t nextBlock;         //!< The byte offset of the next index block, 0 if this is the last one.
+    uint32_t capacity;          //!< ARCHIVE_INDEX_ENTRIES of the writer.
+    uint32_t count;             //!< The number of valid entries.
+    ArchiveEntry entries[ARCHIVE_INDEX_ENTRIES];    //!< The entries, only the first count are valid.
+};
+
+ArchiveEntry makeArchiveEntry(const RecordHeader &header, int64_t timestamp, const std::string &name,
+                              const ArchiveResults &results);
+bool appendArchiveSession(const std::string &fileName, ArchiveEntry entry, std::span<const double> voltage);
+bool appendArchiveSession(const std::string &fileName, ArchiveEntry entry, RecordReader &record);
+
+//! The ArchiveReader class gives access to the sessions of an archive without reading it.
+/*!
+ * The archive is mapped into memory read-only, only the entries of the index are collected when it is opened. The
+ * columns of a session are returned as spans into the mapping, so any session, or any time range of it, is
+ * available without parsing or copying. The spans are valid as long as the reader is open. Sessions appended after
+ * the archive was opened are not seen.
+ */
+class ArchiveReader {
+
+public:
+    ArchiveReader() = default;
+    ~ArchiveReader();
+    ArchiveReader(const ArchiveReader &) = delete;
+    ArchiveReader &operator=(const ArchiveReader &) = delete;
+
+    bool open(const std::string &fileName);
+    void close();
+
+    size_t getNumSessions() const;
+    const ArchiveEntry &getEntry(size_t session) const;
+    const ArchiveEntry *findSession(uint64_t sessionId) const;
+    std::span<const double> getVoltage(size_t session) const;
+    std::span<const float> getPressure(size_t session) const;
+    std::span<const float> getPressure(size_t session, double fromSeconds, double toSeconds) const;
+
+private:
+    const uint8_t *data = nullptr;              //!< The mapped archive.
+    size_t size = 0;                            //!< The size of the mapping in bytes.
+    std::vector<const ArchiveEntry *> entries;  //!< The valid entries of all index blocks, in the order appended.
+};
+
+#endif //OBP_ARCHIVEFORMAT_H
@@ -12,7 +12,17 @@
  * @details
  * This class is based on a previous implementation by Bernd Porr and Matthias H. Henning.
  */
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "common.h"
 #include "ComediHandler.h"
 
@@ -21,18 +31,47 @@
 /**
  * The constructor of the ComediHandler object.
  *
- * Initialises the hardware. If the hardware is not connected, the initialisation fails and the program finishes. *
+ * Starts to open the device in the background, see open(), so the application can set up everything else meanwhile.
+ * The sampling rate is the requested one until the device is open, open() makes sure the device samples at it.
+ * @param nChannels The number of channels to acquire, starting with channel 0.
+ * @param useMmap Try to map the acquisition buffer to read samples without copying them.
  */
-ComediHandler::ComediHandler():
-    adChannel(0) {
+ComediHandler::ComediHandler(int nChannels, bool useMmap):
+    dev(nullptr),
+    sampling_rate(SAMPLING_RATE),
+    numChannels(nChannels),
+    adChannel(0),
+    chanlist(nullptr),
+    rawPending(0),
+    mappedBuffer(nullptr),
+    mappedSize(0),
+    mappedOffset(0),
+    bufferSize(0),
+    backlog(0),
+    overruns(0),
+    bStarted(false),
+    bOpen(false) {
 
     PLOG_VERBOSE << "ComediHandler started";
+    // Each thread waits through its own copy of the future, a shared_future is not safe to share between threads.
+    opened = std::async(std::launch::async, &ComediHandler::open, this, useMmap).share();
+    acquisitionOpened = opened;
+}
+
+/**
+ * Opens and initialises the hardware and starts the acquisition, runs in the background.
+ *
+ * If the hardware is not connected or can not sample at the requested rate, the initialisation fails. The exception
+ * is kept in the future, waitUntilOpen() reports it to the thread that created the handler.
+ * @param useMmap Try to map the acquisition buffer to read samples without copying them.
+ */
+void ComediHandler::open(bool useMmap) {
     const char *filename = COMEDI_DEV_PATH;
 
     /* open the device */
     if ((dev = comedi_open(filename)) == 0) {
         comedi_perror(filename);
-        exit(1);
+        throw std::runtime_error(std::string("Could not open ") + filename);
     }
 
     // do not produce NAN for out of range behaviour
@@ -40,18 +79,19 @@ ComediHandler::ComediHandler():
 
     maxdata = comedi_get_maxdata(dev, COMEDI_SUB_DEVICE, COMEDI_SUB_DEVICE);
     crange = comedi_get_range(dev, COMEDI_SUB_DEVICE, COMEDI_SUB_DEVICE, COMEDI_RANGE_ID);
-    numChannels = comedi_get_n_channels(dev, COMEDI_SUB_DEVICE);
+    const int available = comedi_get_n_channels(dev, COMEDI_SUB_DEVICE);
 
     PLOG_VERBOSE << "maxdata: " << maxdata;
     PLOG_VERBOSE << "crange min: " << crange->min << " max: " << crange->max;
-    PLOG_VERBOSE << "num channels: " << numChannels;
+    PLOG_VERBOSE << "num channels: " << available;
 
-    if (numChannels < COMEDI_NUM_CHANNEL) {
-        PLOG_ERROR << "Number of available device channels (" << numChannels << ") smaller than used ("
-                   << COMEDI_NUM_CHANNEL << ")";
-        exit(-1);
-    } else {
-        numChannels = COMEDI_NUM_CHANNEL;
+    // comedi_to_phys is a linear mapping of the range, precompute it for the bulk conversion.
+    physOffset = crange->min;
+    physScale = (crange->max - crange->min) / maxdata;
+
+    if (numChannels < 1 || available < numChannels) {
+        throw std::runtime_error("Number of available device channels (" + std::to_string(available) +
+                                 ") smaller than used (" + std::to_string(numChannels) + ")");
     }
 
     chanlist = new unsigned[numChannels];
@@ -64,8 +104,7 @@ ComediHandler::ComediHandler():
                                            (int) (1e9 / (SAMPLING_RATE)));
 
     if (ret < 0) {
-        PLOG_ERROR << "comedi_get_cmd_generic_timed failed";
-        exit(-1);
+        throw std::runtime_error("comedi_get_cmd_generic_timed failed");
     }
 
     /* Modify parts of the command */
@@ -86,54 +125,142 @@ ComediHandler::ComediHandler():
     ret = comedi_command_test(dev, &comediCommand);
     PLOG_INFO << "first test returned " << ret;
     if (ret < 0) {
-        PLOG_ERROR << "Comedi test command failed";
         comedi_perror("comedi_command_test");
-        exit(-1);
+        throw std::runtime_error("Comedi test command failed");
     }
 
     ret = comedi_command_test(dev, &comediCommand);
     PLOG_INFO << "second test returned " << ret;
     if (ret < 0) {
-        PLOG_ERROR << "Comedi test command failed";
         comedi_perror("comedi_command_test");
-        exit(-1);
+        throw std::runtime_error("Comedi test command failed");
     }
 
     // the timing is done channel by channel
     // this means that the actual sampling rate is divided by
     // number of channels
+    double rate = sampling_rate;
     if ((comediCommand.convert_src == TRIG_TIMER) && (comediCommand.convert_arg)) {
-        sampling_rate = (((double) 1E9 / comediCommand.convert_arg) / numChannels);
+        rate = (((double) 1E9 / comediCommand.convert_arg) / numChannels);
     }
-    PLOG_VERBOSE << "sampling rate (channel by channel): " << sampling_rate;
+    PLOG_VERBOSE << "sampling rate (channel by channel): " << rate;
 
     // the timing is done scan by scan (all channels at once)
     // the sampling rate is equivalent of the scan_begin_arg
     if ((comediCommand.scan_begin_src == TRIG_TIMER) && (comediCommand.scan_begin_arg)) {
-        sampling_rate = (double) 1E9 / comediCommand.scan_begin_arg;
+        rate = (double) 1E9 / comediCommand.scan_begin_arg;
+    }
+    PLOG_VERBOSE << "sampling rate (all channels): " << rate;
+
+    // The rate was already handed out while the device was opened, the processing is set up for it. A board that
+    // rounds the scan period to its timer is accepted, the timing is then off by the small relative deviation.
+    if (std::abs(rate - sampling_rate) > COMEDI_RATE_TOLERANCE * sampling_rate) {
+        throw std::runtime_error("Device samples at " + std::to_string(rate) + " Hz instead of " +
+                                 std::to_string(sampling_rate) + " Hz");
+    }
+    if (rate != sampling_rate) {
+        PLOG_WARNING << "Device samples at " << rate << " Hz instead of " << sampling_rate << " Hz";
+    }
+
+    int size = comedi_get_buffer_size(dev, COMEDI_SUB_DEVICE);
+    bufferSize = size > 0 ? size : 0;
+
+    if (useMmap) {
+        mapBuffer();
     }
-    PLOG_VERBOSE << "sampling rate (all channels): " << sampling_rate;
 
     /* start the command */
     ret = comedi_command(dev, &comediCommand);
     if (ret < 0) {
-        PLOG_ERROR << "Comedi command failed";
         comedi_perror("comedi_command");
-        exit(1);
+        throw std::runtime_error("Comedi command failed");
     }
 
     int subdev_flags = comedi_get_subdevice_flags(dev, COMEDI_SUB_DEVICE);
 
     if ((sigmaBoard = subdev_flags & SDF_LSAMPL))
     {
-        readSize = sizeof(lsampl_t) * numChannels;
+        sampleSize = sizeof(lsampl_t);
     }
     else {
         PLOG_WARNING << "Detected device is not a sigma board, ADC resolution might not be sufficient.";
-        readSize = sizeof(sampl_t) * numChannels;
+        sampleSize = sizeof(sampl_t);
+    }
+    readSize = sampleSize * numChannels;
+
+    rawBuffer.resize(readSize * COMEDI_BLOCK_SIZE);
+    voltageBuffer.resize(numChannels * COMEDI_BLOCK_SIZE);
+    bStarted = true;
+}
+
+/**
+ * The destructor of the ComediHandler object.
+ *
+ * Waits until the device is open, unmaps the acquisition buffer and closes the device.
+ */
+ComediHandler::~ComediHandler() {
+    opened.wait();
+    if (mappedBuffer) {
+        munmap(mappedBuffer, mappedSize);
+    }
+    if (dev) {
+        comedi_close(dev);
     }
+    delete[] chanlist;
+}
 
-};
+/**
+ * Waits until the device is open, only called by the thread that created the handler.
+ * @return False if the device could not be opened or started, the reason is logged.
+ */
+bool ComediHandler::waitUntilOpen() {
+    try {
+        opened.get();
+    } catch (const std::exception &e) {
+        PLOG_ERROR << e.what();
+    }
+    return bStarted;
+}
+
+/**
+ * Checks if the device is open and waits for it if not, only called by the acquisition thread.
+ * If the device could not be opened, it waits for the whole timeout, so the thread does not spin until it is stopped.
+ * @param timeoutMs The maximal time to wait in ms.
+ * @return True if the device is open and acquiring.
+ */
+bool ComediHandler::waitOpen(int timeoutMs) {
+    if (!bOpen) {
+        const bool bDone = acquisitionOpened.wait_for(std::chrono::milliseconds(timeoutMs)) == std::future_status::ready;
+        bOpen = bDone && bStarted;
+        if (bDone && !bOpen) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        }
+    }
+    return bOpen;
+}
+
+/**
+ * Maps the acquisition buffer of the device into memory. If the driver does not support it, mappedBuffer stays
+ * nullptr and the samples are read with read().
+ */
+void ComediHandler::mapBuffer() {
+    int size = comedi_get_buffer_size(dev, COMEDI_SUB_DEVICE);
+    if (size <= 0) {
+        PLOG_WARNING << "Could not get comedi buffer size, using read() instead of mmap";
+        return;
+    }
+
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, comedi_fileno(dev), 0);
+    if (map == MAP_FAILED) {
+        PLOG_WARNING << "Could not map comedi buffer (" << strerror(errno) << "), using read() instead of mmap";
+        return;
+    }
+
+    mappedBuffer = (unsigned char *) map;
+    mappedSize = size;
+    mappedOffset = comedi_get_buffer_offset(dev, COMEDI_SUB_DEVICE);
+    PLOG_VERBOSE << "mapped comedi buffer of " << mappedSize << " bytes";
+}
 
 /**
  * Gets the sampling rate from the device.
@@ -143,6 +270,52 @@ double ComediHandler::getSamplingRate() {
     return sampling_rate;
 }
 
+/**
+ * Gets the number of channels that are acquired, and interleaved in the blocks.
+ * @return The number of channels.
+ */
+int ComediHandler::getNumChannels() {
+    return numChannels;
+}
+
+/**
+ * Gets the number of scans that were waiting in the acquisition buffer at the last block read.
+ * @return The number of scans.
+ */
+size_t ComediHandler::getBacklog() {
+    return backlog;
+}
+
+/**
+ * Gets the number of times the acquisition buffer was found full or the driver reported an overflow.
+ * @return The number of overruns.
+ */
+uint64_t ComediHandler::getOverruns() {
+    return overruns;
+}
+
+/**
+ * Gets the contents of the buffer before a block read and updates the backlog and the overrun counter.
+ * @return The number of bytes in the buffer, negative on error.
+ */
+int ComediHandler::checkBufferContents() {
+    int contents = getBufferContents();
+    if (contents < 0) {
+        if (errno == EPIPE) {
+            overruns++;
+            PLOG_ERROR << "Comedi buffer overflow";
+        }
+        backlog = 0;
+        return contents;
+    }
+    if (bufferSize > 0 && (size_t) contents >= bufferSize) {
+        overruns++;
+        PLOG_WARNING << "Comedi buffer full, samples are lost";
+    }
+    backlog = contents / readSize;
+    return contents;
+}
+
 /**
  * Checks the buffer, if there is anything in it.
  * @return The number of samples in the buffer.
@@ -189,3 +362,122 @@ int ComediHandler::readRawSample() {
     return v;
 }
 
+/**
+ * Blocks until there is data available to read from the device or until the timeout expires.
+ *
+ * While the device is still being opened, waits for that instead.
+ * Waits on the device file descriptor instead of polling the buffer, the calling thread sleeps until the driver
+ * signals new data.
+ * @param timeoutMs The maximal time to wait in ms. Allows the calling thread to check whether it should stop.
+ * @return True if there is data to read.
+ */
+bool ComediHandler::waitForData(int timeoutMs) {
+    if (!waitOpen(timeoutMs)) {
+        return false;
+    }
+    struct pollfd pfd = {comedi_fileno(dev), POLLIN, 0};
+    int ret = poll(&pfd, 1, timeoutMs);
+    if (ret < 0 && errno != EINTR) {
+        PLOG_ERROR << "Error waiting for device: " << strerror(errno);
+    }
+    return ret > 0 && (pfd.revents & POLLIN);
+}
+
+/**
+ * Reads everything that is currently in the buffer with a single read() and converts it into voltage values.
+ *
+ * At most COMEDI_BLOCK_SIZE scans are read per call. Incomplete scans are kept and completed by the next call.
+ * The returned span points into a buffer that is reused, it is only valid until the next call.
+ * @return The voltage samples of all channels read from the buffer, interleaved, empty if there was nothing to read.
+ */
+std::span<const double> ComediHandler::readVoltageBlock() {
+    if (!waitOpen(0)) {
+        return {};
+    }
+    if (mappedBuffer) {
+        return readMappedBlock();
+    }
+
+    int contents = checkBufferContents();
+    if (contents <= 0) {
+        return {};
+    }
+
+    size_t toRead = std::min((size_t) contents, rawBuffer.size() - rawPending);
+    ssize_t ret = read(comedi_fileno(dev), rawBuffer.data() + rawPending, toRead);
+    if (ret == 0) {
+        PLOG_ERROR << "Error reading from device: end of acquisition!";
+        exit(-1);
+    } else if (ret < 0) {
+        PLOG_ERROR << "Error reading from device: " << strerror(errno);
+        return {};
+    }
+
+    size_t available = rawPending + ret;
+    size_t nScans = available / readSize;
+    // The scans are stored one after the other, so all channels are converted in one pass.
+    size_t nSamples = nScans * numChannels;
+    if (sigmaBoard) {
+        const auto *raw = (const lsampl_t *) rawBuffer.data();
+        for (size_t i = 0; i < nSamples; i++) {
+            voltageBuffer[i] = toVoltage(raw[i]);
+        }
+    } else {
+        const auto *raw = (const sampl_t *) rawBuffer.data();
+        for (size_t i = 0; i < nSamples; i++) {
+            voltageBuffer[i] = toVoltage(raw[i]);
+        }
+    }
+
+    rawPending = available - nScans * readSize;
+    if (rawPending > 0) {
+        memmove(rawBuffer.data(), rawBuffer.data() + nScans * readSize, rawPending);
+    }
+    return {voltageBuffer.data(), nSamples};
+}
+
+/**
+ * Converts the complete scans in the mapped acquisition buffer into voltage values and marks them as read.
+ *
+ * The samples are read where the driver wrote them. A scan can wrap around the end of the ring buffer, therefore the
+ * position is wrapped per sample. Incomplete scans stay in the buffer until the next call.
+ * @return The voltage samples of all channels read from the buffer, interleaved, empty if there was nothing to read.
+ */
+std::span<const double> ComediHandler::readMappedBlock() {
+    int contents = checkBufferContents();
+    if (contents <= 0) {
+        return {};
+    }
+
+    size_t nScans = std::min((size_t) contents / readSize, (size_t) COMEDI_BLOCK_SIZE);
+    size_t nSamples = nScans * numChannels;
+    size_t pos = mappedOffset;
+    for (size_t i = 0; i < nSamples; i++) {
+        if (pos >= mappedSize) {
+            pos -= mappedSize;
+        }
+        if (sigmaBoard) {
+            voltageBuffer[i] = toVoltage(*(const lsampl_t *) (mappedBuffer + pos));
+        } else {
+            voltageBuffer[i] = toVoltage(*(const sampl_t *) (mappedBuffer + pos));
+        }
+        pos += sampleSize;
+    }
+
+    size_t nBytes = nScans * readSize;
+    if (comedi_mark_buffer_read(dev, COMEDI_SUB_DEVICE, nBytes) < 0) {
+        comedi_perror("comedi_mark_buffer_read");
+    }
+    mappedOffset = (mappedOffset + nBytes) % mappedSize;
+    return {voltageBuffer.data(), nSamples};
+}
+
+/**
+ * Converts a raw ADC value into voltage with the precomputed linear mapping. Same result as comedi_to_phys with
+ * COMEDI_OOR_NUMBER behaviour.
+ * @param raw The raw ADC value.
+ * @return The value in voltage.
+ */
+double ComediHandler::toVoltage(lsampl_t raw) const {
+    return physOffset + physScale * raw;
+}
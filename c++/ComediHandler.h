@@ -15,31 +15,71 @@
 #ifndef OBP_COMEDIHANDLER_H
 #define OBP_COMEDIHANDLER_H
 
+#include <atomic>
+#include <future>
+#include <vector>
+#include <span>
 #include <comedilib.h>
 
+#include "ISampleSource.h"
+
 #define COMEDI_SUB_DEVICE   0   //!< using sub device 0
 #define COMEDI_RANGE_ID     0   //!<  +/- 1.325V  for sigma device*/
-#define COMEDI_NUM_CHANNEL  1   //!<  only one channel is used */
+#define COMEDI_NUM_CHANNEL  1   //!<  default number of channels, one per cuff */
 #define COMEDI_DEV_PATH     "/dev/comedi0" //!<  the path to access the comedi device
+#define COMEDI_BLOCK_SIZE   1000 //!<  maximal number of scans converted per block read
+#define COMEDI_POLL_TIMEOUT 100  //!<  maximal time in ms to wait for new data before returning
+#define COMEDI_USE_MMAP     true //!<  read samples straight from the mapped acquisition buffer if possible
+#define COMEDI_RATE_TOLERANCE 0.01 //!<  maximal relative deviation of the device's sampling rate from SAMPLING_RATE
 
 
 //! The ComediHandler class abstracts access to the hardware.
 /*!
- * The class uses the comedi library (comedilib) to read data from the hardware device. The ComediHandler is
- * initialised when the Processing object is created. If the initialisation fails, e.g. because there is no device
- * connected, the application terminates, and an error message is printed. Upon a successful start-up, single samples
- * can be read from the device either as a raw integer value or as a voltage value. Optionally, the entire buffer
- * content can be read as raw values. The application is only reading voltage values.
+ * The class uses the comedi library (comedilib) to read data from the hardware device. The device is opened and the
+ * acquisition is started in the background when the ComediHandler is created, so the application can create the
+ * Processing object and the GUI meanwhile. Until then, the sampling rate is the requested SAMPLING_RATE, and
+ * waitForData() waits for the device instead of the data. If the initialisation fails, e.g. because there is no
+ * device connected or it can not sample within COMEDI_RATE_TOLERANCE of the requested rate, an error message is
+ * logged and waitUntilOpen() returns false, so the application can terminate from the thread that created the
+ * handler, and the acquisition thread never gets data. Upon a successful start-up, single samples can be read from
+ * the device either as a raw integer value or as a voltage value. Optionally, the entire buffer content can be read
+ * as raw values. The application is only reading voltage values.
+ *
+ * The acquisition thread uses the block interface: waitForData() blocks on the device file descriptor until samples
+ * are available and readVoltageBlock() drains everything the buffer holds with a single read() call. The samples are
+ * converted to voltages into a buffer that is reused for every block.
+ *
+ * If the driver supports it, the acquisition buffer is mapped into memory at start-up. The samples are then
+ * converted straight from the mapped ring buffer and marked as read, without read() and without copying the raw data.
+ * Drivers that can not be mapped fall back to the read() path.
+ *
+ * Several channels can be acquired at once, channels 0 to nChannels - 1 are sampled in one comedi command. A block
+ * then holds complete scans, with the voltages of all channels interleaved as defined by ISampleSource. All channels
+ * are read and converted by the same call, there are no per-channel system calls. The single sample functions only
+ * return the first channel.
+ *
+ * Every block read also records how many scans were waiting in the acquisition buffer, and counts an overrun if the
+ * buffer was full or the driver reports one.
+ *
+ * The block interface implements ISampleSource, the Processing class only uses the ComediHandler through it.
  */
-class ComediHandler
+class ComediHandler : public ISampleSource
 {
 public:
-    ComediHandler();
+    explicit ComediHandler(int nChannels = COMEDI_NUM_CHANNEL, bool useMmap = COMEDI_USE_MMAP);
+    ~ComediHandler() override;
 
-    double getSamplingRate();
+    bool waitUntilOpen();
+
+    double getSamplingRate() override;
+    int getNumChannels() override;
     int getBufferContents();
     int getRawSample();
     double getVoltageSample();
+    bool waitForData(int timeoutMs = COMEDI_POLL_TIMEOUT) override;
+    std::span<const double> readVoltageBlock() override;
+    size_t getBacklog() override;
+    uint64_t getOverruns() override;
 
 private:
 
@@ -55,7 +95,33 @@ private:
     const int adChannel;
     unsigned *chanlist;
 
+    double physOffset;                      //!< Voltage at raw value 0, precomputed from the range.
+    double physScale;                       //!< Voltage per raw value step, precomputed from the range.
+    std::vector<unsigned char> rawBuffer;   //!< Reused buffer for bulk reads of raw scans.
+    size_t rawPending;                      //!< Bytes of an incomplete scan left in rawBuffer from the last read.
+    std::vector<double> voltageBuffer;      //!< Reused buffer for the converted voltage samples.
+
+    unsigned char *mappedBuffer;            //!< The mapped acquisition buffer, nullptr if read() is used.
+    size_t mappedSize;                      //!< The size of the mapped acquisition buffer in bytes.
+    size_t mappedOffset;                    //!< The read position in the mapped acquisition buffer in bytes.
+    size_t sampleSize;                      //!< The size of one raw sample in bytes.
+
+    size_t bufferSize;                      //!< The size of the acquisition buffer in bytes.
+    size_t backlog;                         //!< The number of scans in the buffer at the last read.
+    std::atomic<uint64_t> overruns;         //!< The number of times the buffer was full or overflowed.
+
+    std::shared_future<void> opened;        //!< Ready once the device is open and acquiring, or holds the failure.
+    std::shared_future<void> acquisitionOpened; //!< The copy of opened used by the acquisition thread.
+    std::atomic<bool> bStarted;             //!< The device was opened and the acquisition started.
+    bool bOpen;                             //!< The device is open, only used by the acquisition thread.
+
+    void open(bool useMmap);
+    bool waitOpen(int timeoutMs);
+    void mapBuffer();
+    int checkBufferContents();
+    std::span<const double> readMappedBlock();
     int readRawSample();
+    [[nodiscard]] double toVoltage(lsampl_t raw) const;
 };
 
 
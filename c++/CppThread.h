@@ -8,28 +8,72 @@
  * (C) 2020, Bernd Porr <mail@bernporr.me.uk>
  **/
 
+#include <atomic>
 #include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+// scheduling of a thread, applied by the thread itself when it starts
+struct ThreadAttributes {
+	int priority = 0;		// SCHED_FIFO priority from 1 to 99, 0 keeps the default scheduling
+	std::vector<int> cpus;		// the CPUs the thread may run on, empty for all
+	bool bLockMemory = false;	// lock all current and future memory of the process with mlockall
+};
 
 // abstract thread which contains the inner workings of the thread model
+// run() can finish when stopRequested() returns true, requestStop() sets it from any thread
 class CppThread {
 
 public:
+	// the attributes that could not be applied, usually because of missing privileges
+	enum AttributeError {
+		PriorityFailed = 1,
+		AffinityFailed = 2,
+		MemoryLockFailed = 4,
+	};
+
 	void start() {
-		uthread = new std::thread(CppThread::exec, this);
+		bStopRequested = false;
+		attributeErrors = 0;
+		uthread = std::thread(CppThread::exec, this);
+	}
+
+	// has to be called before start()
+	void setAttributes(const ThreadAttributes &newAttributes) {
+		attributes = newAttributes;
+	}
+
+	const ThreadAttributes &getAttributes() const {
+		return attributes;
+	}
+
+	// a combination of AttributeError flags, valid once run() was called
+	int getAttributeErrors() const {
+		return attributeErrors;
 	}
 
 	void join() {
-		uthread->join();
-		delete uthread;
-		uthread = NULL;
+		if (uthread.joinable()) {
+			uthread.join();
+		}
+	}
+
+	void requestStop() {
+		bStopRequested = true;
+	}
+
+	bool stopRequested() const {
+		return bStopRequested;
 	}
 
 	CppThread() {};
 	
+	// the ancestors have to stop and join the thread in their destructor, this is only the last resort
 	virtual ~CppThread() {
-		if (uthread) {
-			delete uthread;
-		}
+		requestStop();
+		join();
 	}
 
 protected:
@@ -37,10 +81,42 @@ protected:
 	virtual void run() = 0;	
 
 private:
-	std::thread* uthread = NULL;
+	std::thread uthread;
+	std::atomic<bool> bStopRequested = false;
+	ThreadAttributes attributes;
+	std::atomic<int> attributeErrors = 0;
+
+	// applies the attributes to the calling thread
+	void applyAttributes() {
+		int errors = 0;
+		if (attributes.bLockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+			errors |= MemoryLockFailed;
+		}
+		if (!attributes.cpus.empty()) {
+			cpu_set_t cpuSet;
+			CPU_ZERO(&cpuSet);
+			for (int cpu : attributes.cpus) {
+				if (cpu >= 0 && cpu < CPU_SETSIZE) {
+					CPU_SET(cpu, &cpuSet);
+				}
+			}
+			if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0) {
+				errors |= AffinityFailed;
+			}
+		}
+		if (attributes.priority > 0) {
+			sched_param param{};
+			param.sched_priority = attributes.priority;
+			if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+				errors |= PriorityFailed;
+			}
+		}
+		attributeErrors = errors;
+	}
 
 	// static function which points back to the class
 	static void exec(CppThread* cppThread) {
+		cppThread->applyAttributes();
 		cppThread->run();
 	}
 };
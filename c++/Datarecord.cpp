@@ -7,93 +7,319 @@
  *
  */
 
-#include <QtCore/QTextStream>
-#include <QtWidgets/QFileDialog>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstddef>
+#include <ctime>
+#include <thread>
+
+#include "common.h"
 #include "Datarecord.h"
 
 /**
- * Constructor to prepare recording of data at a later point.
- * @param samplingRate The sampling rate at which the data will be recorded.
+ * Constructor to prepare recording of data at a later point. The writer thread has to be started separately.
  */
-Datarecord::Datarecord(double samplingRate)
-{
-    nsample = 0;
-    this->samplingRate = samplingRate;
-    boRecord = false;
+Datarecord::Datarecord() :
+        samples(RECORD_QUEUE_SIZE),
+        requests(RECORD_REQUEST_SIZE),
+        bRunning(true),
+        bTextExport(true),
+        bEnabled(true),
+        droppedSamples(0),
+        queuedSamples(0),
+        recFile(nullptr),
+        recStartTime(0),
+        recHeader(),
+        writtenSamples(0) {
+    writeBuffer.reserve(2 * RECORD_BATCH_SIZE);
 }
 
-//
 /**
- * Constructor that starts recording immediately
- * @param filename The filename to record data with.
- * @param samplingRate The sampling rate at which the data will be recorded.
+ * Destructor of Datarecord. Deletes the recording if there is one open.
  */
-Datarecord::Datarecord(QString filename, double samplingRate) // = "default.dat")
-{
-    rec_filename = filename;
-    if (!rec_filename.isNull()) {
-        rec_file = new QFile(rec_filename);
-        if (rec_file->open(QIODevice::WriteOnly | QFile::Truncate)) {
-            outStream = new QTextStream(rec_file);
-        }
+Datarecord::~Datarecord() {
+    if (recFile) {
+        closeFile(false);
     }
-    nsample = 0;
-    this->samplingRate = samplingRate;
-    boRecord = true;
 }
+
 /**
- * Destructor of Datarecord. Save the file if there is one open.
+ * Starts a new recording. Called by the acquisition thread, does not wait for the file to be opened.
+ * @param header The header of the new recording.
  */
-Datarecord::~Datarecord() {
-    if (rec_file) {
-        rec_file->close();
+void Datarecord::startRecording(const RecordHeader &header) {
+    if (!bEnabled) {
+        return;
+    }
+    pushRequest(Command::Start, header);
+}
+
+/**
+ * Adds a single sample to the current recording. Called by the acquisition thread, does not wait for the sample to
+ * be written. If the writer thread falls behind so far that the queue is full, the sample is dropped.
+ * @param sample The sample to add.
+ */
+void Datarecord::addSample(double sample) {
+    if (!bEnabled) {
+        return;
+    }
+    if (samples.push(sample)) {
+        queuedSamples++;
+    } else {
+        droppedSamples++;
+    }
+}
+
+/**
+ * Stops the current recording. Called by the acquisition thread, does not wait for the file to be closed.
+ * @param bKeep True to keep the recording, false to delete it.
+ * @param results The results of the measurement, stored in the archive with a kept recording.
+ */
+void Datarecord::stopRecording(bool bKeep, const ArchiveResults &results) {
+    if (!bEnabled) {
+        return;
     }
-};
+    pushRequest(bKeep ? Command::Keep : Command::Discard, RecordHeader{}, results);
+}
+
+/**
+ * Queues a request for the writer thread, after the samples that are already queued.
+ * @param cmd The request.
+ * @param header The header of the recording, only used to start one.
+ * @param results The results of the measurement, only used to keep a recording.
+ */
+void Datarecord::pushRequest(Command cmd, const RecordHeader &header, const ArchiveResults &results) {
+    if (!requests.push({cmd, queuedSamples, header, results})) {
+        PLOG_ERROR << "Could not queue recording request, writer thread not responding";
+    }
+}
+
+/**
+ * Sets if kept recordings are also exported in the text format.
+ * @param bExport True to export the text format.
+ */
+void Datarecord::setTextExport(bool bExport) {
+    bTextExport = bExport;
+}
+
+/**
+ * Checks if kept recordings are also exported in the text format.
+ * @return True if the text format is exported.
+ */
+bool Datarecord::getTextExport() {
+    return bTextExport;
+}
+
+/**
+ * Sets the archive that kept recordings are appended to. It is created with the first recording.
+ * @param fileName The name of the archive, empty to not append recordings to an archive.
+ */
+void Datarecord::setArchive(const std::string &fileName) {
+    std::lock_guard<std::mutex> lock(archiveMutex);
+    archiveName = fileName;
+}
+
+/**
+ * Returns the archive that kept recordings are appended to.
+ * @return The name of the archive, empty if there is none.
+ */
+std::string Datarecord::getArchive() {
+    std::lock_guard<std::mutex> lock(archiveMutex);
+    return archiveName;
+}
+
+/**
+ * Sets if recordings are written at all. Should only be changed between recordings.
+ * @param bEnable True to write recordings, false to ignore all samples and requests.
+ */
+void Datarecord::setEnabled(bool bEnable) {
+    bEnabled = bEnable;
+}
 
 /**
- * Start storing data to a file. Opens file with the name specified by the parameter.
- * @param filename The name of the file to open.
+ * Checks if recordings are written.
+ * @return True if recordings are written.
  */
-void Datarecord::startRecording(QString filename) {
-    if (!rec_filename.isNull()) {
-        rec_file = new QFile(rec_filename);
-        if (rec_file->open(QIODevice::WriteOnly)) {
-            outStream = new QTextStream(rec_file);
-            nsample = 0;
-            boRecord = true;
+bool Datarecord::getEnabled() {
+    return bEnabled;
+}
+
+/**
+ * Stops the writer thread after everything in the queue is written, so it terminates and can be joined.
+ */
+void Datarecord::stopThread() {
+    bRunning = false;
+}
+
+/**
+ * The main running function of the writer thread.
+ */
+void Datarecord::run() {
+    double batch[RECORD_BATCH_SIZE];
+    Request request{};
+    bool bPending = false;
+
+    while (true) {
+        if (!bPending) {
+            bPending = requests.pop(request);
+        }
+
+        /**
+         * The samples are only taken out of the queue up to the next request, which is applied right after them.
+         */
+        size_t limit = RECORD_BATCH_SIZE;
+        if (bPending) {
+            limit = std::min<uint64_t>(limit, request.sampleCount - writtenSamples);
+        }
+        const size_t n = samples.pop(std::span<double>(batch, limit));
+        writtenSamples += n;
+        if (recFile) {
+            writeBuffer.insert(writeBuffer.end(), batch, batch + n);
+            if (writeBuffer.size() >= RECORD_BATCH_SIZE) {
+                flush();
+            }
+        }
+
+        if (bPending && writtenSamples == request.sampleCount) {
+            applyRequest(request);
+            bPending = false;
+            continue;
+        }
+
+        long dropped = droppedSamples.exchange(0);
+        if (dropped > 0) {
+            PLOG_WARNING << "Recording too slow, dropped " << dropped << " samples";
+        }
+
+        if (n == 0 && !bPending) {
+            if (!bRunning) {
+                break;
+            }
+            /**
+             * Nothing to do, write what is buffered and wait for more.
+             */
+            flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(RECORD_WAIT_MS));
         }
     }
+
+    if (recFile) {
+        PLOG_WARNING << "Recording not finished, deleting " << recFilename;
+        closeFile(false);
+    }
 }
+
 /**
- * Stop storing data to a file. Closed the previously declared file.
+ * Applies a request of the acquisition thread.
+ * @param request The request.
  */
-void Datarecord::stopRecording() {
-    nsample = 0;
-    boRecord = false;
-    if (rec_file) {
-        rec_file->close();
+void Datarecord::applyRequest(const Request &request) {
+    switch (request.cmd) {
+        case Command::Start:
+            openFile(request.header);
+            break;
+        case Command::Keep:
+            closeFile(true, request.results);
+            break;
+        case Command::Discard:
+            closeFile(false);
+            break;
     }
 }
+
 /**
- * Add a single sample to a file.
- * @param sample The sample to add.
+ * Opens a new recording file and writes the header. An open recording is deleted, it was not stopped.
+ * @param header The header of the new recording.
  */
-void Datarecord::addSample(double sample) {
-    if (!boRecord || !rec_file) {
+void Datarecord::openFile(const RecordHeader &header) {
+    if (recFile) {
+        PLOG_WARNING << "Recording not finished, deleting " << recFilename;
+        closeFile(false);
+    }
+
+    recHeader = header;
+    recHeader.nSamples = 0;
+    recStartTime = std::time(nullptr);
+    recFile = createFile(recFilename);
+    if (!recFile) {
+        PLOG_ERROR << "Could not open recording " << recFilename << RECORD_EXTENSION;
         return;
     }
-    nsample++;
-    *outStream << (float) nsample / samplingRate << "\t" << sample << "\n";
+    std::fwrite(&recHeader, sizeof(recHeader), 1, recFile);
 }
+
 /**
- * Save the content of a vector to a file.
- * @param fileName The name of the file to store the data to.
- * @param samples  The vector to store to a file.
+ * Finishes the open recording. The number of samples is written to the header, and if requested, the recording is
+ * exported in the text format and appended to the archive.
+ * @param bKeep True to keep the recording, false to delete it.
+ * @param results The results of the measurement, stored in the archive.
  */
-void Datarecord::saveAll(QString fileName, std::vector<double> samples) {
-    startRecording(fileName);
-    for (auto sample : samples) {
-        addSample(sample);
+void Datarecord::closeFile(bool bKeep, const ArchiveResults &results) {
+    if (!recFile) {
+        return;
+    }
+    flush();
+
+    if (bKeep) {
+        std::fseek(recFile, offsetof(RecordHeader, nSamples), SEEK_SET);
+        std::fwrite(&recHeader.nSamples, sizeof(recHeader.nSamples), 1, recFile);
+    }
+    std::fclose(recFile);
+    recFile = nullptr;
+
+    const std::string binFilename = recFilename + RECORD_EXTENSION;
+    const std::string archive = getArchive();
+    if (!bKeep) {
+        std::remove(binFilename.c_str());
+    } else if (bTextExport || !archive.empty()) {
+        // The recording is read block by block, a long one does not fit into memory.
+        RecordReader record;
+        if (record.open(binFilename)) {
+            if (bTextExport) {
+                exportRecordText(record, recFilename + ".dat");
+            }
+            if (!archive.empty()) {
+                appendArchiveSession(archive, makeArchiveEntry(record.getHeader(), recStartTime, recFilename, results),
+                                     record);
+            }
+        }
+    }
+}
+
+/**
+ * Writes the buffered samples to the open recording.
+ */
+void Datarecord::flush() {
+    if (recFile && !writeBuffer.empty()) {
+        if (std::fwrite(writeBuffer.data(), sizeof(double), writeBuffer.size(), recFile) != writeBuffer.size()) {
+            PLOG_ERROR << "Could not write to recording " << recFilename << RECORD_EXTENSION;
+        }
+        recHeader.nSamples += writeBuffer.size();
+    }
+    writeBuffer.clear();
+}
+
+/**
+ * Creates a recording file named after the current time. The file is created exclusively: if a recording with that
+ * name already exists, a number is appended. So neither a previous recording nor one of another channel that starts
+ * in the same second is ever overwritten.
+ * @param fileName Gets the file name, without extension.
+ * @return The file opened for writing, nullptr if it could not be created.
+ */
+std::FILE *Datarecord::createFile(std::string &fileName) {
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+    localtime_r(&now, &local);
+    char name[32];
+    std::strftime(name, sizeof(name), "%Y_%m_%d_%H_%M_%S", &local);
+
+    fileName = std::string(name) + "_data";
+    for (int i = 1;; i++) {
+        std::FILE *file = std::fopen((fileName + RECORD_EXTENSION).c_str(), "wbx");
+        if (file || errno != EEXIST) {
+            return file;
+        }
+        fileName = std::string(name) + "_" + std::to_string(i) + "_data";
     }
-    stopRecording();
 }
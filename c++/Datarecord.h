@@ -13,41 +13,103 @@
 #ifndef OBP_DATARECORD_H
 #define OBP_DATARECORD_H
 
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
 
-#include <QtCore/QString>
-#include <QtCore/QFile>
-#include <QtCore/QTextStream>
+#include "CppThread.h"
+#include "SPSCQueue.h"
+#include "RecordFormat.h"
+#include "ArchiveFormat.h"
+
+/**
+ * Class dependant configuration values:
+ */
+#define RECORD_QUEUE_SIZE   65536   //!< Number of samples that can be queued for the writer thread.
+#define RECORD_REQUEST_SIZE 16      //!< Number of start and stop requests that can be queued for the writer thread.
+#define RECORD_BATCH_SIZE   1024    //!< Number of samples written to the file at once.
+#define RECORD_WAIT_MS      20      //!< Time in ms the writer thread waits if there is nothing to write.
 
 //! The Datarecord Class
 /*!
- * The class Datarecord is used to store data in a file. There are two options. One is to store it sample by sample,
- * the other by handing it a vector of doubles to store. If the sampling rate is supplied, it will save the values
- * with the corresponding time. Otherwise, data will be numbered with the sample. In this application, the data is
- * stored at the end of a measurement. A vector is handed to the object together with a file name that represents the
- * current date and time.
+ * The class Datarecord is used to store data in a file while a measurement is running. It inherits from CppThread,
+ * the file is written by its own thread, so the acquisition thread never waits for the file system.
+ *
+ * The acquisition thread starts a recording with a RecordHeader, adds the raw samples one by one and stops the
+ * recording at the end of the measurement. These calls only put the sample or the request in a lock-free queue. The
+ * samples and the requests have separate queues, so a request is never lost when the writer falls behind and the
+ * sample queue is full. Each request stores how many samples were queued before it, so the writer thread applies it
+ * exactly between the right samples. The writer thread writes the samples incrementally, in the binary format that
+ * is defined in RecordFormat.h, to a file that is named after the date and time the recording started. When a
+ * recording is stopped, it is either kept or, if the measurement was cancelled, deleted.
+ *
+ * Optionally, a kept recording is also exported in the text format (time and pressure in mmHg per line), which was
+ * the format used before the binary one. This is done by the writer thread as well. If an archive is set, kept
+ * recordings are also appended to it as a session, with the results passed to stopRecording.
  */
-class Datarecord {
+class Datarecord : public CppThread {
 
 public:
-    Datarecord(double samplingRate);
-    Datarecord(QString filename, double samplingRate);
-    ~Datarecord();
+    Datarecord();
+    ~Datarecord() override;
 
+    void startRecording(const RecordHeader &header);
     void addSample(double sample);
-    void saveAll(QString fileName, std::vector<double> samples);
-    void startRecording(QString filename);
-    void stopRecording();
+    void stopRecording(bool bKeep, const ArchiveResults &results = {});
+    void setTextExport(bool bExport);
+    bool getTextExport();
+    void setArchive(const std::string &fileName);
+    std::string getArchive();
+    void setEnabled(bool bEnable);
+    bool getEnabled();
+    void stopThread();
+
 private:
+    //! The requests passed to the writer thread.
+    enum class Command {
+        Start,      //!< Start a new recording.
+        Keep,       //!< Finish the recording and keep it.
+        Discard,    //!< Finish the recording and delete it.
+    };
+
+    //! A request in the queue to the writer thread.
+    struct Request {
+        Command cmd;            //!< The request.
+        uint64_t sampleCount;   //!< The number of samples queued before the request.
+        RecordHeader header;    //!< The header of the recording, if the request is Start.
+        ArchiveResults results; //!< The results of the measurement, if the request is Keep.
+    };
 
-    QString rec_filename;
-    QFile*  rec_file;
-    QTextStream* outStream;
-    bool boRecord;
-    long int nsample;
-    double samplingRate;
+    void run() override;
+    void pushRequest(Command cmd, const RecordHeader &header, const ArchiveResults &results = {});
+    void applyRequest(const Request &request);
+    void openFile(const RecordHeader &header);
+    void closeFile(bool bKeep, const ArchiveResults &results = {});
+    void flush();
+    static std::FILE *createFile(std::string &fileName);
 
+    SPSCQueue<double> samples;          //!< Samples for the writer thread.
+    SPSCQueue<Request> requests;        //!< Start and stop requests for the writer thread.
+    std::atomic<bool> bRunning;         //!< The writer thread is running.
+    std::atomic<bool> bTextExport;      //!< Also export kept recordings in the text format.
+    std::atomic<bool> bEnabled;         //!< Recordings are written, otherwise all calls are ignored.
+    std::atomic<long> droppedSamples;   //!< Samples that were dropped because the queue was full.
+    uint64_t queuedSamples;             //!< The number of samples queued, only used by the acquisition thread.
+    std::mutex archiveMutex;            //!< Protects the name of the archive.
+    std::string archiveName;            //!< The archive kept recordings are appended to, empty for none.
+
+    // Only used by the writer thread:
+    FILE *recFile;                      //!< The open recording, nullptr if there is none.
+    std::string recFilename;            //!< The name of the open recording.
+    std::time_t recStartTime;           //!< The time the open recording was started.
+    RecordHeader recHeader;             //!< The header of the open recording.
+    std::vector<double> writeBuffer;    //!< Samples waiting to be written to the file.
+    uint64_t writtenSamples;            //!< The number of samples taken out of the queue.
 };
 
 
 #endif //OBP_DATARECORD_H
-
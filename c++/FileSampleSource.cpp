@@ -0,0 +1,111 @@
+/**
+ * @file        FileSampleSource.cpp
+ * @brief       The implementation of the FileSampleSource class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+#include <algorithm>
+#include <thread>
+
+#include "FileSampleSource.h"
+#include "RecordFormat.h"
+
+/**
+ * Constructor of the FileSampleSource, reads the recording.
+ * @param fileName The name of the recording, binary if it has the RECORD_EXTENSION, text otherwise.
+ * @param bRealTime True to hand out the samples at the pace of the sampling rate, false for as fast as possible.
+ * @param samplingRate The sampling rate of a text file, binary recordings store their own.
+ */
+FileSampleSource::FileSampleSource(const std::string &fileName, bool bRealTime, double samplingRate) :
+        position(0),
+        samplingRate(samplingRate),
+        bRealTime(bRealTime),
+        bStarted(false) {
+    const std::string extension = RECORD_EXTENSION;
+    if (fileName.size() > extension.size() &&
+        fileName.compare(fileName.size() - extension.size(), extension.size(), extension) == 0) {
+        RecordHeader header;
+        if (readRecord(fileName, header, samples)) {
+            this->samplingRate = header.samplingRate;
+        } else {
+            samples.clear();
+        }
+    } else if (!readTextRecord(fileName, samples)) {
+        samples.clear();
+    }
+}
+
+/**
+ * Checks if the recording could be read.
+ * @return True if there are samples to play back.
+ */
+bool FileSampleSource::isOpen() const {
+    return !samples.empty();
+}
+
+/**
+ * Checks if all samples were handed out.
+ * @return True if there are no samples left.
+ */
+bool FileSampleSource::isEndOfData() const {
+    return position == samples.size();
+}
+
+/**
+ * Gets the sampling rate of the recording.
+ * @return The sampling rate in Hz.
+ */
+double FileSampleSource::getSamplingRate() {
+    return samplingRate;
+}
+
+/**
+ * Waits until new samples are available. In real time, this waits until a full block is due or the time runs out.
+ * When all samples are handed out, this waits the whole timeout, so a calling loop does not spin.
+ * @param timeoutMs The maximal time to wait in ms.
+ * @return True if there are new samples.
+ */
+bool FileSampleSource::waitForData(int timeoutMs) {
+    if (isEndOfData()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        return false;
+    }
+    if (!bStarted) {
+        startTime = std::chrono::steady_clock::now();
+        bStarted = true;
+    }
+    if (bRealTime) {
+        const size_t due = std::min(position + FILE_SOURCE_BLOCK_SIZE, samples.size());
+        const auto dueTime = startTime + std::chrono::duration<double>(due / samplingRate);
+        const auto timeout = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        std::this_thread::sleep_until(std::min<std::chrono::steady_clock::time_point>(
+                std::chrono::time_point_cast<std::chrono::steady_clock::duration>(dueTime), timeout));
+    }
+    return getAvailable() > 0;
+}
+
+/**
+ * Hands out the available samples, at most FILE_SOURCE_BLOCK_SIZE at once.
+ * @return The voltage samples, pointing into the recording.
+ */
+std::span<const double> FileSampleSource::readVoltageBlock() {
+    const size_t n = std::min<size_t>(getAvailable(), FILE_SOURCE_BLOCK_SIZE);
+    const auto block = std::span<const double>(samples).subspan(position, n);
+    position += n;
+    return block;
+}
+
+/**
+ * Gets the number of samples that can be handed out now.
+ * @return The number of samples.
+ */
+size_t FileSampleSource::getAvailable() const {
+    size_t end = samples.size();
+    if (bRealTime && bStarted) {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+        end = std::min(end, (size_t) (elapsed.count() * samplingRate));
+    }
+    return (end > position) ? end - position : 0;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file        FileSampleSource.h
+ * @brief       The header file of the FileSampleSource class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the FileSampleSource class and contains the general class description.
+ */
+#ifndef OBP_FILESAMPLESOURCE_H
+#define OBP_FILESAMPLESOURCE_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "ISampleSource.h"
+
+/**
+ * Class dependant configuration values:
+ */
+#define FILE_SOURCE_BLOCK_SIZE  100     //!< Maximal number of samples returned per block.
+
+//! The FileSampleSource class plays back a recording as if it was acquired.
+/*!
+ * The recording is read into memory when the source is created, either a binary recording (RECORD_EXTENSION) or a
+ * text file with voltages in the second column. The samples are then handed out in blocks, either at the pace of the
+ * sampling rate, like the hardware would, or as fast as they are read. When all samples are handed out, the source
+ * does not provide any more data.
+ */
+class FileSampleSource : public ISampleSource {
+
+public:
+    explicit FileSampleSource(const std::string &fileName, bool bRealTime = true,
+                              double samplingRate = SAMPLING_RATE);
+
+    [[nodiscard]] bool isOpen() const;
+    [[nodiscard]] bool isEndOfData() const;
+
+    double getSamplingRate() override;
+    bool waitForData(int timeoutMs) override;
+    std::span<const double> readVoltageBlock() override;
+
+private:
+    [[nodiscard]] size_t getAvailable() const;
+
+    std::vector<double> samples;                        //!< All samples of the recording.
+    size_t position;                                    //!< The next sample to hand out.
+    double samplingRate;                                //!< The sampling rate of the recording.
+    bool bRealTime;                                     //!< Hand out the samples at the pace of the sampling rate.
+    bool bStarted;                                      //!< The first block was requested.
+    std::chrono::steady_clock::time_point startTime;    //!< The time the first block was requested.
+};
+
+#endif //OBP_FILESAMPLESOURCE_H
@@ -11,6 +11,7 @@
 #ifndef OBP_IOBSERVER_H
 #define OBP_IOBSERVER_H
 
+#include <span>
 #include "common.h"
 
 //! The IObserver Class provides the functionality to receive events from an observable object.
@@ -35,6 +36,20 @@ public:
      */
     virtual void eNewData(double pData, double oData) {};
 
+    /**
+     * The virtual function to handle a block of new data, sent once per processed block instead of once per sample.
+     *
+     * By default, every pair is passed on to eNewData, so observers that only implement eNewData still get all data.
+     * Both spans have the same size and are only valid during the call.
+     * @param pData The new pressure data.
+     * @param oData The new oscillation data.
+     */
+    virtual void eNewDataBlock(std::span<const double> pData, std::span<const double> oData) {
+        for (size_t i = 0; i < pData.size(); i++) {
+            eNewData(pData[i], oData[i]);
+        }
+    };
+
     /**
      * The virtual function to handle screen events.
      * @param eScreen The new screen.
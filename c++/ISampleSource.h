@@ -0,0 +1,88 @@
+/**
+ * @file        ISampleSource.h
+ * @brief       The header file of the ISampleSource interface.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines and implements the ISampleSource interface and contains the general class description.
+ */
+#ifndef OBP_ISAMPLESOURCE_H
+#define OBP_ISAMPLESOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+//! The ISampleSource Class provides the voltage samples that are processed.
+/*!
+ * The Processing class reads its samples through this interface, so it does not depend on where they come from. The
+ * ComediHandler acquires them from the hardware, a FileSampleSource plays back a recording and a
+ * SyntheticSampleSource generates them. The samples are read in blocks: waitForData() waits until there are samples,
+ * readVoltageBlock() returns all that are available. Both are only ever called by the processing thread.
+ *
+ * A source can acquire several channels at once, e.g. one per cuff. The samples of all channels are then interleaved
+ * scan by scan in the blocks: sample i of channel c is at index i * getNumChannels() + c, and a block always holds
+ * complete scans.
+ */
+class ISampleSource {
+
+public:
+    /**
+     * Virtual destructor, so sources can be deleted through the interface.
+     */
+    virtual ~ISampleSource() = default;
+
+    /**
+     * Gets the sampling rate of the samples.
+     * @return The sampling rate in Hz.
+     */
+    virtual double getSamplingRate() = 0;
+
+    /**
+     * Gets the number of channels that are acquired together.
+     * @return The number of interleaved channels in the blocks, 1 unless overridden.
+     */
+    virtual int getNumChannels() {
+        return 1;
+    }
+
+    /**
+     * Waits until new samples are available.
+     * @param timeoutMs The maximal time to wait in ms, so the caller can check if it should stop.
+     * @return True if there are new samples, false if the time ran out.
+     */
+    virtual bool waitForData(int timeoutMs) = 0;
+
+    /**
+     * Reads all samples that are currently available.
+     * @return The voltage samples of all channels, interleaved, only valid until the next call.
+     */
+    virtual std::span<const double> readVoltageBlock() = 0;
+
+    /**
+     * Gets how far the reading trails the source: the number of scans that were waiting at the last read.
+     * @return The number of scans, 0 unless overridden.
+     */
+    virtual size_t getBacklog() {
+        return 0;
+    }
+
+    /**
+     * Gets the number of times the buffer of the source was full, so samples were lost. Can be called from any
+     * thread.
+     * @return The number of overruns, 0 unless overridden.
+     */
+    virtual uint64_t getOverruns() {
+        return 0;
+    }
+
+protected:
+    /**
+     * Protected constructor, cannot be instantiated directly.
+     */
+    ISampleSource() = default;
+};
+
+#endif //OBP_ISAMPLESOURCE_H
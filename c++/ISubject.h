@@ -12,7 +12,8 @@
 #ifndef OBP_ISUBJECT_H
 #define OBP_ISUBJECT_H
 
-#include <list>
+#include <vector>
+#include <span>
 #include <algorithm>
 
 #include "common.h"
@@ -23,8 +24,8 @@
  * ISubject is a simple interface defined in a header file that lets the implementing class notify its observers
  * about specific events. Each notification is realised as a protected notify-X method. The public methods are
  * 'attach' and 'detach'. Through these, a class that implements the IObserver can be attached to the subject. When
- * an observer is attached to the subject, a reference to the object is stored in a list. If one of the notify
- * methods is called, the notification is sent to all the observers in the list. An observer can be removed through
+ * an observer is attached to the subject, a reference to the object is stored in a vector. If one of the notify
+ * methods is called, the notification is sent to all the observers in the vector. An observer can be removed through
  * the detach method.
  *
  * The ISubject class can not be instantiated directly. A child class has to inherit from it. A protected constructor
@@ -46,7 +47,7 @@ public:
      * @param observer The observer to remove.
      */
     virtual void detach(IObserver *observer) {
-        observerList.remove(observer);
+        observerList.erase(std::remove(observerList.begin(), observerList.end(), observer), observerList.end());
     }
 
 protected:
@@ -77,6 +78,17 @@ protected:
                       });
     }
 
+    /**
+     * Notify observers about a block of new data pairs.
+     * @param pData The new pressure data samples.
+     * @param oData The new oscillation data samples, as many as pressure data samples.
+     */
+    virtual void notifyNewDataBlock(std::span<const double> pData, std::span<const double> oData) {
+        for (IObserver *observer : observerList) {
+            observer->eNewDataBlock(pData, oData);
+        }
+    }
+
     /**
      * Notify observers about a change in the screen to display.
      * @param eScreen The new screen to display.
@@ -113,7 +125,7 @@ protected:
                       });
     }
 private:
-    std::list<IObserver *> observerList;  //!< The list of attached observers, used to iterate over when sending notifications.
+    std::vector<IObserver *> observerList;  //!< The attached observers, used to iterate over when sending notifications.
 
 };
 
@@ -0,0 +1,114 @@
+/**
+ * @file        IirBlockFilter.h
+ * @brief       The header file of the IirBlockFilter class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines and implements the IirBlockFilter template class and contains the general class description.
+ */
+#ifndef OBP_IIRBLOCKFILTER_H
+#define OBP_IIRBLOCKFILTER_H
+
+#include <cassert>
+#include <cstddef>
+#include <span>
+
+//! The IirBlockFilter class runs a cascade of biquads over a whole block of samples.
+/*!
+ * The filter does not design anything itself, the coefficients are copied from a filter of the Iir library after
+ * it was set up. The biquads are calculated in direct form II, like the Iir library does by default, so the output
+ * is the same as filtering sample by sample, apart from rounding.
+ *
+ * The filter can run several independent recordings with the same coefficients at once, one per lane. The samples
+ * of the lanes are interleaved in the block: sample i of lane l is at index i * Lanes + l. The innermost loop runs
+ * over the lanes, so the compiler can calculate a biquad for all lanes with SIMD instructions. The acquisition
+ * filters one channel per filter, the replay of many text files with the same settings uses several lanes.
+ *
+ * @tparam Stages The number of biquads in the cascade, (order + 1) / 2 for the Iir filters.
+ * @tparam Lanes The number of independent recordings filtered at once.
+ */
+template<int Stages, int Lanes = 1>
+class IirBlockFilter {
+    static_assert(Stages > 0 && Lanes > 0, "IirBlockFilter needs at least one biquad and one lane");
+
+public:
+    /**
+     * Copies the coefficients from a filter of the Iir library and resets the filter state.
+     * The getters of the Iir biquads return the coefficients as they were set, they are normalised by a0 here.
+     * @param iirFilter The set up Iir filter, a cascade of at most Stages biquads.
+     */
+    template<class IirFilter>
+    void setup(IirFilter &iirFilter) {
+        nStages = iirFilter.getNumStages();
+        assert(nStages <= Stages);
+        for (int s = 0; s < nStages; s++) {
+            const auto &biquad = iirFilter[s];
+            const double a0 = biquad.getA0();
+            b0[s] = biquad.getB0() / a0;
+            b1[s] = biquad.getB1() / a0;
+            b2[s] = biquad.getB2() / a0;
+            a1[s] = biquad.getA1() / a0;
+            a2[s] = biquad.getA2() / a0;
+        }
+        reset();
+    }
+
+    /**
+     * Resets the state of all biquads in all lanes to 0.
+     */
+    void reset() {
+        for (int s = 0; s < Stages; s++) {
+            for (int l = 0; l < Lanes; l++) {
+                v1[s][l] = 0.0;
+                v2[s][l] = 0.0;
+            }
+        }
+    }
+
+    /**
+     * Resets the state of all biquads of a lane to 0.
+     * @param lane The lane, less than Lanes.
+     */
+    void reset(int lane) {
+        assert(lane >= 0 && lane < Lanes);
+        for (int s = 0; s < Stages; s++) {
+            v1[s][lane] = 0.0;
+            v2[s][lane] = 0.0;
+        }
+    }
+
+    /**
+     * Filters a block of samples in place.
+     * @param block The interleaved samples of all lanes, the size has to be a multiple of Lanes.
+     */
+    void filter(std::span<double> block) {
+        assert(block.size() % Lanes == 0);
+        const size_t n = block.size() / Lanes;
+        double *data = block.data();
+        for (size_t i = 0; i < n; i++) {
+            double *x = data + i * Lanes;
+            for (int s = 0; s < nStages; s++) {
+                for (int l = 0; l < Lanes; l++) {
+                    const double w = x[l] - a1[s] * v1[s][l] - a2[s] * v2[s][l];
+                    x[l] = b0[s] * w + b1[s] * v1[s][l] + b2[s] * v2[s][l];
+                    v2[s][l] = v1[s][l];
+                    v1[s][l] = w;
+                }
+            }
+        }
+    }
+
+private:
+    int nStages = 0;        //!< The number of biquads used.
+    double b0[Stages]{};    //!< The b0 coefficient of each biquad, normalised by a0.
+    double b1[Stages]{};    //!< The b1 coefficient of each biquad, normalised by a0.
+    double b2[Stages]{};    //!< The b2 coefficient of each biquad, normalised by a0.
+    double a1[Stages]{};    //!< The a1 coefficient of each biquad, normalised by a0.
+    double a2[Stages]{};    //!< The a2 coefficient of each biquad, normalised by a0.
+    alignas(32) double v1[Stages][Lanes]{};   //!< The first state of each biquad per lane.
+    alignas(32) double v2[Stages][Lanes]{};   //!< The second state of each biquad per lane.
+};
+
+#endif //OBP_IIRBLOCKFILTER_H
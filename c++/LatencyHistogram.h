@@ -0,0 +1,148 @@
+/**
+ * @file        LatencyHistogram.h
+ * @brief       The header file of the LatencyHistogram class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines and implements the LatencyHistogram class and contains the general class description.
+ */
+#ifndef OBP_LATENCYHISTOGRAM_H
+#define OBP_LATENCYHISTOGRAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+/**
+ * Class dependant configuration values:
+ */
+#define LATENCY_SUB_BITS    3   //!< Each power of two is split into 2^LATENCY_SUB_BITS buckets, 12.5 % resolution.
+#define LATENCY_MAX_BITS    40  //!< Values from 2^LATENCY_MAX_BITS on, about 18 minutes in ns, are in the last bucket.
+#define LATENCY_BUCKETS     ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) //!< Number of buckets.
+
+//! A summary of a LatencyHistogram at one point in time.
+struct LatencySnapshot {
+    uint64_t count = 0;     //!< The number of recorded values.
+    double mean = 0.0;      //!< The mean of the values.
+    uint64_t p50 = 0;       //!< The median, the upper bound of its bucket.
+    uint64_t p99 = 0;       //!< The 99th percentile, the upper bound of its bucket.
+    uint64_t p999 = 0;      //!< The 99.9th percentile, the upper bound of its bucket.
+    uint64_t max = 0;       //!< The largest value.
+};
+
+//! The LatencyHistogram class counts values, usually durations in ns, in fixed buckets.
+/*!
+ * The buckets are log-linear: every power of two is split into the same number of buckets, so the resolution is
+ * the same relative error over the whole range, from a few ns to minutes. Recording a value only needs a few bit
+ * operations and relaxed atomic increments, it never locks or allocates. The histogram can therefore always be on,
+ * and one thread can record while another one takes a snapshot. A snapshot is not atomic as a whole, it may miss
+ * the values recorded while it is taken.
+ */
+class LatencyHistogram {
+
+public:
+    /**
+     * Adds a value to the histogram.
+     * @param value The value, e.g. a duration in ns.
+     */
+    void record(uint64_t value) {
+        buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t current = max.load(std::memory_order_relaxed);
+        while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * Summarises the recorded values.
+     * @return The count, mean, percentiles and maximum of the values.
+     */
+    [[nodiscard]] LatencySnapshot snapshot() const {
+        LatencySnapshot snap;
+        uint64_t counts[LATENCY_BUCKETS];
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            counts[i] = buckets[i].load(std::memory_order_relaxed);
+            snap.count += counts[i];
+        }
+        if (snap.count == 0) {
+            return snap;
+        }
+        snap.mean = (double) sum.load(std::memory_order_relaxed) / (double) snap.count;
+        snap.max = max.load(std::memory_order_relaxed);
+        snap.p50 = percentile(counts, snap.count, 500, snap.max);
+        snap.p99 = percentile(counts, snap.count, 990, snap.max);
+        snap.p999 = percentile(counts, snap.count, 999, snap.max);
+        return snap;
+    }
+
+    /**
+     * Removes all recorded values.
+     */
+    void reset() {
+        for (auto &bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    /**
+     * Gets the bucket of a value.
+     * @param value The value.
+     * @return The index of the bucket.
+     */
+    static int bucketOf(uint64_t value) {
+        if (value < (1u << LATENCY_SUB_BITS)) {
+            return (int) value;
+        }
+        const int msb = std::min(63 - std::countl_zero(value), LATENCY_MAX_BITS);
+        const int sub = (int) (value >> (msb - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1);
+        return std::min(((msb - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub, LATENCY_BUCKETS - 1);
+    }
+
+    /**
+     * Gets the largest value that falls into a bucket.
+     * @param bucket The index of the bucket.
+     * @return The upper bound of the bucket.
+     */
+    static uint64_t upperBound(int bucket) {
+        if (bucket < (1 << LATENCY_SUB_BITS)) {
+            return bucket;
+        }
+        const int msb = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+        const uint64_t sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+        return (((1ull << LATENCY_SUB_BITS) + sub + 1) << (msb - LATENCY_SUB_BITS)) - 1;
+    }
+
+    /**
+     * Finds a percentile in the bucket counts.
+     * @param counts The counts of all buckets.
+     * @param total The sum of the counts.
+     * @param perMille The percentile in per mille.
+     * @param max The largest value, no percentile is larger.
+     * @return The upper bound of the bucket the percentile is in.
+     */
+    static uint64_t percentile(const uint64_t *counts, uint64_t total, uint64_t perMille, uint64_t max) {
+        uint64_t sum = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            sum += counts[i];
+            if (sum * 1000 >= total * perMille) {
+                return std::min(upperBound(i), max);
+            }
+        }
+        return max;
+    }
+
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS]{};   //!< The number of values in each bucket.
+    std::atomic<uint64_t> count = 0;                    //!< The number of recorded values.
+    std::atomic<uint64_t> sum = 0;                      //!< The sum of the recorded values.
+    std::atomic<uint64_t> max = 0;                      //!< The largest recorded value.
+};
+
+#endif //OBP_LATENCYHISTOGRAM_H
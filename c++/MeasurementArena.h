@@ -0,0 +1,284 @@
+/**
+ * @file        MeasurementArena.h
+ * @brief       The header file of the MeasurementArena, FixedVector and FixedRing classes.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines and implements the MeasurementArena, FixedVector and FixedRing classes and contains the general class
+ * descriptions.
+ */
+#ifndef OBP_MEASUREMENTARENA_H
+#define OBP_MEASUREMENTARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#include "common.h"
+
+//! The FixedVector class is a vector with a fixed capacity on memory it does not own.
+/*!
+ * A FixedVector is a typed view on memory that is provided by a MeasurementArena. It offers the subset of the
+ * std::vector interface that is needed to store the data of a measurement, but it never allocates: the capacity is
+ * fixed when it is created. Adding a value to a full FixedVector is logged as an error and does not change it.
+ *
+ * Values are copied in and out as they are, therefore only trivially copyable types can be stored.
+ */
+template<typename T>
+class FixedVector {
+    static_assert(std::is_trivially_copyable_v<T>, "FixedVector can only hold trivially copyable values.");
+
+public:
+    /**
+     * Constructor of an empty FixedVector without any memory.
+     */
+    FixedVector() = default;
+
+    /**
+     * Constructor of an empty FixedVector.
+     * @param data The memory for the values.
+     * @param capacity The number of values that fit into the memory.
+     */
+    FixedVector(T *data, size_t capacity) :
+            first(data),
+            last(data),
+            limit(data + capacity) {
+    }
+
+    /**
+     * Adds a value at the end, if there is space left. Adding to a full vector is an error, it is logged.
+     * @param value The value to add.
+     * @return False if the vector is full and the value was not added.
+     */
+    bool push_back(const T &value) {
+        if (last == limit) {
+            PLOG_ERROR << "FixedVector of " << capacity() << " values full, value dropped";
+            assert(false);
+            return false;
+        }
+        *last++ = value;
+        return true;
+    }
+
+    /**
+     * Removes the last value.
+     */
+    void pop_back() {
+        assert(last != first);
+        --last;
+    }
+
+    /**
+     * Removes the first values, the following ones are moved to the front.
+     * @param n The number of values to remove, at most size().
+     */
+    void erase_front(size_t n) {
+        assert(n <= size());
+        std::memmove(first, first + n, (size() - n) * sizeof(T));
+        last -= n;
+    }
+
+    /**
+     * Removes all values, the capacity stays the same.
+     */
+    void clear() { last = first; }
+
+    T &operator[](size_t i) { return first[i]; }
+    const T &operator[](size_t i) const { return first[i]; }
+    T &front() { return *first; }
+    const T &front() const { return *first; }
+    T &back() { return *(last - 1); }
+    const T &back() const { return *(last - 1); }
+    T *begin() { return first; }
+    T *end() { return last; }
+    const T *begin() const { return first; }
+    const T *end() const { return last; }
+    const T *cbegin() const { return first; }
+    const T *cend() const { return last; }
+    T *data() { return first; }
+    const T *data() const { return first; }
+    [[nodiscard]] size_t size() const { return last - first; }
+    [[nodiscard]] size_t capacity() const { return limit - first; }
+    [[nodiscard]] bool empty() const { return last == first; }
+    [[nodiscard]] bool full() const { return last == limit; }
+
+private:
+    T *first = nullptr;     //!< The first value.
+    T *last = nullptr;      //!< One past the last value.
+    T *limit = nullptr;     //!< One past the end of the memory.
+};
+
+//! The FixedRing class keeps the latest values of a stream on memory it does not own.
+/*!
+ * A FixedRing is a ring buffer view on memory that is provided by a MeasurementArena. Values are added at the end
+ * and overwrite the oldest one when the ring is full. Unlike in a FixedVector, a value keeps its position: the n-th
+ * value added since the last clear() is always accessed at position n, as long as it is one of the last capacity()
+ * values.
+ *
+ * Values are copied in and out as they are, therefore only trivially copyable types can be stored.
+ */
+template<typename T>
+class FixedRing {
+    static_assert(std::is_trivially_copyable_v<T>, "FixedRing can only hold trivially copyable values.");
+
+public:
+    /**
+     * Constructor of an empty FixedRing without any memory.
+     */
+    FixedRing() = default;
+
+    /**
+     * Constructor of an empty FixedRing.
+     * @param data The memory for the values.
+     * @param capacity The number of values that fit into the memory.
+     */
+    FixedRing(T *data, size_t capacity) :
+            values(data),
+            length(capacity) {
+    }
+
+    /**
+     * Adds a value at the end, the oldest value is overwritten if the ring is full.
+     * @param value The value to add.
+     */
+    void push_back(const T &value) {
+        assert(length > 0);
+        values[next] = value;
+        if (++next == length) {
+            next = 0;
+        }
+        count++;
+    }
+
+    /**
+     * Removes all values, the next value added is at position 0 again.
+     */
+    void clear() {
+        next = 0;
+        count = 0;
+    }
+
+    /**
+     * Gets a value by its position.
+     * @param pos The position, from oldest() up to size() - 1.
+     * @return The value at the position.
+     */
+    T &operator[](uint64_t pos) {
+        assert(pos >= oldest() && pos < count);
+        return values[pos % length];
+    }
+
+    /**
+     * Gets a value by its position.
+     * @param pos The position, from oldest() up to size() - 1.
+     * @return The value at the position.
+     */
+    const T &operator[](uint64_t pos) const {
+        assert(pos >= oldest() && pos < count);
+        return values[pos % length];
+    }
+
+    const T &back() const { return values[(next == 0 ? length : next) - 1]; }
+    [[nodiscard]] uint64_t size() const { return count; }
+    [[nodiscard]] uint64_t oldest() const { return (count > length) ? count - length : 0; }
+    [[nodiscard]] size_t capacity() const { return length; }
+    [[nodiscard]] bool empty() const { return count == 0; }
+
+private:
+    T *values = nullptr;    //!< The memory of the values.
+    size_t length = 0;      //!< The number of values that fit into the memory.
+    size_t next = 0;        //!< The index in the memory the next value is written to.
+    uint64_t count = 0;     //!< The number of values added since the last clear, the position of the next one.
+};
+
+//! The MeasurementArena class holds all memory needed during a measurement in one allocation.
+/*!
+ * The arena allocates a single block of memory when it is created. FixedVector and FixedRing views are then handed
+ * out from that block, one after the other, until it is used up. Nothing is ever given back, the views are only valid
+ * as long as the arena exists. This way, all the memory for a measurement is allocated at start-up and the
+ * acquisition thread never allocates while a measurement is running.
+ *
+ * The required size can be calculated beforehand with bytesFor() for every view that will be taken from the arena.
+ * The memory is zeroed when it is allocated, so it is already mapped when the measurement starts.
+ */
+class MeasurementArena {
+
+public:
+    /**
+     * Constructor of the MeasurementArena, allocates the memory.
+     * @param bytes The size of the arena in bytes.
+     */
+    explicit MeasurementArena(size_t bytes) :
+            memory(new std::byte[bytes]()),
+            size(bytes),
+            used(0) {
+    }
+
+    /**
+     * Takes a FixedVector from the arena.
+     * @param capacity The number of values the vector can hold.
+     * @return An empty vector, without memory if the arena is used up.
+     */
+    template<typename T>
+    FixedVector<T> allocate(size_t capacity) {
+        T *data = take<T>(capacity);
+        return data ? FixedVector<T>(data, capacity) : FixedVector<T>();
+    }
+
+    /**
+     * Takes a FixedRing from the arena.
+     * @param capacity The number of values the ring holds.
+     * @return An empty ring, without memory if the arena is used up.
+     */
+    template<typename T>
+    FixedRing<T> allocateRing(size_t capacity) {
+        T *data = take<T>(capacity);
+        return data ? FixedRing<T>(data, capacity) : FixedRing<T>();
+    }
+
+    /**
+     * Gets the number of bytes needed in the arena for a FixedVector or a FixedRing, including alignment.
+     * @param capacity The number of values the vector or ring can hold.
+     * @return The size in bytes.
+     */
+    template<typename T>
+    static constexpr size_t bytesFor(size_t capacity) {
+        return capacity * sizeof(T) + alignof(T) - 1;
+    }
+
+    /**
+     * Gets the number of bytes already handed out.
+     * @return The used size in bytes.
+     */
+    [[nodiscard]] size_t getUsed() const {
+        return used;
+    }
+
+private:
+    /**
+     * Takes the aligned memory for some values from the arena.
+     * @param capacity The number of values.
+     * @return The memory, nullptr if the arena is used up.
+     */
+    template<typename T>
+    T *take(size_t capacity) {
+        const size_t offset = (used + alignof(T) - 1) / alignof(T) * alignof(T);
+        if (offset + capacity * sizeof(T) > size) {
+            PLOG_ERROR << "Measurement arena too small for " << capacity << " values";
+            assert(false);
+            return nullptr;
+        }
+        used = offset + capacity * sizeof(T);
+        return reinterpret_cast<T *>(memory.get() + offset);
+    }
+
+    std::unique_ptr<std::byte[]> memory;    //!< The memory of the arena.
+    size_t size;                            //!< The size of the memory in bytes.
+    size_t used;                            //!< The number of bytes handed out.
+};
+
+#endif //OBP_MEASUREMENTARENA_H
@@ -0,0 +1,189 @@
+/**
+ * @file        MinMaxDecimator.cpp
+ * @brief       The implementation of the MinMaxDecimator class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+#include <algorithm>
+
+#include "MinMaxDecimator.h"
+#include "Profiler.h"
+
+/**
+ * Constructor of the MinMaxDecimator, initialises all values to 0 with one column per sample.
+ * @param length The number of latest samples that are kept.
+ */
+MinMaxDecimator::MinMaxDecimator(size_t length) :
+        data(length, 0.0),
+        samplesPerColumn(1),
+        nSamples(length) {
+    rebuild();
+}
+
+/**
+ * Sets the number of columns the data is reduced to, usually the width of the plot in pixels.
+ * @param nColumns The number of columns.
+ */
+void MinMaxDecimator::setColumns(int nColumns) {
+    if (nColumns <= 0) {
+        return;
+    }
+    size_t newSamplesPerColumn = (data.size() + nColumns - 1) / nColumns;
+    if (newSamplesPerColumn != samplesPerColumn) {
+        samplesPerColumn = newSamplesPerColumn;
+        rebuild();
+    }
+}
+
+/**
+ * Adds a new sample, replacing the oldest one.
+ * @param value The new sample.
+ */
+void MinMaxDecimator::push(double value) {
+    data.push(value);
+    add(value, nSamples % samplesPerColumn == 0);
+    trimFirstColumn();
+}
+
+/**
+ * Adds several new samples, replacing the oldest ones.
+ * @param values The new samples, the last one is the newest.
+ */
+void MinMaxDecimator::push(std::span<const double> values) {
+    OBP_PROFILE_SCOPE(profile, ProfileStage::PlotDecimation, values.size());
+    data.push(values);
+    for (double value : values) {
+        add(value, nSamples % samplesPerColumn == 0);
+    }
+    trimFirstColumn();
+}
+
+/**
+ * Gets the number of points to draw.
+ * @return The number of points.
+ */
+size_t MinMaxDecimator::size() const {
+    if (samplesPerColumn == 1) {
+        return data.size();
+    }
+    return 2 * ((nSamples - 1) / samplesPerColumn - firstColumn() + 1);
+}
+
+/**
+ * Gets the number of latest samples that are kept.
+ * @return The number of samples.
+ */
+size_t MinMaxDecimator::length() const {
+    return data.size();
+}
+
+/**
+ * Gets the age of a point, oldest point first.
+ * @param i The index of the point.
+ * @return The age of the point in samples, the newest sample has an age of 1.
+ */
+double MinMaxDecimator::age(size_t i) const {
+    if (samplesPerColumn == 1) {
+        return (double) (data.size() - i);
+    }
+    const Column &col = column(i / 2);
+    bool bMin = isMinFirst(col) == (i % 2 == 0);
+    return (double) (nSamples - (bMin ? col.minIdx : col.maxIdx));
+}
+
+/**
+ * Gets the value of a point, oldest point first.
+ * @param i The index of the point.
+ * @return The value of the point.
+ */
+double MinMaxDecimator::value(size_t i) const {
+    if (samplesPerColumn == 1) {
+        return data[i];
+    }
+    const Column &col = column(i / 2);
+    bool bMin = isMinFirst(col) == (i % 2 == 0);
+    return bMin ? col.min : col.max;
+}
+
+/**
+ * Adds a sample to the columns.
+ * @param value The new sample.
+ * @param bNewColumn True if the sample is the first one of a column.
+ */
+void MinMaxDecimator::add(double value, bool bNewColumn) {
+    const size_t idx = nSamples++;
+    Column &col = columns[(idx / samplesPerColumn) % columns.size()];
+    if (bNewColumn) {
+        col = {value, value, idx, idx};
+    } else if (value < col.min) {
+        col.min = value;
+        col.minIdx = idx;
+    } else if (value > col.max) {
+        col.max = value;
+        col.maxIdx = idx;
+    }
+}
+
+/**
+ * Recalculates all columns from the stored samples.
+ */
+void MinMaxDecimator::rebuild() {
+    // One more column than needed to show all samples, because the oldest one can be partially outside.
+    columns.resize((data.size() + samplesPerColumn - 1) / samplesPerColumn + 1);
+    nSamples -= data.size();
+    for (size_t i = 0; i < data.size(); i++) {
+        add(data[i], i == 0 || nSamples % samplesPerColumn == 0);
+    }
+}
+
+/**
+ * Recalculates the oldest column from the stored samples if its minimum or maximum is no longer stored, so no point
+ * is older than the stored samples.
+ */
+void MinMaxDecimator::trimFirstColumn() {
+    const size_t oldest = nSamples - data.size();
+    Column &col = columns[firstColumn() % columns.size()];
+    if (col.minIdx >= oldest && col.maxIdx >= oldest) {
+        return;
+    }
+    const size_t end = std::min((firstColumn() + 1) * samplesPerColumn, nSamples);
+    col = {data[0], data[0], oldest, oldest};
+    for (size_t idx = oldest + 1; idx < end; idx++) {
+        const double value = data[idx - oldest];
+        if (value < col.min) {
+            col.min = value;
+            col.minIdx = idx;
+        } else if (value > col.max) {
+            col.max = value;
+            col.maxIdx = idx;
+        }
+    }
+}
+
+/**
+ * Gets the column number of the column with the oldest sample.
+ * @return The absolute column number.
+ */
+size_t MinMaxDecimator::firstColumn() const {
+    return (nSamples - data.size()) / samplesPerColumn;
+}
+
+/**
+ * Gets a column, oldest first.
+ * @param i The index of the column.
+ * @return The column.
+ */
+const MinMaxDecimator::Column &MinMaxDecimator::column(size_t i) const {
+    return columns[(firstColumn() + i) % columns.size()];
+}
+
+/**
+ * Checks if the minimum of a column occurred before its maximum, so the points are drawn in the right order.
+ * @param col The column to check.
+ * @return True if the minimum came first.
+ */
+bool MinMaxDecimator::isMinFirst(const Column &col) const {
+    return col.minIdx <= col.maxIdx;
+}
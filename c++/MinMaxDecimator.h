@@ -0,0 +1,70 @@
+/**
+ * @file        MinMaxDecimator.h
+ * @brief       The header file of the MinMaxDecimator class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the MinMaxDecimator class and contains the general class description.
+ */
+#ifndef OBP_MINMAXDECIMATOR_H
+#define OBP_MINMAXDECIMATOR_H
+
+#include <span>
+#include <vector>
+
+#include "RingBuffer.h"
+
+//! The MinMaxDecimator class reduces a data stream to the points needed to draw it.
+/*!
+ * The latest values of the stream are kept in a RingBuffer. In addition, the values are grouped into columns of
+ * samplesPerColumn consecutive samples, and only the minimum and the maximum of each column is shown. If there is
+ * one column per pixel, the drawn line looks the same as if every sample was drawn, but the number of points only
+ * depends on the number of columns.
+ *
+ * The columns are aligned to the absolute sample number, so they do not change when the data scrolls. Every new
+ * sample only updates the minimum and maximum of the newest column. The columns are only recalculated from the
+ * stored data if the number of columns changes. The oldest column is partly replaced by the new samples, it is
+ * recalculated from the remaining ones when its minimum or maximum is replaced.
+ *
+ * The points are accessed oldest first. The position of a point is given as its age in samples, where the newest
+ * sample has an age of 1.
+ */
+class MinMaxDecimator {
+
+public:
+    explicit MinMaxDecimator(size_t length);
+
+    void setColumns(int columns);
+    void push(double value);
+    void push(std::span<const double> values);
+
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] size_t length() const;
+    [[nodiscard]] double age(size_t i) const;
+    [[nodiscard]] double value(size_t i) const;
+
+private:
+    //! The minimum and maximum of one column, together with the absolute sample number they occurred at.
+    struct Column {
+        double min;
+        double max;
+        size_t minIdx;
+        size_t maxIdx;
+    };
+
+    RingBuffer<double> data;        //!< The latest samples, needed to recalculate the columns.
+    std::vector<Column> columns;    //!< The columns as a ring, indexed by column number modulo its size.
+    size_t samplesPerColumn;        //!< The number of samples reduced to one column.
+    size_t nSamples;                //!< The absolute number of samples added, starting with the initial ones.
+
+    void add(double value, bool bNewColumn);
+    void rebuild();
+    void trimFirstColumn();
+    [[nodiscard]] size_t firstColumn() const;
+    [[nodiscard]] const Column &column(size_t i) const;
+    [[nodiscard]] bool isMinFirst(const Column &col) const;
+};
+
+#endif //OBP_MINMAXDECIMATOR_H
@@ -0,0 +1,199 @@
+/**
+ * @file        MultiChannelProcessing.cpp
+ * @brief       The implementation of the MultiChannelProcessing class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+#include <algorithm>
+
+#include "MultiChannelProcessing.h"
+
+/**
+ * The constructor of the MultiChannelProcessing thread, creates the processing of every channel of the source.
+ * @param source The source of the samples, it has to exist as long as the thread.
+ * @param nWorkers The number of worker threads, at most one per channel is used. 0 to process all channels in the
+ * acquisition thread.
+ * @param fcLP Cutoff frequency for the low-pass filters of all channels.
+ * @param fcHP Cutoff frequency for the high-pass filters of all channels.
+ */
+MultiChannelProcessing::MultiChannelProcessing(ISampleSource *source, unsigned int nWorkers, double fcLP,
+                                               double fcHP) :
+        source(source),
+        channelSamples(PROC_BLOCK_SIZE),
+        bRunning(false) {
+    assert(source != nullptr);
+    for (int c = 0; c < source->getNumChannels(); c++) {
+        channels.push_back(std::make_unique<Processing>(source, c, fcLP, fcHP));
+    }
+
+    nWorkers = std::min(nWorkers, (unsigned int) channels.size());
+    if (nWorkers > 0) {
+        for (auto &channel : channels) {
+            tasks.push_back(std::make_unique<ChannelTask>(channel.get()));
+        }
+        scheduler = std::make_unique<WorkStealingScheduler>(nWorkers);
+    }
+}
+
+/**
+ * The destructor of the MultiChannelProcessing thread, stops the workers before the channels are deleted.
+ */
+MultiChannelProcessing::~MultiChannelProcessing() {
+    shutdown();
+}
+
+/**
+ * Gets the number of channels that are processed.
+ * @return The number of channels of the source.
+ */
+int MultiChannelProcessing::getNumChannels() {
+    return (int) channels.size();
+}
+
+/**
+ * Gets the processing of a channel, to configure it, attach observers or start a measurement.
+ * @param channel The channel.
+ * @return The processing of the channel.
+ */
+Processing *MultiChannelProcessing::getChannel(int channel) {
+    return channels.at(channel).get();
+}
+
+/**
+ * Gets the number of worker threads that process the channels.
+ * @return The number of workers, 0 if the channels are processed in the acquisition thread.
+ */
+unsigned int MultiChannelProcessing::getNumWorkers() {
+    return scheduler ? scheduler->getNumWorkers() : 0;
+}
+
+/**
+ * Stops the thread so it can be joined.
+ */
+void MultiChannelProcessing::stopThread() {
+    bRunning = false;
+}
+
+/**
+ * Stops the thread and the workers and waits for them, then shuts the channels down. Has to be called before the
+ * observers of the channels are destroyed, see Processing::shutdown().
+ */
+void MultiChannelProcessing::shutdown() {
+    stopThread();
+    join();
+    if (scheduler) {
+        scheduler->stop();
+    }
+    for (auto &channel : channels) {
+        channel->shutdown();
+    }
+}
+
+/**
+ * The main running function of the thread.
+ *
+ * The channels are marked as running, so their settings can not be changed any more. Every acquired block is
+ * either passed to all channels or demultiplexed for the workers.
+ */
+void MultiChannelProcessing::run() {
+    bRunning = true;
+    for (auto &channel : channels) {
+        channel->bRunning = true;
+    }
+    if (scheduler) {
+        scheduler->start();
+    }
+
+    const int nChannels = getNumChannels();
+    while (bRunning) {
+        if (source->waitForData(PROC_WAIT_TIMEOUT)) {
+            const auto scans = source->readVoltageBlock();
+            const auto readTime = std::chrono::steady_clock::now();
+            if (scheduler) {
+                demultiplex(scans, readTime);
+            } else {
+                for (auto &channel : channels) {
+                    channel->processScans(scans, nChannels, readTime);
+                }
+            }
+        }
+    }
+
+    if (scheduler) {
+        scheduler->stop();
+    }
+    for (auto &channel : channels) {
+        channel->bRunning = false;
+    }
+}
+
+/**
+ * Queues the samples of every channel in a block of scans and submits the channels to the workers.
+ *
+ * If the workers fall so far behind that the queue of a channel is full, the samples that do not fit are dropped.
+ * @param scans The voltage samples of all channels, interleaved scan by scan.
+ * @param readTime The time the scans were read from the source, queued with the samples.
+ */
+void MultiChannelProcessing::demultiplex(std::span<const double> scans,
+                                         std::chrono::steady_clock::time_point readTime) {
+    const size_t nChannels = tasks.size();
+    const size_t nScans = scans.size() / nChannels;
+    for (size_t first = 0; first < nScans; first += channelSamples.size()) {
+        const size_t n = std::min(channelSamples.size(), nScans - first);
+        for (size_t c = 0; c < nChannels; c++) {
+            const double *scan = scans.data() + first * nChannels + c;
+            for (size_t i = 0; i < n; i++) {
+                channelSamples[i] = scan[i * nChannels];
+            }
+            // The samples are only queued if their read time can be queued with them.
+            ChannelTask &task = *tasks[c];
+            const size_t queued = task.blocks.size() < task.blocks.capacity() ?
+                                  task.samples.push(std::span<const double>(channelSamples.data(), n)) : 0;
+            if (queued > 0) {
+                task.blocks.push({queued, readTime});
+            }
+            if (queued < n) {
+                PLOG_WARNING << "Processing of channel " << c << " too slow, samples dropped";
+            }
+            scheduler->submit(&task);
+        }
+    }
+}
+
+/**
+ * Constructor of the task of a channel.
+ * @param processing The processing of the channel.
+ */
+MultiChannelProcessing::ChannelTask::ChannelTask(Processing *processing) :
+        samples(MULTI_QUEUE_SIZE),
+        blocks(MULTI_QUEUE_BLOCKS),
+        processing(processing),
+        block(PROC_BLOCK_SIZE) {
+}
+
+/**
+ * Processes the queued samples of the channel, at most MULTI_TASK_BLOCKS blocks so the other channels get their turn.
+ * @return True if there are still samples queued.
+ */
+bool MultiChannelProcessing::ChannelTask::runPending() {
+    QueuedBlock queued{};
+    for (int i = 0; i < MULTI_TASK_BLOCKS; i++) {
+        if (!blocks.pop(queued)) {
+            return false;
+        }
+        // The samples of a block are queued before the block, they are all there.
+        const size_t n = samples.pop(std::span<double>(block).first(queued.nSamples));
+        processing->processScans({block.data(), n}, 1, queued.readTime);
+    }
+    return hasPending();
+}
+
+/**
+ * Checks if there are samples queued for the channel.
+ * @return True if there are samples queued.
+ */
+bool MultiChannelProcessing::ChannelTask::hasPending() {
+    return blocks.size() > 0;
+}
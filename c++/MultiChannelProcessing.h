@@ -0,0 +1,95 @@
+/**
+ * @file        MultiChannelProcessing.h
+ * @brief       The header file of the MultiChannelProcessing class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the MultiChannelProcessing class and contains the general class description.
+ */
+#ifndef OBP_MULTICHANNELPROCESSING_H
+#define OBP_MULTICHANNELPROCESSING_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "CppThread.h"
+#include "ISampleSource.h"
+#include "Processing.h"
+#include "SPSCQueue.h"
+#include "WorkStealingScheduler.h"
+
+/**
+ * Class dependant configuration values:
+ */
+#define MULTI_QUEUE_SIZE    65536   //!< Number of samples per channel that can wait for a worker.
+#define MULTI_QUEUE_BLOCKS  1024    //!< Number of blocks per channel that can wait for a worker.
+#define MULTI_TASK_BLOCKS   4       //!< Number of blocks a worker processes of one channel before the next channel.
+
+//! The MultiChannelProcessing class processes all channels of a source from one acquisition thread.
+/*!
+ * There is one Processing instance per channel of the source, each with its own state machine, SignalConditioner,
+ * OBPDetection, Datarecord and observers. The instances are not started as threads themselves. Instead, the
+ * MultiChannelProcessing thread waits for the source, reads every block once and passes it to all channels, which
+ * take their samples out of the interleaved scans. This way, several cuffs can be measured with one DAQ card, and
+ * reading the samples does not cost more system calls than with a single channel.
+ *
+ * With worker threads, the acquisition thread only queues the samples of every channel, with the time the block was
+ * read, and submits the channel to a WorkStealingScheduler. The workers run the channels in parallel, each channel
+ * on one worker at a time, so its samples stay in order. Without workers, all channels are processed one after the
+ * other by the acquisition thread itself.
+ *
+ * The channels are configured, observed and controlled through getChannel(), like a single Processing instance.
+ * Their settings can only be changed before the thread is started.
+ */
+class MultiChannelProcessing : public CppThread {
+
+public:
+    explicit MultiChannelProcessing(ISampleSource *source, unsigned int nWorkers = std::thread::hardware_concurrency(),
+                                    double fcLP = 10.0, double fcHP = 0.5);
+    ~MultiChannelProcessing() override;
+
+    int getNumChannels();
+    Processing *getChannel(int channel);
+    unsigned int getNumWorkers();
+    void stopThread();
+    void shutdown();
+
+private:
+    //! A block of samples in the queue of a channel.
+    struct QueuedBlock {
+        size_t nSamples;                                    //!< The number of samples of the block.
+        std::chrono::steady_clock::time_point readTime;     //!< The time the block was read from the source.
+    };
+
+    //! The queued samples of one channel, processed by the workers one block after the other.
+    class ChannelTask : public SerialTask {
+    public:
+        explicit ChannelTask(Processing *processing);
+
+        bool runPending() override;
+        bool hasPending() override;
+
+        SPSCQueue<double> samples;      //!< The demultiplexed samples of the channel, filled by the acquisition.
+        SPSCQueue<QueuedBlock> blocks;  //!< The size and read time of every queued block, filled by the acquisition.
+
+    private:
+        Processing *processing;         //!< The processing of the channel.
+        std::vector<double> block;      //!< The block of samples that is processed.
+    };
+
+    void run() override;
+    void demultiplex(std::span<const double> scans, std::chrono::steady_clock::time_point readTime);
+
+    ISampleSource *source;                              //!< The source of the data, not owned.
+    std::vector<std::unique_ptr<Processing>> channels;  //!< The processing of every channel.
+    std::vector<std::unique_ptr<ChannelTask>> tasks;    //!< The queued samples of every channel, if there are workers.
+    std::unique_ptr<WorkStealingScheduler> scheduler;   //!< The workers, nullptr to process in this thread.
+    std::vector<double> channelSamples;                 //!< The samples of one channel taken out of a block.
+    std::atomic<bool> bRunning;                         //!< The thread is running.
+};
+
+#endif //OBP_MULTICHANNELPROCESSING_H
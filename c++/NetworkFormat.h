@@ -0,0 +1,65 @@
+/**
+ * @file        NetworkFormat.h
+ * @brief       The header file of the network streaming format.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the frames a measurement station sends to a collector over TCP.
+ *
+ * The stream is a sequence of frames. Every frame starts with a NetFrameHeader, followed by payloadSize bytes of
+ * payload. All values are in the byte order of the station, like in the binary recordings. The sequence number
+ * counts all frames a station queued, so the collector can see how many frames were dropped under backpressure. The
+ * Hello frame is not counted, its sequence number is the one after the last frame the station sent completely on an
+ * earlier connection, so the frames sent before a reconnect are not seen as dropped.
+ *
+ * The payloads of the frame types are:
+ *  - Hello: NetHelloPayload, always the first frame after connecting.
+ *  - Data: NetDataPayload, followed by pairs of pressure and oscillation values as floats.
+ *  - Results: the MAP, SBP and DBP as doubles, 0 if a value could not be calculated.
+ *  - HeartRate: the heart rate as a double.
+ *  - Screen: the new Screen as uint32_t.
+ *  - Ready: no payload.
+ */
+#ifndef OBP_NETWORKFORMAT_H
+#define OBP_NETWORKFORMAT_H
+
+#include <cstdint>
+
+#define NET_MAGIC           "OBPN"      //!< Identifies a frame, not zero terminated.
+#define NET_VERSION         1           //!< The current version of the streaming format.
+#define NET_DEFAULT_PORT    4712        //!< The default TCP port of the collector.
+#define NET_MAX_PAIRS       1024        //!< Maximal number of data pairs in one frame.
+
+//! The types of frames.
+enum class NetFrameType : uint16_t {
+    Hello = 1,      //!< Identifies the station.
+    Data = 2,       //!< A block of filtered data.
+    Results = 3,    //!< The results of a measurement.
+    HeartRate = 4,  //!< A new heart rate value.
+    Screen = 5,     //!< The screen the station switched to.
+    Ready = 6,      //!< The station is ready for a measurement.
+};
+
+//! The header at the start of every frame.
+struct NetFrameHeader {
+    char magic[4];          //!< NET_MAGIC.
+    uint16_t version;       //!< NET_VERSION of the station.
+    uint16_t type;          //!< The NetFrameType.
+    uint32_t station;       //!< The identifier of the station.
+    uint32_t payloadSize;   //!< The size of the payload after the header in bytes.
+    uint64_t sequence;      //!< The number of frames queued by the station before this one.
+};
+
+//! The payload of a Hello frame.
+struct NetHelloPayload {
+    double samplingRate;    //!< The sampling rate of the data in Hz.
+};
+
+//! The start of the payload of a Data frame.
+struct NetDataPayload {
+    uint64_t firstSample;   //!< The index of the first pair since the station started.
+};
+
+#endif //OBP_NETWORKFORMAT_H
@@ -0,0 +1,420 @@
+/**
+ * @file        NetworkSink.cpp
+ * @brief       The implementation of the NetworkSink class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "NetworkSink.h"
+
+/**
+ * Constructor of the NetworkSink. The sender thread has to be started separately.
+ * @param host The host name or address of the collector.
+ * @param port The TCP port of the collector.
+ * @param station The identifier of this station, sent to the collector.
+ * @param samplingRate The sampling rate of the data.
+ */
+NetworkSink::NetworkSink(std::string host, uint16_t port, uint32_t station, double samplingRate) :
+        host(std::move(host)),
+        port(port),
+        station(station),
+        samplingRate(samplingRate),
+        queuedPairs(0),
+        sequence(0),
+        nextSample(0),
+        droppedFrames(0),
+        bConnected(false),
+        sock(-1),
+        sentSequence(0) {
+    freeBuffers.reserve(NET_QUEUE_FRAMES);
+}
+
+/**
+ * Destructor of the NetworkSink. Stops the sender thread and closes the connection.
+ */
+NetworkSink::~NetworkSink() {
+    stopThread();
+    join();
+    closeConnection();
+}
+
+/**
+ * Handles a single new data pair, sent as a data frame of its own.
+ * @param pData The new pressure data.
+ * @param oData The new oscillation data.
+ */
+void NetworkSink::eNewData(double pData, double oData) {
+    eNewDataBlock({&pData, 1}, {&oData, 1});
+}
+
+/**
+ * Handles a block of new data pairs. As many pairs as fit are appended to the newest data frame in the queue, the
+ * rest is queued in new data frames of at most NET_MAX_PAIRS pairs.
+ * @param pData The new pressure data.
+ * @param oData The new oscillation data.
+ */
+void NetworkSink::eNewDataBlock(std::span<const double> pData, std::span<const double> oData) {
+    for (size_t first = appendToQueued(pData, oData); first < pData.size(); first += NET_MAX_PAIRS) {
+        const size_t n = std::min<size_t>(NET_MAX_PAIRS, pData.size() - first);
+        Frame frame = takeFrame(NetFrameType::Data, sizeof(NetDataPayload));
+        const NetDataPayload data{nextSample};
+        std::memcpy(frame.bytes.data() + sizeof(NetFrameHeader), &data, sizeof(data));
+        writePairs(frame, pData.subspan(first, n), oData.subspan(first, n));
+        nextSample += n;
+        queueFrame(std::move(frame));
+    }
+}
+
+/**
+ * Handles notifications to switch the displayed screen.
+ * @param eScreen The new screen.
+ */
+void NetworkSink::eSwitchScreen(Screen eScreen) {
+    const auto screen = (uint32_t) eScreen;
+    queueEvent(NetFrameType::Screen, &screen, sizeof(screen));
+}
+
+/**
+ * Handles notifications about new results.
+ * @param map The MAP value.
+ * @param sbp The SBP value.
+ * @param dbp The DBP value.
+ */
+void NetworkSink::eResults(double map, double sbp, double dbp) {
+    const double results[3] = {map, sbp, dbp};
+    queueEvent(NetFrameType::Results, results, sizeof(results));
+}
+
+/**
+ * Handles notifications about a new heart rate.
+ * @param heartRate The new heart rate value.
+ */
+void NetworkSink::eHeartRate(double heartRate) {
+    queueEvent(NetFrameType::HeartRate, &heartRate, sizeof(heartRate));
+}
+
+/**
+ * Handles notifications that the station is ready for a measurement.
+ */
+void NetworkSink::eReady() {
+    queueEvent(NetFrameType::Ready, nullptr, 0);
+}
+
+/**
+ * Checks if the sender is connected to the collector.
+ * @return True if connected.
+ */
+bool NetworkSink::isConnected() {
+    return bConnected;
+}
+
+/**
+ * Returns the number of frames dropped because the queue was full.
+ * @return The number of dropped frames.
+ */
+uint64_t NetworkSink::getDroppedFrames() {
+    return droppedFrames;
+}
+
+/**
+ * Stops the sender thread, frames that were not sent yet are dropped.
+ */
+void NetworkSink::stopThread() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    requestStop();
+    queueCond.notify_all();
+}
+
+/**
+ * Sends the queued frames to the collector, connects and reconnects to it as needed.
+ */
+void NetworkSink::run() {
+    while (!stopRequested()) {
+        if (sock < 0 && !connectToCollector()) {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCond.wait_for(lock, std::chrono::milliseconds(NET_RECONNECT_MS), [this] { return stopRequested(); });
+            continue;
+        }
+
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            if (!queueCond.wait_for(lock, std::chrono::milliseconds(NET_WAIT_MS),
+                                    [this] { return stopRequested() || !queue.empty(); }) || queue.empty()) {
+                continue;
+            }
+            frame = std::move(queue.front());
+            queue.pop_front();
+            queuedPairs -= frame.nPairs;
+        }
+
+        // A frame that could not be sent completely is lost, the collector resynchronises on the next connection.
+        if (!sendAll(frame.bytes.data(), frame.bytes.size())) {
+            PLOG_WARNING << "Connection to collector " << host << ":" << port << " lost";
+            closeConnection();
+        } else {
+            std::memcpy(&sentSequence, frame.bytes.data() + offsetof(NetFrameHeader, sequence), sizeof(sentSequence));
+            sentSequence++;
+        }
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        freeBuffers.push_back(std::move(frame.bytes));
+    }
+}
+
+/**
+ * Prepares a frame with its header. The buffer of a sent frame is reused if there is one.
+ * @param type The type of the frame.
+ * @param payloadSize The size of the payload in bytes, written by the caller after the header.
+ * @return The frame, the sequence number is set when it is queued.
+ */
+NetworkSink::Frame NetworkSink::takeFrame(NetFrameType type, size_t payloadSize) {
+    Frame frame{type, {}, 0};
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!freeBuffers.empty()) {
+            frame.bytes = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+    }
+    // Data frames grow while they wait in the queue, they get the capacity of a full frame right away.
+    if (type == NetFrameType::Data) {
+        frame.bytes.reserve(sizeof(NetFrameHeader) + sizeof(NetDataPayload) + NET_MAX_PAIRS * 2 * sizeof(float));
+    }
+    frame.bytes.resize(sizeof(NetFrameHeader) + payloadSize);
+
+    NetFrameHeader header{};
+    std::memcpy(header.magic, NET_MAGIC, sizeof(header.magic));
+    header.version = NET_VERSION;
+    header.type = (uint16_t) type;
+    header.station = station;
+    header.payloadSize = (uint32_t) payloadSize;
+    std::memcpy(frame.bytes.data(), &header, sizeof(header));
+    return frame;
+}
+
+/**
+ * Appends the first pairs of a block to the newest frame in the queue, if it is a data frame with room left.
+ * @param pData The new pressure data.
+ * @param oData The new oscillation data.
+ * @return The number of pairs appended.
+ */
+size_t NetworkSink::appendToQueued(std::span<const double> pData, std::span<const double> oData) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (queue.empty() || queue.back().type != NetFrameType::Data || queue.back().nPairs >= NET_MAX_PAIRS) {
+        return 0;
+    }
+    const size_t n = std::min<size_t>(NET_MAX_PAIRS - queue.back().nPairs, pData.size());
+    makeRoom(n, 0);
+    writePairs(queue.back(), pData.first(n), oData.first(n));
+    queuedPairs += n;
+    nextSample += n;
+    return n;
+}
+
+/**
+ * Appends pairs to the payload of a data frame and updates the payload size in its header.
+ * @param frame The data frame.
+ * @param pData The pressure data.
+ * @param oData The oscillation data, as many as pressure data.
+ */
+void NetworkSink::writePairs(Frame &frame, std::span<const double> pData, std::span<const double> oData) {
+    const size_t offset = frame.bytes.size();
+    frame.bytes.resize(offset + pData.size() * 2 * sizeof(float));
+    auto *pairs = reinterpret_cast<float *>(frame.bytes.data() + offset);
+    for (size_t i = 0; i < pData.size(); i++) {
+        pairs[2 * i] = (float) pData[i];
+        pairs[2 * i + 1] = (float) oData[i];
+    }
+    frame.nPairs += pData.size();
+    const auto payloadSize = (uint32_t) (frame.bytes.size() - sizeof(NetFrameHeader));
+    std::memcpy(frame.bytes.data() + offsetof(NetFrameHeader, payloadSize), &payloadSize, sizeof(payloadSize));
+}
+
+/**
+ * Drops the oldest data frames until the queue has room. The oldest frames of other events are only dropped if
+ * there is no data frame and the queue has too many frames. The queueMutex has to be locked.
+ * @param nPairs The number of data pairs that are added.
+ * @param nFrames The number of frames that are added, 0 if the pairs are appended to the newest frame, which is kept.
+ */
+void NetworkSink::makeRoom(size_t nPairs, size_t nFrames) {
+    const size_t nKept = nFrames == 0 ? 1 : 0;
+    while (queue.size() > nKept &&
+           (queue.size() + nFrames > NET_QUEUE_FRAMES || queuedPairs + nPairs > NET_QUEUE_PAIRS)) {
+        const auto end = queue.end() - (std::ptrdiff_t) nKept;
+        auto dropped = std::find_if(queue.begin(), end,
+                                    [](const Frame &queued) { return queued.type == NetFrameType::Data; });
+        if (dropped == end) {
+            if (queue.size() + nFrames <= NET_QUEUE_FRAMES) {
+                return;
+            }
+            dropped = queue.begin();
+        }
+        queuedPairs -= dropped->nPairs;
+        freeBuffers.push_back(std::move(dropped->bytes));
+        queue.erase(dropped);
+        droppedFrames++;
+    }
+}
+
+/**
+ * Queues a frame for the sender. If the queue is full, the oldest data frames are dropped, see makeRoom().
+ * @param frame The frame to queue.
+ */
+void NetworkSink::queueFrame(Frame &&frame) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    std::memcpy(frame.bytes.data() + offsetof(NetFrameHeader, sequence), &sequence, sizeof(sequence));
+    sequence++;
+
+    makeRoom(frame.nPairs, 1);
+    queuedPairs += frame.nPairs;
+    queue.push_back(std::move(frame));
+    queueCond.notify_one();
+}
+
+/**
+ * Queues a frame of an event with a small payload.
+ * @param type The type of the frame.
+ * @param payload The payload.
+ * @param payloadSize The size of the payload in bytes.
+ */
+void NetworkSink::queueEvent(NetFrameType type, const void *payload, size_t payloadSize) {
+    Frame frame = takeFrame(type, payloadSize);
+    if (payloadSize > 0) {
+        std::memcpy(frame.bytes.data() + sizeof(NetFrameHeader), payload, payloadSize);
+    }
+    queueFrame(std::move(frame));
+}
+
+/**
+ * Connects a new socket to an address of the collector. The socket is not blocking while it connects, so an address
+ * that does not answer fails after NET_RECONNECT_MS instead of the timeout of the system.
+ * @param address The address.
+ * @return The connected, blocking socket, -1 if the connection failed.
+ */
+static int connectAddress(const addrinfo *address) {
+    const int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) {
+        return -1;
+    }
+    const int flags = fcntl(fd, F_GETFL, 0);
+    int error = fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 ? 0 : errno;
+    if (error == 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+        error = errno;
+        if (error == EINPROGRESS) {
+            pollfd pending{fd, POLLOUT, 0};
+            socklen_t length = sizeof(error);
+            if (poll(&pending, 1, NET_RECONNECT_MS) != 1 ||
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0) {
+                error = ETIMEDOUT;
+            }
+        }
+    }
+    if (error != 0 || fcntl(fd, F_SETFL, flags) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Connects to the collector and sends the Hello frame. The addresses of the collector are tried one after the
+ * other, until the sender is stopped.
+ * @return True if connected.
+ */
+bool NetworkSink::connectToCollector() {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    const std::string service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses) != 0) {
+        PLOG_WARNING << "Could not resolve collector " << host;
+        return false;
+    }
+
+    for (addrinfo *address = addresses; address && sock < 0 && !stopRequested(); address = address->ai_next) {
+        sock = connectAddress(address);
+    }
+    freeaddrinfo(addresses);
+    if (sock < 0) {
+        return false;
+    }
+
+    /**
+     * The frames are already batched by block, so they are sent right away. A collector that does not read any more
+     * makes the send fail after a while, instead of blocking the sender forever.
+     */
+    const int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    timeval timeout{NET_SEND_TIMEOUT_MS / 1000, (NET_SEND_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    uint8_t hello[sizeof(NetFrameHeader) + sizeof(NetHelloPayload)];
+    NetFrameHeader header{};
+    std::memcpy(header.magic, NET_MAGIC, sizeof(header.magic));
+    header.version = NET_VERSION;
+    header.type = (uint16_t) NetFrameType::Hello;
+    header.station = station;
+    header.payloadSize = sizeof(NetHelloPayload);
+    header.sequence = sentSequence;
+    const NetHelloPayload payload{samplingRate};
+    std::memcpy(hello, &header, sizeof(header));
+    std::memcpy(hello + sizeof(header), &payload, sizeof(payload));
+    if (!sendAll(hello, sizeof(hello))) {
+        closeConnection();
+        return false;
+    }
+
+    PLOG_INFO << "Connected to collector " << host << ":" << port;
+    bConnected = true;
+    return true;
+}
+
+/**
+ * Sends a buffer completely.
+ * @param data The bytes to send.
+ * @param size The number of bytes.
+ * @return True if all bytes were sent.
+ */
+bool NetworkSink::sendAll(const uint8_t *data, size_t size) {
+    while (size > 0) {
+        const ssize_t sent = send(sock, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+/**
+ * Closes the connection to the collector, if there is one.
+ */
+void NetworkSink::closeConnection() {
+    if (sock >= 0) {
+        close(sock);
+        sock = -1;
+    }
+    bConnected = false;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file        NetworkSink.h
+ * @brief       The header file of the NetworkSink class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the NetworkSink class and contains the general class description.
+ */
+#ifndef OBP_NETWORKSINK_H
+#define OBP_NETWORKSINK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "CppThread.h"
+#include "IObserver.h"
+#include "NetworkFormat.h"
+
+/**
+ * Class dependant configuration values:
+ */
+#define NET_QUEUE_PAIRS     (60 * SAMPLING_RATE)    //!< Maximal number of data pairs waiting to be sent, 1 minute.
+#define NET_QUEUE_FRAMES    256     //!< Maximal number of frames waiting to be sent, data and events.
+#define NET_RECONNECT_MS    1000    //!< Time in ms between two attempts to connect to the collector.
+#define NET_WAIT_MS         100     //!< Maximal time in ms the sender waits for frames before checking if it stops.
+#define NET_SEND_TIMEOUT_MS 2000    //!< Time in ms after which a blocked send to the collector fails.
+
+//! The NetworkSink Class streams the data and the results of a station to a collector.
+/*!
+ * NetworkSink is an observer of Processing that sends everything it is notified about to a central collector over
+ * TCP, in the frames defined in NetworkFormat.h. It is used instead of the Window on stations without a display.
+ * A sink observes a single Processing, each channel of a MultiChannelProcessing needs a sink with its own
+ * station identifier.
+ *
+ * The notifications only put a frame in a bounded queue. A new data block is appended to the newest data frame
+ * that is still waiting, until it has NET_MAX_PAIRS pairs, so the small blocks of a single poll do not fill the
+ * queue with frames. The frames are sent by a thread of their own, so Processing never waits for the network. If
+ * the collector is not reachable, or does not take the frames fast enough, the oldest data frames are dropped when
+ * the queue holds NET_QUEUE_PAIRS data pairs or NET_QUEUE_FRAMES frames. Frames of the other events are only
+ * dropped if the queue contains nothing but those. The sender reconnects until it is stopped, and starts every
+ * connection with a Hello frame carrying the station identifier. Connecting to an address takes at most
+ * NET_RECONNECT_MS, so the sender stops soon after it is asked to. Only the name lookup of the collector is not
+ * bounded, it can take as long as the resolver timeout. An address avoids the lookup.
+ *
+ * The buffers of sent frames are reused, so no memory is allocated once the queue was filled.
+ */
+class NetworkSink : public IObserver, public CppThread {
+
+public:
+    NetworkSink(std::string host, uint16_t port, uint32_t station, double samplingRate = SAMPLING_RATE);
+    ~NetworkSink() override;
+
+    void eNewData(double pData, double oData) override;
+    void eNewDataBlock(std::span<const double> pData, std::span<const double> oData) override;
+    void eSwitchScreen(Screen eScreen) override;
+    void eResults(double map, double sbp, double dbp) override;
+    void eHeartRate(double heartRate) override;
+    void eReady() override;
+
+    bool isConnected();
+    uint64_t getDroppedFrames();
+    void stopThread();
+
+private:
+    //! A frame waiting to be sent.
+    struct Frame {
+        NetFrameType type;          //!< The type of the frame.
+        std::vector<uint8_t> bytes; //!< The header and the payload.
+        size_t nPairs;              //!< The number of data pairs in a data frame.
+    };
+
+    void run() override;
+    Frame takeFrame(NetFrameType type, size_t payloadSize);
+    size_t appendToQueued(std::span<const double> pData, std::span<const double> oData);
+    void writePairs(Frame &frame, std::span<const double> pData, std::span<const double> oData);
+    void makeRoom(size_t nPairs, size_t nFrames);
+    void queueFrame(Frame &&frame);
+    void queueEvent(NetFrameType type, const void *payload, size_t payloadSize);
+    bool connectToCollector();
+    bool sendAll(const uint8_t *data, size_t size);
+    void closeConnection();
+
+    const std::string host;             //!< The host name or address of the collector.
+    const uint16_t port;                //!< The TCP port of the collector.
+    const uint32_t station;             //!< The identifier of this station.
+    const double samplingRate;          //!< The sampling rate of the data, sent in the Hello frame.
+
+    std::mutex queueMutex;              //!< Protects the queue, the free buffers and the counters.
+    std::condition_variable queueCond;  //!< Signals the sender that a frame was queued or that it stops.
+    std::deque<Frame> queue;            //!< Frames waiting to be sent, the oldest first.
+    size_t queuedPairs;                 //!< The number of data pairs in the queue.
+    std::vector<std::vector<uint8_t>> freeBuffers;  //!< Buffers of sent or dropped frames for reuse.
+    uint64_t sequence;                  //!< The number of frames queued so far.
+    uint64_t nextSample;                //!< The index of the next data pair.
+    std::atomic<uint64_t> droppedFrames;    //!< The frames dropped because the queue was full.
+    std::atomic<bool> bConnected;       //!< The sender is connected to the collector.
+    int sock;                           //!< The socket of the connection, -1 if not connected. Only used by the sender.
+    uint64_t sentSequence;              //!< The sequence number after the last frame sent completely, sent in the
+                                        //!< Hello frame. Only used by the sender.
+};
+
+
+#endif //OBP_NETWORKSINK_H
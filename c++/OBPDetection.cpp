@@ -9,9 +9,13 @@
  */
 
 #include <iostream>
+#include <chrono>
+#include <limits>
 #include <cmath>
 #include <numeric>
 #include "OBPDetection.h"
+#include "Profiler.h"
+#include "SimdKernels.h"
 
 /**
  * Constructor of the OBPDetection class.
@@ -20,11 +24,30 @@
  * @param sampling_rate Sets the sampling rate of the processed data. Used to calculate the heart rate.
  */
 OBPDetection::OBPDetection(double sampling_rate) :
-        pData(DEFAULT_DATA_SIZE),
-        oData(DEFAULT_DATA_SIZE),
+        OBPDetection(makeDetectionConfig(sampling_rate))
+{
+}
+
+/**
+ * Constructor of the OBPDetection class with a configuration other than the default one.
+ *
+ * The vectors are allocated for the data size and the maximal number of peaks of the configuration, its settings are
+ * the initial values of the settings.
+ * @param config The configuration, see makeDetectionConfig().
+ */
+OBPDetection::OBPDetection(const DetectionConfig &config) :
+        arena(0),
+        sampleCount(0),
+        bStreaming(false),
+        sweepDone(0),
         enoughData(false),
-        samplingRate(sampling_rate)
+        ratio_SBP(config.ratioSBP),
+        ratio_DBP(config.ratioDBP),
+        minNbrPeaks(config.minNbrPeaks),
+        cutoffHyst(config.cutoffHyst),
+        config(config)
 {
+    allocate();
     reset();
 }
 
@@ -99,14 +122,47 @@ void OBPDetection::setMinNbrPeaks(int val)
     }
 }
 
+/**
+ * Gets the hysteresis below the DBP ratio the oscillations have to be in to end the measurement.
+ * @return The value of the hysteresis.
+ */
+double OBPDetection::getCutoffHyst()
+{
+    return cutoffHyst;
+}
+
 /**
  * Resets the configuration values to their default.
  */
 void OBPDetection::resetConfigValues()
 {
-    ratio_SBP = 0.57;
-    ratio_DBP = 0.70;
-    minNbrPeaks = 10;
+    ratio_SBP = DEFAULT_RATIO_SBP;
+    ratio_DBP = DEFAULT_RATIO_DBP;
+    minNbrPeaks = DEFAULT_NBR_PEAKS;
+}
+
+/**
+ * Sets the streaming mode, in which only the recent samples and peaks are kept, so there is no limit on the length
+ * of a measurement. Resets the measurement, the vectors are allocated again if the mode changes.
+ * @param bStream True for the streaming mode, false to keep all samples of a measurement.
+ */
+void OBPDetection::setStreaming(bool bStream)
+{
+    if (bStream != bStreaming)
+    {
+        bStreaming = bStream;
+        allocate();
+    }
+    reset();
+}
+
+/**
+ * Checks if the streaming mode is set.
+ * @return True in streaming mode.
+ */
+bool OBPDetection::getStreaming() const
+{
+    return bStreaming;
 }
 
 /**
@@ -124,41 +180,66 @@ double OBPDetection::getCurrentHeartRate()
 }
 
 /**
- * Calculates the average over all saved heart rate entries.
+ * Calculates the average over all saved heart rate entries from their running sum.
  * @return The average heart rate in the current calculations.
  */
 double OBPDetection::getAverageHeartRate()
 {
-    return getAverage(hrData);
+    double av = 0.0;
+    if (!hrData.empty())
+    {
+        av = hrSum / hrData.size();
+    }
+    return av;
 }
 
 /**
- * Returns the calculated value for the mean arterial pressure (MAP).
+ * Returns the calculated value for the mean arterial pressure (MAP), calculates the results first if needed.
  * @return The calculated MAP.
  */
-double OBPDetection::getMAP() const
+double OBPDetection::getMAP()
 {
+    finaliseResults();
     return resMAP;
 }
 
 /**
- * Returns the calculated value for the systolic blood pressure (SBP).
+ * Returns the calculated value for the systolic blood pressure (SBP), calculates the results first if needed.
  * @return The calculated SBP.
  */
-double OBPDetection::getSBP() const
+double OBPDetection::getSBP()
 {
+    finaliseResults();
     return resSBP;
 }
 
 /**
- * Returns the calculated value for the diastolic blood pressure (DBP).
+ * Returns the calculated value for the diastolic blood pressure (DBP), calculates the results first if needed.
  * @return The calculated DBP.
  */
-double OBPDetection::getDBP() const
+double OBPDetection::getDBP()
 {
+    finaliseResults();
     return resDBP;
 }
 
+/**
+ * Calculates the results of the last peak with enough data, if that was not done yet. The results are not calculated
+ * when the peak is found, but only when they are read or when the next maximum might change the OMWE. Call this to
+ * calculate them at a time of your choice, e.g. before the thread that processes the samples has to wait.
+ *
+ * In streaming mode, the pressure around the MAP is overwritten after DEFAULT_DATA_SIZE samples without a maximum,
+ * the results have to be read before.
+ */
+void OBPDetection::finaliseResults()
+{
+    if (bResultsPending)
+    {
+        bResultsPending = false;
+        findMAP();
+    }
+}
+
 /**
  * Check if enough data has been acquired to start calculation of the OMWE and the BP values.
  * The calculations could potentially still fail.
@@ -169,6 +250,33 @@ bool OBPDetection::getIsEnoughData() const
     return enoughData;
 }
 
+/**
+ * Gets the time the last new peak took to process: finding the minima, extending the OMWE and tracking the results.
+ * @return The duration in ns, 0 if there was no peak yet.
+ */
+int64_t OBPDetection::getLastPeakNs() const
+{
+    return lastPeakNs;
+}
+
+/**
+ * Gets the values of the OMWE calculated so far, e.g. to compare them with a reference.
+ * @return The values of the OMWE, valid until the next sample is processed.
+ */
+std::span<const double> OBPDetection::getOMWE() const
+{
+    return {omweData.data(), omweData.size()};
+}
+
+/**
+ * Gets the times of the values of the OMWE calculated so far.
+ * @return The times (sample numbers) of the values of the OMWE, valid until the next sample is processed.
+ */
+std::span<const int64_t> OBPDetection::getOMWETimes() const
+{
+    return {omweTimes.data(), omweTimes.size()};
+}
+
 /**
  * Processes one data sample pair of pressure and oscillation at a time.
  * Returns true if the process has finished and results might be available.
@@ -182,40 +290,80 @@ bool OBPDetection::getIsEnoughData() const
  */
 bool OBPDetection::processSample(double pressure, double oscillation)
 {
+    OBP_PROFILE_SCOPE(profile, ProfileStage::DetectionSteady);
     bool newMax = false;
-    pData.push_back(pressure);
-    oData.push_back(oscillation);
-    if (checkMaxima())
+    if (sampleCount == 0)
+    {
+        loadSettings();
+    }
+    if (bStreaming)
     {
+        pSumRing.push_back(pSumRing.back() + pressure);
+    } else
+    {
+        if (pData.full())
+        {
+            return false;
+        }
+        pData.push_back(pressure);
+        pSum.push_back(pSum.back() + pressure);
+    }
+    sampleCount++;
+    // The sample before the current one is the last one that can be part of a trough before a new maximum.
+    trackTrough(pairTrough, prevOscillation[1], sampleCount - 2);
+    trackTrough(lastTrough, prevOscillation[1], sampleCount - 2);
+    const bool bNewPeak = checkMaxima(oscillation);
+    prevOscillation[0] = prevOscillation[1];
+    prevOscillation[1] = oscillation;
+    if (bNewPeak)
+    {
+        OBP_PROFILE_STAGE(profile, ProfileStage::DetectionPeak);
+        // The peaks are rare, timing every one of them costs nothing compared to their processing.
+        const auto peakStart = std::chrono::steady_clock::now();
+        if (bStreaming)
+        {
+            removeOldPeaks();
+        }
         findMinima();
+        findOWME();
         if (isEnoughData())
         {
-            findOWME();
-            findMAP();
+            bResultsPending = true;
+            resultSamples = sampleCount;
             enoughData = true;
         }
+        if (!sweepGrid.empty())
+        {
+            evaluateSweep();
+        }
         newMax = true;
+        lastPeakNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - peakStart).count();
     }
     return newMax;
 }
 
 
 /**
- * Checks the latest samples in oData if there is a local maxima and puts it in a vector to hold all
+ * Checks if the sample before the current one is a local maxima and puts it in a vector to hold all
  * local maxima, together with a reference to the 'time' (sample number) it was recorded.
+ * Only the current sample and the two before it are needed, the samples are not stored.
+ * @param oscillation The oscillation of the current sample.
  * @return true if a local maxima was found.
  */
-bool OBPDetection::checkMaxima()
+bool OBPDetection::checkMaxima(double oscillation)
 {
+    OBP_PROFILE_SCOPE(profile, ProfileStage::CheckMaxima);
     bool isValid = false;
 
-    if (oData.size() > minDataSize && *(oData.end() - 2) > prominence)
+    // is the middle one of the last three entries the (first) largest?
+    const double middle = prevOscillation[1];
+    if (sampleCount > config.minDataSize && middle > config.prominence)
     {
-        auto i = std::max_element((oData.end() - 3), oData.end());
-
-        // is result the middle entry?
-        if (std::distance(i, oData.end()) == 2)
+        if (middle > prevOscillation[0] && middle >= oscillation)
         {
+            // The maxima, heart rates and OMWE the pending results are calculated from might change.
+            finaliseResults();
             isValid = isValidMaxima();
         }
 
@@ -231,19 +379,20 @@ bool OBPDetection::checkMaxima()
  */
 bool OBPDetection::isValidMaxima()
 {
-    static int validPulseCnt = 0; // Only for logging purposes.
     bool isValid = false;
 
-    assert(oData.size() >= 2);
+    assert(sampleCount >= 2);
 
-    const double testValue = *(oData.end() - 2); // testing the second to last entry
-    const auto testSmplNbr = (oData.size() - 1); // NEW: in relation to oData for min-detect!
+    const double testValue = prevOscillation[1]; // testing the second to last entry
+    const auto testSmplNbr = (size_t) (sampleCount - 1); // NEW: in relation to the troughs for min-detect!
 
     if (maxtime.empty())
     {
         // Accept any value as a first value, only start testing after the second one
         maxtime.push_back(testSmplNbr);
         maxAmp.push_back(testValue);
+        maxAmpPeak = testValue;
+        startTrough(lastTrough, testSmplNbr);
         // do not set isValid true, because this would start checking for a minimum between two maxima
     } else
     {
@@ -251,12 +400,14 @@ bool OBPDetection::isValidMaxima()
         assert(!maxAmp.empty());
 
         //time since last max is <minPeakTime (ms) and the new sample is larger: replace the old value
-        if ((testSmplNbr - maxtime.back()) < minPeakTime)
+        if ((testSmplNbr - maxtime.back()) < (size_t) config.minPeakTime)
         {
             if (maxAmp.back() < testValue)
             {
+                // The trough before the last maximum continues up to the new one.
                 maxAmp.back() = testValue;
                 maxtime.back() = testSmplNbr;
+                startTrough(lastTrough, testSmplNbr);
             } else
             {
                 // Skip this maxima, it is too quick after the last one, but smaller.
@@ -271,15 +422,20 @@ bool OBPDetection::isValidMaxima()
         {
             maxAmp.push_back(testValue);
             maxtime.push_back(testSmplNbr);
+            pairTrough = lastTrough;
+            startTrough(lastTrough, testSmplNbr);
         }
+        maxAmpPeak = std::max(maxAmpPeak, maxAmp.back());
 
         if (maxtime.size() > 1)
         {
-            double newHR = (60.0 * samplingRate) / (double) (maxtime.back() - (*(maxtime.end() - 2)));
+            double newHR = (60.0 * config.samplingRate) / (double) (maxtime.back() - (*(maxtime.end() - 2)));
 
             if (isHeartRateValid(newHR))
             {
                 hrData.push_back(newHR);
+                hrTime.push_back(maxtime.back());
+                hrSum += newHR;
                 validPulseCnt++;
                 isValid = true;
             } else
@@ -292,7 +448,12 @@ bool OBPDetection::isValidMaxima()
                 mintime.clear();
                 maxtime.push_back(testSmplNbr);
                 maxAmp.push_back(testValue);
+                maxAmpPeak = testValue;
+                startTrough(lastTrough, testSmplNbr);
                 hrData.clear();
+                hrTime.clear();
+                hrSum = 0.0;
+                resetOMWE();
                 isValid = false;
             }
         }
@@ -308,58 +469,89 @@ bool OBPDetection::isValidMaxima()
  */
 bool OBPDetection::isHeartRateValid(double heartRate)
 {
-    return (minValidHR <= heartRate && heartRate <= maxValidHR);
+    return (config.minValidHR <= heartRate && heartRate <= config.maxValidHR);
 }
 
 
 /**
- * Finds the minimal value in the oscillation between two maxima.
+ * Takes the minimal value in the oscillation between the last two maxima from the running minimum, so the samples
+ * between them do not have to be searched again.
  */
 void OBPDetection::findMinima()
 {
+    OBP_PROFILE_SCOPE(profile, ProfileStage::FindMinima);
 
-    if (maxAmp.size() >= 2)
+    // If the last maximum was not just found, the last pair and therefore its minimum did not change.
+    if (maxAmp.size() >= 2 && maxtime.back() == sampleCount - 1)
     {
-        // get sub-vector of oData from second last to last max value
-        auto firstMax = oData.begin() + *(maxtime.end() - 2);
-        auto lastMax = oData.begin() + maxtime.back();
-        // find minimal value in between
-        auto iter = std::min_element(firstMax, lastMax);
-        // find distance from first max value to calculate time of minima
-        // min time = first max time + dist
-        auto dist = std::distance(firstMax, iter);
-
         // Check if the last maxima value was replaced. If yes, replace last minima value
         if (mintime.size() == (maxtime.size() - 1))
         {
-            minAmp.back() = *iter;
-            mintime.back() = dist + *(maxtime.end() - 2);
+            minAmp.back() = pairTrough.value;
+            mintime.back() = pairTrough.time;
         } else
         {
-            minAmp.push_back(*iter);
-            mintime.push_back(dist + *(maxtime.end() - 2));
+            minAmp.push_back(pairTrough.value);
+            mintime.push_back(pairTrough.time);
         }
     }
 
 }
 
 /**
- * Checks, if enough data has been received to calculate the blood pressure.
- * @return
+ * Starts a running minimum, the next sample it tracks is the first one of the trough.
+ * @param trough The running minimum.
+ * @param time The time (sample number) of the first sample.
+ */
+void OBPDetection::startTrough(Trough &trough, int64_t time)
+{
+    trough.value = std::numeric_limits<double>::infinity();
+    trough.time = time;
+}
+
+/**
+ * Adds a sample to a running minimum, the first sample with the minimal value is kept.
+ * @param trough The running minimum.
+ * @param value The oscillation of the sample.
+ * @param time The time (sample number) of the sample.
+ */
+void OBPDetection::trackTrough(Trough &trough, double value, int64_t time)
+{
+    if (value < trough.value)
+    {
+        trough.value = value;
+        trough.time = time;
+    }
+}
+
+/**
+ * Checks, if enough data has been received to calculate the blood pressure with the configured values.
+ * @return True if there is enough data.
  */
 bool OBPDetection::isEnoughData()
+{
+    return isEnoughData(config.minNbrPeaks, config.ratioDBP, config.cutoffHyst);
+}
+
+/**
+ * Checks, if enough data has been received to calculate the blood pressure with the given configuration values.
+ * @param nbrPeaks The number of peaks required to be able to perform the algorithm.
+ * @param ratioDBP The DBP ratio.
+ * @param hysteresis The hysteresis below ratioDBP the oscillations have to be in.
+ * @return True if there is enough data.
+ */
+bool OBPDetection::isEnoughData(int nbrPeaks, double ratioDBP, double hysteresis) const
 {
     bool bIsEnough = false;
     // minimum number of peaks detected:
-    if (maxAmp.size() > minNbrPeaks)
+    if ((int) maxAmp.size() > nbrPeaks)
     {
-        auto maxEl = std::max_element(maxAmp.begin(), maxAmp.end());
         // maximum value has minimal size of 1.5
         // the last two values are larger than the current --> continuously decreasing
-        if (*maxEl > 1.5 && (((maxAmp.back() < *(maxAmp.end() - 3)) && (maxAmp.back() < *(maxAmp.end() - 2))) ||
-                             (maxAmp.back() < 2 * prominence)))
+        if (maxAmpPeak > 1.5 && (((maxAmp.back() < *(maxAmp.end() - 3)) && (maxAmp.back() < *(maxAmp.end() - 2))) ||
+                                 (maxAmp.back() < 2 * config.prominence)))
         {
-            double cutoff = (*maxEl) * (ratio_DBP - cutoffHyst);
+            double cutoff = maxAmpPeak * (ratioDBP - hysteresis);
             // the last three values (current included), are smaller than the cutoff
             if ((*(maxAmp.end() - 3) < cutoff) && (*(maxAmp.end() - 2) < cutoff) && (maxAmp.back() < cutoff))
             {
@@ -377,43 +569,165 @@ bool OBPDetection::isEnoughData()
  * maxAmp and maxtime) in preparation to find the maximal oscillation and the ratios of it for the systolic and
  * diastolic blood pressure.
  *
- * The calculated values will be stored in omvweTimes and omweData.
+ * The calculated values will be stored in omvweTimes and omweData. The envelope is only extended by the min/max
+ * pairs that were added since the last call. The last pair is calculated again on every call, because the last
+ * maximum, and therefore also the last minimum, can still be replaced.
  */
 void OBPDetection::findOWME()
 {
-    // forward iteration using const iterator, because they should not be touched
-    auto timeMax1 = maxtime.cbegin();
-    auto ampMin1 = minAmp.cbegin();
-    auto ampMax1 = maxAmp.cbegin();
+    OBP_PROFILE_SCOPE(profile, ProfileStage::FindOMWE);
+    // Remove the points of the last pair, they might have changed.
+    while (omweData.size() > 2 * omwePairs)
+    {
+        omweData.pop_back();
+        omweTimes.pop_back();
+        omweStats.pop_back();
+    }
 
     // The min values are defined between two max values. Therefore, iterate trough them until the second to last value.
-    for (auto timeMin1 = mintime.cbegin(); timeMin1 != (mintime.cend() - 1); ++timeMin1)
+    const size_t nPairs = (mintime.size() > 1) ? mintime.size() - 1 : 0;
+    for (size_t i = omwePairs; i < nPairs; i++)
     {
-        auto timeMin2 = std::next(timeMin1, 1);
-        auto timeMax2 = std::next(timeMax1, 1);
-        auto ampMin2 = std::next(ampMin1, 1);
-        auto ampMax2 = std::next(ampMax1, 1);
-
-        assert(*timeMin1 > *timeMax1);
-        assert(*timeMin2 > *timeMax2);
+        assert(mintime[i] > maxtime[i]);
+        assert(mintime[i + 1] > maxtime[i + 1]);
 
         // Empty a value interpolated between the two max (resp. min) values at the position (in time)
         // where another min (resp. max) value is to be able to calculate the envelope.
-        auto lerpMax = std::lerp(*ampMax1, *ampMax2, getRatio(*timeMax1, *timeMax2, *timeMin1));
-        auto lerpMin = std::lerp(*ampMin1, *ampMin2, getRatio(*timeMin1, *timeMin2, *timeMax2));
+        auto lerpMax = std::lerp(maxAmp[i], maxAmp[i + 1], getRatio(maxtime[i], maxtime[i + 1], mintime[i]));
+        auto lerpMin = std::lerp(minAmp[i], minAmp[i + 1], getRatio(mintime[i], mintime[i + 1], maxtime[i + 1]));
 
         // Empty the envelope, save both time and values.
-        omweData.push_back(lerpMax - *ampMin1);
-        omweTimes.push_back(*timeMin1);
-        omweData.push_back(*ampMax2 - lerpMin);
-        omweTimes.push_back(*timeMax2);
+        addOMWEPoint(lerpMax - minAmp[i], mintime[i]);
+        addOMWEPoint(maxAmp[i + 1] - lerpMin, maxtime[i + 1]);
+    }
+    omwePairs = (nPairs > 0) ? nPairs - 1 : 0;
+}
+
+/**
+ * Adds a point to the OMWE and updates the running maximum and the SBP and DBP crossings.
+ *
+ * The SBP crossing can only move forward when the maximum increases, because the searched value increases with it.
+ * The DBP crossing is searched again from a new maximum, which is always the newest point. Each point therefore only
+ * needs a constant amount of work on average.
+ * @param value The value of the envelope.
+ * @param time The time (sample number) of the value.
+ */
+void OBPDetection::addOMWEPoint(double value, int64_t time)
+{
+    const int idx = (int) omweData.size();
+    omweData.push_back(value);
+    omweTimes.push_back(time);
+    omweStats.push_back(nextOMWEStats(idx));
+}
+
+/**
+ * Calculates the running results of the OMWE up to a point from the results of the point before it.
+ * @param idx The index of the point in omweData, the results of all points before it are in omweStats.
+ * @return The running results up to and including the point.
+ */
+OBPDetection::OMWEStats OBPDetection::nextOMWEStats(int idx) const
+{
+    const double value = omweData[idx];
+    OMWEStats stats{};
+    if (omweStats.empty() || value > omweData[omweStats.back().maxIdx])
+    {
+        // New maximum, the crossing before it is at the same position or later.
+        stats.maxIdx = idx;
+        stats.sbpIdx = omweStats.empty() ? 0 : omweStats.back().sbpIdx;
+        const double sbpSearch = config.ratioSBP * value;
+        stats.sbpIdx += (int) findFirstAbove(omweValues(stats.sbpIdx, idx), sbpSearch);
+        stats.dbpIdx = -1;
+    } else
+    {
+        stats = omweStats.back();
+    }
+
+    if (stats.dbpIdx < 0 && value < config.ratioDBP * omweData[stats.maxIdx])
+    {
+        stats.dbpIdx = idx;
+    }
+    return stats;
+}
+
+/**
+ * Gets a range of the OMWE values, to search it with the vectorised kernels.
+ * @param first The index of the first value.
+ * @param last One past the index of the last value, at most the number of values.
+ * @return The values from first to last.
+ */
+std::span<const double> OBPDetection::omweValues(int first, int last) const
+{
+    assert(0 <= first && first <= last && last <= (int) omweData.size());
+    return {omweData.data() + first, (size_t) (last - first)};
+}
+
+/**
+ * Removes the oldest peaks in streaming mode, before the pressure around them is overwritten in the ring buffer.
+ *
+ * With the peaks, their minima, heart rates and OMWE points are removed, at least the last two peaks are kept. The
+ * running results of the remaining OMWE points are calculated again, as if the envelope started with them.
+ */
+void OBPDetection::removeOldPeaks()
+{
+    // The pressure is looked up within one second of a point, see getPressureAt().
+    const int64_t oldest = (int64_t) pSumRing.oldest() + 2 * (int64_t) config.samplingRate + 2;
+    size_t n = 0;
+    while (n + 2 < maxtime.size() && maxtime[n] < oldest)
+    {
+        n++;
+    }
+    if (n == 0)
+    {
+        return;
+    }
 
-        // Increase all the iterators not handled by the for loop:
-        timeMax1++;
-        ampMin1++;
-        ampMax1++;
+    // Replaced maxima add rates as well, so the rates are matched to the peaks by the time the interval ended.
+    size_t nRates = 0;
+    while (nRates < hrTime.size() && hrTime[nRates] <= maxtime[n])
+    {
+        nRates++;
+    }
+    hrData.erase_front(nRates);
+    hrTime.erase_front(nRates);
+    maxAmp.erase_front(n);
+    maxtime.erase_front(n);
+    minAmp.erase_front(std::min(n, minAmp.size()));
+    mintime.erase_front(std::min(n, mintime.size()));
+    hrSum = std::accumulate(hrData.begin(), hrData.end(), 0.0);
+    maxAmpPeak = *std::max_element(maxAmp.begin(), maxAmp.end());
+
+    // Every min/max pair has two points in the OMWE.
+    const size_t nPoints = std::min(2 * n, omweData.size());
+    omweData.erase_front(nPoints);
+    omweTimes.erase_front(nPoints);
+    omwePairs = (omwePairs > n) ? omwePairs - n : 0;
+    omweStats.clear();
+    for (int idx = 0; idx < (int) omweData.size(); idx++)
+    {
+        omweStats.push_back(nextOMWEStats(idx));
     }
+}
+
+/**
+ * Copies the settings into the configuration of the measurement, before its first sample is processed.
+ */
+void OBPDetection::loadSettings()
+{
+    config.ratioSBP = ratio_SBP;
+    config.ratioDBP = ratio_DBP;
+    config.minNbrPeaks = minNbrPeaks;
+    config.cutoffHyst = cutoffHyst;
+}
 
+/**
+ * Removes all values of the OMWE, used when the min and max values are reset.
+ */
+void OBPDetection::resetOMWE()
+{
+    omweData.clear();
+    omweTimes.clear();
+    omweStats.clear();
+    omwePairs = 0;
 }
 
 /**
@@ -421,98 +735,231 @@ void OBPDetection::findOWME()
  *
  * The results will be saved in the result variables resMAP, resSBP and resDBP. They are saved as doubled, but this
  * does not represent their precision.
+ *
+ * The maximum and the crossings are taken from the running results of the last OMWE point. The pressure is looked
+ * up in the samples up to the peak the results belong to.
  */
 void OBPDetection::findMAP()
 {
+    OBP_PROFILE_SCOPE(profile, ProfileStage::FindMAP);
+    if (omweStats.empty())
+    {
+        PLOG_WARNING << "couldn't find MAP, no OMWE";
+        return;
+    }
+
+    calculateBP(omweStats.back(), config.ratioSBP, config.ratioDBP, resultSamples, resMAP, resSBP, resDBP);
+}
 
-    auto maxOMWE = std::max_element(omweData.begin(), omweData.end());
-    auto maxTime = omweTimes[std::distance(omweData.begin(), maxOMWE)];
+/**
+ * Searches the SBP and DBP crossings in the whole OMWE for ratios other than the configured ones. The maximum does
+ * not depend on the ratios and is taken from the running results of the last OMWE point.
+ * @param ratioSBP The SBP ratio.
+ * @param ratioDBP The DBP ratio.
+ * @return The maximum and the crossings, like addOMWEPoint() would have found them with these ratios.
+ */
+OBPDetection::OMWEStats OBPDetection::findCrossings(double ratioSBP, double ratioDBP) const
+{
+    assert(!omweStats.empty());
 
-    resMAP = getPressureAt(maxTime);
+    OMWEStats stats{};
+    stats.maxIdx = omweStats.back().maxIdx;
+    const double maxVAL = omweData[stats.maxIdx];
 
-    double maxVAL = *maxOMWE;
-    double sbpSearch = ratio_SBP * maxVAL;
-    double ubSBP = 0;
-    double lbSBP = 0;
-    int lbSTime = 0;
-    int ubSTime = 0;
+    const double sbpSearch = ratioSBP * maxVAL;
+    stats.sbpIdx = (int) findFirstAbove(omweValues(0, stats.maxIdx), sbpSearch);
 
-    for (auto omweSBP = omweData.begin(); omweSBP != maxOMWE; ++omweSBP)
+    const double dbpSearch = ratioDBP * maxVAL;
+    stats.dbpIdx = stats.maxIdx + 1;
+    stats.dbpIdx += (int) findFirstBelow(omweValues(stats.dbpIdx, (int) omweData.size()), dbpSearch);
+    if (stats.dbpIdx == (int) omweData.size())
     {
-        if (*omweSBP > sbpSearch)
-        {
-            ubSBP = *omweSBP;
-            ubSTime = omweTimes[std::distance(omweData.begin(), omweSBP)];
-            omweSBP--;
-            lbSBP = *omweSBP;
-            lbSTime = omweTimes[std::distance(omweData.begin(), omweSBP)];
-            break;
-        }
+        stats.dbpIdx = -1;
     }
+    return stats;
+}
 
-    int lerpSBPtime = (int) std::lerp(lbSTime, ubSTime, getRatio(lbSBP, ubSBP, sbpSearch));
-    resSBP = getPressureAt(lerpSBPtime);
+/**
+ * Calculates the blood pressure from the maximum and the crossings of the OMWE. The values are interpolated between
+ * the crossing and the point before it.
+ * @param stats The maximum and the crossings of the OMWE.
+ * @param ratioSBP The SBP ratio the crossings were found with.
+ * @param ratioDBP The DBP ratio the crossings were found with.
+ * @param nSamples The number of samples at the time of the results.
+ * @param map The calculated MAP.
+ * @param sbp The calculated SBP.
+ * @param dbp The calculated DBP, not changed if there is no DBP crossing.
+ */
+void OBPDetection::calculateBP(const OMWEStats &stats, double ratioSBP, double ratioDBP, int64_t nSamples,
+                               double &map, double &sbp, double &dbp)
+{
+    const double maxVAL = omweData[stats.maxIdx];
+
+    map = getPressureAt(omweTimes[stats.maxIdx], nSamples);
 
-    double dbpSearch = ratio_DBP * maxVAL;
-    double ubDBP = 0;
-    double lbDBP = 0;
-    int lbDTime = 0;
-    int ubDTime = 0;
-    for (auto omweDBP = maxOMWE; omweDBP != omweData.end(); ++omweDBP)
+    // The first value above the searched one is the upper bound, the one before it the lower bound. If the envelope
+    // starts above the searched value, there is nothing to interpolate with.
+    const double sbpSearch = ratioSBP * maxVAL;
+    int64_t lerpSBPtime = omweTimes[stats.sbpIdx];
+    if (stats.sbpIdx > 0)
     {
-        if (*omweDBP < dbpSearch)
-        {
-            lbDBP = *omweDBP;
-            lbDTime = omweTimes[std::distance(omweData.begin(), omweDBP)];
-            omweDBP--;
-            ubDBP = *omweDBP;
-            ubDTime = omweTimes[std::distance(omweData.begin(), omweDBP)];
-            break;
-        }
+        const int lb = stats.sbpIdx - 1;
+        const int ub = stats.sbpIdx;
+        lerpSBPtime = (int64_t) std::lerp((double) omweTimes[lb], (double) omweTimes[ub],
+                                          getRatio(omweData[lb], omweData[ub], sbpSearch));
     }
-    if (lbDBP != 0)
+    sbp = getPressureAt(lerpSBPtime, nSamples);
+
+    const double dbpSearch = ratioDBP * maxVAL;
+    if (stats.dbpIdx > 0)
     {
         // The curve is falling, "upper bound" time is lower than "lower bound" time.
         // The ratio is calculated the same way as before, but to account for the lower
         // value relating to the higher time the ratio is inverted.
         // The interpolation is done from the "upper bound" time (earlier in time) to the
         // "lower bound" time (later in time).
-        int lerpDBPtime = (int) std::lerp(ubDTime, lbDTime, 1.0 - getRatio(lbDBP, ubDBP, dbpSearch));
-        resDBP = getPressureAt(lerpDBPtime);
+        const int lb = stats.dbpIdx;
+        const int ub = stats.dbpIdx - 1;
+        int64_t lerpDBPtime = (int64_t) std::lerp((double) omweTimes[ub], (double) omweTimes[lb],
+                                                  1.0 - getRatio(omweData[lb], omweData[ub], dbpSearch));
+        dbp = getPressureAt(lerpDBPtime, nSamples);
     } else
     {
         PLOG_WARNING << "couldn't find DBP";
     }
 }
 
+/**
+ * Checks all settings of the parameter sweep that do not have final results yet. If a setting has enough data, its
+ * results are calculated from the current OMWE, like findMAP() would do if it was the configured setting.
+ */
+void OBPDetection::evaluateSweep()
+{
+    for (size_t i = 0; i < sweepGrid.size(); i++)
+    {
+        const SweepParams &params = sweepGrid[i];
+        SweepResult &result = sweepResults[i];
+        if (result.bDone || !isEnoughData(params.minNbrPeaks, params.ratioDBP, params.cutoffHyst))
+        {
+            continue;
+        }
+
+        result.bDone = true;
+        sweepDone++;
+        if (!omweStats.empty())
+        {
+            calculateBP(findCrossings(params.ratioSBP, params.ratioDBP), params.ratioSBP, params.ratioDBP,
+                        sampleCount, result.map, result.sbp, result.dbp);
+        }
+        result.hr = getAverageHeartRate();
+    }
+}
+
 /**
  * Get a pressure value at a specific time. Considers the average heart rate and gets the pressure as the average
- * value over the samples for one pulse centered around the specified time value.
+ * value over the samples for one pulse centered around the specified time value. Close to the start or the end of the
+ * data, the window is limited to the available samples.
  * @param time The time value (in samples) where to get the pressure.
+ * @param nSamples The number of samples the window is limited to, at most sampleCount.
  * @return The pressure value at the specified time.
  */
-double OBPDetection::getPressureAt(int time)
+double OBPDetection::getPressureAt(int64_t time, int64_t nSamples)
 {
-    double average;
-    int hrSamplesHalf = (samplingRate * (int) getAverage(hrData)) / 120;
+    int hrSamplesHalf = (config.samplingRate * (int) getAverageHeartRate()) / 120;
 
-    assert(!pData.empty());
+    assert(nSamples > 0 && nSamples <= sampleCount);
 
-    if (pData.size() > time + hrSamplesHalf)
+    const int64_t first = std::max<int64_t>(time - hrSamplesHalf, 0);
+    const int64_t last = std::min<int64_t>(time + hrSamplesHalf, nSamples);
+    if (first != time - hrSamplesHalf || last != time + hrSamplesHalf)
     {
-        auto firstP = &pData[time - hrSamplesHalf];
-        auto lastP = &pData[time + hrSamplesHalf];
-        std::vector<double> newVec(firstP, lastP);
-        average = getAverage(newVec);
+        PLOG_WARNING << "Trying to get pressure at time " << time << " with hrSamplesHalf: " << hrSamplesHalf <<
+                     "and pData.size(): " << nSamples;
+    }
+
+    double average;
+    if (first < last)
+    {
+        average = getAveragePressure(first, last);
     } else
     {
-        PLOG_WARNING << "Trying to get pressure at time " << time << " with hrSamplesHalf: " << hrSamplesHalf <<
-                     "and pData.size(): " << pData.size();
-        average = pData[time];
+        average = pressureAt(std::clamp<int64_t>(time, 0, nSamples - 1));
     }
     return average;
 }
 
+/**
+ * Calculates the average pressure over a window from the prefix sums, without iterating over the window.
+ * @param first The first sample of the window.
+ * @param last One past the last sample of the window, has to be larger than first.
+ * @return The average pressure in the window.
+ */
+double OBPDetection::getAveragePressure(int64_t first, int64_t last)
+{
+    assert(0 <= first && first < last && last <= sampleCount);
+    return (pressureSumAt(last) - pressureSumAt(first)) / (last - first);
+}
+
+/**
+ * Gets a pressure sample. In streaming mode, it is taken from the difference of the prefix sums.
+ * @param time The time (sample number) of the sample, one of the recent ones in streaming mode.
+ * @return The pressure value.
+ */
+double OBPDetection::pressureAt(int64_t time) const
+{
+    return bStreaming ? pressureSumAt(time + 1) - pressureSumAt(time) : pData[time];
+}
+
+/**
+ * Gets the prefix sum of the pressure, from the ring buffer in streaming mode.
+ * @param time The number of samples in the sum, one of the recent ones in streaming mode.
+ * @return The sum of the pressure of the first samples.
+ */
+double OBPDetection::pressureSumAt(int64_t time) const
+{
+    return bStreaming ? pSumRing[time] : pSum[time];
+}
+
+/**
+ * Allocates the arena for the current mode and takes all vectors from it. In streaming mode, the samples are not
+ * stored and the prefix sums are in the ring, otherwise the ring is empty.
+ */
+void OBPDetection::allocate()
+{
+    const int dataSize = bStreaming ? 0 : config.dataSize;
+    arena = MeasurementArena(arenaSize(config, bStreaming));
+    pData = arena.allocate<double>(dataSize);
+    pSum = arena.allocate<double>(bStreaming ? 0 : dataSize + 1);
+    pSumRing = arena.allocateRing<double>(bStreaming ? config.dataSize + 1 : 0);
+    maxAmp = arena.allocate<double>(config.maxPeaks);
+    maxtime = arena.allocate<int64_t>(config.maxPeaks);
+    minAmp = arena.allocate<double>(config.maxPeaks);
+    mintime = arena.allocate<int64_t>(config.maxPeaks);
+    omweData = arena.allocate<double>(2 * config.maxPeaks);
+    omweTimes = arena.allocate<int64_t>(2 * config.maxPeaks);
+    hrData = arena.allocate<double>(2 * config.maxPeaks);
+    hrTime = arena.allocate<int64_t>(2 * config.maxPeaks);
+    omweStats = arena.allocate<OMWEStats>(2 * config.maxPeaks);
+}
+
+/**
+ * Calculates the size of the arena that holds all the vectors of a measurement, see allocate().
+ * @param config The configuration with the data size and the maximal number of peaks.
+ * @param bStreaming True for the streaming mode.
+ * @return The size in bytes.
+ */
+size_t OBPDetection::arenaSize(const DetectionConfig &config, bool bStreaming)
+{
+    const int dataSize = bStreaming ? 0 : config.dataSize;
+    return MeasurementArena::bytesFor<double>(dataSize) +
+           MeasurementArena::bytesFor<double>(bStreaming ? 0 : dataSize + 1) +
+           MeasurementArena::bytesFor<double>(bStreaming ? config.dataSize + 1 : 0) +
+           2 * MeasurementArena::bytesFor<double>(config.maxPeaks) +
+           2 * MeasurementArena::bytesFor<int64_t>(config.maxPeaks) +
+           2 * MeasurementArena::bytesFor<double>(2 * config.maxPeaks) +
+           2 * MeasurementArena::bytesFor<int64_t>(2 * config.maxPeaks) +
+           MeasurementArena::bytesFor<OMWEStats>(2 * config.maxPeaks);
+}
 
 /**
  * Helper function that gets the ratio from a value that is in between two others
@@ -528,38 +975,104 @@ double OBPDetection::getRatio(double lowerBound, double upperBound, double value
     return ((value - lowerBound) / (upperBound - lowerBound));
 }
 
-/**
- * Calculates the average value in a given vector and returns it.
- * @param avVector A vector of doubles to take the average from.
- * @return The average of all the values in the vector.
- */
-double OBPDetection::getAverage(std::vector<double> avVector)
-{
-    double av = 0.0;
-    if (!avVector.empty())
-    {
-        av = std::accumulate(avVector.begin(), avVector.end(), 0.0) / avVector.size();
-    }
-    return av;
-}
-
 /**
  * Resets all variables to start a new measurement.
  */
 void OBPDetection::reset()
 {
     pData.clear();
-    oData.clear();
-    omweData.clear();
-    omweTimes.clear();
+    pSum.clear();
+    pSumRing.clear();
+    if (bStreaming)
+    {
+        pSumRing.push_back(0.0);
+    } else
+    {
+        pSum.push_back(0.0);
+    }
+    sampleCount = 0;
+    prevOscillation[0] = 0.0;
+    prevOscillation[1] = 0.0;
+    startTrough(pairTrough, 0);
+    startTrough(lastTrough, 0);
+    resetOMWE();
     maxAmp.clear();
     maxtime.clear();
     minAmp.clear();
     mintime.clear();
     hrData.clear();
+    hrTime.clear();
+    hrSum = 0.0;
+    maxAmpPeak = 0.0;
+    validPulseCnt = 0;
 
     resMAP = 0.0;
     resSBP = 0.0;
     resDBP = 0.0;
+    bResultsPending = false;
+    resultSamples = 0;
     enoughData = false;
+
+    sweepResults.assign(sweepGrid.size(), SweepResult{});
+    sweepDone = 0;
+}
+
+/**
+ * Sets up a parameter sweep for the following measurements, an empty grid removes the sweep. Resets the measurement.
+ * @param grid The settings to evaluate, the results are in the same order.
+ */
+void OBPDetection::setSweep(std::span<const SweepParams> grid)
+{
+    sweepGrid.assign(grid.begin(), grid.end());
+    reset();
+}
+
+/**
+ * Gets the results of the parameter sweep. Settings that do not have enough data yet have bDone false.
+ * @return The result of each setting, in the order of the grid.
+ */
+std::span<const SweepResult> OBPDetection::getSweepResults() const
+{
+    return sweepResults;
+}
+
+/**
+ * Checks if all settings of the parameter sweep have final results.
+ * @return True if the sweep is done, or if there is no sweep.
+ */
+bool OBPDetection::isSweepDone() const
+{
+    return sweepDone == sweepGrid.size();
+}
+
+/**
+ * Creates the settings of a parameter sweep from all combinations of the given values. The last values change
+ * fastest, so the results can be read as a matrix with one dimension per value list.
+ * @param ratiosSBP The SBP ratios to evaluate.
+ * @param ratiosDBP The DBP ratios to evaluate.
+ * @param minNbrPeaks The minimal numbers of peaks to evaluate.
+ * @param cutoffHysts The hysteresis values to evaluate.
+ * @return The settings of the sweep.
+ */
+std::vector<SweepParams> OBPDetection::makeSweepGrid(std::span<const double> ratiosSBP,
+                                                     std::span<const double> ratiosDBP,
+                                                     std::span<const int> minNbrPeaks,
+                                                     std::span<const double> cutoffHysts)
+{
+    std::vector<SweepParams> grid;
+    grid.reserve(ratiosSBP.size() * ratiosDBP.size() * minNbrPeaks.size() * cutoffHysts.size());
+    for (double ratioSBP : ratiosSBP)
+    {
+        for (double ratioDBP : ratiosDBP)
+        {
+            for (int nbrPeaks : minNbrPeaks)
+            {
+                for (double cutoffHyst : cutoffHysts)
+                {
+                    grid.push_back({ratioSBP, ratioDBP, nbrPeaks, cutoffHyst});
+                }
+            }
+        }
+    }
+    return grid;
 }
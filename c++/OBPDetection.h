@@ -11,9 +11,12 @@
 #ifndef OBP_OBPDETECTION_H
 #define OBP_OBPDETECTION_H
 
-#include <vector>
+#include <span>
 #include <atomic>
+#include <cstdint>
+#include <vector>
 #include "common.h"
+#include "MeasurementArena.h"
 
 /**
  * Class dependant configuration values:
@@ -22,6 +25,69 @@
 #define MIN_RATIO 0.01 //!< A ratio minimum should be larger than 0.
 #define MAX_RATIO 0.99 //!< A ratio maximum should be smaller than 1.
 #define MIN_PEAKS 5    //!< With less than 5 peaks, the detection is impossible.
+#define MIN_PEAK_TIME 300 //!< The minimal time between two peaks in samples (minPeakTime).
+#define MAX_PEAKS (DEFAULT_DATA_SIZE / MIN_PEAK_TIME + 1) //!< Maximal number of peaks in a measurement.
+#define MIN_DATA_SIZE 1200 //!< The number of samples before the oscillations are analysed (minDataSize).
+#define DEFAULT_RATIO_SBP 0.57 //!< The default SBP ratio, from literature.
+#define DEFAULT_RATIO_DBP 0.70 //!< The default DBP ratio, from literature.
+#define DEFAULT_NBR_PEAKS 10   //!< The default number of peaks required to perform the algorithm.
+
+//! The configuration values of the OBPDetection, constant during a measurement.
+/*!
+ * The window sizes and the limits are fixed when an OBPDetection is created. The settings, i.e. the ratios, the number
+ * of peaks and the hysteresis, can be changed at any time and are copied into the configuration when a measurement
+ * starts. The samples are processed with this plain copy, so the values can be kept in registers instead of being
+ * loaded from an atomic on every sample.
+ */
+struct DetectionConfig
+{
+    double samplingRate;    //!< The sampling rate needed to calculate the heart rate from samples.
+    int dataSize;           //!< The maximal number of samples of a measurement, the size of the ring in streaming mode.
+    int maxPeaks;           //!< The maximal number of peaks of a measurement.
+    int minPeakTime;        //!< The minimal time two peaks should be apart, of multiples only the larger one counts.
+    int minDataSize;        //!< The min. size of oscillation data, before this it will not be analysed.
+    double prominence;      //!< The min. prominence of one oscillation to count as a maximum.
+    double minValidHR;      //!< The minimal valid heart rate.
+    double maxValidHR;      //!< The maximal valid heart rate.
+    double ratioSBP;        //!< The SBP ratio.
+    double ratioDBP;        //!< The DBP ratio.
+    int minNbrPeaks;        //!< The number of peaks required to be able to perform the algorithm.
+    double cutoffHyst;      //!< The hysteresis below ratioDBP the oscillations have to be in to end the measurement.
+};
+
+/**
+ * Creates the configuration of an OBPDetection with the default settings.
+ * @param samplingRate The sampling rate of the processed data.
+ * @param minPeakTime The minimal time between two peaks in samples.
+ * @param minDataSize The number of samples before the oscillations are analysed.
+ * @param dataSize The maximal number of samples of a measurement.
+ * @return The configuration.
+ */
+constexpr DetectionConfig makeDetectionConfig(double samplingRate, int minPeakTime = MIN_PEAK_TIME,
+                                              int minDataSize = MIN_DATA_SIZE, int dataSize = DEFAULT_DATA_SIZE)
+{
+    return {samplingRate, dataSize, dataSize / minPeakTime + 1, minPeakTime, minDataSize, 0.25, 50.0, 120.0,
+            DEFAULT_RATIO_SBP, DEFAULT_RATIO_DBP, DEFAULT_NBR_PEAKS, 0.3};
+}
+
+//! The configuration values of one setting in a parameter sweep.
+struct SweepParams
+{
+    double ratioSBP;    //!< The SBP ratio.
+    double ratioDBP;    //!< The DBP ratio.
+    int minNbrPeaks;    //!< The number of peaks required to be able to perform the algorithm.
+    double cutoffHyst;  //!< The hysteresis below ratioDBP the oscillations have to be in to end the measurement.
+};
+
+//! The results of one setting in a parameter sweep.
+struct SweepResult
+{
+    bool bDone;         //!< There was enough data for this setting, the results are final.
+    double map;         //!< The calculated MAP.
+    double sbp;         //!< The calculated SBP.
+    double dbp;         //!< The calculated DBP.
+    double hr;          //!< The average heart rate when the setting had enough data.
+};
 
 
 //! The OBPDetection class handles the implementation of the algorithm to get
@@ -43,11 +109,57 @@
  * Similarly, the diastolic blood pressure is defined as the pressure in time
  * after the MAP where the OMVE is a fraction of @ratio_DBP of the value at
  * the MAP.
+ *
+ * The OMVE is built incrementally: each new min/max pair only adds its own
+ * points, and for every point the running maximum and the SBP and DBP
+ * crossing candidates up to that point are stored. Finding the MAP, SBP and
+ * DBP therefore does not need to search through the whole envelope. They
+ * are only calculated when they are read, or when the next maximum might
+ * change the envelope, not on every peak with enough data. The average heart
+ * rate is kept as a running sum.
+ *
+ * All data of a measurement is stored in FixedVectors that are taken from one
+ * MeasurementArena, allocated in the constructor. Their capacity is given by
+ * the data size and the maximal number of peaks of the DetectionConfig,
+ * DEFAULT_DATA_SIZE and MAX_PEAKS unless another configuration is given.
+ * Processing a sample never allocates.
+ * The prefix sums of the pressure are stored as well, so the average
+ * pressure over any window can be calculated without iterating over it.
+ *
+ * The oscillation is not stored at all. The peaks are detected from the
+ * current sample and the two before it, and the running minimum since the
+ * last two maxima is tracked on every sample, so the minimum between two
+ * maxima is known when the second one is found. All state is kept in the
+ * instance, several instances can process samples in parallel.
+ *
+ * The settings can be changed from another thread while samples are
+ * processed. They are copied with the rest of the configuration when the
+ * first sample of a measurement is processed, which makes a change take
+ * effect with the next measurement.
+ *
+ * For long recordings, the detection can run in a streaming mode. Then the
+ * pressure samples are not stored, and the prefix sums are kept in a FixedRing
+ * of the last dataSize samples. The sample times stay absolute, they are
+ * 64-bit. Peaks, minima, heart rates and OMWE points that are too old to look
+ * up their pressure are removed from the front, and the running OMWE results
+ * are rebuilt from the remaining points. The envelope therefore covers the
+ * recent peaks only, and the memory stays the same no matter how long the
+ * recording runs. The arena is allocated again for the mode when it changes.
+ *
+ * For tuning, a parameter sweep can be set up with a list of settings. The
+ * peaks, minima and the OMWE do not depend on the settings, so all of them
+ * are evaluated in the same pass: after every peak, each setting that did not
+ * have enough data yet is checked, and the first time it has, its results are
+ * calculated from the current OMWE and kept. This gives the same results as
+ * a separate measurement with each setting, as long as samples are processed
+ * until isSweepDone() or the end of the data. The crossings of each setting
+ * are searched with the vectorised kernels of SimdKernels.h.
  */
 class OBPDetection {
 //TODO: add configurable parameters in constructor
 public:
     OBPDetection(double sampling_rate);
+    explicit OBPDetection(const DetectionConfig &config);
     ~OBPDetection();
 
     // Configuration getter and setters:
@@ -56,8 +168,11 @@ public:
     double getRatioDBP();
     void setRatioDBP(double val);
     int getMinNbrPeaks();
+    double getCutoffHyst();
     void setMinNbrPeaks(int val);
     void resetConfigValues();
+    void setStreaming(bool bStream);
+    [[nodiscard]] bool getStreaming() const;
 
     // Process values sample by sample:
     bool processSample(double pressure, double oscillation);
@@ -65,62 +180,120 @@ public:
     // Getter for results:
     double getCurrentHeartRate();
     double getAverageHeartRate();
-    [[nodiscard]] double getMAP() const;
-    [[nodiscard]] double getSBP() const;
-    [[nodiscard]] double getDBP() const;
+    double getMAP();
+    double getSBP();
+    double getDBP();
+    void finaliseResults();
     [[nodiscard]] bool getIsEnoughData() const;
+    [[nodiscard]] std::span<const double> getOMWE() const;
+    [[nodiscard]] std::span<const int64_t> getOMWETimes() const;
+    [[nodiscard]] int64_t getLastPeakNs() const;
     void reset();
 
+    // Parameter sweep:
+    void setSweep(std::span<const SweepParams> grid);
+    [[nodiscard]] std::span<const SweepResult> getSweepResults() const;
+    [[nodiscard]] bool isSweepDone() const;
+    static std::vector<SweepParams> makeSweepGrid(std::span<const double> ratiosSBP, std::span<const double> ratiosDBP,
+                                                  std::span<const int> minNbrPeaks,
+                                                  std::span<const double> cutoffHysts);
+
 private:
+    //! The running results of the OMWE up to and including one of its points.
+    struct OMWEStats
+    {
+        int maxIdx; //!< Index of the maximal OMWE value.
+        int sbpIdx; //!< Index of the first value before the maximum that is larger than ratio_SBP times the maximum.
+        int dbpIdx; //!< Index of the first value after the maximum smaller than ratio_DBP times the maximum, or -1.
+    };
+
+    //! The running minimum of the oscillation since a maximum.
+    struct Trough
+    {
+        double value;   //!< The minimal value since the start.
+        int64_t time;   //!< The time of the first sample with the minimal value.
+    };
+
+    MeasurementArena arena;       //!< Holds the memory of all the vectors below.
+
     // vectors to store values for calculations
-    std::vector<double> pData;    //!< Stores the pressure data.
-    std::vector<double> oData;    //!< Stores the oscillation data.
-    std::vector<double> maxAmp;   //!< Stores the detected maxima.
-    std::vector<int> maxtime;     //!< Stores the times values where the maxima occurred.
-    std::vector<double> minAmp;   //!< Stores the detected minima.
-    std::vector<int> mintime;     //!< Stores the times values where the minima occurred.
-    std::vector<double> omweData; //!< Stores the calculated values of the OMWE.
-    std::vector<int> omweTimes;   //!< Stores the time series where the OMWE was calculated.
-    std::vector<double> hrData;   //!< Stores the detected heart rate values.
+    FixedVector<double> pData;    //!< Stores the pressure data, not used in streaming mode.
+    FixedVector<double> pSum;     //!< Stores the prefix sums of pData, pSum[i] is the sum of the first i values.
+    FixedRing<double> pSumRing;   //!< Stores the recent prefix sums in streaming mode, like pSum.
+    int64_t sampleCount;          //!< The number of samples processed since the last reset.
+    bool bStreaming;              //!< Only the recent samples are kept, in pSumRing.
+    double prevOscillation[2];    //!< The oscillation of the two samples before the current one, the older first.
+    Trough pairTrough;            //!< The minimum since the second to last maximum, between the last two.
+    Trough lastTrough;            //!< The minimum since the last maximum.
+    FixedVector<double> maxAmp;   //!< Stores the detected maxima.
+    FixedVector<int64_t> maxtime; //!< Stores the times values where the maxima occurred.
+    FixedVector<double> minAmp;   //!< Stores the detected minima.
+    FixedVector<int64_t> mintime; //!< Stores the times values where the minima occurred.
+    FixedVector<double> omweData; //!< Stores the calculated values of the OMWE.
+    FixedVector<int64_t> omweTimes; //!< Stores the time series where the OMWE was calculated.
+    FixedVector<double> hrData;   //!< Stores the detected heart rate values.
+    FixedVector<int64_t> hrTime;  //!< Stores the time of the maximum that ended the interval of each heart rate.
+    double hrSum;                 //!< The sum of hrData, for the average heart rate.
+    FixedVector<OMWEStats> omweStats; //!< Stores the running results for every point in omweData.
+    size_t omwePairs;                 //!< The number of min/max pairs with final values in omweData.
+    double maxAmpPeak;                //!< The largest value in maxAmp.
+    int validPulseCnt;                //!< The number of valid pulses in a row, only for logging.
+
+    // parameter sweep, allocated when it is set up
+    std::vector<SweepParams> sweepGrid;     //!< The settings of the parameter sweep.
+    std::vector<SweepResult> sweepResults;  //!< The results of each setting in sweepGrid.
+    size_t sweepDone;                       //!< The number of settings with final results.
 
     // variables to store results
     double resMAP{};    //!< The result of the MAP calculation.
     double resSBP{};    //!< The result of the SBP calculation.
     double resDBP{};    //!< The result of the DBP calculation.
     bool enoughData;    //!< Enough data is available to attempt calculation of the OMWE.
+    bool bResultsPending; //!< The results of the last peak with enough data are not calculated yet.
+    int64_t resultSamples; //!< The number of samples at the last peak with enough data.
+    int64_t lastPeakNs{}; //!< The time in ns the last new peak took to process.
 
     // variables to store configurations
-    // The values that are directly initialised are considered as configuration alues but not implemented as such,
-    // they might just as well be constants until then.
+    // The settings can be changed at any time, they are copied into config when a measurement starts.
     std::atomic<double> ratio_SBP;               //! from literature, might be changed in settings later
     std::atomic<double> ratio_DBP;               //! from literature, might be changed in settings later
-    std::atomic<double> maxValidHR = 120.0;      //! The maximal valid heart rate
-    std::atomic<double> minValidHR = 50.0;       //! The minimal valid heart rate
-    std::atomic<double> prominence = 0.25;       //! The min. prominence of one oscillation to count as a maximum
-    std::atomic<int> minDataSize = 1200;         //! The min. size of oscillation data. Before this it will not be
-    //! analysed.
-    std::atomic<int> minPeakTime = 300;          //! The minimal time two peaks should be apart. If there are
-    //! multiples, only the larger one will be considered.
-    std::atomic<double> samplingRate;            //! The sampling rate needed to calculate the heart rate from samples.
-    std::atomic<int> minNbrPeaks = 10;           //! The number of oscillation peaks required to be able to perform
+    std::atomic<int> minNbrPeaks;                //! The number of oscillation peaks required to be able to perform
     //! the algorithm.
-    std::atomic<double> cutoffHyst = 0.3;        //! The hysteresis below ratio_DBP the oscillations have to be in
+    std::atomic<double> cutoffHyst;              //! The hysteresis below ratio_DBP the oscillations have to be in
     //! order to be able to end the measurement. This is not from the total OMVE, but from the maximal amplitude.
     //! (OMVE calculated afterwards).
+    DetectionConfig config;                      //! The configuration of the current measurement.
 
     // private functions:
-    bool checkMaxima();
+    bool checkMaxima(double oscillation);
     bool isValidMaxima();
     bool isHeartRateValid(double heartRate);
     void findMinima();
+    static void startTrough(Trough &trough, int64_t time);
+    static void trackTrough(Trough &trough, double value, int64_t time);
     bool isEnoughData();
+    [[nodiscard]] bool isEnoughData(int nbrPeaks, double ratioDBP, double hysteresis) const;
     void findOWME();
+    void addOMWEPoint(double value, int64_t time);
+    [[nodiscard]] OMWEStats nextOMWEStats(int idx) const;
+    [[nodiscard]] std::span<const double> omweValues(int first, int last) const;
+    void removeOldPeaks();
+    void loadSettings();
+    void resetOMWE();
     void findMAP();
-    double getPressureAt(int time);
+    [[nodiscard]] OMWEStats findCrossings(double ratioSBP, double ratioDBP) const;
+    void calculateBP(const OMWEStats &stats, double ratioSBP, double ratioDBP, int64_t nSamples, double &map,
+                     double &sbp, double &dbp);
+    void evaluateSweep();
+    double getPressureAt(int64_t time, int64_t nSamples);
+    double getAveragePressure(int64_t first, int64_t last);
+    [[nodiscard]] double pressureAt(int64_t time) const;
+    [[nodiscard]] double pressureSumAt(int64_t time) const;
+    void allocate();
 
     // Static functions:
+    static size_t arenaSize(const DetectionConfig &config, bool bStreaming);
     static double getRatio(double lowerBound, double upperBound, double value);
-    static double getAverage(std::vector<double> avVector);
 };
 
 
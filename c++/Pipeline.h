@@ -0,0 +1,115 @@
+/**
+ * @file        Pipeline.h
+ * @brief       The header file of the Pipeline class template.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines and implements the Pipeline class template and contains the general class description.
+ */
+#ifndef OBP_PIPELINE_H
+#define OBP_PIPELINE_H
+
+#include <cassert>
+#include <span>
+
+#include "OBPDetection.h"
+#include "SignalConditioner.h"
+
+//! The Pipeline class template converts, filters and analyses samples of a sampling rate and filter order known at
+//! compile time.
+/*!
+ * A Pipeline does the same as a SignalConditioner together with an OBPDetection, but the sampling rate and the order
+ * of the filters are template parameters. The number of biquads, the windows of the detection and the sizes of its
+ * data are derived from them at compile time. The windows that are given in samples at SAMPLING_RATE, MIN_PEAK_TIME
+ * and MIN_DATA_SIZE, are scaled to cover the same time at the rate. At SAMPLING_RATE and IIRORDER, a Pipeline gives
+ * exactly the same results as a SignalConditioner with an OBPDetection, the conversion and the filters are those of a
+ * BasicSignalConditioner of the order.
+ *
+ * Only the cutoff frequencies are runtime values. The filter coefficients are designed by the Iir library in the
+ * constructor, its design cannot be evaluated at compile time.
+ *
+ * A Pipeline is meant for tools that process data of one known device, like recordings at the nominal rate. The
+ * application keeps the runtime configurable SignalConditioner and OBPDetection, so the settings can be changed in
+ * the GUI.
+ *
+ * @tparam Rate The sampling rate in Hz.
+ * @tparam Order The order of the low-pass and the high-pass filter.
+ */
+template<int Rate, int Order>
+class Pipeline {
+    static_assert(Rate > 0, "The sampling rate has to be positive.");
+    static_assert(Order > 0, "The filter order has to be positive.");
+
+public:
+    static constexpr int stages = BasicSignalConditioner<Order>::stages; //!< The number of biquads of a filter.
+    static constexpr int blockSize = Rate;                               //!< Samples filtered at once, one second.
+    static constexpr DetectionConfig detectionConfig =
+            makeDetectionConfig(Rate, MIN_PEAK_TIME * Rate / SAMPLING_RATE, MIN_DATA_SIZE * Rate / SAMPLING_RATE,
+                                Rate * 60 * DEFAULT_MINUTES);           //!< The configuration of the detection.
+    static_assert(detectionConfig.minPeakTime > 0, "The sampling rate is too low to separate two peaks.");
+
+    /**
+     * Constructor of the Pipeline, designs the filters.
+     * @param fcLP Cutoff frequency for the low-pass filter.
+     * @param fcHP Cutoff frequency for the high-pass filter.
+     */
+    Pipeline(double fcLP, double fcHP) :
+            conditioner(Rate, fcLP, fcHP),
+            detection(detectionConfig) {
+    }
+
+    /**
+     * Sets the values needed to convert voltage to mmHg.
+     * @param ambientVoltage The voltage at ambient pressure.
+     * @param corrFactor The correction factor of the voltage divider.
+     */
+    void setCalibration(double ambientVoltage, double corrFactor) {
+        conditioner.setCalibration(ambientVoltage, corrFactor);
+    }
+
+    /**
+     * Resets the state of the filters, the detection is reset on its own when a measurement starts.
+     */
+    void reset() {
+        conditioner.reset();
+    }
+
+    /**
+     * Gets the detection the filtered samples are passed to, e.g. to change its settings or get the results.
+     * @return The detection.
+     */
+    OBPDetection &getDetection() {
+        return detection;
+    }
+
+    /**
+     * Converts a block of samples to mmHg and filters it with the low-pass and high-pass filters.
+     * @param samples The voltage samples, at most blockSize and as many as fit in the other spans.
+     * @param ymmHg The samples converted to mmHg.
+     * @param yLP The low-pass filtered samples.
+     * @param yHP The high-pass filtered samples.
+     */
+    void process(std::span<const double> samples, std::span<double> ymmHg, std::span<double> yLP,
+                 std::span<double> yHP) {
+        assert(samples.size() <= (size_t) blockSize);
+        conditioner.process(samples, ymmHg, yLP, yHP);
+    }
+
+    /**
+     * Filters a block of samples that are already in mmHg with the low-pass and high-pass filters.
+     * @param ymmHg The pressure samples, at most as many as fit in the other spans.
+     * @param yLP The low-pass filtered samples.
+     * @param yHP The high-pass filtered samples.
+     */
+    void filter(std::span<const double> ymmHg, std::span<double> yLP, std::span<double> yHP) {
+        conditioner.filter(ymmHg, yLP, yHP);
+    }
+
+private:
+    BasicSignalConditioner<Order> conditioner;  //!< Converts and filters the samples.
+    OBPDetection detection;                     //!< The algorithm, with the windows of the rate.
+};
+
+#endif //OBP_PIPELINE_H
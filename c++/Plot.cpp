@@ -17,22 +17,21 @@ int Plot::nextPenColour = (int) Qt::darkRed;  //!
 
 /**
  * Plot constructor, initialises an empty plot curve with no titles.
- * @param xData A pointer to the data that represents the x-axis.
- * @param yData A pointer to the data that represents the y-axis.
- * @param length The lenght of the data (the same for x and y-axis.
+ * @param length The number of data samples shown in the plot.
+ * @param samplingRate The sampling rate of the data, used to calculate the x-axis.
  * @param max   The maximal value of the y-axis.
  * @param min   The maximal value of the y-axis.
  * @param parent A reference to the parent object.
  */
-Plot::Plot(double *xData, double *yData, int length, double yMax, double yMin, QWidget *parent) :
-        QwtPlot(parent),
-        xData(xData),
-        yData(yData) {
+Plot::Plot(int length, double samplingRate, double yMax, double yMin, QWidget *parent) :
+        QwtPlot(parent) {
     setyAxisScale(yMin, yMax);
     dataCurve = new QwtPlotCurve("");
     dataCurve->setPen(QPen((Qt::GlobalColor) nextPenColour++, 3));
-    dataCurve->setRawSamples(xData, yData, length);
-    dataLength = length;
+    // The axes are fixed, the curve does not need to be scanned for its bounds on every replot.
+    dataCurve->setItemAttribute(QwtPlotItem::AutoScale, false);
+    series = new PlotSeries(length, samplingRate);
+    dataCurve->setData(series);
     dataCurve->attach(this);
 
     QwtPlot::setAxisScale(QwtPlot::xBottom, 8, 0);
@@ -107,7 +106,82 @@ void Plot::setyAxisExtent(double extent) {
  * @param yNew The new data to set at the end of the plot.
  */
 void Plot::setNewData(double yNew) {
-    static int cnt = 0;
-    memmove(yData, yData + 1, (dataLength - 1) * sizeof(yData[0]));
-    yData[dataLength - 1] = yNew;
-}
\ No newline at end of file
+    series->append(yNew);
+}
+
+/**
+ * Adds several new data samples to the end of the graph, deleting the oldest ones.
+ * @param yNew The new data to set at the end of the plot, the last one is the newest.
+ */
+void Plot::setNewData(std::span<const double> yNew) {
+    series->append(yNew);
+}
+
+/**
+ * Handles resizing of the plot. The data is decimated to one column per pixel of the plot canvas.
+ * @param e The resize event.
+ */
+void Plot::resizeEvent(QResizeEvent *e) {
+    QwtPlot::resizeEvent(e);
+    series->setColumns(canvas()->width());
+}
+
+/**
+ * PlotSeries constructor, initialises all values to 0.
+ * @param length The number of data samples in the series.
+ * @param samplingRate The sampling rate of the data, used to calculate the x-values.
+ */
+PlotSeries::PlotSeries(int length, double samplingRate) :
+        yData(length),
+        samplePeriod(1.0 / samplingRate) {
+}
+
+/**
+ * Gets the number of points in the series.
+ * @return The number of points.
+ */
+size_t PlotSeries::size() const {
+    return yData.size();
+}
+
+/**
+ * Gets a point in logical order.
+ * @param i The index of the point, 0 is the oldest.
+ * @return The time and value of the point.
+ */
+QPointF PlotSeries::sample(size_t i) const {
+    return {yData.age(i) * samplePeriod, yData.value(i)};
+}
+
+/**
+ * Gets the bounds of the series. Only the time axis is known without scanning all values, the axes of the plot are
+ * fixed, so this is not used for scaling.
+ * @return The time span of the series with a height of 0.
+ */
+QRectF PlotSeries::boundingRect() const {
+    return {samplePeriod, 0.0, (double) (yData.length() - 1) * samplePeriod, 0.0};
+}
+
+/**
+ * Adds a new value, replacing the oldest one.
+ * @param yNew The new value.
+ */
+void PlotSeries::append(double yNew) {
+    yData.push(yNew);
+}
+
+/**
+ * Adds several new values, replacing the oldest ones.
+ * @param yNew The new values, the last one is the newest.
+ */
+void PlotSeries::append(std::span<const double> yNew) {
+    yData.push(yNew);
+}
+
+/**
+ * Sets the number of columns the values are reduced to.
+ * @param columns The number of columns, usually the width of the plot canvas in pixels.
+ */
+void PlotSeries::setColumns(int columns) {
+    yData.setColumns(columns);
+}
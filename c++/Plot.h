@@ -11,17 +11,46 @@
 #ifndef OBP_PLOT_H
 #define OBP_PLOT_H
 
+#include <span>
 #include <qwt/qwt_plot.h>
 #include <qwt/qwt_plot_curve.h>
+#include <qwt/qwt_series_data.h>
+
+#include "MinMaxDecimator.h"
+
+//! The PlotSeries class lets a plot curve read its data from a ring buffer.
+/*!
+ * The y-values are stored in a RingBuffer, so new values are added without moving the older ones. Qwt reads the
+ * values in logical order, from the oldest to the newest one. The x-values are not stored, they are calculated from
+ * the age of the value: the oldest value is at length / samplingRate seconds, the newest at 1 / samplingRate.
+ *
+ * The values are passed to Qwt through a MinMaxDecimator, which reduces them to the minimum and maximum per pixel
+ * column of the plot canvas. The cost of a replot therefore depends on the width of the plot and not on the number
+ * of samples shown.
+ */
+class PlotSeries : public QwtSeriesData<QPointF> {
+public:
+    PlotSeries(int length, double samplingRate);
+
+    size_t size() const override;
+    QPointF sample(size_t i) const override;
+    QRectF boundingRect() const override;
+    void append(double yNew);
+    void append(std::span<const double> yNew);
+    void setColumns(int columns);
+private:
+    MinMaxDecimator yData;      //!< The y-values, reduced to the displayed points.
+    double samplePeriod;        //!< The time between two values in s.
+};
 
 //! The Plot class displays a single plot as a Qwt widget.
 /*!
  * The Plot class inherits from QwtPlot. It handles setting up plot and axis titles, scaling and changing the
- * displayed data.
+ * displayed data. The data is stored in a PlotSeries, which is owned by the curve.
  */
 class Plot : public QwtPlot {
 public:
-    Plot(double *xData, double *yData, int length,
+    Plot(int length, double samplingRate,
          double yMax, double yMin,
              QWidget *parent = 0);
 
@@ -31,12 +60,14 @@ public:
     void setyAxisExtent(double extent);
     void setyAxisScale(double yMin, double yMax);
     void setNewData(double yNew);
+    void setNewData(std::span<const double> yNew);
+protected:
+    void resizeEvent(QResizeEvent *e) override;
 private:
     static int nextPenColour;   //!< Stores the pen color for the next plot object
 
     QwtPlotCurve *dataCurve;    //!< The curve object
-    double *xData, *yData;      //!< Pointers to the x and y data
-    int dataLength;             //!< The length of the data pointers
+    PlotSeries *series;         //!< The data of the curve, owned by dataCurve
 };
 
 
@@ -9,29 +9,48 @@
 #include <iostream>
 #include <unistd.h>
 #include <cmath>
-#include <QtCore/QDateTime>
+#include <numeric>
 
 #include "Processing.h"
+#include "Profiler.h"
 
 
  /**
   * The constructor of the Processing thread.
   *
   * Initialises internal objects and prepares the thread for running.
+  * @param source The source of the samples, it has to exist as long as the Processing thread.
+  * @param channel The channel of the source to process.
   * @param fcLP Cutoff frequency for the low-pass filter. Changing the default is not recommended.
   * @param fcHP Cutoff frequency for the high-pass filter. Changing the default might have severe concequences.
   */
-Processing::Processing(double fcLP, double fcHP) :
-        rawData(DEFAULT_DATA_SIZE),
+Processing::Processing(ISampleSource *source, int channel, double fcLP, double fcHP) :
+        nStored(0),
+        channelBlock(PROC_BLOCK_SIZE),
+        ymmHgBlock(PROC_BLOCK_SIZE),
+        yLPBlock(PROC_BLOCK_SIZE),
+        yHPBlock(PROC_BLOCK_SIZE),
+        source(source),
+        channel(channel),
         bRunning(false),
-        bMeasuring(false) {
+        bMeasuring(false),
+        bStreaming(false),
+        ambientVoltage(0.0),
+        cachedAmbient(NAN),
+        ambientWindow(AMBIENT_AV_TIME),
+        cutoffLP(fcLP),
+        cutoffHP(fcHP),
+        lastReadNs(0),
+        statsLogInterval(0),
+        detectionCount(0) {
 
     PLOG_VERBOSE << "Processing started";
 
     currentState = ProcState::Config;
-    comedi = new ComediHandler();
+    assert(source != nullptr);
+    assert(channel >= 0 && channel < source->getNumChannels());
 
-    sampling_rate = comedi->getSamplingRate();
+    sampling_rate = source->getSamplingRate();
 
     /**
      * LP filter, default value is 10 Hz, which also takes care of 50 Hz noise.
@@ -40,27 +59,23 @@ Processing::Processing(double fcLP, double fcHP) :
         PLOG_WARNING << "Processing running with low pass filter of: " << fcLP;
     }
 
-    iirLP = new Iir::Butterworth::LowPass<IIRORDER>;
-    assert(iirLP != NULL);
-    iirLP->setup(sampling_rate, fcLP);
-
     /**
      * HP filter, default value is 0.5 Hz.
      */
     if (fcHP != 0.5) {
         PLOG_WARNING << "Processing running with high pass filter of: " << fcHP;
     }
-    iirHP = new Iir::Butterworth::HighPass<IIRORDER>;
-    assert(iirHP != NULL);
-    iirHP->setup(sampling_rate, fcHP);
+    conditioner = new SignalConditioner(sampling_rate, fcLP, fcHP);
 
     obpDetect = new OBPDetection(sampling_rate);
-    record = new Datarecord(sampling_rate);
+    record = new Datarecord();
+    record->start();
+    completion = new Completion(*this);
+    completion->start();
 
     /**
      * Initialise and reset all values.
      */
-    rawData.clear();
     resetConfigValues();
 
 }
@@ -72,10 +87,11 @@ Processing::Processing(double fcLP, double fcHP) :
  */
 Processing::~Processing() {
     stopMeasurement();
-    stopThread();
-    delete iirHP;
-    delete iirLP;
-    delete comedi;
+    shutdown();
+    record->stopThread();
+    record->join();
+    delete completion;
+    delete conditioner;
     delete record;
     delete obpDetect;
 }
@@ -161,6 +177,111 @@ int Processing::getPumpUpValue() {
     return mmHgInflate;
 }
 
+/**
+ * Sets if the measurements are recorded to files.
+ *
+ * Only possible before the thread is running.
+ * @param bRecord True to record the measurements.
+ */
+void Processing::setRecording(bool bRecord) {
+    if (!bRunning) {
+        record->setEnabled(bRecord);
+    }
+}
+
+/**
+ * Sets the archive that recorded measurements are appended to, in addition to their own files.
+ * @param fileName The name of the archive, empty to not use an archive.
+ */
+void Processing::setArchive(const std::string &fileName) {
+    record->setArchive(fileName);
+}
+
+/**
+ * Sets the streaming mode for long measurements. The samples are then only streamed to the recording and the
+ * algorithm only keeps the recent peaks, so a measurement is never cancelled because it is too long.
+ *
+ * Only possible before the thread is running.
+ * @param bStream True for the streaming mode.
+ */
+void Processing::setStreaming(bool bStream) {
+    if (!bRunning) {
+        bStreaming = bStream;
+        obpDetect->setStreaming(bStream);
+    }
+}
+
+/**
+ * Checks if the streaming mode is set.
+ * @return True in streaming mode.
+ */
+bool Processing::getStreaming() {
+    return bStreaming;
+}
+
+/**
+ * Checks if the measurements are recorded to files.
+ * @return True if the measurements are recorded.
+ */
+bool Processing::getRecording() {
+    return record->getEnabled();
+}
+
+/**
+ * Sets the scheduling of the acquisition thread: real-time priority, CPU affinity and locked memory.
+ *
+ * Only possible before the thread is running, the attributes are applied when it starts.
+ * @param attributes The attributes of the thread.
+ */
+void Processing::setThreadAttributes(const ThreadAttributes &attributes) {
+    if (!bRunning) {
+        setAttributes(attributes);
+    }
+}
+
+/**
+ * Sets how often the stats are written to the log, with info severity.
+ * @param seconds The time between two logs in s, 0 to disable.
+ */
+void Processing::setStatsLogInterval(int seconds) {
+    statsLogInterval = std::max(0, seconds);
+}
+
+/**
+ * Takes a snapshot of the instrumentation. Can be called from any thread.
+ * @return The latencies of all stages, the backlog and the overruns of the source.
+ */
+ProcessingStats Processing::getStats() {
+    ProcessingStats stats;
+    for (int i = 0; i < (int) LatencyStage::Count; i++) {
+        stats.latency[i] = latency[i].snapshot();
+    }
+    stats.backlog = backlog.snapshot();
+    stats.overruns = source->getOverruns();
+    return stats;
+}
+
+/**
+ * Removes everything recorded by the instrumentation so far.
+ */
+void Processing::resetStats() {
+    for (auto &histogram : latency) {
+        histogram.reset();
+    }
+    backlog.reset();
+}
+
+/**
+ * Records that the GUI drew the newest data it received. Called by the GUI thread after drawing.
+ */
+void Processing::recordDelivery() {
+    const int64_t readNs = lastReadNs;
+    if (readNs != 0) {
+        latency[(int) LatencyStage::Delivered].record(
+                toNs(std::chrono::steady_clock::now().time_since_epoch()) - readNs);
+    }
+}
+
 /**
  * Gets the sampling rate of the data acquisition.
  *
@@ -170,6 +291,43 @@ double Processing::getSamplingRate() {
     return sampling_rate;
 }
 
+/**
+ * Sets a recently calibrated ambient voltage, e.g. from the last run of the application. It is used as soon as the
+ * pressure is stable at it, so the calibration does not have to wait for a full window.
+ *
+ * Only possible before the thread is running.
+ * @param voltage The cached ambient voltage, NAN to calibrate without one.
+ */
+void Processing::setCachedAmbient(double voltage) {
+    if (!bRunning) {
+        cachedAmbient = voltage;
+    }
+}
+
+/**
+ * Gets the voltage at ambient pressure.
+ * @return The calibrated ambient voltage, 0 before the calibration finished.
+ */
+double Processing::getAmbientVoltage() {
+    return ambientVoltage;
+}
+
+/**
+ * Gets the channel of the source that is processed.
+ * @return The channel.
+ */
+int Processing::getChannel() {
+    return channel;
+}
+
+/**
+ * Gets the state of the measurement, from any thread.
+ * @return The current state.
+ */
+Processing::ProcState Processing::getState() {
+    return currentState;
+}
+
 /**
  * Resets the configuration values to their default.
  *
@@ -193,22 +351,113 @@ void Processing::resetConfigValues() {
 void Processing::run() {
     bRunning = true;
 
+    const int errors = getAttributeErrors();
+    if (errors & PriorityFailed) {
+        PLOG_WARNING << "Could not set real-time priority " << getAttributes().priority
+                     << " for the acquisition thread, CAP_SYS_NICE or an rtprio limit is needed";
+    }
+    if (errors & AffinityFailed) {
+        PLOG_WARNING << "Could not pin the acquisition thread to the configured CPUs";
+    }
+    if (errors & MemoryLockFailed) {
+        PLOG_WARNING << "Could not lock the memory, CAP_IPC_LOCK or a memlock limit is needed";
+    }
+
     while (bRunning) {
 
         /**
-         * Read comedi buffer and process the sample.
+         * Wait for the source to have new samples and process all of them as one block.
+         * The wait times out regularly, so the thread can finish when it is stopped.
          */
-        if (comedi->getBufferContents() > 0) {
-            processSample(comedi->getVoltageSample());
-        } else {
-            /**
-             * If there was no data in the buffer, sleep for 1ms.
-             */
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (source->waitForData(PROC_WAIT_TIMEOUT)) {
+            const auto scans = source->readVoltageBlock();
+            backlog.record(source->getBacklog());
+            processScans(scans, source->getNumChannels());
+        }
+
+        const int interval = statsLogInterval;
+        const auto now = std::chrono::steady_clock::now();
+        if (interval > 0 && now - lastStatsLog >= std::chrono::seconds(interval)) {
+            lastStatsLog = now;
+            logStats();
         }
     }
 }
 
+/**
+ * Processes the samples of this channel in a block of interleaved scans.
+ *
+ * With a single channel, the block is processed as it is. Otherwise, the samples of this channel are copied out of
+ * the scans and processed in blocks of at most PROC_BLOCK_SIZE samples.
+ * @param scans The voltage samples of all channels, interleaved scan by scan.
+ * @param nChannels The number of channels in the scans.
+ * @param readTime The time the scans were read from the source.
+ */
+void Processing::processScans(std::span<const double> scans, int nChannels,
+                              std::chrono::steady_clock::time_point readTime) {
+    blockReadTime = readTime;
+    if (nChannels == 1) {
+        processBlock(scans);
+        return;
+    }
+
+    const size_t nScans = scans.size() / nChannels;
+    for (size_t first = 0; first < nScans; first += channelBlock.size()) {
+        const size_t n = std::min(channelBlock.size(), nScans - first);
+        const double *scan = scans.data() + first * nChannels + channel;
+        for (size_t i = 0; i < n; i++) {
+            channelBlock[i] = scan[i * nChannels];
+        }
+        processBlock({channelBlock.data(), n});
+    }
+}
+
+/**
+ * Processes a block of newly acquired samples in the order they were acquired.
+ * @param samples The voltage samples read from the device.
+ */
+void Processing::processBlock(std::span<const double> samples) {
+    OBP_PROFILE_SCOPE(profile, ProfileStage::ProcessBlock, samples.size());
+
+    /**
+     * Until the ambient pressure is known, the samples can not be converted and are only used for the configuration.
+     */
+    size_t i = 0;
+    while (i < samples.size() && currentState == ProcState::Config) {
+        processSample(samples[i++], 0.0, 0.0, 0.0);
+    }
+
+    /**
+     * The rest of the block is converted and filtered at once, then passed to the state machine.
+     */
+    auto rest = samples.subspan(i);
+    if (rest.empty()) {
+        return;
+    }
+    while (!rest.empty()) {
+        auto block = rest.first(std::min(rest.size(), yLPBlock.size()));
+        filterBlock(block);
+        latency[(int) LatencyStage::Filtered].record(toNs(std::chrono::steady_clock::now() - blockReadTime));
+        notifyNewDataBlock({yLPBlock.data(), block.size()}, {yHPBlock.data(), block.size()});
+        for (size_t j = 0; j < block.size(); j++) {
+            processSample(block[j], ymmHgBlock[j], yLPBlock[j], yHPBlock[j]);
+        }
+        rest = rest.subspan(block.size());
+    }
+    latency[(int) LatencyStage::Detected].record(toNs(std::chrono::steady_clock::now() - blockReadTime));
+    lastReadNs = toNs(blockReadTime.time_since_epoch());
+}
+
+/**
+ * Converts a block of samples to mmHg and filters it with the low-pass and high-pass filters.
+ *
+ * The results are stored in ymmHgBlock, yLPBlock and yHPBlock.
+ * @param samples The voltage samples, at most as many as fit in the block buffers.
+ */
+void Processing::filterBlock(std::span<const double> samples) {
+    conditioner->process(samples, ymmHgBlock, yLPBlock, yHPBlock);
+}
+
 /**
  * Stops the thread by stopping the data acquisition so the thread terminates and can be joined.
  */
@@ -216,6 +465,17 @@ void Processing::stopThread() {
     bRunning = false;
 }
 
+/**
+ * Stops the thread and waits for it, then waits until the observers are notified of the finished measurements and
+ * stops the completion thread. Has to be called before the observers are destroyed, no observer is notified after it.
+ */
+void Processing::shutdown() {
+    stopThread();
+    join();
+    completion->stop();
+    completion->join();
+}
+
 /**
  * Starts a new measurement.
  */
@@ -230,38 +490,23 @@ void Processing::stopMeasurement() {
     bMeasuring = false;
 }
 
-/**
- * Gets a file name (string) from the current time.
- * @return The file name as a QString.
- */
-QString Processing::getFilename() {
-    QDateTime dateTime = QDateTime::currentDateTime();
-    QString dateTimeString = dateTime.toString("yyyy_MM_dd_hh_mm_ss");
-    dateTimeString.append("_data.dat");
-    return dateTimeString;
-}
-
 /**
  * Processing a single new sample in a state machine.
- * @param newSample
+ *
+ * The converted and filtered values are only valid after configuration is done, before that they are 0.
+ * @param newSample The voltage sample.
+ * @param ymmHg The sample converted to mmHg.
+ * @param yLP The low-pass filtered sample.
+ * @param yHP The high-pass filtered sample.
  */
-void Processing::processSample(double newSample) {
+void Processing::processSample(double newSample, double ymmHg, double yLP, double yHP) {
 
     /**
-     * Every sample is filtered and sent to the Observers
-     * after configuration is done.
-     * The raw data is stored to save to a file after a successful measurement.
+     * The filtered samples are sent to the Observers by processBlock, once per block.
+     * The raw data is streamed to a file, which is kept after a successful measurement.
      */
-    double ymmHg = 0.0;
-    double yLP = 0.0;
-    double yHP = 0.0;
-    if (currentState != ProcState::Config) {
-        ymmHg = getmmHgValue(newSample);
-        yLP = iirLP->filter(ymmHg);
-        yHP = iirHP->filter(yLP);
-        notifyNewData(yLP, yHP);
-    }
-    if (rawData.size() > DEFAULT_DATA_SIZE) {
+    // Without streaming, the OBPDetection only has room for DEFAULT_DATA_SIZE samples.
+    if (!bStreaming && nStored >= DEFAULT_DATA_SIZE) {
         PLOG_WARNING << "Recording too long to continue algorithm. Cancelled";
         // Setting bMeasuring false will ensure return to Idle state.
         bMeasuring = false;
@@ -269,14 +514,10 @@ void Processing::processSample(double newSample) {
     switch (currentState) {
         case ProcState::Config:
 
-            if (checkAmbient()) {
+            if (checkAmbient(newSample)) {
                 currentState = ProcState::Idle;
                 // Send ready signal to observers
                 notifyReady();
-                rawData.clear();
-
-            } else {
-                rawData.push_back(newSample);
             }
 
             break;
@@ -285,7 +526,9 @@ void Processing::processSample(double newSample) {
 
             if (bMeasuring) {
                 // Reset parameters:
-                rawData.clear();
+                nStored = 0;
+                record->startRecording(makeRecordHeader(sampling_rate, ambientVoltage, corrFactor,
+                                                        cutoffLP, cutoffHP, IIRORDER));
                 notifyResults(0.0, 0.0, 0.0);
                 notifyHeartRate(0.0);
                 currentState = ProcState::Inflate;
@@ -295,10 +538,11 @@ void Processing::processSample(double newSample) {
             break;
         case ProcState::Inflate:
             if (!bMeasuring) {
+                record->stopRecording(false);
                 currentState = ProcState::Idle;
                 notifySwitchScreen(Screen::startScreen);
             } else {
-                rawData.push_back(ymmHg);
+                storeSample(newSample);
 
                 // Check if pressure in cuff is large enough, so it can be switched to the next state.
                 if (ymmHg > mmHgInflate) {
@@ -311,12 +555,27 @@ void Processing::processSample(double newSample) {
             break;
         case ProcState::Deflate:
             if (!bMeasuring) {
+                record->stopRecording(false);
                 currentState = ProcState::Idle;
                 notifySwitchScreen(Screen::startScreen);
             } else {
-                rawData.push_back(ymmHg);
-
-                if (obpDetect->processSample(yLP, yHP)) {
+                storeSample(newSample);
+
+                // Reading the clock twice per sample costs as much as the detection, so only every Nth is timed.
+                // The detection times every peak itself, they are rare and the ones of interest.
+                bool bNewPeak;
+                if (++detectionCount % PROC_LATENCY_STRIDE == 0) {
+                    const auto start = std::chrono::steady_clock::now();
+                    bNewPeak = obpDetect->processSample(yLP, yHP);
+                    if (!bNewPeak) {
+                        latency[(int) LatencyStage::DetectionSteady].record(
+                                toNs(std::chrono::steady_clock::now() - start));
+                    }
+                } else {
+                    bNewPeak = obpDetect->processSample(yLP, yHP);
+                }
+                if (bNewPeak) {
+                    latency[(int) LatencyStage::DetectionPeak].record(obpDetect->getLastPeakNs());
                     if (obpDetect->getIsEnoughData()) {
                         notifyHeartRate(obpDetect->getAverageHeartRate());
                         notifySwitchScreen(Screen::emptyCuffScreen);
@@ -333,20 +592,26 @@ void Processing::processSample(double newSample) {
             break;
         case ProcState::Empty:
             if (!bMeasuring) {
+                record->stopRecording(false);
                 currentState = ProcState::Idle;
                 notifySwitchScreen(Screen::startScreen);
             } else {
-                rawData.push_back(ymmHg);
+                storeSample(newSample);
                 if (ymmHg < 2) {
-                    notifyResults(obpDetect->getMAP(), obpDetect->getSBP(), obpDetect->getDBP());
-                    record->saveAll(Processing::getFilename(), rawData);
-                    notifySwitchScreen(Screen::resultScreen);
+                    const ArchiveResults results = {obpDetect->getMAP(), obpDetect->getSBP(), obpDetect->getDBP(),
+                                                    obpDetect->getAverageHeartRate()};
+                    record->stopRecording(true, results);
+                    if (!completion->post(results)) {
+                        PLOG_WARNING << "Completion thread too slow, notifying the results directly";
+                        notifyResults(results.map, results.sbp, results.dbp);
+                        notifySwitchScreen(Screen::resultScreen);
+                    }
                     currentState = ProcState::Results;
                 }
             }
             break;
         case ProcState::Results:
-            if (!bMeasuring) {
+            if (!bMeasuring && completion->isIdle()) {
                 currentState = ProcState::Idle;
                 notifySwitchScreen(Screen::startScreen);
             }
@@ -355,43 +620,131 @@ void Processing::processSample(double newSample) {
 }
 
 /**
- * Calculates the mmHg value from the given voltage input.
- * @param voltageValue The voltage input.
- * @return The corresponding value in mmHg.
+ * Stores a sample of the running measurement. The raw sample is streamed to the recording and counted for the
+ * length limit of the measurement.
+ * @param newSample The voltage sample.
  */
-double Processing::getmmHgValue(double voltageValue) const {
-    return ((voltageValue - ambientVoltage) * kPa_per_V * corrFactor) / kPa_per_mmHg;
+void Processing::storeSample(double newSample) {
+    nStored++;
+    record->addSample(newSample);
 }
 
 /**
- * Checks the ambient pressure. This method needs to be called repeatedly at startup
- * until it returns true.
+ * Checks the ambient pressure. This method needs to be called with every raw sample at startup until it returns true.
  *
- * @return
+ * If the pressure is stable in the window of the latest samples, it is assumed to be the ambient pressure. Every
+ * sample moves the window, so the calibration finishes with the first stable window instead of restarting after a
+ * deviation. A cached ambient voltage is taken as soon as a shorter window is stable at it.
+ * @param newSample The raw voltage sample.
+ * @return True if the ambient voltage is calibrated.
  */
-bool Processing::checkAmbient() {
-    bool bAmbientValid = false;
+bool Processing::checkAmbient(double newSample) {
+    ambientWindow.push(newSample);
+
+    const double av = ambientWindow.mean();
+    const bool bStable = ambientWindow.max() - av < AMBIENT_DEVIATION && av - ambientWindow.min() < AMBIENT_DEVIATION;
+    const double cached = cachedAmbient;
+    double ambient;
+    if (bStable && ambientWindow.isFull()) {
+        ambient = av;
+    } else if (bStable && ambientWindow.size() >= AMBIENT_CACHE_TIME && std::abs(av - cached) < AMBIENT_DEVIATION) {
+        ambient = cached;
+    } else {
+        return false;
+    }
 
-    /**
-     * The raw data is observed for the configured amount of time.
-     */
-    if (rawData.size() == AMBIENT_AV_TIME) {
-        double av = 1.0 * std::accumulate(rawData.begin(), rawData.end(), 0.0) / rawData.size();
-        double max = *std::max_element(rawData.begin(), rawData.end());
-        auto min = *std::min_element(rawData.begin(), rawData.end());
+    PLOG_VERBOSE << "min: " << ambientWindow.min() << " max: " << ambientWindow.max() << " av: " << av;
+    ambientVoltage = ambient;
+    conditioner->setCalibration(ambient, corrFactor);
+    ambientWindow.clear();
+    return true;
+}
 
-        /**
-         * If the pressure is stable for the configured amount of time, it is assumed to be
-         * the ambient pressure. The average value is stored.
-         */
-        PLOG_VERBOSE << "min: " << min << " max: " << max << " av: " << av;
-        if (std::abs(av - max) < AMBIENT_DEVIATION) {
-            ambientVoltage = av;
-            bAmbientValid = true;
+/**
+ * Writes a snapshot of the instrumentation to the log, one line per stage with the percentiles in us.
+ */
+void Processing::logStats() {
+    static const char *const stageNames[(int) LatencyStage::Count] = {
+            "filtered", "detected", "delivered", "detection steady", "detection peak"};
+
+    const ProcessingStats stats = getStats();
+    for (int i = 0; i < (int) LatencyStage::Count; i++) {
+        const LatencySnapshot &snap = stats.latency[i];
+        PLOG_INFO << "Latency " << stageNames[i] << ": n=" << snap.count << " p50=" << snap.p50 / 1000.0
+                  << " p99=" << snap.p99 / 1000.0 << " p999=" << snap.p999 / 1000.0 << " max=" << snap.max / 1000.0
+                  << " us";
+    }
+    PLOG_INFO << "Source backlog: p50=" << stats.backlog.p50 << " p99=" << stats.backlog.p99 << " max="
+              << stats.backlog.max << " scans, " << stats.overruns << " overruns";
+}
+
+/**
+ * Converts a duration to ns.
+ * @param duration The duration.
+ * @return The duration in ns.
+ */
+int64_t Processing::toNs(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+/**
+ * Constructor of the completion thread.
+ * @param processing The processing whose observers are notified.
+ */
+Processing::Completion::Completion(Processing &processing) :
+        processing(processing),
+        jobs(PROC_COMPLETION_SIZE),
+        pending(0) {
+}
+
+/**
+ * Hands a finished measurement to the completion thread, only called by the acquisition thread.
+ * @param results The results of the measurement.
+ * @return False if the queue is full and the measurement was not posted.
+ */
+bool Processing::Completion::post(const ArchiveResults &results) {
+    pending++;
+    if (!jobs.push(results)) {
+        pending--;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(jobMutex);
+    jobCond.notify_one();
+    return true;
+}
+
+/**
+ * Checks if all posted measurements are completed.
+ * @return True if the observers were notified of all posted measurements.
+ */
+bool Processing::Completion::isIdle() {
+    return pending == 0;
+}
+
+/**
+ * Stops the completion thread once it completed the posted measurements.
+ */
+void Processing::Completion::stop() {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    requestStop();
+    jobCond.notify_all();
+}
+
+/**
+ * The main running function of the completion thread, notifies the observers of the finished measurements.
+ */
+void Processing::Completion::run() {
+    ArchiveResults results{};
+    while (true) {
+        if (jobs.pop(results)) {
+            processing.notifyResults(results.map, results.sbp, results.dbp);
+            processing.notifySwitchScreen(Screen::resultScreen);
+            pending--;
+        } else if (stopRequested()) {
+            break;
         } else {
-            rawData.clear();
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobCond.wait(lock, [this] { return stopRequested() || jobs.size() > 0; });
         }
     }
-
-    return bAmbientValid;
-}
\ No newline at end of file
+}
@@ -11,35 +11,97 @@
 #ifndef OBP_PROCESSING_H
 #define OBP_PROCESSING_H
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
-#include <comedilib.h>
-#include <Iir.h>
+#include <span>
 
 #include "common.h"
 #include "CppThread.h"
 #include "Datarecord.h"
 #include "ISubject.h"
-#include "ComediHandler.h"
+#include "LatencyHistogram.h"
+#include "ISampleSource.h"
 #include "OBPDetection.h"
+#include "SignalConditioner.h"
+#include "SlidingWindow.h"
+#include "SPSCQueue.h"
 
 /**
  * Class dependant configuration values:
  */
 #define MAX_PUMPUP 250  //!< Maximal settable pump-up value.
-#define IIRORDER 4      //!< IIR filter order.
+#define PROC_BLOCK_SIZE 1000    //!< Maximal number of samples converted and filtered at once.
+#define PROC_WAIT_TIMEOUT 100   //!< Maximal time in ms to wait for new samples before checking if the thread stops.
+#define PROC_LATENCY_STRIDE 8   //!< Only every Nth sample's detection without a new peak is timed.
+#define PROC_COMPLETION_SIZE 4  //!< Finished measurements that can wait for the completion thread.
+
+//! The stages of the processing with a latency histogram, all durations in ns.
+enum class LatencyStage {
+    Filtered,           //!< From reading a block from the source until it is converted and filtered.
+    Detected,           //!< From reading a block until all its samples went through the state machine.
+    Delivered,          //!< From reading the newest block until the GUI drew it.
+    DetectionSteady,    //!< Duration of OBPDetection::processSample for a timed sample without a new peak.
+    DetectionPeak,      //!< Duration of the peak processing in OBPDetection::processSample, for every new peak.
+    Count,              //!< The number of stages.
+};
+
+//! A snapshot of the instrumentation of a Processing instance.
+struct ProcessingStats {
+    LatencySnapshot latency[(int) LatencyStage::Count];    //!< The latencies of the stages in ns.
+    LatencySnapshot backlog;                                //!< The scans waiting in the source at every read.
+    uint64_t overruns = 0;                                  //!< The number of overruns of the source.
+};
 
 //! The Processing class handles the data acquisition and processing.
 /*!
  * The processing class inherits from the CppThread class and the ISubject class. CppThread is a wrapper to the
  * std::thread class that was written by Bernd Porr to avoid static methods and makes the inheriting class a runnable
- * thread. Processing has an instance of ComediHandler to acquire and two IIR filter instances to pre-process the data.
- * The raw, unfiltered data is stored in a vector that can be handed to the Datarecord instance to save it as a file.
+ * thread. Processing reads the data from an ISampleSource and has a SignalConditioner to pre-process it.
+ * The raw, unfiltered data is streamed to the Datarecord instance, which writes it to a file in its own thread.
  * The filtered data is sent to the observer(s) to display and passed to the OPDetection instance that performs the
  * algorithm. Data acquisition and filtering are happening whenever the thread is running, the state machine
  * decides when data is passed to the OBPDetection or stored to a file.
+ *
+ * The sample source is handed to the constructor. In the application, it is the ComediHandler that acquires the data
+ * from the hardware. Processing itself does not depend on the hardware, Qt or the GUI, so it can also process a
+ * recording or generated data, e.g. to test or profile it.
+ *
+ * The samples are read from the source in blocks. Each block is converted to mmHg and filtered as a whole by the
+ * SignalConditioner before the state machine handles the samples one by one.
+ *
+ * On a loaded host, the acquisition thread can be given a real-time priority, be pinned to CPUs and lock the memory
+ * of the process with setThreadAttributes(), so it is not preempted long enough for the acquisition buffer to
+ * overrun. If the privileges for this are missing, a warning is logged and the thread runs with what could be set.
+ *
+ * The processing is always instrumented: the time a block was read from the source is compared to the time it was
+ * filtered, went through the state machine and was drawn by the GUI. The detection of every PROC_LATENCY_STRIDE-th
+ * sample without a new peak is timed, and the processing of every new peak. The durations are recorded in lock-free
+ * histograms, together with the backlog of the source at every read. With worker threads, the read time travels with
+ * the samples through the queue of the channel, so the latencies include the time the samples waited for a worker.
+ * getStats() takes a snapshot from any thread, and setStatsLogInterval() periodically writes it to the log.
+ *
+ * At startup, the ambient pressure is calibrated: the mean, minimum and maximum of the latest AMBIENT_AV_TIME raw
+ * samples are kept in a sliding window, and the first window in which the pressure is stable gives the ambient
+ * voltage. If a recently calibrated ambient voltage is set with setCachedAmbient(), it is used as soon as the
+ * pressure is stable at it for AMBIENT_CACHE_TIME samples.
+ *
+ * When the cuff is empty, the finished measurement is handed to a completion thread, which notifies the observers of
+ * the results and switches to the result screen. The acquisition thread only finalises the results and queues them,
+ * together with the request to keep the recording, and goes straight back to acquiring. The Results state is left once
+ * the completion thread is done, so the result screen is never shown after the start screen of the next measurement.
+ * Since the completion thread notifies the observers, shutdown() has to be called before they are destroyed.
+ *
+ * A Processing instance handles one channel of the source, channel 0 unless another one is given. If the source
+ * acquires several channels, e.g. for several cuffs, the samples of the channel are taken out of the interleaved
+ * blocks. To serve all channels from one acquisition thread, the instances are not started themselves but driven by
+ * a MultiChannelProcessing thread, which reads each block once and passes it to all of them with processScans().
  */
 class Processing : public CppThread, public ISubject {
 
+public:
+    //! The states of the measurement, the values are published in the shared memory (SharedMemoryFormat.h).
     enum class ProcState {
         Config,     //!< Configure the ambient pressure.
         Idle,       //!< Waiting for user to start the measurement.
@@ -49,8 +111,7 @@ class Processing : public CppThread, public ISubject {
         Results,    //!< Display the results.
     };
 
-public:
-    explicit Processing(double fcLP = 10.0, double fcHP = 0.5);
+    explicit Processing(ISampleSource *source, int channel = 0, double fcLP = 10.0, double fcHP = 0.5);
     ~Processing() override;
 
     void setRatioSBP(double val);
@@ -61,38 +122,79 @@ public:
     int getMinNbrPeaks();
     void setPumpUpValue(int val);
     int getPumpUpValue();
+    void setRecording(bool bRecord);
+    bool getRecording();
+    void setArchive(const std::string &fileName);
+    void setStreaming(bool bStream);
+    bool getStreaming();
+    void setThreadAttributes(const ThreadAttributes &attributes);
+    void setStatsLogInterval(int seconds);
+    ProcessingStats getStats();
+    void resetStats();
+    void recordDelivery();
     double getSamplingRate();
+    void setCachedAmbient(double voltage);
+    double getAmbientVoltage();
+    int getChannel();
+    ProcState getState();
 
     void resetConfigValues();
     void startMeasurement();
     void stopMeasurement();
     void stopThread();
+    void shutdown();
+
+    void processScans(std::span<const double> scans, int nChannels,
+                      std::chrono::steady_clock::time_point readTime = std::chrono::steady_clock::now());
 
 private:
-    void run() override;
-    void processSample(double newSample);
-    [[nodiscard]] double getmmHgValue(double voltageValue) const;
-    bool checkAmbient();
+    friend class MultiChannelProcessing;        //!< Marks the channels as running while it drives them.
+
+    //! A thread that notifies the observers of finished measurements.
+    class Completion : public CppThread {
+    public:
+        explicit Completion(Processing &processing);
 
-    static QString getFilename();
+        bool post(const ArchiveResults &results);
+        bool isIdle();
+        void stop();
 
-    std::vector<double> rawData;                 //!< stores the acquired raw data
+    private:
+        void run() override;
 
-    Iir::Butterworth::LowPass<IIRORDER> *iirLP;  //!< Low-pass filter instance
-    Iir::Butterworth::HighPass<IIRORDER> *iirHP; //!< High-pass filter instance
+        Processing &processing;             //!< The processing with the observers.
+        SPSCQueue<ArchiveResults> jobs;     //!< The results of the finished measurements.
+        std::atomic<unsigned> pending;      //!< Posted measurements that are not completed yet.
+        std::mutex jobMutex;                //!< Protects the wait for jobs.
+        std::condition_variable jobCond;    //!< Signals the thread that a job was posted or that it stops.
+    };
+
+    void run() override;
+    void processBlock(std::span<const double> samples);
+    void filterBlock(std::span<const double> samples);
+    void processSample(double newSample, double ymmHg, double yLP, double yHP);
+    void storeSample(double newSample);
+    bool checkAmbient(double newSample);
+    void logStats();
+    static int64_t toNs(std::chrono::steady_clock::duration duration);
+
+    size_t nStored;                              //!< The number of samples stored in the running measurement
+    std::vector<double> channelBlock;            //!< The samples of this channel taken out of interleaved scans
+
+    SignalConditioner *conditioner;              //!< Converts and filters the acquired data
+    std::vector<double> ymmHgBlock;              //!< The current block converted to mmHg
+    std::vector<double> yLPBlock;                //!< The current block after low-pass filtering
+    std::vector<double> yHPBlock;                //!< The current block after high-pass filtering
 
     Datarecord *record;                         //!< Datarecord instance to store data
-    ComediHandler *comedi;                      //!< ComediHandler instance to acquire data
+    Completion *completion;                     //!< Completes finished measurements in its own thread
+    ISampleSource *source;                      //!< The source of the data, not owned
+    const int channel;                          //!< The channel of the source that is processed
     OBPDetection *obpDetect;                    //!< LOBPDetection instance that implements the algorithm
     std::atomic<bool> bRunning;                 //!< process is running and displaying data on screen.
     std::atomic<bool> bMeasuring;               //!< Boolean to indicate an ongoing measurement.
-    ProcState currentState;                     //!< Stores the state of the application
-
-    /**
-     * Important data acquisition values:
-     */
-    const double kPa_per_mmHg = 0.133322;       //!< Value of kPa per 1 mmHg, from literature
-    const double kPa_per_V = 50;                //!< Value of kPa per 1 V, from pressure sensor data sheet.
+    std::atomic<bool> bStreaming;               //!< Long measurements, the samples are only streamed to the recording.
+    std::atomic<ProcState> currentState;        //!< Stores the state of the application
 
     /**
      * User set configuration values:
@@ -104,7 +206,22 @@ private:
      * Program set configuation values.
      */
     std::atomic<double> sampling_rate;          //!< The sampling rate of the data acquisition
-    double ambientVoltage;                      //!< The voltage at ambient pressure, needed for calculations.
+    std::atomic<double> ambientVoltage;         //!< The voltage at ambient pressure, needed for calculations.
+    std::atomic<double> cachedAmbient;          //!< A recently calibrated ambient voltage, NAN if there is none.
+    SlidingWindow ambientWindow;                //!< The latest raw samples while calibrating the ambient pressure.
+    double cutoffLP;                            //!< The cutoff frequency of the low-pass filter.
+    double cutoffHP;                            //!< The cutoff frequency of the high-pass filter.
+
+    /**
+     * Instrumentation:
+     */
+    LatencyHistogram latency[(int) LatencyStage::Count];    //!< The latencies of the stages in ns.
+    LatencyHistogram backlog;                               //!< The scans waiting in the source at every read.
+    std::chrono::steady_clock::time_point blockReadTime;    //!< The time the current block was read.
+    std::atomic<int64_t> lastReadNs;                        //!< The time the newest processed block was read.
+    std::atomic<int> statsLogInterval;                      //!< The time in s between two logs of the stats.
+    std::chrono::steady_clock::time_point lastStatsLog;     //!< The time the stats were last logged.
+    unsigned detectionCount;                                //!< The samples passed to the detection, to time some.
 
 };
 
@@ -0,0 +1,120 @@
+/**
+ * @file        Profiler.h
+ * @brief       The header file of the profiling helpers.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines and implements the ProfileScope class and the profiling macros, and contains their general description.
+ *
+ * The stages of the processing pipeline are marked with OBP_PROFILE_SCOPE. Unless OBP_PROFILE is defined, the macros
+ * are empty and the application is not changed at all. The benchmark target defines OBP_PROFILE: every marked scope
+ * then measures its duration, counts the samples it processed and the allocations made by its thread, and adds them
+ * to the statistics of its stage. The allocations are counted by the benchmark, which replaces the global operator
+ * new and increments profileAllocations.
+ */
+#ifndef OBP_PROFILER_H
+#define OBP_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+//! The stages of the pipeline that can be profiled.
+enum class ProfileStage
+{
+    ProcessBlock,       //!< Processing a block of acquired samples, including everything below.
+    Conditioning,       //!< Converting and filtering a block.
+    DetectionSteady,    //!< OBPDetection::processSample without a new peak.
+    DetectionPeak,      //!< OBPDetection::processSample with a new peak.
+    CheckMaxima,        //!< Checking for a new maximum.
+    FindMinima,         //!< Finding the minimum between the last two maxima.
+    FindOMWE,           //!< Extending the OMWE.
+    FindMAP,            //!< Calculating the results.
+    PlotDecimation,     //!< Adding samples to the decimated plot data.
+    Count,              //!< The number of stages.
+};
+
+#define PROFILE_BUCKETS 64  //!< Number of power of two buckets in the duration histogram of a stage.
+
+//! The statistics of one stage, updated by all threads.
+struct ProfileStats
+{
+    std::atomic<uint64_t> calls;                        //!< The number of calls.
+    std::atomic<uint64_t> samples;                      //!< The number of processed samples.
+    std::atomic<uint64_t> totalNs;                      //!< The total duration in ns.
+    std::atomic<uint64_t> maxNs;                        //!< The longest call in ns.
+    std::atomic<uint64_t> allocations;                  //!< The number of allocations during the calls.
+    std::atomic<uint64_t> histogram[PROFILE_BUCKETS];   //!< Calls per duration, bucket i holds [2^i, 2^(i+1)) ns.
+};
+
+inline ProfileStats profileStats[(int) ProfileStage::Count]{};  //!< The statistics of every stage.
+inline thread_local uint64_t profileAllocations = 0;            //!< The allocations made by the current thread.
+
+//! The ProfileScope class measures one call of a stage, from its construction to its destruction.
+class ProfileScope
+{
+public:
+    /**
+     * Starts measuring a call.
+     * @param stage The stage of the call.
+     * @param samples The number of samples processed by the call.
+     */
+    explicit ProfileScope(ProfileStage stage, uint64_t samples = 1) :
+            stage(stage),
+            samples(samples),
+            allocations(profileAllocations),
+            start(std::chrono::steady_clock::now())
+    {
+    }
+
+    /**
+     * Changes the stage of the call, if it is only known during the call.
+     * @param newStage The stage of the call.
+     */
+    void setStage(ProfileStage newStage)
+    {
+        stage = newStage;
+    }
+
+    /**
+     * Finishes measuring the call and adds it to the statistics of its stage.
+     */
+    ~ProfileScope()
+    {
+        const auto ns = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        ProfileStats &stats = profileStats[(int) stage];
+        stats.calls.fetch_add(1, std::memory_order_relaxed);
+        stats.samples.fetch_add(samples, std::memory_order_relaxed);
+        stats.totalNs.fetch_add(ns, std::memory_order_relaxed);
+        stats.allocations.fetch_add(profileAllocations - allocations, std::memory_order_relaxed);
+        uint64_t max = stats.maxNs.load(std::memory_order_relaxed);
+        while (ns > max && !stats.maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        {
+        }
+        int bucket = 0;
+        while (bucket < PROFILE_BUCKETS - 1 && (ns >> (bucket + 1)) != 0)
+        {
+            bucket++;
+        }
+        stats.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    ProfileStage stage;                                 //!< The stage of the call.
+    uint64_t samples;                                   //!< The number of samples processed by the call.
+    uint64_t allocations;                               //!< The allocations of the thread when the call started.
+    std::chrono::steady_clock::time_point start;        //!< The time the call started.
+};
+
+#ifdef OBP_PROFILE
+#define OBP_PROFILE_SCOPE(name, ...) ProfileScope name(__VA_ARGS__) //!< Measures the rest of the scope as a stage.
+#define OBP_PROFILE_STAGE(name, stage) name.setStage(stage)         //!< Changes the stage of a measured scope.
+#else
+#define OBP_PROFILE_SCOPE(name, ...)
+#define OBP_PROFILE_STAGE(name, stage)
+#endif
+
+#endif //OBP_PROFILER_H
@@ -0,0 +1,282 @@
+/**
+ * @file        RecordFormat.cpp
+ * @brief       The implementation of the binary recording format functions.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "common.h"
+#include "RecordFormat.h"
+
+/**
+ * Creates a header for a new recording.
+ * @param samplingRate The sampling rate in Hz.
+ * @param ambientVoltage The voltage at ambient pressure.
+ * @param corrFactor The correction factor of the voltage divider.
+ * @param fcLP The cutoff frequency of the low-pass filter in Hz.
+ * @param fcHP The cutoff frequency of the high-pass filter in Hz.
+ * @param filterOrder The order of the IIR filters.
+ * @return The header, with 0 samples.
+ */
+RecordHeader makeRecordHeader(double samplingRate, double ambientVoltage, double corrFactor,
+                              double fcLP, double fcHP, int filterOrder) {
+    RecordHeader header{};
+    std::strncpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+    header.version = RECORD_VERSION;
+    header.headerSize = sizeof(RecordHeader);
+    header.nSamples = 0;
+    header.samplingRate = samplingRate;
+    header.ambientVoltage = ambientVoltage;
+    header.corrFactor = corrFactor;
+    header.fcLP = fcLP;
+    header.fcHP = fcHP;
+    header.filterOrder = filterOrder;
+    return header;
+}
+
+/**
+ * Checks if a header was written by a compatible writer.
+ * @param header The header to check.
+ * @return True if the header can be read.
+ */
+bool isValidRecordHeader(const RecordHeader &header) {
+    return std::strncmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) == 0 &&
+           header.version <= RECORD_VERSION &&
+           header.headerSize >= sizeof(RecordHeader);
+}
+
+/**
+ * Converts a recorded voltage sample to mmHg, the same way as the application does during a measurement.
+ * @param header The header of the recording.
+ * @param voltage The voltage sample.
+ * @return The pressure in mmHg.
+ */
+double recordToMmHg(const RecordHeader &header, double voltage) {
+    return voltageToMmHg(voltage, header.ambientVoltage, header.corrFactor);
+}
+
+/**
+ * Reads a binary recording into memory.
+ *
+ * If the recording was not finished, the number of samples in the header is 0 and all complete samples in the file
+ * are read.
+ * @param fileName The name of the recording file.
+ * @param header The header read from the file.
+ * @param samples The samples read from the file, in voltage.
+ * @return True if the file could be read.
+ */
+bool readRecord(const std::string &fileName, RecordHeader &header, std::vector<double> &samples) {
+    RecordReader record;
+    if (!record.open(fileName)) {
+        return false;
+    }
+    header = record.getHeader();
+    samples.clear();
+    samples.reserve(record.getNumSamples());
+    while (samples.size() < record.getNumSamples()) {
+        const std::span<const double> block = record.read(samples.size());
+        if (block.empty()) {
+            return false;
+        }
+        samples.insert(samples.end(), block.begin(), block.end());
+    }
+    return true;
+}
+
+/**
+ * Reads the samples of a text recording into memory, the second value of every line.
+ * @param fileName The name of the text file.
+ * @param samples The samples read from the file.
+ * @return True if the file could be read and contains samples.
+ */
+bool readTextRecord(const std::string &fileName, std::vector<double> &samples) {
+    FILE *file = std::fopen(fileName.c_str(), "rb");
+    if (!file) {
+        PLOG_ERROR << "Could not open " << fileName;
+        return false;
+    }
+    std::fseek(file, 0, SEEK_END);
+    const long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    std::string text(size > 0 ? size : 0, '\0');
+    const bool bRead = std::fread(text.data(), 1, text.size(), file) == text.size();
+    std::fclose(file);
+    if (!bRead) {
+        PLOG_ERROR << "Could not read " << fileName;
+        return false;
+    }
+
+    /**
+     * The text is parsed line by line, the first value is the time and the second value the sample.
+     */
+    samples.clear();
+    const char *pos = text.c_str();
+    while (*pos) {
+        char *end;
+        std::strtod(pos, &end);
+        if (end != pos) {
+            pos = end;
+            const double value = std::strtod(pos, &end);
+            if (end != pos) {
+                samples.push_back(value);
+                pos = end;
+            }
+        }
+        while (*pos && *pos != '\n') {
+            pos++;
+        }
+        if (*pos) {
+            pos++;
+        }
+    }
+
+    if (samples.empty()) {
+        PLOG_ERROR << "No samples in " << fileName;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Writes samples in the text format: one line per sample with the time in s and the pressure in mmHg, separated by
+ * a tab.
+ * @param file The text file.
+ * @param header The header of the recording.
+ * @param samples The voltage samples.
+ * @param nsample The number of samples written before, counts the written ones.
+ */
+static void writeTextLines(FILE *file, const RecordHeader &header, std::span<const double> samples, long &nsample) {
+    for (double sample : samples) {
+        nsample++;
+        std::fprintf(file, "%g\t%g\n", (float) nsample / header.samplingRate, recordToMmHg(header, sample));
+    }
+}
+
+/**
+ * Exports a recording in the text format: one line per sample with the time in s and the pressure in mmHg,
+ * separated by a tab.
+ * @param header The header of the recording.
+ * @param samples The voltage samples of the recording.
+ * @param fileName The name of the text file.
+ * @return True if the file was written.
+ */
+bool exportRecordText(const RecordHeader &header, std::span<const double> samples, const std::string &fileName) {
+    FILE *file = std::fopen(fileName.c_str(), "w");
+    if (!file) {
+        PLOG_ERROR << "Could not open " << fileName;
+        return false;
+    }
+    long nsample = 0;
+    writeTextLines(file, header, samples, nsample);
+    return std::fclose(file) == 0;
+}
+
+/**
+ * Exports a binary recording in the text format, one block at a time.
+ * @param record The open recording.
+ * @param fileName The name of the text file.
+ * @return True if the recording was read and the file was written.
+ */
+bool exportRecordText(RecordReader &record, const std::string &fileName) {
+    FILE *file = std::fopen(fileName.c_str(), "w");
+    if (!file) {
+        PLOG_ERROR << "Could not open " << fileName;
+        return false;
+    }
+    long nsample = 0;
+    bool bOk = true;
+    while (bOk && (uint64_t) nsample < record.getNumSamples()) {
+        const std::span<const double> block = record.read(nsample);
+        bOk = !block.empty();
+        writeTextLines(file, record.getHeader(), block, nsample);
+    }
+    return std::fclose(file) == 0 && bOk;
+}
+
+/**
+ * Destructor of the RecordReader, closes the recording.
+ */
+RecordReader::~RecordReader() {
+    close();
+}
+
+/**
+ * Opens a binary recording and reads its header.
+ * @param fileName The name of the recording file.
+ * @return True if the recording is valid.
+ */
+bool RecordReader::open(const std::string &fileName) {
+    close();
+    file = std::fopen(fileName.c_str(), "rb");
+    if (!file) {
+        PLOG_ERROR << "Could not open recording " << fileName;
+        return false;
+    }
+
+    bool bOk = std::fread(&header, sizeof(header), 1, file) == 1 && isValidRecordHeader(header) &&
+               std::fseek(file, 0, SEEK_END) == 0;
+    if (bOk) {
+        long dataBytes = std::ftell(file) - (long) header.headerSize;
+        nSamples = (dataBytes > 0) ? dataBytes / sizeof(double) : 0;
+        if (header.nSamples != 0 && header.nSamples < nSamples) {
+            nSamples = header.nSamples;
+        }
+    }
+    if (!bOk) {
+        PLOG_ERROR << "Could not read recording " << fileName;
+        close();
+    }
+    return bOk;
+}
+
+/**
+ * Closes the recording, if one is open.
+ */
+void RecordReader::close() {
+    if (file) {
+        std::fclose(file);
+        file = nullptr;
+    }
+    header = RecordHeader{};
+    nSamples = 0;
+}
+
+/**
+ * Returns the header of the open recording.
+ * @return The header.
+ */
+const RecordHeader &RecordReader::getHeader() const {
+    return header;
+}
+
+/**
+ * Returns the number of samples of the open recording.
+ * @return The number of samples, 0 if no recording is open.
+ */
+uint64_t RecordReader::getNumSamples() const {
+    return nSamples;
+}
+
+/**
+ * Reads a block of samples, the span is valid up to the next read.
+ * @param first The first sample of the block.
+ * @return Up to RECORD_READ_BLOCK samples, empty at the end of the recording or if it could not be read.
+ */
+std::span<const double> RecordReader::read(uint64_t first) {
+    if (!file || first >= nSamples) {
+        return {};
+    }
+    const size_t n = std::min<uint64_t>(RECORD_READ_BLOCK, nSamples - first);
+    if (std::fseek(file, (long) (header.headerSize + first * sizeof(double)), SEEK_SET) != 0 ||
+        std::fread(block, sizeof(double), n, file) != n) {
+        PLOG_ERROR << "Could not read recording at sample " << first;
+        return {};
+    }
+    return {block, n};
+}
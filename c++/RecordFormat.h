@@ -0,0 +1,84 @@
+/**
+ * @file        RecordFormat.h
+ * @brief       The header file of the binary recording format.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the RecordHeader structure and the functions to read and convert binary recordings.
+ *
+ * A binary recording starts with a RecordHeader, followed by the raw voltage samples of the measurement as
+ * consecutive doubles in the byte order of the recording machine. The header contains everything needed to
+ * convert the samples to mmHg and to filter them like the application did during the measurement.
+ *
+ * Text recordings contain one sample per line, after the time in the first column. Further columns are ignored.
+ */
+#ifndef OBP_RECORDFORMAT_H
+#define OBP_RECORDFORMAT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <vector>
+
+#define RECORD_MAGIC        "OBPREC"    //!< Identifies a binary recording file, padded with zeros to 8 bytes.
+#define RECORD_VERSION      1           //!< The current version of the binary recording format.
+#define RECORD_EXTENSION    ".obp"      //!< File extension of binary recordings.
+#define RECORD_READ_BLOCK   4096        //!< Number of samples a RecordReader reads at once.
+
+//! The header at the start of every binary recording.
+struct RecordHeader {
+    char magic[8];              //!< RECORD_MAGIC, padded with zeros.
+    uint32_t version;           //!< RECORD_VERSION of the writer.
+    uint32_t headerSize;        //!< The size of the header in bytes, the samples start after it.
+    uint64_t nSamples;          //!< The number of samples, 0 if the recording was not finished.
+    double samplingRate;        //!< The sampling rate in Hz.
+    double ambientVoltage;      //!< The voltage at ambient pressure.
+    double corrFactor;          //!< The correction factor of the voltage divider.
+    double fcLP;                //!< The cutoff frequency of the low-pass filter in Hz.
+    double fcHP;                //!< The cutoff frequency of the high-pass filter in Hz.
+    uint32_t filterOrder;       //!< The order of the IIR filters.
+    uint32_t reserved;          //!< Unused, 0.
+};
+
+RecordHeader makeRecordHeader(double samplingRate, double ambientVoltage, double corrFactor,
+                              double fcLP, double fcHP, int filterOrder);
+bool isValidRecordHeader(const RecordHeader &header);
+double recordToMmHg(const RecordHeader &header, double voltage);
+bool readRecord(const std::string &fileName, RecordHeader &header, std::vector<double> &samples);
+bool readTextRecord(const std::string &fileName, std::vector<double> &samples);
+bool exportRecordText(const RecordHeader &header, std::span<const double> samples, const std::string &fileName);
+
+//! The RecordReader class reads a binary recording block by block.
+/*!
+ * Only one block of samples is in memory at a time, so a recording of any length can be converted without loading
+ * it. The header is read and checked when the recording is opened. If the recording was not finished, all complete
+ * samples in the file are read.
+ */
+class RecordReader {
+
+public:
+    RecordReader() = default;
+    ~RecordReader();
+    RecordReader(const RecordReader &) = delete;
+    RecordReader &operator=(const RecordReader &) = delete;
+
+    bool open(const std::string &fileName);
+    void close();
+
+    const RecordHeader &getHeader() const;
+    uint64_t getNumSamples() const;
+    std::span<const double> read(uint64_t first);
+
+private:
+    std::FILE *file = nullptr;          //!< The open recording, nullptr if there is none.
+    RecordHeader header{};              //!< The header of the open recording.
+    uint64_t nSamples = 0;              //!< The number of samples of the open recording.
+    double block[RECORD_READ_BLOCK];    //!< The samples of the last block read.
+};
+
+bool exportRecordText(RecordReader &record, const std::string &fileName);
+
+#endif //OBP_RECORDFORMAT_H
@@ -0,0 +1,414 @@
+/**
+ * @file        Replay.cpp
+ * @brief       The implementation of the ReplaySession and ReplayEngine classes.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+#include <algorithm>
+#include <chrono>
+
+#include "Replay.h"
+#include "RecordFormat.h"
+#include "SimdKernels.h"
+
+/**
+ * Checks if a file is a binary recording.
+ * @param fileName The name of the file.
+ * @return True if it has the RECORD_EXTENSION.
+ */
+static bool isRecordFile(const std::string &fileName) {
+    const std::string extension = RECORD_EXTENSION;
+    return fileName.size() > extension.size() &&
+           fileName.compare(fileName.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+/**
+ * Constructor of a ReplaySession.
+ * @param config The configuration of the replay, has to outlive the session.
+ */
+ReplaySession::ReplaySession(const ReplayConfig &config) :
+        config(config),
+        ymmHgBlock(REPLAY_BLOCK_SIZE),
+        yLPBlock(REPLAY_BLOCK_SIZE),
+        yHPBlock(REPLAY_BLOCK_SIZE),
+        bMmHg(false),
+        lastSamplingRate(0.0) {
+}
+
+/**
+ * Replays a recorded file.
+ * @param fileName The name of the file, binary if it has the RECORD_EXTENSION, text otherwise.
+ * @return The result of the replay.
+ */
+ReplayResult ReplaySession::replay(const std::string &fileName) {
+    Progress progress;
+    ReplayResult &result = progress.result;
+    if (!load(fileName)) {
+        return result;
+    }
+    result.nSamples = samples.size();
+    result.status = ReplayStatus::NoDeflation;
+    const auto start = std::chrono::steady_clock::now();
+    obpDetect->reset();
+
+    /**
+     * The samples are processed in blocks, like the acquired ones are in Processing.
+     */
+    for (size_t i = 0; i < samples.size() && !progress.bFinished; i += REPLAY_BLOCK_SIZE) {
+        const auto block = std::span<const double>(samples).subspan(i, std::min<size_t>(REPLAY_BLOCK_SIZE,
+                                                                                          samples.size() - i));
+        if (bMmHg) {
+            std::copy(block.begin(), block.end(), ymmHgBlock.begin());
+            conditioner->filter(std::span<const double>(ymmHgBlock).first(block.size()), yLPBlock, yHPBlock);
+        } else {
+            conditioner->process(block, ymmHgBlock, yLPBlock, yHPBlock);
+        }
+        processBlock(*obpDetect, progress, ymmHgBlock.data(), yLPBlock.data(), yHPBlock.data(), block.size(), 1);
+        result.nProcessed = i + block.size();
+    }
+    result.processNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    finish(*obpDetect, result);
+    return result;
+}
+
+/**
+ * Replays the text files of a queue in CONDITIONER_LANES lanes, with the settings of the ReplayConfig.
+ *
+ * The blocks of the lanes are interleaved and converted and filtered at once, every lane is then passed to its own
+ * OBPDetection. When the replay of a file is done, its lane takes the next file from the queue at the start of the
+ * next block, so the lanes are busy until there are no files left. The time spent processing a block is divided among
+ * the files in it by their number of samples.
+ * @param queue The files to replay, gets the results.
+ */
+void ReplaySession::replayLanes(IReplayQueue &queue) {
+    setupLanes();
+    Lane lanes[CONDITIONER_LANES];
+    for (int l = 0; l < CONDITIONER_LANES; l++) {
+        lanes[l].bActive = startLane(l, lanes[l], queue);
+    }
+
+    while (std::any_of(lanes, lanes + CONDITIONER_LANES, [](const Lane &lane) { return lane.bActive; })) {
+        const auto start = std::chrono::steady_clock::now();
+        size_t nValid[CONDITIONER_LANES];
+        size_t n = 0;
+        auto &input = config.bMmHg ? laneMmHgBlock : laneBlock;
+        for (int l = 0; l < CONDITIONER_LANES; l++) {
+            const std::vector<double> &laneInput = laneSamples[l];
+            nValid[l] = lanes[l].bActive ? std::min<size_t>(REPLAY_BLOCK_SIZE, laneInput.size() - lanes[l].position)
+                                         : 0;
+            for (size_t j = 0; j < REPLAY_BLOCK_SIZE; j++) {
+                input[j * CONDITIONER_LANES + l] = j < nValid[l] ? laneInput[lanes[l].position + j] : 0.0;
+            }
+            n = std::max(n, nValid[l]);
+        }
+        const size_t nInterleaved = n * CONDITIONER_LANES;
+        if (config.bMmHg) {
+            laneConditioner->filter(std::span<const double>(laneMmHgBlock).first(nInterleaved), laneLPBlock,
+                                    laneHPBlock);
+        } else {
+            laneConditioner->process(std::span<const double>(laneBlock).first(nInterleaved), laneMmHgBlock,
+                                     laneLPBlock, laneHPBlock);
+        }
+
+        size_t nTotal = 0;
+        for (int l = 0; l < CONDITIONER_LANES; l++) {
+            if (lanes[l].bActive) {
+                processBlock(*laneDetect[l], lanes[l].progress, laneMmHgBlock.data() + l, laneLPBlock.data() + l,
+                             laneHPBlock.data() + l, nValid[l], CONDITIONER_LANES);
+                lanes[l].position += nValid[l];
+                lanes[l].progress.result.nProcessed = lanes[l].position;
+                nTotal += nValid[l];
+            }
+        }
+        const auto blockNs = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+        for (int l = 0; l < CONDITIONER_LANES; l++) {
+            Lane &lane = lanes[l];
+            if (!lane.bActive) {
+                continue;
+            }
+            ReplayResult &result = lane.progress.result;
+            result.processNs += nTotal > 0 ? (int64_t) (blockNs * nValid[l] / nTotal) : 0;
+            if (lane.progress.bFinished || lane.position >= laneSamples[l].size()) {
+                finish(*laneDetect[l], result);
+                queue.done(lane.id, result);
+                lane.bActive = startLane(l, lane, queue);
+            }
+        }
+    }
+}
+
+/**
+ * Loads the next file of the queue into a lane. Files that can not be read are returned to the queue right away.
+ * @param l The index of the lane.
+ * @param lane The lane.
+ * @param queue The files to replay.
+ * @return True if the lane has a file, false if there are none left.
+ */
+bool ReplaySession::startLane(int l, Lane &lane, IReplayQueue &queue) {
+    std::string fileName;
+    while (queue.next(fileName, lane.id)) {
+        lane.progress = Progress();
+        if (!readTextRecord(fileName, laneSamples[l])) {
+            queue.done(lane.id, lane.progress.result);
+            continue;
+        }
+        lane.position = 0;
+        lane.progress.result.nSamples = laneSamples[l].size();
+        lane.progress.result.status = ReplayStatus::NoDeflation;
+        laneConditioner->reset(l);
+        if (!config.bMmHg) {
+            laneConditioner->setCalibration(l, ambientVoltageOf(laneSamples[l]), config.corrFactor);
+        }
+        laneDetect[l]->reset();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Passes the filtered samples of a block to the OBPDetection, once the pressure exceeded the pump-up value and until
+ * the replay of the file is finished.
+ * @param detection The algorithm of the file.
+ * @param progress The progress of the replay of the file, updated.
+ * @param ymmHg The first sample of the block in mmHg.
+ * @param yLP The first low-pass filtered sample of the block.
+ * @param yHP The first high-pass filtered sample of the block.
+ * @param n The number of samples in the block.
+ * @param stride The distance between two samples of the file, more than 1 if the samples of lanes are interleaved.
+ */
+void ReplaySession::processBlock(OBPDetection &detection, Progress &progress, const double *ymmHg, const double *yLP,
+                                 const double *yHP, size_t n, size_t stride) const {
+    ReplayResult &result = progress.result;
+    for (size_t j = 0; j < n * stride && !progress.bFinished; j += stride) {
+        if (!progress.bDeflating) {
+            if (ymmHg[j] > config.pumpUpValue) {
+                detection.reset();
+                result.status = ReplayStatus::NotEnoughData;
+                progress.bDeflating = true;
+            }
+            continue;
+        }
+
+        if (detection.processSample(yLP[j], yHP[j]) && detection.getIsEnoughData() &&
+            result.status != ReplayStatus::Ok) {
+            result.status = ReplayStatus::Ok;
+            result.map = detection.getMAP();
+            result.sbp = detection.getSBP();
+            result.dbp = detection.getDBP();
+            result.hr = detection.getAverageHeartRate();
+        }
+        progress.bFinished = (result.status == ReplayStatus::Ok && detection.isSweepDone()) ||
+                             ymmHg[j] < REPLAY_MIN_PRESSURE;
+    }
+}
+
+/**
+ * Adds the results of the parameter sweep to the result of a file.
+ * @param detection The algorithm that replayed the file.
+ * @param result The result of the file.
+ */
+void ReplaySession::finish(const OBPDetection &detection, ReplayResult &result) {
+    const auto sweepResults = detection.getSweepResults();
+    result.sweep.assign(sweepResults.begin(), sweepResults.end());
+}
+
+/**
+ * Loads the samples of a file and prepares the conversion, the filters and the algorithm for it.
+ * @param fileName The name of the file.
+ * @return True if the file could be read.
+ */
+bool ReplaySession::load(const std::string &fileName) {
+    if (isRecordFile(fileName)) {
+        RecordHeader header;
+        if (!readRecord(fileName, header, samples)) {
+            return false;
+        }
+        bMmHg = false;
+        conditioner = std::make_unique<SignalConditioner>(header.samplingRate, header.fcLP, header.fcHP);
+        conditioner->setCalibration(header.ambientVoltage, header.corrFactor);
+        setupDetection(header.samplingRate);
+        return true;
+    }
+
+    if (!readTextRecord(fileName, samples)) {
+        return false;
+    }
+    bMmHg = config.bMmHg;
+    conditioner = std::make_unique<SignalConditioner>(config.samplingRate, config.fcLP, config.fcHP);
+    if (!bMmHg) {
+        conditioner->setCalibration(ambientVoltageOf(samples), config.corrFactor);
+    }
+    setupDetection(config.samplingRate);
+    return true;
+}
+
+/**
+ * Gets the ambient voltage of a text file.
+ *
+ * Without a configured ambient voltage, the start of the recording is assumed to be at ambient pressure.
+ * @param voltages The samples of the file.
+ * @return The ambient voltage.
+ */
+double ReplaySession::ambientVoltageOf(const std::vector<double> &voltages) const {
+    if (config.ambientVoltage != 0.0) {
+        return config.ambientVoltage;
+    }
+    const size_t n = std::min<size_t>(voltages.size(), AMBIENT_AV_TIME);
+    return meanOf(std::span<const double>(voltages).first(n));
+}
+
+/**
+ * Prepares the OBPDetection for a file. It is only created again if the sampling rate changed.
+ * @param samplingRate The sampling rate of the file.
+ */
+void ReplaySession::setupDetection(double samplingRate) {
+    if (!obpDetect || lastSamplingRate != samplingRate) {
+        obpDetect = createDetection(samplingRate);
+        lastSamplingRate = samplingRate;
+    }
+}
+
+/**
+ * Creates an OBPDetection with the settings of the configuration.
+ * @param samplingRate The sampling rate of the files it replays.
+ * @return The algorithm.
+ */
+std::unique_ptr<OBPDetection> ReplaySession::createDetection(double samplingRate) const {
+    auto detection = std::make_unique<OBPDetection>(samplingRate);
+    detection->resetConfigValues();
+    detection->setRatioSBP(config.ratioSBP);
+    detection->setRatioDBP(config.ratioDBP);
+    detection->setMinNbrPeaks(config.minNbrPeaks);
+    detection->setSweep(config.sweep);
+    return detection;
+}
+
+/**
+ * Prepares the conditioner, the algorithms and the buffers of the lanes the first time they are used. Text files all
+ * have the settings of the configuration, so they are kept from one replayLanes() to the next.
+ */
+void ReplaySession::setupLanes() {
+    if (laneConditioner) {
+        return;
+    }
+    laneConditioner = std::make_unique<LaneConditioner>(config.samplingRate, config.fcLP, config.fcHP);
+    for (auto &detection : laneDetect) {
+        detection = createDetection(config.samplingRate);
+    }
+    laneBlock.resize(REPLAY_BLOCK_SIZE * CONDITIONER_LANES);
+    laneMmHgBlock.resize(REPLAY_BLOCK_SIZE * CONDITIONER_LANES);
+    laneLPBlock.resize(REPLAY_BLOCK_SIZE * CONDITIONER_LANES);
+    laneHPBlock.resize(REPLAY_BLOCK_SIZE * CONDITIONER_LANES);
+}
+
+/**
+ * Constructor of the ReplayEngine.
+ * @param config The configuration of the replay.
+ */
+ReplayEngine::ReplayEngine(const ReplayConfig &config) :
+        config(config),
+        files(nullptr),
+        nextFile(0),
+        bLanes(false) {
+}
+
+/**
+ * Replays the files in parallel and waits until all of them are done.
+ * @param fileNames The files to replay.
+ * @param nThreads The number of worker threads, at least one is used.
+ * @return The result of every file, in the same order as the files.
+ */
+std::vector<ReplayResult> ReplayEngine::run(const std::vector<std::string> &fileNames, unsigned int nThreads) {
+    files = &fileNames;
+    results.assign(fileNames.size(), ReplayResult());
+    nextFile = 0;
+
+    nThreads = std::clamp<size_t>(nThreads, 1, std::max<size_t>(fileNames.size(), 1));
+    bLanes = fileNames.size() >= (size_t) nThreads * CONDITIONER_LANES;
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (unsigned int i = 0; i < nThreads; i++) {
+        workers.push_back(std::make_unique<Worker>(*this));
+        workers.back()->start();
+    }
+    for (auto &worker : workers) {
+        worker->join();
+    }
+
+    files = nullptr;
+    return std::move(results);
+}
+
+/**
+ * Constructor of a worker thread.
+ * @param engine The engine with the files and results.
+ */
+ReplayEngine::Worker::Worker(ReplayEngine &engine) :
+        engine(engine),
+        session(engine.config) {
+}
+
+/**
+ * The main running function of the worker thread, replays files until there are none left.
+ */
+void ReplayEngine::Worker::run() {
+    if (engine.bLanes) {
+        session.replayLanes(*this);
+        return;
+    }
+    for (size_t i = engine.nextFile++; i < engine.files->size(); i = engine.nextFile++) {
+        engine.results[i] = session.replay((*engine.files)[i]);
+    }
+}
+
+/**
+ * Gets the next text file for the lanes of the session. Binary recordings taken on the way are replayed right away,
+ * they have their own settings.
+ * @param fileName The name of the file.
+ * @param id The index of the file.
+ * @return False if there are no files left.
+ */
+bool ReplayEngine::Worker::next(std::string &fileName, size_t &id) {
+    for (size_t i = engine.nextFile++; i < engine.files->size(); i = engine.nextFile++) {
+        if (!isRecordFile((*engine.files)[i])) {
+            fileName = (*engine.files)[i];
+            id = i;
+            return true;
+        }
+        engine.results[i] = session.replay((*engine.files)[i]);
+    }
+    return false;
+}
+
+/**
+ * Stores the result of a file replayed in a lane.
+ * @param id The index of the file.
+ * @param result The result of the replay.
+ */
+void ReplayEngine::Worker::done(size_t id, ReplayResult &result) {
+    engine.results[id] = std::move(result);
+}
+
+/**
+ * Gets a short description of a replay status.
+ * @param status The status.
+ * @return The description.
+ */
+const char *toString(ReplayStatus status) {
+    switch (status) {
+        case ReplayStatus::Ok:
+            return "ok";
+        case ReplayStatus::ReadError:
+            return "read error";
+        case ReplayStatus::NoDeflation:
+            return "no deflation";
+        case ReplayStatus::NotEnoughData:
+            return "not enough data";
+    }
+    return "";
+}
@@ -0,0 +1,202 @@
+/**
+ * @file        Replay.h
+ * @brief       The header file of the ReplaySession and ReplayEngine classes.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the ReplaySession and ReplayEngine classes and contains the general class descriptions.
+ */
+#ifndef OBP_REPLAY_H
+#define OBP_REPLAY_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "CppThread.h"
+#include "OBPDetection.h"
+#include "SignalConditioner.h"
+
+/**
+ * Class dependant configuration values:
+ */
+#define REPLAY_BLOCK_SIZE       1000    //!< Number of samples converted and filtered at once.
+#define REPLAY_MIN_PRESSURE     20      //!< Pressure in mmHg below which a deflation is cancelled, as in Processing.
+
+//! The configuration of a replay, applies to all files.
+struct ReplayConfig {
+    double samplingRate = SAMPLING_RATE;        //!< Sampling rate of text files, binary files store their own.
+    double fcLP = 10.0;                         //!< Cutoff frequency of the low-pass filter for text files.
+    double fcHP = 0.5;                          //!< Cutoff frequency of the high-pass filter for text files.
+    bool bMmHg = false;                         //!< Text files contain mmHg instead of voltage.
+    double ambientVoltage = 0.0;                //!< Ambient voltage of text files, 0 to use the start of the file.
+    double corrFactor = 2.6;                    //!< Correction factor of the voltage divider for text files.
+    double pumpUpValue = PUMP_UP_VALUE_MIN;     //!< Pressure in mmHg that has to be exceeded to start deflating.
+    double ratioSBP = 0.0;                      //!< SBP ratio, 0 to keep the default of OBPDetection.
+    double ratioDBP = 0.0;                      //!< DBP ratio, 0 to keep the default of OBPDetection.
+    int minNbrPeaks = 0;                        //!< Minimal number of peaks, 0 to keep the default of OBPDetection.
+    std::vector<SweepParams> sweep;             //!< Settings of a parameter sweep, empty for no sweep.
+};
+
+//! The outcome of the replay of a single file.
+enum class ReplayStatus {
+    Ok,             //!< The blood pressure was found.
+    ReadError,      //!< The file could not be read.
+    NoDeflation,    //!< The pressure never exceeded the pump-up value.
+    NotEnoughData,  //!< The deflation ended before there was enough data.
+};
+
+//! The result of the replay of a single file.
+struct ReplayResult {
+    ReplayStatus status = ReplayStatus::ReadError;  //!< The outcome of the replay.
+    size_t nSamples = 0;                            //!< The number of samples in the file.
+    size_t nProcessed = 0;                          //!< The number of samples processed until the replay finished.
+    int64_t processNs = 0;                          //!< The time in ns spent processing them, without reading.
+    double map = 0.0;                               //!< The mean arterial pressure.
+    double sbp = 0.0;                               //!< The systolic blood pressure.
+    double dbp = 0.0;                               //!< The diastolic blood pressure.
+    double hr = 0.0;                                //!< The average heart rate.
+    std::vector<SweepResult> sweep;                 //!< The results of the parameter sweep, if there is one.
+};
+
+//! The interface of the files a ReplaySession replays in lanes.
+class IReplayQueue {
+
+public:
+    virtual ~IReplayQueue() = default;
+
+    /**
+     * Gets the next text file to replay.
+     * @param fileName The name of the file.
+     * @param id The identifier the result is returned with.
+     * @return False if there are no files left.
+     */
+    virtual bool next(std::string &fileName, size_t &id) = 0;
+
+    /**
+     * Receives the result of a file.
+     * @param id The identifier of the file.
+     * @param result The result of the replay, can be moved.
+     */
+    virtual void done(size_t id, ReplayResult &result) = 0;
+};
+
+//! The ReplaySession class runs the algorithm over recorded files, one after the other.
+/*!
+ * A recorded file is processed exactly like the Processing class processes the acquired samples: the voltage is
+ * converted to mmHg and filtered by a SignalConditioner, the samples are passed to the OBPDetection once the pressure
+ * exceeded the pump-up value and until there is enough data, or until the pressure falls too low.
+ *
+ * Binary recordings (RECORD_EXTENSION) contain everything needed to process them in their header. Text files contain
+ * a time and a value per line, the values are either voltages, like the data sets in the data folder, or already in
+ * mmHg, like text files exported by Datarecord. Their settings are taken from the ReplayConfig. Further columns in
+ * text files are ignored.
+ *
+ * If the configuration contains a parameter sweep, the samples are processed until all of its settings have enough
+ * data, the results of all settings are then returned together with the result of the configured setting.
+ *
+ * Text files all share the settings of the ReplayConfig, so CONDITIONER_LANES of them can be replayed together by
+ * replayLanes(): their blocks are converted and filtered at once by a LaneConditioner, each lane has its own
+ * OBPDetection and takes the next file from an IReplayQueue as soon as its file is done. The results are the same as
+ * replaying the files one by one.
+ *
+ * A session keeps its OBPDetection and the sample buffers from one file to the next, so the arena of the OBPDetection
+ * is only allocated once per thread. Sessions are independent of each other and can run in parallel.
+ */
+class ReplaySession {
+
+public:
+    explicit ReplaySession(const ReplayConfig &config);
+
+    ReplayResult replay(const std::string &fileName);
+    void replayLanes(IReplayQueue &queue);
+
+private:
+    //! The progress of the replay of a single file.
+    struct Progress {
+        ReplayResult result;        //!< The result so far.
+        bool bDeflating = false;    //!< The pressure exceeded the pump-up value.
+        bool bFinished = false;     //!< Nothing more is processed for the file.
+    };
+
+    //! The file replayed in a lane.
+    struct Lane {
+        Progress progress;          //!< The progress of the replay of the file.
+        size_t id = 0;              //!< The identifier of the file in the queue.
+        size_t position = 0;        //!< The index of the next sample of the file.
+        bool bActive = false;       //!< The lane has a file.
+    };
+
+    bool load(const std::string &fileName);
+    [[nodiscard]] double ambientVoltageOf(const std::vector<double> &voltages) const;
+    void setupDetection(double samplingRate);
+    [[nodiscard]] std::unique_ptr<OBPDetection> createDetection(double samplingRate) const;
+    void setupLanes();
+    bool startLane(int l, Lane &lane, IReplayQueue &queue);
+    void processBlock(OBPDetection &detection, Progress &progress, const double *ymmHg, const double *yLP,
+                      const double *yHP, size_t n, size_t stride) const;
+    static void finish(const OBPDetection &detection, ReplayResult &result);
+
+    const ReplayConfig &config;                 //!< The configuration of the replay.
+    std::unique_ptr<OBPDetection> obpDetect;    //!< The algorithm, recreated if the sampling rate changes.
+    std::unique_ptr<SignalConditioner> conditioner; //!< Converts and filters the samples of the current file.
+    std::vector<double> samples;                //!< The samples of the current file.
+    std::vector<double> ymmHgBlock;             //!< The current block converted to mmHg.
+    std::vector<double> yLPBlock;               //!< The current block after low-pass filtering.
+    std::vector<double> yHPBlock;               //!< The current block after high-pass filtering.
+    bool bMmHg;                                 //!< The samples of the current file are in mmHg.
+    double lastSamplingRate;                    //!< The sampling rate obpDetect was created with.
+    std::unique_ptr<LaneConditioner> laneConditioner;           //!< Converts and filters the lanes, created on use.
+    std::unique_ptr<OBPDetection> laneDetect[CONDITIONER_LANES]; //!< The algorithm of every lane.
+    std::vector<double> laneSamples[CONDITIONER_LANES];         //!< The samples of the file of every lane.
+    std::vector<double> laneBlock;              //!< The current block of all lanes, interleaved.
+    std::vector<double> laneMmHgBlock;          //!< The current block of all lanes converted to mmHg.
+    std::vector<double> laneLPBlock;            //!< The current block of all lanes after low-pass filtering.
+    std::vector<double> laneHPBlock;            //!< The current block of all lanes after high-pass filtering.
+};
+
+//! The ReplayEngine class replays many recorded files in parallel.
+/*!
+ * The files are distributed over a number of worker threads, each with its own ReplaySession. Every worker takes the
+ * next file that is not taken yet, so long files do not hold up the others. If there are enough files to keep all
+ * workers busy with CONDITIONER_LANES files each, the workers replay the text files in lanes, binary recordings are
+ * still replayed one by one. The results are in the order of the files, no matter which worker processed them.
+ */
+class ReplayEngine {
+
+public:
+    explicit ReplayEngine(const ReplayConfig &config);
+
+    std::vector<ReplayResult> run(const std::vector<std::string> &fileNames, unsigned int nThreads);
+
+private:
+    //! A thread that replays files until there are none left.
+    class Worker : public CppThread, public IReplayQueue {
+    public:
+        explicit Worker(ReplayEngine &engine);
+
+        bool next(std::string &fileName, size_t &id) override;
+        void done(size_t id, ReplayResult &result) override;
+
+    private:
+        void run() override;
+
+        ReplayEngine &engine;       //!< The engine with the files and results.
+        ReplaySession session;      //!< The session replaying the files.
+    };
+
+    const ReplayConfig config;                      //!< The configuration of the replay.
+    const std::vector<std::string> *files;          //!< The files of the current run.
+    std::vector<ReplayResult> results;              //!< The results of the current run.
+    std::atomic<size_t> nextFile;                   //!< The index of the next file to replay.
+    bool bLanes;                                    //!< The workers replay the text files in lanes.
+};
+
+const char *toString(ReplayStatus status);
+
+#endif //OBP_REPLAY_H
@@ -0,0 +1,101 @@
+/**
+ * @file        RingBuffer.h
+ * @brief       The header file of the RingBuffer class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines and implements the RingBuffer template class and contains the general class description.
+ */
+#ifndef OBP_RINGBUFFER_H
+#define OBP_RINGBUFFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+//! The RingBuffer class always holds the latest values of a data stream.
+/*!
+ * The buffer has a fixed length and is filled with an initial value when it is created. Every new value overwrites
+ * the oldest one, so adding a value is a single write, no matter how long the buffer is. The values are accessed in
+ * logical order: index 0 is the oldest value, index size() - 1 is the newest.
+ *
+ * The class is not thread safe, the values must be added and read by the same thread.
+ */
+template<typename T>
+class RingBuffer {
+
+public:
+    /**
+     * Constructor of the RingBuffer.
+     * @param length The number of values the buffer holds.
+     * @param initial The value the buffer is filled with initially.
+     */
+    explicit RingBuffer(size_t length, const T &initial = T()) :
+            data(length, initial),
+            start(0) {
+    }
+
+    /**
+     * Adds a new value, replacing the oldest one.
+     * @param value The value to add.
+     */
+    void push(const T &value) {
+        data[start] = value;
+        if (++start == data.size()) {
+            start = 0;
+        }
+    }
+
+    /**
+     * Adds several new values at once, replacing the oldest ones. The values are copied in at most two blocks.
+     * @param values The values to add, the last one is the newest.
+     */
+    void push(std::span<const T> values) {
+        const size_t length = data.size();
+        if (values.size() >= length) {
+            values = values.last(length);
+        }
+        const size_t first = std::min(values.size(), length - start);
+        std::copy_n(values.begin(), first, data.begin() + start);
+        std::copy(values.begin() + first, values.end(), data.begin());
+        start = (start + values.size()) % length;
+    }
+
+    /**
+     * Gets a value in logical order.
+     * @param i The index, 0 is the oldest value.
+     * @return The value at the index.
+     */
+    const T &operator[](size_t i) const {
+        size_t j = start + i;
+        if (j >= data.size()) {
+            j -= data.size();
+        }
+        return data[j];
+    }
+
+    /**
+     * Gets the newest value.
+     * @return The newest value.
+     */
+    const T &back() const {
+        return (*this)[data.size() - 1];
+    }
+
+    /**
+     * Gets the number of values in the buffer, which is always the length it was created with.
+     * @return The length of the buffer.
+     */
+    [[nodiscard]] size_t size() const {
+        return data.size();
+    }
+
+private:
+    std::vector<T> data;    //!< The values, the oldest one is at start.
+    size_t start;           //!< The position of the oldest value, the next one to be replaced.
+};
+
+#endif //OBP_RINGBUFFER_H
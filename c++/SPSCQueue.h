@@ -0,0 +1,128 @@
+/**
+ * @file        SPSCQueue.h
+ * @brief       The header file of the SPSCQueue class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines and implements the SPSCQueue template class and contains the general class description.
+ */
+#ifndef OBP_SPSCQUEUE_H
+#define OBP_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "common.h"
+
+//! The SPSCQueue class is a lock-free queue for exactly one producer and one consumer thread.
+/*!
+ * The queue is a ring buffer with a fixed capacity that is allocated once, in the constructor. The producer only
+ * writes the head index and the consumer only writes the tail index, so neither side ever waits for the other.
+ * If the queue is full, push() fails immediately instead of blocking, it is up to the producer to decide what to do
+ * with the value. The consumer can take the values out one by one or in batches.
+ *
+ * The capacity is rounded up to the next power of two so the indices can be wrapped with a mask.
+ */
+template<typename T>
+class SPSCQueue {
+
+public:
+    /**
+     * Constructor of the SPSCQueue, allocates the ring buffer.
+     * @param minCapacity The minimal number of values the queue can hold.
+     */
+    explicit SPSCQueue(size_t minCapacity) :
+            head(0),
+            tail(0) {
+        size_t capacity = 1;
+        while (capacity < minCapacity) {
+            capacity <<= 1;
+        }
+        buffer.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    /**
+     * Adds a value to the queue. Must only be called from the producer thread.
+     * @param value The value to add.
+     * @return False if the queue is full and the value was not added.
+     */
+    bool push(const T &value) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        buffer[h & mask] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Adds as many values as fit into the queue. Must only be called from the producer thread.
+     * @param values The values to add, the oldest first.
+     * @return The number of values added, the rest did not fit.
+     */
+    size_t push(std::span<const T> values) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        const size_t space = mask + 1 - (h - tail.load(std::memory_order_acquire));
+        const size_t n = (space < values.size()) ? space : values.size();
+        for (size_t i = 0; i < n; i++) {
+            buffer[(h + i) & mask] = values[i];
+        }
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    /**
+     * Removes the oldest value from the queue. Must only be called from the consumer thread.
+     * @param value The removed value, only written if the queue was not empty.
+     * @return False if the queue was empty.
+     */
+    bool pop(T &value) {
+        return pop(std::span<T>(&value, 1)) == 1;
+    }
+
+    /**
+     * Removes as many of the oldest values as fit into the given span. Must only be called from the consumer thread.
+     * @param values The span to write the removed values to, in the order they were added.
+     * @return The number of values removed from the queue.
+     */
+    size_t pop(std::span<T> values) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        const size_t available = head.load(std::memory_order_acquire) - t;
+        const size_t n = (available < values.size()) ? available : values.size();
+        for (size_t i = 0; i < n; i++) {
+            values[i] = buffer[(t + i) & mask];
+        }
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    /**
+     * Gets the number of values in the queue. Only a snapshot if the other thread is active.
+     * @return The number of values in the queue.
+     */
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Gets the number of values the queue can hold.
+     * @return The capacity of the queue.
+     */
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+private:
+    std::vector<T> buffer;                      //!< The ring buffer holding the values.
+    size_t mask;                                //!< Mask to wrap the indices, capacity - 1.
+    alignas(64) std::atomic<size_t> head;       //!< The number of values pushed, only written by the producer.
+    alignas(64) std::atomic<size_t> tail;       //!< The number of values popped, only written by the consumer.
+};
+
+#endif //OBP_SPSCQUEUE_H
@@ -0,0 +1,116 @@
+/**
+ * @file        SharedMemoryFormat.h
+ * @brief       The header file of the shared memory format.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the layout of the POSIX shared memory object a SharedMemorySink publishes the live data in, so local
+ * processes can map it and read the data without copying it.
+ *
+ * The object starts with a ShmHeader, the data follows at offset dataOffset: capacity pressure values, then capacity
+ * oscillation values, all as doubles in the byte order of the station. The pair with the index i since the sink was
+ * created is stored at position i % capacity of both arrays.
+ *
+ * The data is a ring buffer with a single writer. Before the writer overwrites pairs, it increases claimed to the
+ * index after the last pair it writes, and once they are written it increases published to the same value. A reader
+ * uses the pairs below published, and checks after using them that claimed is at most capacity pairs ahead of the
+ * first one, otherwise they were overwritten in the meantime.
+ *
+ * The status (ShmStatus) is protected by a seqlock: the sequence is odd while the writer changes the status. A reader
+ * copies the status and retries if the sequence was odd or changed during the copy. The status is stored as 64-bit
+ * words, which are copied with atomic accesses, so a torn copy is never used.
+ *
+ * A reader never writes to the object, so any number of readers can map it read-only without slowing the writer.
+ */
+#ifndef OBP_SHAREDMEMORYFORMAT_H
+#define OBP_SHAREDMEMORYFORMAT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#define SHM_MAGIC               "OBPS"      //!< Identifies the shared memory, not zero terminated.
+#define SHM_VERSION             1           //!< The current version of the shared memory format.
+#define SHM_DEFAULT_NAME        "/obp"      //!< The default name of the shared memory object.
+#define SHM_DEFAULT_CAPACITY    65536       //!< The default number of pairs in the ring, about a minute of data.
+#define SHM_STATE_UNKNOWN       UINT64_MAX  //!< The state if the sink does not know the Processing.
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the shared memory needs lock-free 64-bit atomics");
+
+//! The status of the station, published with every change.
+struct ShmStatus {
+    uint64_t state;         //!< The Processing::ProcState as integer, SHM_STATE_UNKNOWN if not known.
+    uint64_t screen;        //!< The Screen that is displayed, as integer.
+    uint64_t resultCount;   //!< Counts the result notifications, the results are reset when a measurement starts.
+    uint64_t readyCount;    //!< Counts the ready notifications, the station is ready for a measurement after one.
+    double heartRate;       //!< The latest heart rate in bpm, 0 if there is none.
+    double map;             //!< The latest MAP in mmHg, 0 if there is none.
+    double sbp;             //!< The latest SBP in mmHg, 0 if there is none.
+    double dbp;             //!< The latest DBP in mmHg, 0 if there is none.
+};
+
+#define SHM_STATUS_WORDS (sizeof(ShmStatus) / sizeof(uint64_t))    //!< The number of words of the status.
+
+//! The header at the start of the shared memory.
+struct ShmHeader {
+    char magic[4];                              //!< SHM_MAGIC.
+    uint32_t version;                           //!< SHM_VERSION of the writer.
+    uint64_t capacity;                          //!< The number of pairs in the ring.
+    uint64_t dataOffset;                        //!< The offset of the pressure values from the start in bytes.
+    double samplingRate;                        //!< The sampling rate of the data in Hz.
+    std::atomic<uint64_t> bOpen;                //!< 1 while the writer publishes, 0 once it closed the object.
+
+    alignas(64) std::atomic<uint64_t> sequence; //!< The seqlock of the status, odd while it is written.
+    std::atomic<uint64_t> status[SHM_STATUS_WORDS]; //!< The ShmStatus as words.
+
+    alignas(64) std::atomic<uint64_t> claimed;  //!< The index after the last pair that is or is being written.
+    std::atomic<uint64_t> published;            //!< The index after the last pair that is completely written.
+};
+
+static_assert(sizeof(ShmStatus) % sizeof(uint64_t) == 0, "the status has to consist of 64-bit words");
+
+/**
+ * Writes the status, only one thread may write at a time.
+ * @param header The header in the shared memory.
+ * @param status The new status.
+ */
+inline void shmWriteStatus(ShmHeader &header, const ShmStatus &status) {
+    uint64_t words[SHM_STATUS_WORDS];
+    std::memcpy(words, &status, sizeof(words));
+
+    const uint64_t sequence = header.sequence.load(std::memory_order_relaxed);
+    header.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < SHM_STATUS_WORDS; i++) {
+        header.status[i].store(words[i], std::memory_order_relaxed);
+    }
+    header.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/**
+ * Tries to read the status once.
+ * @param header The header in the shared memory.
+ * @param status The status, only valid if true is returned.
+ * @return False if the status was being written, the read has to be retried then.
+ */
+inline bool shmTryReadStatus(const ShmHeader &header, ShmStatus &status) {
+    const uint64_t sequence = header.sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+        return false;
+    }
+    uint64_t words[SHM_STATUS_WORDS];
+    for (size_t i = 0; i < SHM_STATUS_WORDS; i++) {
+        words[i] = header.status[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header.sequence.load(std::memory_order_relaxed) != sequence) {
+        return false;
+    }
+    std::memcpy(&status, words, sizeof(words));
+    return true;
+}
+
+#endif //OBP_SHAREDMEMORYFORMAT_H
@@ -0,0 +1,169 @@
+/**
+ * @file        SharedMemoryReader.cpp
+ * @brief       The implementation of the SharedMemoryReader class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SharedMemoryReader.h"
+
+/**
+ * Constructor of the SharedMemoryReader, maps the shared memory object read-only.
+ * @param name The name of the shared memory object, starting with a slash.
+ */
+SharedMemoryReader::SharedMemoryReader(const std::string &name) :
+        header(nullptr),
+        mappedSize(0),
+        capacity(0),
+        pressure(nullptr),
+        oscillation(nullptr) {
+
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info{};
+    void *memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(ShmHeader)) {
+        memory = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return;
+    }
+
+    // The header is only complete once the writer marked the object as open.
+    const auto *mapped = static_cast<const ShmHeader *>(memory);
+    if (mapped->bOpen.load(std::memory_order_acquire) == 0 ||
+        std::memcmp(mapped->magic, SHM_MAGIC, sizeof(mapped->magic)) != 0 || mapped->version != SHM_VERSION ||
+        mapped->dataOffset + 2 * mapped->capacity * sizeof(double) > (size_t) info.st_size) {
+        munmap(memory, info.st_size);
+        return;
+    }
+
+    header = mapped;
+    mappedSize = info.st_size;
+    capacity = mapped->capacity;
+    pressure = reinterpret_cast<const double *>(static_cast<const uint8_t *>(memory) + mapped->dataOffset);
+    oscillation = pressure + capacity;
+}
+
+/**
+ * Destructor of the SharedMemoryReader, unmaps the object.
+ */
+SharedMemoryReader::~SharedMemoryReader() {
+    if (header) {
+        munmap(const_cast<ShmHeader *>(header), mappedSize);
+    }
+}
+
+/**
+ * Checks if the object could be mapped.
+ * @return True if the object is mapped.
+ */
+bool SharedMemoryReader::isOpen() {
+    return header != nullptr;
+}
+
+/**
+ * Checks if the writer still publishes to the mapped object.
+ * @return False if the writer closed it, or it is not mapped.
+ */
+bool SharedMemoryReader::isWriterOpen() {
+    return header && header->bOpen.load(std::memory_order_acquire) != 0;
+}
+
+/**
+ * Gets the sampling rate of the data.
+ * @return The sampling rate in Hz, 0 if the object is not mapped.
+ */
+double SharedMemoryReader::getSamplingRate() {
+    return header ? header->samplingRate : 0.0;
+}
+
+/**
+ * Gets the number of pairs in the ring.
+ * @return The capacity of the ring.
+ */
+size_t SharedMemoryReader::getCapacity() {
+    return capacity;
+}
+
+/**
+ * Reads the status, retries up to SHM_READ_RETRIES times while the writer changes it.
+ * @param status The status, only valid if true is returned.
+ * @return False if the status could not be read.
+ */
+bool SharedMemoryReader::readStatus(ShmStatus &status) {
+    if (!header) {
+        return false;
+    }
+    for (int i = 0; i < SHM_READ_RETRIES; i++) {
+        if (shmTryReadStatus(*header, status)) {
+            return true;
+        }
+        std::this_thread::yield();
+    }
+    return false;
+}
+
+/**
+ * Gets the number of pairs published so far, the index after the newest pair.
+ * @return The number of pairs.
+ */
+uint64_t SharedMemoryReader::getPublishedPairs() {
+    return header ? header->published.load(std::memory_order_acquire) : 0;
+}
+
+/**
+ * Gets the published pairs from an index on, without copying them. Only the pairs up to the end of the ring are
+ * returned, the rest is returned by the next call.
+ * @param next The index of the first pair wanted. If it was overwritten already, it is set to the oldest pair that
+ * is still in the ring.
+ * @param pData The pressure values from next on.
+ * @param oData The oscillation values from next on.
+ * @return The number of pairs, 0 if there are no new ones.
+ */
+size_t SharedMemoryReader::peekData(uint64_t &next, std::span<const double> &pData, std::span<const double> &oData) {
+    pData = {};
+    oData = {};
+    if (!header) {
+        return 0;
+    }
+    const uint64_t published = header->published.load(std::memory_order_acquire);
+    const uint64_t claimed = header->claimed.load(std::memory_order_relaxed);
+    if (claimed > capacity) {
+        next = std::max<uint64_t>(next, claimed - capacity);
+    }
+    if (next >= published) {
+        return 0;
+    }
+    const size_t position = next % capacity;
+    const size_t n = std::min<uint64_t>(published - next, capacity - position);
+    pData = {pressure + position, n};
+    oData = {oscillation + position, n};
+    return n;
+}
+
+/**
+ * Checks if pairs returned by peekData() were not overwritten while they were used.
+ * @param first The index of the first pair, as set by peekData().
+ * @return True if the pairs are intact, false if they have to be discarded.
+ */
+bool SharedMemoryReader::isIntact(uint64_t first) {
+    if (!header) {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header->claimed.load(std::memory_order_relaxed) <= first + capacity;
+}
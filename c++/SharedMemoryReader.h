@@ -0,0 +1,70 @@
+/**
+ * @file        SharedMemoryReader.h
+ * @brief       The header file of the SharedMemoryReader class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the SharedMemoryReader class and contains the general class description.
+ */
+#ifndef OBP_SHAREDMEMORYREADER_H
+#define OBP_SHAREDMEMORYREADER_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "SharedMemoryFormat.h"
+
+/**
+ * Class dependant configuration values:
+ */
+#define SHM_READ_RETRIES    1000    //!< Maximal number of attempts to read the status while it is written.
+
+//! The SharedMemoryReader Class reads the data and the status a SharedMemorySink publishes.
+/*!
+ * SharedMemoryReader maps the shared memory object of a SharedMemorySink read-only, in any local process. The data
+ * is not copied: peekData() returns the newest pairs as spans into the ring. Since the writer does not wait for the
+ * readers, it may overwrite the pairs while they are used, so isIntact() has to be asked after using them. If they
+ * were overwritten, they are discarded and the reader continues with the oldest pairs that are still in the ring:
+ *
+ *     uint64_t next = reader.getPublishedPairs();
+ *     ...
+ *     const size_t n = reader.peekData(next, pData, oData);
+ *     // use pData and oData
+ *     if (reader.isIntact(next)) {
+ *         next += n;
+ *     }
+ *
+ * The status is read with readStatus(), which retries while the writer changes it.
+ *
+ * If the writer is restarted, it creates a new object and closes the mapped one, the reader has to be constructed
+ * again then. A reader is used by one thread.
+ */
+class SharedMemoryReader {
+
+public:
+    explicit SharedMemoryReader(const std::string &name = SHM_DEFAULT_NAME);
+    ~SharedMemoryReader();
+
+    bool isOpen();
+    bool isWriterOpen();
+    double getSamplingRate();
+    size_t getCapacity();
+
+    bool readStatus(ShmStatus &status);
+    uint64_t getPublishedPairs();
+    size_t peekData(uint64_t &next, std::span<const double> &pData, std::span<const double> &oData);
+    bool isIntact(uint64_t first);
+
+private:
+    const ShmHeader *header;            //!< The mapped object, nullptr if it could not be mapped.
+    size_t mappedSize;                  //!< The size of the mapped object in bytes.
+    size_t capacity;                    //!< The number of pairs in the ring.
+    const double *pressure;             //!< The pressure values of the ring.
+    const double *oscillation;          //!< The oscillation values of the ring.
+};
+
+
+#endif //OBP_SHAREDMEMORYREADER_H
@@ -0,0 +1,212 @@
+/**
+ * @file        SharedMemorySink.cpp
+ * @brief       The implementation of the SharedMemorySink class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "SharedMemorySink.h"
+
+/**
+ * Constructor of the SharedMemorySink, creates and maps the shared memory object.
+ * @param name The name of the shared memory object, starting with a slash.
+ * @param process The Processing whose state is published, nullptr to publish SHM_STATE_UNKNOWN.
+ * @param capacity The number of pairs in the ring.
+ * @param samplingRate The sampling rate of the data.
+ */
+SharedMemorySink::SharedMemorySink(std::string name, Processing *process, size_t capacity, double samplingRate) :
+        name(std::move(name)),
+        process(process),
+        capacity(std::max<size_t>(capacity, 1)),
+        header(nullptr),
+        mappedSize(0),
+        pressure(nullptr),
+        oscillation(nullptr),
+        nextPair(0),
+        status{SHM_STATE_UNKNOWN, (uint64_t) Screen::startScreen, 0, 0, 0.0, 0.0, 0.0, 0.0},
+        lastState(SHM_STATE_UNKNOWN) {
+
+    // The values start on a cache line of their own.
+    const size_t dataOffset = (sizeof(ShmHeader) + 63) / 64 * 64;
+    const size_t size = dataOffset + 2 * this->capacity * sizeof(double);
+
+    // Readers of a previous object keep their mapping, they see that it was closed.
+    shm_unlink(this->name.c_str());
+    const int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        PLOG_ERROR << "Could not create shared memory " << this->name;
+        return;
+    }
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, (off_t) size) == 0) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (memory == MAP_FAILED) {
+        PLOG_ERROR << "Could not map shared memory " << this->name;
+        shm_unlink(this->name.c_str());
+        return;
+    }
+
+    std::memset(memory, 0, size);
+    mappedSize = size;
+    header = new(memory) ShmHeader();
+    pressure = reinterpret_cast<double *>(static_cast<uint8_t *>(memory) + dataOffset);
+    oscillation = pressure + this->capacity;
+
+    if (process) {
+        status.state = (uint64_t) process->getState();
+        lastState = status.state;
+    }
+    shmWriteStatus(*header, status);
+
+    std::memcpy(header->magic, SHM_MAGIC, sizeof(header->magic));
+    header->version = SHM_VERSION;
+    header->capacity = this->capacity;
+    header->dataOffset = dataOffset;
+    header->samplingRate = samplingRate;
+    header->bOpen.store(1, std::memory_order_release);
+}
+
+/**
+ * Destructor of the SharedMemorySink. Marks the object as closed for the readers and removes it.
+ */
+SharedMemorySink::~SharedMemorySink() {
+    if (header) {
+        header->bOpen.store(0, std::memory_order_release);
+        munmap(header, mappedSize);
+        shm_unlink(name.c_str());
+    }
+}
+
+/**
+ * Handles a single new data pair.
+ * @param pData The new pressure data.
+ * @param oData The new oscillation data.
+ */
+void SharedMemorySink::eNewData(double pData, double oData) {
+    eNewDataBlock({&pData, 1}, {&oData, 1});
+}
+
+/**
+ * Handles a block of new data pairs, copies them to the ring and publishes them. If the state of the Processing
+ * changed, the status is published as well.
+ * @param pData The new pressure data.
+ * @param oData The new oscillation data.
+ */
+void SharedMemorySink::eNewDataBlock(std::span<const double> pData, std::span<const double> oData) {
+    if (!header) {
+        return;
+    }
+
+    // Of a block larger than the ring, only the newest pairs are kept.
+    const size_t skipped = pData.size() > capacity ? pData.size() - capacity : 0;
+    nextPair += skipped;
+    const uint64_t end = nextPair + pData.size() - skipped;
+    header->claimed.store(end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i = skipped; i < pData.size();) {
+        const size_t position = nextPair % capacity;
+        const size_t n = std::min(pData.size() - i, capacity - position);
+        std::memcpy(pressure + position, pData.data() + i, n * sizeof(double));
+        std::memcpy(oscillation + position, oData.data() + i, n * sizeof(double));
+        nextPair += n;
+        i += n;
+    }
+    header->published.store(end, std::memory_order_release);
+
+    /**
+     * The lock is only taken when the state changed since it was published last. The status may be published by
+     * another thread meanwhile, so the state is compared again with the published one under the lock.
+     */
+    if (process && (uint64_t) process->getState() != lastState.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(statusMutex);
+        if ((uint64_t) process->getState() != status.state) {
+            publishStatus();
+        }
+    }
+}
+
+/**
+ * Handles notifications to switch the displayed screen.
+ * @param eScreen The new screen.
+ */
+void SharedMemorySink::eSwitchScreen(Screen eScreen) {
+    std::lock_guard<std::mutex> lock(statusMutex);
+    status.screen = (uint64_t) eScreen;
+    publishStatus();
+}
+
+/**
+ * Handles notifications about new results.
+ * @param map The MAP value.
+ * @param sbp The SBP value.
+ * @param dbp The DBP value.
+ */
+void SharedMemorySink::eResults(double map, double sbp, double dbp) {
+    std::lock_guard<std::mutex> lock(statusMutex);
+    status.map = map;
+    status.sbp = sbp;
+    status.dbp = dbp;
+    status.resultCount++;
+    publishStatus();
+}
+
+/**
+ * Handles notifications about a new heart rate.
+ * @param heartRate The new heart rate value.
+ */
+void SharedMemorySink::eHeartRate(double heartRate) {
+    std::lock_guard<std::mutex> lock(statusMutex);
+    status.heartRate = heartRate;
+    publishStatus();
+}
+
+/**
+ * Handles notifications that the station is ready for a measurement.
+ */
+void SharedMemorySink::eReady() {
+    std::lock_guard<std::mutex> lock(statusMutex);
+    status.readyCount++;
+    publishStatus();
+}
+
+/**
+ * Checks if the shared memory object could be created.
+ * @return True if the data is published.
+ */
+bool SharedMemorySink::isOpen() {
+    return header != nullptr;
+}
+
+/**
+ * Returns the number of pairs published so far, including the ones that were overwritten since.
+ * @return The number of pairs.
+ */
+uint64_t SharedMemorySink::getPublishedPairs() {
+    return header ? header->published.load(std::memory_order_relaxed) : 0;
+}
+
+/**
+ * Publishes the status with the current state of the Processing. The status mutex has to be locked.
+ */
+void SharedMemorySink::publishStatus() {
+    if (!header) {
+        return;
+    }
+    if (process) {
+        status.state = (uint64_t) process->getState();
+        lastState.store(status.state, std::memory_order_relaxed);
+    }
+    shmWriteStatus(*header, status);
+}
@@ -0,0 +1,78 @@
+/**
+ * @file        SharedMemorySink.h
+ * @brief       The header file of the SharedMemorySink class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the SharedMemorySink class and contains the general class description.
+ */
+#ifndef OBP_SHAREDMEMORYSINK_H
+#define OBP_SHAREDMEMORYSINK_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+
+#include "common.h"
+#include "IObserver.h"
+#include "Processing.h"
+#include "SharedMemoryFormat.h"
+
+//! The SharedMemorySink Class publishes the data and the status of a station in POSIX shared memory.
+/*!
+ * SharedMemorySink is an observer of Processing that writes the filtered data to a ring buffer and the state, heart
+ * rate and results to a seqlock protected status, in the shared memory object defined in SharedMemoryFormat.h. Other
+ * local processes, e.g. to monitor or log a station, map the object with a SharedMemoryReader and read the data where
+ * it is, any number of them at the same time. The object is created when the sink is constructed, an existing object
+ * with the same name is replaced, and it is removed when the sink is destroyed.
+ *
+ * The readers never write to the object, so they can not slow the acquisition thread down: a new data block is
+ * copied to the ring and published with two atomic stores, without a system call or a lock. A reader that does not
+ * keep up misses the overwritten data. The whole object is written once when it is created, so the first blocks do
+ * not cause page faults.
+ *
+ * The Processing is asked for its state with every block, so the state is published at most a block late. Like the
+ * other sinks, a sink observes a single Processing, each channel of a MultiChannelProcessing needs its own object.
+ */
+class SharedMemorySink : public IObserver {
+
+public:
+    explicit SharedMemorySink(std::string name = SHM_DEFAULT_NAME, Processing *process = nullptr,
+                              size_t capacity = SHM_DEFAULT_CAPACITY, double samplingRate = SAMPLING_RATE);
+    ~SharedMemorySink();
+
+    void eNewData(double pData, double oData) override;
+    void eNewDataBlock(std::span<const double> pData, std::span<const double> oData) override;
+    void eSwitchScreen(Screen eScreen) override;
+    void eResults(double map, double sbp, double dbp) override;
+    void eHeartRate(double heartRate) override;
+    void eReady() override;
+
+    bool isOpen();
+    uint64_t getPublishedPairs();
+
+private:
+    void publishStatus();
+
+    const std::string name;             //!< The name of the shared memory object.
+    Processing *process;                //!< The Processing whose state is published, may be nullptr. Not owned.
+    const size_t capacity;              //!< The number of pairs in the ring.
+
+    ShmHeader *header;                  //!< The mapped object, nullptr if it could not be created.
+    size_t mappedSize;                  //!< The size of the mapped object in bytes.
+    double *pressure;                   //!< The pressure values of the ring.
+    double *oscillation;                //!< The oscillation values of the ring.
+    uint64_t nextPair;                  //!< The index of the next pair. Only used by the acquisition thread.
+
+    std::mutex statusMutex;             //!< Serialises the writers of the status, the readers do not take it.
+    ShmStatus status;                   //!< The status that is published.
+    std::atomic<uint64_t> lastState;    //!< The state that was published last, a copy of status.state that can be
+                                        //!< read without the mutex.
+};
+
+
+#endif //OBP_SHAREDMEMORYSINK_H
@@ -0,0 +1,172 @@
+/**
+ * @file        SignalConditioner.h
+ * @brief       The header file of the BasicSignalConditioner class template.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines and implements the BasicSignalConditioner template class, the SignalConditioner and LaneConditioner types
+ * and contains the general class description.
+ */
+#ifndef OBP_SIGNALCONDITIONER_H
+#define OBP_SIGNALCONDITIONER_H
+
+#include <algorithm>
+#include <cassert>
+#include <span>
+#include <Iir.h>
+
+#include "common.h"
+#include "IirBlockFilter.h"
+#include "Profiler.h"
+
+/**
+ * Class dependant configuration values:
+ */
+#define IIRORDER 4                      //!< IIR filter order.
+#define IIRSTAGES ((IIRORDER + 1) / 2)  //!< Number of biquads in an IIR filter.
+#define CONDITIONER_LANES 4             //!< Number of recordings a LaneConditioner converts and filters at once.
+
+//! The BasicSignalConditioner class template converts voltage samples to mmHg and filters them.
+/*!
+ * This is the pre-processing that is done on every acquired sample before it is passed to the OBPDetection. The
+ * voltage is converted to mmHg with the ambient voltage and the correction factor of the voltage divider. The pressure
+ * is then low-pass filtered to remove noise and high-pass filtered to get the oscillations.
+ *
+ * The filters are Butterworth filters designed by the Iir library, the blocks are filtered by IirBlockFilter instances
+ * with their coefficients. The class does not depend on Qt or comedi, so recorded data can be processed exactly like
+ * the application does without any hardware.
+ *
+ * Several recordings with the same filter settings can be converted and filtered at once, one per lane. The samples
+ * of the lanes are interleaved in the blocks, as in IirBlockFilter, so the biquads of all lanes are calculated
+ * together. Every lane has its own calibration, the filters are the same for all of them.
+ *
+ * The application uses a SignalConditioner, the replay of many text files a LaneConditioner, and a Pipeline one with
+ * the filter order it was compiled for.
+ *
+ * @tparam Order The order of the low-pass and the high-pass filter.
+ * @tparam Lanes The number of independent recordings converted and filtered at once.
+ */
+template<int Order, int Lanes = 1>
+class BasicSignalConditioner {
+    static_assert(Order > 0, "The filter order has to be positive.");
+
+public:
+    static constexpr int stages = (Order + 1) / 2;  //!< The number of biquads of a filter.
+
+    /**
+     * Constructor of the BasicSignalConditioner, designs the filters shared by all lanes.
+     * @param samplingRate The sampling rate of the samples.
+     * @param fcLP Cutoff frequency for the low-pass filter.
+     * @param fcHP Cutoff frequency for the high-pass filter.
+     */
+    BasicSignalConditioner(double samplingRate, double fcLP, double fcHP) :
+            ambientVoltage{},
+            corrFactor{} {
+        Iir::Butterworth::LowPass<Order> iirLP;
+        iirLP.setup(samplingRate, fcLP);
+        blockLP.setup(iirLP);
+
+        Iir::Butterworth::HighPass<Order> iirHP;
+        iirHP.setup(samplingRate, fcHP);
+        blockHP.setup(iirHP);
+
+        std::fill_n(corrFactor, Lanes, 1.0);
+    }
+
+    /**
+     * Sets the values needed to convert voltage to mmHg, for all lanes.
+     * @param ambientVoltage The voltage at ambient pressure.
+     * @param corrFactor The correction factor of the voltage divider.
+     */
+    void setCalibration(double ambientVoltage, double corrFactor) {
+        std::fill_n(this->ambientVoltage, Lanes, ambientVoltage);
+        std::fill_n(this->corrFactor, Lanes, corrFactor);
+    }
+
+    /**
+     * Sets the values needed to convert the voltage of a lane to mmHg.
+     * @param lane The lane, less than Lanes.
+     * @param ambientVoltage The voltage at ambient pressure.
+     * @param corrFactor The correction factor of the voltage divider.
+     */
+    void setCalibration(int lane, double ambientVoltage, double corrFactor) {
+        assert(lane >= 0 && lane < Lanes);
+        this->ambientVoltage[lane] = ambientVoltage;
+        this->corrFactor[lane] = corrFactor;
+    }
+
+    /**
+     * Resets the state of the filters of all lanes.
+     */
+    void reset() {
+        blockLP.reset();
+        blockHP.reset();
+    }
+
+    /**
+     * Resets the state of the filters of a lane, before it starts with another recording.
+     * @param lane The lane, less than Lanes.
+     */
+    void reset(int lane) {
+        blockLP.reset(lane);
+        blockHP.reset(lane);
+    }
+
+    /**
+     * Calculates the mmHg value from the given voltage input, with the calibration of the first lane.
+     * @param voltageValue The voltage input.
+     * @return The corresponding value in mmHg.
+     */
+    [[nodiscard]] double getmmHgValue(double voltageValue) const {
+        return voltageToMmHg(voltageValue, ambientVoltage[0], corrFactor[0]);
+    }
+
+    /**
+     * Converts a block of interleaved samples to mmHg and filters it with the low-pass and high-pass filters.
+     * @param samples The voltage samples of all lanes, a multiple of Lanes that fits in the other spans.
+     * @param ymmHg The samples converted to mmHg.
+     * @param yLP The low-pass filtered samples.
+     * @param yHP The high-pass filtered samples.
+     */
+    void process(std::span<const double> samples, std::span<double> ymmHg,
+                 std::span<double> yLP, std::span<double> yHP) {
+        OBP_PROFILE_SCOPE(profile, ProfileStage::Conditioning, samples.size());
+        assert(samples.size() % Lanes == 0);
+        for (size_t j = 0; j < samples.size(); j += Lanes) {
+            for (int l = 0; l < Lanes; l++) {
+                ymmHg[j + l] = voltageToMmHg(samples[j + l], ambientVoltage[l], corrFactor[l]);
+            }
+        }
+        filter(ymmHg.first(samples.size()), yLP, yHP);
+    }
+
+    /**
+     * Filters a block of interleaved samples that are already in mmHg with the low-pass and high-pass filters.
+     * @param ymmHg The pressure samples of all lanes, a multiple of Lanes that fits in the other spans.
+     * @param yLP The low-pass filtered samples.
+     * @param yHP The high-pass filtered samples.
+     */
+    void filter(std::span<const double> ymmHg, std::span<double> yLP, std::span<double> yHP) {
+        const size_t n = ymmHg.size();
+        std::copy_n(ymmHg.begin(), n, yLP.begin());
+        blockLP.filter(yLP.first(n));
+        std::copy_n(yLP.begin(), n, yHP.begin());
+        blockHP.filter(yHP.first(n));
+    }
+
+private:
+    IirBlockFilter<stages, Lanes> blockLP;  //!< Low-pass filter for the lanes.
+    IirBlockFilter<stages, Lanes> blockHP;  //!< High-pass filter for the lanes.
+    double ambientVoltage[Lanes];           //!< The voltage at ambient pressure per lane.
+    double corrFactor[Lanes];               //!< Correction factor of the voltage divider per lane.
+};
+
+//! Converts and filters the samples of one channel, as the application does.
+using SignalConditioner = BasicSignalConditioner<IIRORDER>;
+
+//! Converts and filters CONDITIONER_LANES recordings with the same filter settings at once.
+using LaneConditioner = BasicSignalConditioner<IIRORDER, CONDITIONER_LANES>;
+
+#endif //OBP_SIGNALCONDITIONER_H
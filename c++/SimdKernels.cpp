@@ -0,0 +1,331 @@
+/**
+ * @file        SimdKernels.cpp
+ * @brief       The implementation of the vectorised kernels.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * The AVX2 functions are compiled for AVX2 with a target attribute, the rest of the file for the baseline of the
+ * architecture. They are only called if the CPU supports AVX2. FMA is not enabled, so no multiply-add is contracted
+ * and the results do not depend on the CPU beyond what is stated in SimdKernels.h.
+ */
+#include <atomic>
+
+#include "SimdKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OBP_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define OBP_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+//! The implementations of the kernels for one instruction set.
+struct SimdKernels {
+    SimdLevel level;                                                    //!< The instruction set.
+    size_t (*firstAbove)(const double *values, size_t n, double threshold); //!< See findFirstAbove().
+    size_t (*firstBelow)(const double *values, size_t n, double threshold); //!< See findFirstBelow().
+    double (*mean)(const double *values, size_t n);                     //!< See meanOf(), n is larger than 0.
+};
+
+/**
+ * Scalar search for the first value above a threshold.
+ * @param values The values.
+ * @param n The number of values.
+ * @param threshold The threshold.
+ * @return The index of the first value that is not smaller than or equal to the threshold, n if there is none.
+ */
+static size_t firstAboveScalar(const double *values, size_t n, double threshold) {
+    size_t i = 0;
+    while (i < n && values[i] <= threshold) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Scalar search for the first value below a threshold.
+ * @param values The values.
+ * @param n The number of values.
+ * @param threshold The threshold.
+ * @return The index of the first value that is not larger than or equal to the threshold, n if there is none.
+ */
+static size_t firstBelowScalar(const double *values, size_t n, double threshold) {
+    size_t i = 0;
+    while (i < n && values[i] >= threshold) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Scalar mean, adds the values in order like std::accumulate.
+ * @param values The values.
+ * @param n The number of values, larger than 0.
+ * @return The mean of the values.
+ */
+static double meanScalar(const double *values, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += values[i];
+    }
+    return sum / n;
+}
+
+static const SimdKernels scalarKernels = {SimdLevel::Scalar, firstAboveScalar, firstBelowScalar, meanScalar};
+
+#ifdef OBP_SIMD_AVX2
+
+/**
+ * AVX2 search for the first value above a threshold, compares four values at once.
+ * @param values The values.
+ * @param n The number of values.
+ * @param threshold The threshold.
+ * @return The same index as firstAboveScalar().
+ */
+__attribute__((target("avx2")))
+static size_t firstAboveAVX2(const double *values, size_t n, double threshold) {
+    const __m256d t = _mm256_set1_pd(threshold);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // Not less or equal, true for NaN like the scalar loop condition is false for it.
+        const int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values + i), t, _CMP_NLE_UQ));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + firstAboveScalar(values + i, n - i, threshold);
+}
+
+/**
+ * AVX2 search for the first value below a threshold, compares four values at once.
+ * @param values The values.
+ * @param n The number of values.
+ * @param threshold The threshold.
+ * @return The same index as firstBelowScalar().
+ */
+__attribute__((target("avx2")))
+static size_t firstBelowAVX2(const double *values, size_t n, double threshold) {
+    const __m256d t = _mm256_set1_pd(threshold);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values + i), t, _CMP_NGE_UQ));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + firstBelowScalar(values + i, n - i, threshold);
+}
+
+/**
+ * AVX2 mean, adds the values in four lanes and the lanes at the end.
+ * @param values The values.
+ * @param n The number of values, larger than 0.
+ * @return The mean of the values.
+ */
+__attribute__((target("avx2")))
+static double meanAVX2(const double *values, size_t n) {
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_add_pd(acc, _mm256_loadu_pd(values + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++) {
+        sum += values[i];
+    }
+    return sum / n;
+}
+
+static const SimdKernels avx2Kernels = {SimdLevel::AVX2, firstAboveAVX2, firstBelowAVX2, meanAVX2};
+
+#endif
+
+#ifdef OBP_SIMD_NEON
+
+/**
+ * NEON search for the first value above a threshold, compares two values at once.
+ * @param values The values.
+ * @param n The number of values.
+ * @param threshold The threshold.
+ * @return The same index as firstAboveScalar().
+ */
+static size_t firstAboveNEON(const double *values, size_t n, double threshold) {
+    const float64x2_t t = vdupq_n_f64(threshold);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        // All bits set where the value is less or equal, the first lane without them is the result.
+        const uint64x2_t le = vcleq_f64(vld1q_f64(values + i), t);
+        if (vgetq_lane_u64(le, 0) == 0) {
+            return i;
+        }
+        if (vgetq_lane_u64(le, 1) == 0) {
+            return i + 1;
+        }
+    }
+    return i + firstAboveScalar(values + i, n - i, threshold);
+}
+
+/**
+ * NEON search for the first value below a threshold, compares two values at once.
+ * @param values The values.
+ * @param n The number of values.
+ * @param threshold The threshold.
+ * @return The same index as firstBelowScalar().
+ */
+static size_t firstBelowNEON(const double *values, size_t n, double threshold) {
+    const float64x2_t t = vdupq_n_f64(threshold);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const uint64x2_t ge = vcgeq_f64(vld1q_f64(values + i), t);
+        if (vgetq_lane_u64(ge, 0) == 0) {
+            return i;
+        }
+        if (vgetq_lane_u64(ge, 1) == 0) {
+            return i + 1;
+        }
+    }
+    return i + firstBelowScalar(values + i, n - i, threshold);
+}
+
+/**
+ * NEON mean, adds the values in two lanes and the lanes at the end.
+ * @param values The values.
+ * @param n The number of values, larger than 0.
+ * @return The mean of the values.
+ */
+static double meanNEON(const double *values, size_t n) {
+    float64x2_t acc = vdupq_n_f64(0.0);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        acc = vaddq_f64(acc, vld1q_f64(values + i));
+    }
+    double sum = vgetq_lane_f64(acc, 0) + vgetq_lane_f64(acc, 1);
+    for (; i < n; i++) {
+        sum += values[i];
+    }
+    return sum / n;
+}
+
+static const SimdKernels neonKernels = {SimdLevel::NEON, firstAboveNEON, firstBelowNEON, meanNEON};
+
+#endif
+
+/**
+ * Gets the kernels of an instruction set, if the CPU supports it.
+ * @param level The instruction set.
+ * @return The kernels, nullptr if the instruction set is not supported.
+ */
+static const SimdKernels *getKernels(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar:
+            return &scalarKernels;
+        case SimdLevel::AVX2:
+#ifdef OBP_SIMD_AVX2
+            if (__builtin_cpu_supports("avx2")) {
+                return &avx2Kernels;
+            }
+#endif
+            return nullptr;
+        case SimdLevel::NEON:
+#ifdef OBP_SIMD_NEON
+            // Advanced SIMD is part of every AArch64 CPU.
+            return &neonKernels;
+#endif
+            return nullptr;
+    }
+    return nullptr;
+}
+
+/**
+ * Gets the kernels in use, and chooses the fastest ones the CPU supports on the first call.
+ * @return The kernels.
+ */
+static std::atomic<const SimdKernels *> &activeKernels() {
+    static std::atomic<const SimdKernels *> active = [] {
+        for (SimdLevel level : {SimdLevel::AVX2, SimdLevel::NEON}) {
+            if (const SimdKernels *kernels = getKernels(level)) {
+                return kernels;
+            }
+        }
+        return &scalarKernels;
+    }();
+    return active;
+}
+
+/**
+ * Gets the instruction set the kernels run with.
+ * @return The instruction set.
+ */
+SimdLevel getSimdLevel() {
+    return activeKernels().load(std::memory_order_relaxed)->level;
+}
+
+/**
+ * Sets the instruction set the kernels run with, e.g. to compare an implementation with the scalar one.
+ * @param level The instruction set.
+ * @return False if the CPU does not support it, the kernels are not changed then.
+ */
+bool setSimdLevel(SimdLevel level) {
+    const SimdKernels *kernels = getKernels(level);
+    if (!kernels) {
+        return false;
+    }
+    activeKernels().store(kernels, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * Gets the name of an instruction set.
+ * @param level The instruction set.
+ * @return The name.
+ */
+const char *toString(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar:
+            return "scalar";
+        case SimdLevel::AVX2:
+            return "avx2";
+        case SimdLevel::NEON:
+            return "neon";
+    }
+    return "unknown";
+}
+
+/**
+ * Searches the first value above a threshold, like a loop that skips all values smaller than or equal to it.
+ * @param values The values.
+ * @param threshold The threshold.
+ * @return The index of the first value that is not smaller than or equal to the threshold, values.size() if there
+ * is none.
+ */
+size_t findFirstAbove(std::span<const double> values, double threshold) {
+    return activeKernels().load(std::memory_order_relaxed)->firstAbove(values.data(), values.size(), threshold);
+}
+
+/**
+ * Searches the first value below a threshold, like a loop that skips all values larger than or equal to it.
+ * @param values The values.
+ * @param threshold The threshold.
+ * @return The index of the first value that is not larger than or equal to the threshold, values.size() if there is
+ * none.
+ */
+size_t findFirstBelow(std::span<const double> values, double threshold) {
+    return activeKernels().load(std::memory_order_relaxed)->firstBelow(values.data(), values.size(), threshold);
+}
+
+/**
+ * Calculates the mean of the values.
+ * @param values The values.
+ * @return The mean of the values, 0 if there are none.
+ */
+double meanOf(std::span<const double> values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    return activeKernels().load(std::memory_order_relaxed)->mean(values.data(), values.size());
+}
@@ -0,0 +1,37 @@
+/**
+ * @file        SimdKernels.h
+ * @brief       The header file of the vectorised kernels.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Declares the kernels that search and reduce arrays of doubles with SIMD instructions.
+ *
+ * Every kernel has a scalar implementation and, depending on the architecture, an AVX2 or a NEON one. The fastest
+ * implementation the CPU supports is chosen at runtime, the first time a kernel is called, so the same binary runs
+ * on CPUs without AVX2. The searches give exactly the same index as the scalar loops they replace. The mean adds the
+ * values in several lanes, so it can differ from std::accumulate in the last bits.
+ */
+#ifndef OBP_SIMDKERNELS_H
+#define OBP_SIMDKERNELS_H
+
+#include <cstddef>
+#include <span>
+
+//! The instruction sets the kernels are implemented with.
+enum class SimdLevel {
+    Scalar,     //!< Plain C++, available everywhere.
+    AVX2,       //!< 256-bit vectors on x86, four doubles at once.
+    NEON,       //!< 128-bit vectors on AArch64, two doubles at once.
+};
+
+SimdLevel getSimdLevel();
+bool setSimdLevel(SimdLevel level);
+const char *toString(SimdLevel level);
+
+size_t findFirstAbove(std::span<const double> values, double threshold);
+size_t findFirstBelow(std::span<const double> values, double threshold);
+double meanOf(std::span<const double> values);
+
+#endif //OBP_SIMDKERNELS_H
@@ -0,0 +1,145 @@
+/**
+ * @file        SlidingWindow.h
+ * @brief       The header file of the SlidingWindow class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines and implements the SlidingWindow class and contains the general class description.
+ */
+#ifndef OBP_SLIDINGWINDOW_H
+#define OBP_SLIDINGWINDOW_H
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+//! The SlidingWindow class keeps the mean, minimum and maximum of the latest values of a data stream.
+/*!
+ * The window holds up to a fixed number of values. Every new value replaces the oldest one once the window is full,
+ * and the statistics of the values in the window are available at any time without going over them again.
+ *
+ * The mean is a running sum. The minimum and the maximum are kept in monotonic queues of the positions of the values
+ * that can still become the extreme of the window, so adding a value is amortised constant time. All storage is
+ * allocated when the window is created.
+ *
+ * The class is not thread safe, the values must be added and read by the same thread.
+ */
+class SlidingWindow {
+
+public:
+    /**
+     * Constructor of the SlidingWindow.
+     * @param length The number of values the full window holds.
+     */
+    explicit SlidingWindow(size_t length) :
+            values(length),
+            minQueue(length),
+            maxQueue(length) {
+        assert(length > 0);
+        clear();
+    }
+
+    /**
+     * Removes all values from the window.
+     */
+    void clear() {
+        count = 0;
+        sum = 0.0;
+        minHead = minTail = 0;
+        maxHead = maxTail = 0;
+    }
+
+    /**
+     * Adds a new value, replacing the oldest one if the window is full.
+     * @param value The value to add.
+     */
+    void push(double value) {
+        const size_t length = values.size();
+        if (count >= length) {
+            sum -= values[count % length];
+            // Drop the extremes that just left the window.
+            if (minQueue[minHead % length] == count - length) {
+                minHead++;
+            }
+            if (maxQueue[maxHead % length] == count - length) {
+                maxHead++;
+            }
+        }
+        values[count % length] = value;
+        sum += value;
+
+        while (minTail > minHead && valueAt(minQueue[(minTail - 1) % length]) >= value) {
+            minTail--;
+        }
+        minQueue[minTail++ % length] = count;
+        while (maxTail > maxHead && valueAt(maxQueue[(maxTail - 1) % length]) <= value) {
+            maxTail--;
+        }
+        maxQueue[maxTail++ % length] = count;
+        count++;
+    }
+
+    /**
+     * Gets the number of values in the window.
+     * @return The number of values, at most the length of the window.
+     */
+    [[nodiscard]] size_t size() const {
+        return count < values.size() ? count : values.size();
+    }
+
+    /**
+     * Checks if the window holds as many values as it can.
+     * @return True if the window is full.
+     */
+    [[nodiscard]] bool isFull() const {
+        return count >= values.size();
+    }
+
+    /**
+     * Gets the mean of the values in the window, only valid if there is at least one.
+     * @return The mean.
+     */
+    [[nodiscard]] double mean() const {
+        return sum / size();
+    }
+
+    /**
+     * Gets the smallest value in the window, only valid if there is at least one.
+     * @return The minimum.
+     */
+    [[nodiscard]] double min() const {
+        return valueAt(minQueue[minHead % values.size()]);
+    }
+
+    /**
+     * Gets the largest value in the window, only valid if there is at least one.
+     * @return The maximum.
+     */
+    [[nodiscard]] double max() const {
+        return valueAt(maxQueue[maxHead % values.size()]);
+    }
+
+private:
+    /**
+     * Gets a value in the window by the position it was added at.
+     * @param position The number of values added before it.
+     * @return The value.
+     */
+    [[nodiscard]] double valueAt(size_t position) const {
+        return values[position % values.size()];
+    }
+
+    std::vector<double> values;     //!< The values, the one added at position n is at n modulo the length.
+    std::vector<size_t> minQueue;   //!< Positions of the candidates for the minimum, their values increasing.
+    std::vector<size_t> maxQueue;   //!< Positions of the candidates for the maximum, their values decreasing.
+    size_t count;                   //!< The number of values added since the window was cleared.
+    double sum;                     //!< The sum of the values in the window.
+    size_t minHead;                 //!< The front of minQueue, counting up without wrapping.
+    size_t minTail;                 //!< One past the back of minQueue, counting up without wrapping.
+    size_t maxHead;                 //!< The front of maxQueue, counting up without wrapping.
+    size_t maxTail;                 //!< One past the back of maxQueue, counting up without wrapping.
+};
+
+#endif //OBP_SLIDINGWINDOW_H
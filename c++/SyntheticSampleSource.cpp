@@ -0,0 +1,190 @@
+/**
+ * @file        SyntheticSampleSource.cpp
+ * @brief       The implementation of the SyntheticSampleSource class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+#include <cmath>
+#include <thread>
+
+#include "SyntheticSampleSource.h"
+
+/**
+ * Constructor of the SyntheticSampleSource, with a healthy blood pressure and the default configuration values.
+ * @param bRealTime True to generate the samples at the pace of the sampling rate, false for as fast as possible.
+ * @param samplingRate The sampling rate of the generated samples.
+ */
+SyntheticSampleSource::SyntheticSampleSource(bool bRealTime, double samplingRate) :
+        block(SYNTH_BLOCK_SIZE),
+        samplingRate(samplingRate),
+        bRealTime(bRealTime),
+        bStarted(false),
+        nGenerated(0),
+        phase(Phase::Rest),
+        phaseTime(0.0),
+        cuffPressure(0.0),
+        pulsePhase(0.0),
+        noiseState(0x2545F4914F6CDD1DULL),
+        ratioSBP(0.57),
+        ratioDBP(0.70),
+        pumpUpValue(190.0),
+        ambientVoltage(0.71),
+        corrFactor(2.6) {
+    setBloodPressure(120.0, 80.0, 70.0);
+}
+
+/**
+ * Sets the blood pressure and heart rate to generate. The MAP is estimated from the SBP and the DBP.
+ * @param sbp The systolic blood pressure in mmHg.
+ * @param dbp The diastolic blood pressure in mmHg.
+ * @param heartRate The heart rate in beats per minute.
+ */
+void SyntheticSampleSource::setBloodPressure(double sbp, double dbp, double heartRate) {
+    this->sbp = sbp;
+    this->dbp = dbp;
+    this->map = dbp + (sbp - dbp) / 3.0;
+    this->heartRate = heartRate;
+}
+
+/**
+ * Sets the amplitudes of the oscillations at the SBP and the DBP, relative to the maximal amplitude at the MAP.
+ * @param ratioSBP The ratio at the SBP.
+ * @param ratioDBP The ratio at the DBP.
+ */
+void SyntheticSampleSource::setRatios(double ratioSBP, double ratioDBP) {
+    this->ratioSBP = ratioSBP;
+    this->ratioDBP = ratioDBP;
+}
+
+/**
+ * Sets the pressure the cuff is inflated to.
+ * @param mmHg The pressure in mmHg.
+ */
+void SyntheticSampleSource::setPumpUpValue(double mmHg) {
+    pumpUpValue = mmHg;
+}
+
+/**
+ * Sets the values used to convert the pressure to voltage.
+ * @param ambientVoltage The voltage at ambient pressure.
+ * @param corrFactor The correction factor of the voltage divider.
+ */
+void SyntheticSampleSource::setCalibration(double ambientVoltage, double corrFactor) {
+    this->ambientVoltage = ambientVoltage;
+    this->corrFactor = corrFactor;
+}
+
+/**
+ * Gets the sampling rate of the generated samples.
+ * @return The sampling rate in Hz.
+ */
+double SyntheticSampleSource::getSamplingRate() {
+    return samplingRate;
+}
+
+/**
+ * Waits until the next block is due. Returns immediately if the samples are not generated in real time.
+ * @param timeoutMs The maximal time to wait in ms.
+ * @return True if the next block is due.
+ */
+bool SyntheticSampleSource::waitForData(int timeoutMs) {
+    if (!bStarted) {
+        startTime = std::chrono::steady_clock::now();
+        bStarted = true;
+    }
+    if (!bRealTime) {
+        return true;
+    }
+    const auto dueTime = startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>((nGenerated + SYNTH_BLOCK_SIZE) / samplingRate));
+    const auto timeout = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::this_thread::sleep_until(std::min(dueTime, timeout));
+    return std::chrono::steady_clock::now() >= dueTime;
+}
+
+/**
+ * Generates the next block of samples.
+ * @return The voltage samples, only valid until the next call.
+ */
+std::span<const double> SyntheticSampleSource::readVoltageBlock() {
+    for (double &sample : block) {
+        sample = generate();
+    }
+    nGenerated += block.size();
+    return block;
+}
+
+/**
+ * Generates the next sample and advances the measurement.
+ * @return The voltage sample.
+ */
+double SyntheticSampleSource::generate() {
+    const double dt = 1.0 / samplingRate;
+    double pressure = cuffPressure;
+
+    phaseTime += dt;
+    switch (phase) {
+        case Phase::Rest:
+            cuffPressure = 0.0;
+            if (phaseTime >= SYNTH_REST_TIME) {
+                phase = Phase::Inflate;
+                phaseTime = 0.0;
+            }
+            break;
+        case Phase::Inflate:
+            cuffPressure += SYNTH_INFLATE_RATE * dt;
+            if (cuffPressure >= pumpUpValue) {
+                phase = Phase::Deflate;
+                phaseTime = 0.0;
+            }
+            break;
+        case Phase::Deflate:
+            cuffPressure -= SYNTH_DEFLATE_RATE * dt;
+            pulsePhase += heartRate / 60.0 * dt;
+            pulsePhase -= std::floor(pulsePhase);
+            pressure += getAmplitude(cuffPressure) * std::sin(2.0 * M_PI * pulsePhase);
+            if (cuffPressure <= SYNTH_END_PRESSURE) {
+                phase = Phase::Empty;
+                phaseTime = 0.0;
+            }
+            break;
+        case Phase::Empty:
+            cuffPressure -= SYNTH_EMPTY_RATE * dt;
+            if (cuffPressure <= 0.0) {
+                cuffPressure = 0.0;
+                phase = Phase::Rest;
+                phaseTime = 0.0;
+            }
+            break;
+    }
+
+    pressure += getNoise();
+    return mmHgToVoltage(pressure, ambientVoltage, corrFactor);
+}
+
+/**
+ * Calculates the amplitude of the oscillations at a cuff pressure. The amplitude is a Gaussian around the MAP, with
+ * different widths above and below it, so it falls to ratioSBP at the SBP and to ratioDBP at the DBP.
+ * @param pressure The cuff pressure in mmHg.
+ * @return The amplitude of the oscillations in mmHg.
+ */
+double SyntheticSampleSource::getAmplitude(double pressure) const {
+    const double ratio = (pressure > map) ? ratioSBP : ratioDBP;
+    const double bound = (pressure > map) ? sbp : dbp;
+    const double width = std::abs(bound - map) / std::sqrt(-std::log(ratio));
+    const double x = (pressure - map) / width;
+    return SYNTH_MAX_AMPLITUDE * std::exp(-x * x);
+}
+
+/**
+ * Generates noise with a xorshift generator, so the noise is the same on every run.
+ * @return Uniform noise between -0.01 and 0.01 mmHg.
+ */
+double SyntheticSampleSource::getNoise() {
+    noiseState ^= noiseState << 13;
+    noiseState ^= noiseState >> 7;
+    noiseState ^= noiseState << 17;
+    return ((double) (noiseState >> 11) / (double) (1ULL << 53) - 0.5) * 0.02;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file        SyntheticSampleSource.h
+ * @brief       The header file of the SyntheticSampleSource class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the SyntheticSampleSource class and contains the general class description.
+ */
+#ifndef OBP_SYNTHETICSAMPLESOURCE_H
+#define OBP_SYNTHETICSAMPLESOURCE_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "common.h"
+#include "ISampleSource.h"
+
+/**
+ * Class dependant configuration values:
+ */
+#define SYNTH_BLOCK_SIZE        100     //!< Number of samples generated per block.
+#define SYNTH_REST_TIME         3.0     //!< Time in s at ambient pressure between two measurements.
+#define SYNTH_INFLATE_RATE      40.0    //!< Pressure increase in mmHg/s while inflating.
+#define SYNTH_DEFLATE_RATE      3.0     //!< Pressure decrease in mmHg/s while slowly deflating.
+#define SYNTH_EMPTY_RATE        40.0    //!< Pressure decrease in mmHg/s while emptying the cuff.
+#define SYNTH_END_PRESSURE      10.0    //!< Pressure in mmHg where the cuff is emptied.
+#define SYNTH_MAX_AMPLITUDE     3.0     //!< Amplitude in mmHg of the oscillations at MAP.
+
+//! The SyntheticSampleSource class generates measurements without any hardware.
+/*!
+ * The source repeatedly generates the voltages of a whole measurement: the cuff is at ambient pressure for a while,
+ * then inflated above the pump-up value, deflated slowly and finally emptied. During the deflation, the pressure
+ * oscillates with the heart rate. The amplitude of the oscillations is largest at the MAP and falls off towards the
+ * SBP and the DBP, so that it is a set ratio of the maximum there. A little noise is added, it is generated from a
+ * fixed seed so every run produces the same samples.
+ *
+ * The pressure is converted to voltage with the ambient voltage and correction factor, the inverse of the conversion
+ * in SignalConditioner. The samples are handed out at the pace of the sampling rate, like the hardware would, or as
+ * fast as they are requested.
+ */
+class SyntheticSampleSource : public ISampleSource {
+
+public:
+    explicit SyntheticSampleSource(bool bRealTime = true, double samplingRate = SAMPLING_RATE);
+
+    void setBloodPressure(double sbp, double dbp, double heartRate);
+    void setRatios(double ratioSBP, double ratioDBP);
+    void setPumpUpValue(double mmHg);
+    void setCalibration(double ambientVoltage, double corrFactor);
+
+    double getSamplingRate() override;
+    bool waitForData(int timeoutMs) override;
+    std::span<const double> readVoltageBlock() override;
+
+private:
+    //! The phases of a generated measurement.
+    enum class Phase {
+        Rest,       //!< At ambient pressure.
+        Inflate,    //!< Inflating the cuff.
+        Deflate,    //!< Slowly deflating the cuff.
+        Empty,      //!< Emptying the cuff.
+    };
+
+    double generate();
+    [[nodiscard]] double getAmplitude(double pressure) const;
+    double getNoise();
+
+    std::vector<double> block;                          //!< The last generated block.
+    double samplingRate;                                //!< The sampling rate of the generated samples.
+    bool bRealTime;                                     //!< Generate the samples at the pace of the sampling rate.
+    bool bStarted;                                      //!< The first block was requested.
+    std::chrono::steady_clock::time_point startTime;    //!< The time the first block was requested.
+    uint64_t nGenerated;                                //!< The number of samples generated.
+
+    Phase phase;                //!< The current phase of the measurement.
+    double phaseTime;           //!< The time in s since the current phase started.
+    double cuffPressure;        //!< The pressure of the cuff in mmHg, without oscillations.
+    double pulsePhase;          //!< The phase of the current heart beat, from 0 to 1.
+    uint64_t noiseState;        //!< The state of the noise generator.
+
+    double sbp;                 //!< The systolic blood pressure in mmHg.
+    double dbp;                 //!< The diastolic blood pressure in mmHg.
+    double map;                 //!< The mean arterial pressure in mmHg.
+    double heartRate;           //!< The heart rate in beats per minute.
+    double ratioSBP;            //!< Amplitude at the SBP relative to the maximal amplitude.
+    double ratioDBP;            //!< Amplitude at the DBP relative to the maximal amplitude.
+    double pumpUpValue;         //!< The pressure the cuff is inflated to in mmHg.
+    double ambientVoltage;      //!< The voltage at ambient pressure.
+    double corrFactor;          //!< The correction factor of the voltage divider.
+};
+
+#endif //OBP_SYNTHETICSAMPLESOURCE_H
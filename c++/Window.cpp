@@ -10,6 +10,7 @@
 #include "Window.h"
 #include <qwt/qwt_dial_needle.h>
 #include <iostream>
+#include <QtCore/QDateTime>
 #include <QtCore/QSettings>
 
 
@@ -24,17 +25,11 @@
 Window::Window(Processing *process, QWidget *parent) :
         dataLength(MAX_DATA_LENGTH),
         process(process),
+        dataQueue(DATA_QUEUE_SIZE),
+        droppedData(0),
         QMainWindow(parent)
 {
 
-    for (int i = 0; i < MAX_DATA_LENGTH; i++)
-    {
-        xData[i] = (double) (MAX_DATA_LENGTH - i) / process->getSamplingRate();
-        yLPData[i] = 0;
-        yHPData[i] = 0;
-    }
-
-    std::lock_guard<std::mutex> guard(mtxPlt);
     currentScreen = Screen::startScreen;
     setupUi(this);
 
@@ -45,13 +40,12 @@ Window::Window(Processing *process, QWidget *parent) :
 /**
  * The destructor of the Window class.
  *
- * Stops the process thread if the window is closed.
+ * Stops the process thread if the window is closed, so the window is not notified any more.
  */
 Window::~Window()
 {
     PLOG_VERBOSE << "Cleanup:";
-    process->stopThread();
-    process->join();
+    process->shutdown();
     PLOG_VERBOSE << "Application terminated.";
 }
 
@@ -219,10 +213,10 @@ QWidget *Window::setupPlots(QWidget *parent)
     /**
      * The axises of the plot are currently fixed and can not be changed.
      */
-    pltPre = new Plot(xData, yLPData, dataLength, 250, 0.0, parent);
+    pltPre = new Plot(dataLength, process->getSamplingRate(), 250, 0.0, parent);
     pltPre->setObjectName(QString::fromUtf8("pltPre"));
     pltPre->setAxisTitles("time (s)", "pressure (mmHg)");
-    pltOsc = new Plot(xData, yHPData, dataLength, 4, -3, parent);
+    pltOsc = new Plot(dataLength, process->getSamplingRate(), 4, -3, parent);
     pltOsc->setObjectName(QString::fromUtf8("pltOsc"));
     pltOsc->setAxisTitles("time (s)", "oscillations (ΔmmHg)");
 
@@ -542,33 +536,82 @@ void Window::retranslateUi(QMainWindow *window)
 /**
  * Handles the timer event to update the UI.
  *
- * Always acquires a mutex first, before accessing the plots.
+ * Empties the data queue in batches into the plots, updates the pressure meter with the latest value and redraws
+ * the plots.
  */
 void Window::timerEvent(QTimerEvent *)
 {
-    mtxPlt.lock();
-    pltOsc->replot();
-    pltPre->replot();
-    mtxPlt.unlock();
+    DataPair batch[DATA_BATCH_SIZE];
+    double pBatch[DATA_BATCH_SIZE];
+    double oBatch[DATA_BATCH_SIZE];
+    size_t n;
+    bool bNewData = false;
+    double lastPressure = 0.0;
+
+    while ((n = dataQueue.pop(batch)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            pBatch[i] = batch[i].pData;
+            oBatch[i] = batch[i].oData;
+        }
+        pltPre->setNewData(std::span<const double>(pBatch, n));
+        pltOsc->setNewData(std::span<const double>(oBatch, n));
+        lastPressure = pBatch[n - 1];
+        bNewData = true;
+    }
+
+    long dropped = droppedData.exchange(0);
+    if (dropped > 0)
+    {
+        PLOG_WARNING << "GUI too slow, dropped " << dropped << " data samples";
+    }
+
+    if (bNewData)
+    {
+        meter->setValue(lastPressure);
+        pltOsc->replot();
+        pltPre->replot();
+        process->recordDelivery();
+    }
 }
 
 /**
  * Handles notifications about a new data pair.
  *
- * Always acquires a mutex first, before accessing the plots.
- * Updates the pressure meter through a queued connection event that is called by the Qt thread.
+ * Called from the Processing thread. The data is only put in the queue and never waits for the GUI. If the queue is
+ * full, the data pair is dropped. The plots and the pressure meter are updated in the next timer event.
  * @param pData The newly available pressure data.
  * @param oData The newly available oscillation data.
  */
 void Window::eNewData(double pData, double oData)
 {
-    mtxPlt.lock();
-    pltPre->setNewData(pData);
-    pltOsc->setNewData(oData);
-    mtxPlt.unlock();
+    if (!dataQueue.push({pData, oData}))
+    {
+        droppedData++;
+    }
+}
 
-    bool bOk = QMetaObject::invokeMethod(meter, "setValue", Qt::QueuedConnection, Q_ARG(double, pData));
-    assert(bOk);
+/**
+ * Handles notifications about a block of new data pairs.
+ *
+ * Called from the Processing thread. The pairs are pushed to the queue in batches, so the queue indices are only
+ * updated once per batch. Pairs that do not fit in the queue are dropped.
+ * @param pData The newly available pressure data.
+ * @param oData The newly available oscillation data.
+ */
+void Window::eNewDataBlock(std::span<const double> pData, std::span<const double> oData)
+{
+    DataPair batch[DATA_PUSH_SIZE];
+    for (size_t first = 0; first < pData.size(); first += DATA_PUSH_SIZE)
+    {
+        const size_t n = std::min<size_t>(DATA_PUSH_SIZE, pData.size() - first);
+        for (size_t i = 0; i < n; i++)
+        {
+            batch[i] = {pData[first + i], oData[first + i]};
+        }
+        droppedData += (long) (n - dataQueue.push(std::span<const DataPair>(batch, n)));
+    }
 }
 
 /**
@@ -672,6 +715,10 @@ void Window::eReady()
      * Do not put function inside assert, because it will be removed in the release build!
      */
     assert(bOk);
+    // The settings file is written by the UI thread, not the Processing thread.
+    bOk = QMetaObject::invokeMethod(this, "saveAmbient", Qt::QueuedConnection,
+                                    Q_ARG(double, process->getAmbientVoltage()));
+    assert(bOk);
 }
 
 /**
@@ -762,6 +809,51 @@ void Window::loadSettings()
     settingsDialog->setPumpUpValue(iVal);
     process->setPumpUpValue(iVal);
     pumpUpVal = iVal;
+
+    /** The scheduling of the acquisition thread is only set in the settings file, e.g. "cpuAffinity=2,3".
+    */
+    ThreadAttributes attributes;
+    attributes.priority = settings.value("realtimePriority", 0).toInt();
+    attributes.bLockMemory = settings.value("lockMemory", false).toBool();
+    // The settings file stores a comma separated value as a list.
+    for (const QString &cpu : settings.value("cpuAffinity").toStringList().join(',').split(','))
+    {
+        if (!cpu.trimmed().isEmpty())
+        {
+            attributes.cpus.push_back(cpu.trimmed().toInt());
+        }
+    }
+    process->setThreadAttributes(attributes);
+
+    /** A recently calibrated ambient voltage lets the calibration finish as soon as the pressure is stable at it.
+    */
+    const QDateTime ambientTime = settings.value("ambientTime").toDateTime();
+    if (ambientTime.isValid() && ambientTime.secsTo(QDateTime::currentDateTime()) < AMBIENT_CACHE_AGE)
+    {
+        process->setCachedAmbient(settings.value("ambientVoltage").toDouble());
+    }
+
+    process->setArchive(settings.value("archive", "").toString().toStdString());
+    process->setStreaming(settings.value("streaming", false).toBool());
+
+    const int statsLogInterval = settings.value("statsLogInterval", 0).toInt();
+    process->setStatsLogInterval(statsLogInterval);
+    // the statistics are logged as info, which is below the default severity of the log file
+    if (statsLogInterval > 0 && plog::get() && plog::get()->getMaxSeverity() < plog::info)
+    {
+        plog::get()->setMaxSeverity(plog::info);
+    }
+}
+
+/**
+ * Stores the calibrated ambient voltage in the settings file, so it can be reused after a restart.
+ * @param voltage The ambient voltage.
+ */
+void Window::saveAmbient(double voltage)
+{
+    QSettings settings;
+    settings.setValue("ambientVoltage", voltage);
+    settings.setValue("ambientTime", QDateTime::currentDateTime());
 }
 
 /**
@@ -26,9 +26,9 @@
 #include <QtWidgets/QSplitter>
 #include <QtWidgets/QStackedWidget>
 #include <QtWidgets/QFormLayout>
-#include <mutex>
 #include "common.h"
 #include "IObserver.h"
+#include "SPSCQueue.h"
 #include "Plot.h"
 #include "Processing.h"
 #include "SettingsDialog.h"
@@ -37,6 +37,10 @@
  * Class dependant configuration values:
  */
 #define SCREEN_UPDATE_MS 50  //!< Screen update rate in ms.
+#define DATA_QUEUE_SIZE  MAX_DATA_LENGTH //!< Number of data pairs that can be queued between two screen updates.
+#define DATA_BATCH_SIZE  256 //!< Number of data pairs taken from the queue at once.
+#define DATA_PUSH_SIZE   64  //!< Number of data pairs put in the queue at once.
+#define AMBIENT_CACHE_AGE 3600 //!< Time in s the last calibrated ambient voltage is reused after a restart.
 
 
 //! The Window class is the implementation of the graphical user interface (GUI).
@@ -51,6 +55,9 @@
  * The Window object is instantiated with a reference to a Processing object in the constructor. This is necessary
  * so the user inputs can be relayed and the Processing thread can be stopped when the window is closed, and the
  * application exited.
+ *
+ * New data is handed from the Processing thread to the GUI through a lock-free queue. The Processing thread never
+ * waits on the GUI, the plots are only touched by the Qt thread when it empties the queue before redrawing.
  */
 class Window : public QMainWindow, public IObserver
 {
@@ -65,6 +72,7 @@ protected:
 private:
     // Callbacks from observable class, need to be implemented in a thread safe way:
     void eNewData(double pData, double oData) override;
+    void eNewDataBlock(std::span<const double> pData, std::span<const double> oData) override;
     void eSwitchScreen(Screen eNewScreen) override;
     void eResults(double map, double sbp, double dbp) override;
     void eHeartRate(double map) override;
@@ -86,9 +94,6 @@ private:
     // Settings:
     void loadSettings();
     Processing *process;
-    double xData[MAX_DATA_LENGTH],    //!< X-axis of the plot data (time)
-    yLPData[MAX_DATA_LENGTH],         //!< Y-axis of the low-pass filtered pressure data.
-    yHPData[MAX_DATA_LENGTH];         //!< Y-axis of the high-pass filtered data.
     int dataLength;                   //!< Length of the shown data. Possibility to change zoom.
     int pumpUpVal;                    //!< Pump-up value used to display required pressure.
 
@@ -96,7 +101,13 @@ private:
     // atomic, so access to them is thread safe.
     std::atomic<Screen> currentScreen;
 
-    std::mutex mtxPlt;                //!< mutex for thread save access to the plots:
+    //! A pair of new data samples, as they are passed from the Processing thread to the GUI.
+    struct DataPair {
+        double pData;   //!< The pressure data sample.
+        double oData;   //!< The oscillation data sample.
+    };
+    SPSCQueue<DataPair> dataQueue;    //!< Lock-free queue of new data, filled by Processing, emptied by the Qt thread.
+    std::atomic<long> droppedData;    //!< Data pairs dropped because the queue was full.
 
     // UI components:
     QSplitter *splitter;
@@ -165,6 +176,7 @@ private slots:
     void on_actionExit_triggered();
     void updateValues();
     void resetValuesPerform();
+    void saveAmbient(double voltage);
 };
 
 
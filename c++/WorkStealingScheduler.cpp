@@ -0,0 +1,201 @@
+/**
+ * @file        WorkStealingScheduler.cpp
+ * @brief       The implementation of the WorkStealingScheduler class.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ */
+#include <algorithm>
+#include <chrono>
+
+#include "WorkStealingScheduler.h"
+
+/**
+ * Constructor of the WorkStealingScheduler, creates the workers without starting them.
+ * @param nWorkers The number of worker threads, at least 1.
+ */
+WorkStealingScheduler::WorkStealingScheduler(unsigned int nWorkers) :
+        nextWorker(0),
+        nQueued(0),
+        bRunning(false) {
+    for (unsigned int i = 0; i < std::max(1u, nWorkers); i++) {
+        workers.push_back(std::make_unique<Worker>(*this, i));
+    }
+}
+
+/**
+ * Destructor of the WorkStealingScheduler, stops the workers if they are still running.
+ */
+WorkStealingScheduler::~WorkStealingScheduler() {
+    stop();
+}
+
+/**
+ * Starts the worker threads.
+ */
+void WorkStealingScheduler::start() {
+    bRunning = true;
+    for (auto &worker : workers) {
+        worker->start();
+    }
+}
+
+/**
+ * Stops the worker threads and waits until they finished. Tasks that are still queued are not run any more, they are
+ * removed from the queues and can be submitted again after a restart.
+ */
+void WorkStealingScheduler::stop() {
+    if (!bRunning) {
+        return;
+    }
+    for (auto &worker : workers) {
+        worker->requestStop();
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        bRunning = false;
+    }
+    wakeUp.notify_all();
+    for (auto &worker : workers) {
+        worker->join();
+        while (SerialTask *task = worker->pop()) {
+            task->bScheduled = false;
+        }
+    }
+    nQueued = 0;
+}
+
+/**
+ * Submits a task after new work was queued for it. If the task is already queued or running, nothing happens, the
+ * worker that runs it will find the new work.
+ *
+ * The work has to be queued before the task is submitted.
+ * @param task The task.
+ */
+void WorkStealingScheduler::submit(SerialTask *task) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!task->bScheduled.exchange(true)) {
+        enqueue(nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size(), task);
+    }
+}
+
+/**
+ * Gets the number of worker threads.
+ * @return The number of workers.
+ */
+unsigned int WorkStealingScheduler::getNumWorkers() const {
+    return (unsigned int) workers.size();
+}
+
+/**
+ * Adds a task to the queue of a worker and wakes an idle worker.
+ * @param worker The index of the worker.
+ * @param task The task.
+ */
+void WorkStealingScheduler::enqueue(unsigned int worker, SerialTask *task) {
+    workers[worker]->push(task);
+    nQueued++;
+    {
+        // Taking the lock makes sure a worker that is about to sleep sees the task.
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeUp.notify_one();
+}
+
+/**
+ * Finds the next task for a worker, from its own queue or stolen from another one. Sleeps if there is no task.
+ * @param worker The index of the worker.
+ * @return The task, or nullptr if there was none.
+ */
+SerialTask *WorkStealingScheduler::findTask(unsigned int worker) {
+    SerialTask *task = workers[worker]->pop();
+    for (size_t i = 1; !task && i < workers.size(); i++) {
+        task = workers[(worker + i) % workers.size()]->steal();
+    }
+    if (task) {
+        nQueued--;
+        return task;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wakeUp.wait_for(lock, std::chrono::milliseconds(SCHED_IDLE_WAIT_MS),
+                    [this] { return nQueued > 0 || !bRunning; });
+    return nullptr;
+}
+
+/**
+ * Runs a task and queues it again if it has more work. The task is released first and then checked again, so work
+ * that was queued while it ran is never missed.
+ * @param worker The index of the worker running the task.
+ * @param task The task.
+ */
+void WorkStealingScheduler::runTask(unsigned int worker, SerialTask *task) {
+    if (task->runPending()) {
+        enqueue(worker, task);
+        return;
+    }
+    task->bScheduled.store(false);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (task->hasPending() && !task->bScheduled.exchange(true)) {
+        enqueue(worker, task);
+    }
+}
+
+/**
+ * Constructor of a worker.
+ * @param scheduler The scheduler the worker belongs to.
+ * @param index The index of the worker.
+ */
+WorkStealingScheduler::Worker::Worker(WorkStealingScheduler &scheduler, unsigned int index) :
+        scheduler(scheduler),
+        index(index) {
+}
+
+/**
+ * Adds a task to the back of the queue.
+ * @param task The task.
+ */
+void WorkStealingScheduler::Worker::push(SerialTask *task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(task);
+}
+
+/**
+ * Takes the oldest task of the own queue.
+ * @return The task, or nullptr if the queue is empty.
+ */
+SerialTask *WorkStealingScheduler::Worker::pop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty()) {
+        return nullptr;
+    }
+    SerialTask *task = tasks.front();
+    tasks.pop_front();
+    return task;
+}
+
+/**
+ * Takes the newest task of the queue, called by other workers.
+ * @return The task, or nullptr if the queue is empty.
+ */
+SerialTask *WorkStealingScheduler::Worker::steal() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty()) {
+        return nullptr;
+    }
+    SerialTask *task = tasks.back();
+    tasks.pop_back();
+    return task;
+}
+
+/**
+ * The main running function of the worker, runs tasks until it is stopped.
+ */
+void WorkStealingScheduler::Worker::run() {
+    while (!stopRequested()) {
+        if (SerialTask *task = scheduler.findTask(index)) {
+            scheduler.runTask(index, task);
+        }
+    }
+}
@@ -0,0 +1,114 @@
+/**
+ * @file        WorkStealingScheduler.h
+ * @brief       The header file of the WorkStealingScheduler and SerialTask classes.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Defines the WorkStealingScheduler and SerialTask classes and contains the general class descriptions.
+ */
+#ifndef OBP_WORKSTEALINGSCHEDULER_H
+#define OBP_WORKSTEALINGSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CppThread.h"
+
+/**
+ * Class dependant configuration values:
+ */
+#define SCHED_IDLE_WAIT_MS  100     //!< Maximal time in ms an idle worker sleeps before it checks if it stops.
+
+//! The SerialTask class is work whose parts have to run one after the other, e.g. the processing of one channel.
+/*!
+ * A task is submitted to a WorkStealingScheduler whenever new work for it was queued. The scheduler makes sure that
+ * a task is queued at most once and is never run by two workers at the same time, so the work of a task is always
+ * done in the order it was queued, no matter which worker runs it. Different tasks run in parallel.
+ */
+class SerialTask {
+
+public:
+    virtual ~SerialTask() = default;
+
+    /**
+     * Does the work that is pending. Called by one worker at a time.
+     * @return True if there is still work pending, e.g. because only part of it was done to let other tasks run.
+     */
+    virtual bool runPending() = 0;
+
+    /**
+     * Checks if there is work pending, without doing it.
+     * @return True if there is work pending.
+     */
+    virtual bool hasPending() = 0;
+
+protected:
+    /**
+     * Protected constructor, cannot be instantiated directly.
+     */
+    SerialTask() = default;
+
+private:
+    friend class WorkStealingScheduler;
+
+    std::atomic<bool> bScheduled = false;   //!< The task is queued or running.
+};
+
+//! The WorkStealingScheduler class runs SerialTasks on a pool of worker threads.
+/*!
+ * Every worker has its own queue of tasks. Submitted tasks are distributed over the queues in turn, and a task that
+ * has more work left after it ran is queued again at the back of the same worker's queue. A worker takes the oldest
+ * task from its own queue, so the tasks take turns, and if it is empty, steals the newest task from the queue of
+ * another worker. This way, the load is balanced when the work of some tasks piles up, e.g. when the peaks of
+ * several channels line up, without a common queue that every submit has to lock. Idle workers sleep until a task
+ * is submitted.
+ */
+class WorkStealingScheduler {
+
+public:
+    explicit WorkStealingScheduler(unsigned int nWorkers);
+    ~WorkStealingScheduler();
+
+    void start();
+    void stop();
+    void submit(SerialTask *task);
+    [[nodiscard]] unsigned int getNumWorkers() const;
+
+private:
+    //! A worker thread with its own queue of tasks.
+    class Worker : public CppThread {
+    public:
+        Worker(WorkStealingScheduler &scheduler, unsigned int index);
+
+        void push(SerialTask *task);
+        SerialTask *pop();
+        SerialTask *steal();
+
+    private:
+        void run() override;
+
+        WorkStealingScheduler &scheduler;   //!< The scheduler the worker belongs to.
+        const unsigned int index;           //!< The index of the worker in the scheduler.
+        std::mutex mutex;                   //!< Protects the queue.
+        std::deque<SerialTask *> tasks;     //!< The queued tasks, the oldest at the front.
+    };
+
+    void enqueue(unsigned int worker, SerialTask *task);
+    SerialTask *findTask(unsigned int worker);
+    void runTask(unsigned int worker, SerialTask *task);
+
+    std::vector<std::unique_ptr<Worker>> workers;   //!< The worker threads.
+    std::atomic<unsigned int> nextWorker;           //!< The worker that gets the next submitted task.
+    std::atomic<int> nQueued;                       //!< The number of queued tasks over all workers.
+    std::atomic<bool> bRunning;                     //!< The workers are running.
+    std::mutex sleepMutex;                          //!< Protects the sleeping of idle workers.
+    std::condition_variable wakeUp;                 //!< Wakes idle workers when a task is queued.
+};
+
+#endif //OBP_WORKSTEALINGSCHEDULER_H
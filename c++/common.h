@@ -23,9 +23,37 @@
 //!< Data length per plot for memory allocation
 #define AMBIENT_AV_TIME     250         //!< The averaging time to detect ambient pressure in ms
 #define AMBIENT_DEVIATION   0.001       //!< Allowed deviation for average value in V
+#define AMBIENT_CACHE_TIME  25          //!< The time in ms the pressure has to match a cached ambient voltage
 #define DEFAULT_MINUTES     5           //!< Maximum allowed minutes for
 #define DEFAULT_DATA_SIZE   SAMPLING_RATE*60*DEFAULT_MINUTES
 //!< Maximum allowed data size
+#define KPA_PER_MMHG        0.133322    //!< Value of kPa per 1 mmHg, from literature.
+#define KPA_PER_V           50.0        //!< Value of kPa per 1 V, from pressure sensor data sheet.
+
+/**
+ * Converts a voltage of the pressure sensor to mmHg. All conversions use this function, so a change of the
+ * calibration applies to the measurement, the recordings and the archive alike.
+ * @param voltage The voltage.
+ * @param ambientVoltage The voltage at ambient pressure.
+ * @param corrFactor The correction factor of the voltage divider.
+ * @return The pressure in mmHg.
+ */
+inline double voltageToMmHg(double voltage, double ambientVoltage, double corrFactor)
+{
+    return ((voltage - ambientVoltage) * KPA_PER_V * corrFactor) / KPA_PER_MMHG;
+}
+
+/**
+ * Converts a pressure in mmHg to the voltage of the pressure sensor, the inverse of voltageToMmHg.
+ * @param pressure The pressure in mmHg.
+ * @param ambientVoltage The voltage at ambient pressure.
+ * @param corrFactor The correction factor of the voltage divider.
+ * @return The voltage.
+ */
+inline double mmHgToVoltage(double pressure, double ambientVoltage, double corrFactor)
+{
+    return ambientVoltage + (pressure * KPA_PER_MMHG) / (KPA_PER_V * corrFactor);
+}
 /**
  * Limits for the configurable variables in Processing and OBPDetection
  */
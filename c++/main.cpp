@@ -14,22 +14,108 @@
 
 
 #include <QApplication>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
 #include "common.h"
+#include "ComediHandler.h"
 #include "Processing.h"
+#include "NetworkSink.h"
+#include "SharedMemorySink.h"
 #include "Window.h"
 #include <plog/Initializers/RollingFileInitializer.h>
 
+/**
+ * Runs the measurement without a user interface and streams everything to a collector.
+ *
+ * The measurements are controlled with the commands "start", "stop" and "quit" on the standard input, one per line.
+ * @param collector The collector as host or host:port.
+ * @param station The identifier of this station.
+ * @param shmName The name of the shared memory to publish the data in, nullptr to not publish it.
+ * @return The exit code of the application.
+ */
+static int runHeadless(const std::string &collector, uint32_t station, const char *shmName) {
+    std::string host = collector;
+    uint16_t port = NET_DEFAULT_PORT;
+    const size_t colon = collector.rfind(':');
+    if (colon != std::string::npos && collector.find(':') == colon) {
+        host = collector.substr(0, colon);
+        port = (uint16_t) std::atoi(collector.c_str() + colon + 1);
+    }
+
+    ComediHandler comedi;
+    Processing procThread(&comedi);
+    NetworkSink sink(host, port, station, procThread.getSamplingRate());
+    procThread.attach(&sink);
+    std::unique_ptr<SharedMemorySink> shmSink;
+    if (shmName) {
+        shmSink = std::make_unique<SharedMemorySink>(shmName, &procThread, SHM_DEFAULT_CAPACITY,
+                                                     procThread.getSamplingRate());
+        procThread.attach(shmSink.get());
+    }
+    sink.start();
+    procThread.start();
+
+    // The device is opened in the background, the station can not run without it.
+    const bool bOpen = comedi.waitUntilOpen();
+    std::string command;
+    while (bOpen && std::getline(std::cin, command) && command != "quit") {
+        if (command == "start") {
+            procThread.startMeasurement();
+        } else if (command == "stop") {
+            procThread.stopMeasurement();
+        } else if (!command.empty()) {
+            std::cerr << "Unknown command: " << command << std::endl;
+        }
+    }
+
+    procThread.shutdown();
+    sink.stopThread();
+    sink.join();
+    return bOpen ? 0 : 1;
+}
+
 int main(int argc, char **argv) {
 
     plog::init(plog::warning, "obp_log.csv", 1000000, 5);
 
     PLOG_VERBOSE << "Application started.";
+
+    /**
+     * With --headless, no window is created and the data is streamed to a collector instead.
+     * With --shm, the data is also published in shared memory for local processes.
+     */
+    const char *collector = nullptr;
+    const char *shmName = nullptr;
+    uint32_t station = 0;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            collector = argv[++i];
+        } else if (std::strcmp(argv[i], "--station") == 0) {
+            station = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--shm") == 0) {
+            shmName = argv[++i];
+        }
+    }
+    if (collector) {
+        return runHeadless(collector, station, shmName);
+    }
+
     QApplication app(argc, argv);
     // The following values are set to make storing settings simple.
     app.setOrganizationName("UofG");
     app.setApplicationName("Oscillometric Blood Pressure Measurement");
 
-    Processing procThread;
+    ComediHandler comedi;
+    std::unique_ptr<SharedMemorySink> shmSink;   // destroyed after the processing stopped
+    Processing procThread(&comedi);
+    if (shmName) {
+        shmSink = std::make_unique<SharedMemorySink>(shmName, &procThread, SHM_DEFAULT_CAPACITY,
+                                                     procThread.getSamplingRate());
+        procThread.attach(shmSink.get());
+    }
 
     Window mainW(&procThread);
     mainW.show();
@@ -37,6 +123,10 @@ int main(int argc, char **argv) {
     procThread.attach(&mainW);
     procThread.start();
 
+    // The window is set up while the device is opened in the background, it can not run without it.
+    if (!comedi.waitUntilOpen()) {
+        return 1;
+    }
     return app.exec();
 
 }
@@ -0,0 +1,161 @@
+/**
+ * @file        obp_archive.cpp
+ * @brief       Conversion of recorded measurements to an archive
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Appends recorded files to an archive, one session per file, and lists the sessions of an archive. Directories are
+ * searched for binary recordings and text files. Every file is replayed once while it is converted, so the index of
+ * the archive contains the results of the algorithm.
+ *
+ * Binary recordings are stored with the settings in their header. Text files are expected to contain voltages, like
+ * the data sets in the data folder, their settings are given by the options.
+ *
+ * Usage: obp_archive [options] <archive> <file or directory>...
+ *        obp_archive --list <archive>
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <numeric>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <plog/Initializers/RollingFileInitializer.h>
+
+#include "common.h"
+#include "ArchiveFormat.h"
+#include "RecordFormat.h"
+#include "Replay.h"
+
+/**
+ * Prints how to use the program.
+ * @param name The name of the program.
+ */
+static void printUsage(const char *name) {
+    std::fprintf(stderr,
+                 "Usage: %s [options] <archive> <file or directory>...\n"
+                 "       %s --list <archive>\n"
+                 "  --fs <Hz>        sampling rate of text files (default: %d)\n"
+                 "  --ambient <V>    ambient voltage of text files (default: mean of the first %d samples)\n"
+                 "  --corr <f>       correction factor of text files (default: 2.6)\n",
+                 name, name, SAMPLING_RATE, AMBIENT_AV_TIME);
+}
+
+/**
+ * Adds a file, or all recordings in a directory sorted by name, to the files to convert.
+ * @param path The file or directory.
+ * @param files The files to convert.
+ */
+static void addPath(const std::string &path, std::vector<std::string> &files) {
+    namespace fs = std::filesystem;
+    if (!fs::is_directory(path)) {
+        files.push_back(path);
+        return;
+    }
+    std::vector<std::string> found;
+    for (const auto &entry : fs::directory_iterator(path)) {
+        const auto extension = entry.path().extension();
+        if (entry.is_regular_file() && (extension == RECORD_EXTENSION || extension == ".dat")) {
+            found.push_back(entry.path().string());
+        }
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+/**
+ * Lists the sessions of an archive, one tab separated line per session.
+ * @param fileName The name of the archive.
+ * @return The exit code.
+ */
+static int listArchive(const std::string &fileName) {
+    ArchiveReader reader;
+    if (!reader.open(fileName)) {
+        std::fprintf(stderr, "Could not read %s\n", fileName.c_str());
+        return 1;
+    }
+    std::printf("session\ttimestamp\tname\tfs\tsamples\tmap\tsbp\tdbp\thr\n");
+    for (size_t i = 0; i < reader.getNumSessions(); i++) {
+        const ArchiveEntry &entry = reader.getEntry(i);
+        std::printf("%lu\t%ld\t%s\t%.0f\t%lu\t%.2f\t%.2f\t%.2f\t%.1f\n", (unsigned long) entry.sessionId,
+                    (long) entry.timestamp, entry.name, entry.samplingRate, (unsigned long) entry.nSamples,
+                    entry.results.map, entry.results.sbp, entry.results.dbp, entry.results.hr);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+
+    plog::init(plog::warning, "obp_archive_log.csv", 1000000, 5);
+
+    ReplayConfig config;
+    const char *archive = nullptr;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const bool bHasValue = i + 1 < argc;
+        if (std::strcmp(arg, "--list") == 0 && bHasValue) {
+            return listArchive(argv[i + 1]);
+        } else if (std::strcmp(arg, "--fs") == 0 && bHasValue) {
+            config.samplingRate = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--ambient") == 0 && bHasValue) {
+            config.ambientVoltage = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--corr") == 0 && bHasValue) {
+            config.corrFactor = std::atof(argv[++i]);
+        } else if (arg[0] == '-') {
+            printUsage(argv[0]);
+            return 1;
+        } else if (!archive) {
+            archive = arg;
+        } else {
+            addPath(arg, files);
+        }
+    }
+
+    if (!archive || files.empty() || config.samplingRate <= 0.0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    ReplaySession session(config);
+    int nFailed = 0;
+    for (const std::string &file : files) {
+        RecordHeader header;
+        std::vector<double> samples;
+        bool bOk;
+        if (std::filesystem::path(file).extension() == RECORD_EXTENSION) {
+            bOk = readRecord(file, header, samples);
+        } else {
+            bOk = readTextRecord(file, samples) && !samples.empty();
+            /**
+             * Without a configured ambient voltage, the start of the recording is assumed to be at ambient pressure,
+             * like in the replay.
+             */
+            double ambientVoltage = config.ambientVoltage;
+            if (bOk && ambientVoltage == 0.0) {
+                const size_t n = std::min<size_t>(samples.size(), AMBIENT_AV_TIME);
+                ambientVoltage = std::accumulate(samples.begin(), samples.begin() + (long) n, 0.0) / n;
+            }
+            header = makeRecordHeader(config.samplingRate, ambientVoltage, config.corrFactor, config.fcLP,
+                                      config.fcHP, IIRORDER);
+        }
+
+        struct stat fileStat{};
+        stat(file.c_str(), &fileStat);
+        const ReplayResult result = session.replay(file);
+        const ArchiveResults results{result.map, result.sbp, result.dbp, result.hr};
+        const std::string name = std::filesystem::path(file).stem().string();
+        if (!bOk || !appendArchiveSession(archive, makeArchiveEntry(header, fileStat.st_mtime, name, results),
+                                          samples)) {
+            std::fprintf(stderr, "Could not convert %s\n", file.c_str());
+            nFailed++;
+        }
+    }
+    return nFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,592 @@
+/**
+ * @file        obp_bench.cpp
+ * @brief       Benchmark of the per-sample processing stages
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Measures the cost of every profiled stage of the pipeline (see Profiler.h) in ns per sample and allocations per
+ * sample. The program links the core built with OBP_PROFILE defined and replaces the global operator new to count
+ * allocations.
+ *
+ * The following benchmarks are run, each one on its own with fresh statistics, and repeated several times:
+ *  - detection:  the pre-filtered pressure and oscillation in tests/p.dat and tests/o.dat, passed to OBPDetection
+ *                directly, as in the OBPDetection test.
+ *  - replay:     all recordings in the data folder, converted, filtered and passed to OBPDetection by a ReplaySession.
+ *  - pipeline:   the text recordings of the data folder, converted, filtered and analysed by a Pipeline specialised
+ *                for SAMPLING_RATE and IIRORDER.
+ *  - processing: a whole measurement of a SyntheticSampleSource through the Processing thread, without recording.
+ *  - plot:       the filtered recordings added to a MinMaxDecimator in the blocks the Window passes to the plots.
+ *
+ * OBPDetection::processSample is split into the steady-state path (DetectionSteady) and the calls that found a new
+ * peak and recalculated the minima, the OMWE and the results (DetectionPeak). Besides the mean, the p99 and the
+ * maximal duration of a call are shown, so the per-peak spikes are visible.
+ *
+ * A baseline can be saved and compared against. A stage is reported as a regression if its ns/sample or
+ * allocations/sample exceed the baseline by more than the threshold, and the program then returns 1. The timing of
+ * stages with only a few calls, like FindMAP, is too noisy and only their allocations are compared.
+ *
+ * Every run also times a fixed reference workload, a biquad cascade that does not use the code under test. The
+ * timing of the baseline is scaled by how much faster or slower the reference ran than in the baseline, so a
+ * baseline saved on one machine can be compared against on another. The scaling only holds for builds with the
+ * same optimisation, the tracked baseline tests/bench_baseline.tsv is saved from a Release build with
+ * `obp_bench --save tests/bench_baseline.tsv` in the c++ folder. Unoptimised builds compare the allocations only.
+ *
+ * Usage: obp_bench [options]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <plog/Initializers/RollingFileInitializer.h>
+
+#include "common.h"
+#include "MinMaxDecimator.h"
+#include "OBPDetection.h"
+#include "Pipeline.h"
+#include "Processing.h"
+#include "Profiler.h"
+#include "RecordFormat.h"
+#include "Replay.h"
+#include "SignalConditioner.h"
+#include "SyntheticSampleSource.h"
+
+/**
+ * Class dependant configuration values:
+ */
+#define BENCH_REPEAT        10      //!< Default number of times every benchmark is repeated.
+#define BENCH_THRESHOLD     0.25    //!< Default allowed relative increase over the baseline.
+#define BENCH_MIN_ALLOCS    0.001   //!< Allocations per sample that are always allowed above the baseline.
+#define BENCH_MIN_CALLS     100     //!< Minimal number of calls for the timing of a stage to be compared.
+#define BENCH_PLOT_COLUMNS  800     //!< Number of columns of the benchmarked plot, about its width in pixels.
+#define BENCH_PLOT_BATCH    256     //!< Number of samples added to the plots at once, DATA_BATCH_SIZE of the Window.
+#define BENCH_TIMEOUT       60      //!< Maximal time in s for a measurement through the Processing thread.
+#define BENCH_REF_SAMPLES   100000  //!< Number of samples of the reference workload per call.
+#define BENCH_REF_CALLS     20      //!< Number of calls of the reference workload per run.
+#define BENCH_REFERENCE     "reference/biquad"  //!< The name of the reference workload in the results.
+
+/**
+ * The global operator new is replaced to count the allocations of every thread, the other forms call these ones.
+ */
+void *operator new(size_t size) {
+    profileAllocations++;
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+//! The measured cost of one stage in one benchmark.
+struct BenchResult {
+    std::string name;           //!< The benchmark and the stage, as "benchmark/stage".
+    uint64_t calls;             //!< The number of calls.
+    double nsPerSample;         //!< The mean duration per sample in ns.
+    double allocsPerSample;     //!< The mean number of allocations per sample.
+    uint64_t p99Ns;             //!< The upper bound of the duration of 99 % of the calls in ns.
+    uint64_t maxNs;             //!< The longest call in ns.
+};
+
+/**
+ * Gets the name of a stage.
+ * @param stage The stage.
+ * @return The name.
+ */
+static const char *stageName(ProfileStage stage) {
+    switch (stage) {
+        case ProfileStage::ProcessBlock:
+            return "process_block";
+        case ProfileStage::Conditioning:
+            return "conditioning";
+        case ProfileStage::DetectionSteady:
+            return "detection_steady";
+        case ProfileStage::DetectionPeak:
+            return "detection_peak";
+        case ProfileStage::CheckMaxima:
+            return "check_maxima";
+        case ProfileStage::FindMinima:
+            return "find_minima";
+        case ProfileStage::FindOMWE:
+            return "find_omwe";
+        case ProfileStage::FindMAP:
+            return "find_map";
+        case ProfileStage::PlotDecimation:
+            return "plot_decimation";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * Resets the statistics of all stages, before a benchmark starts.
+ */
+static void resetStats() {
+    for (auto &stats : profileStats) {
+        stats.calls = 0;
+        stats.samples = 0;
+        stats.totalNs = 0;
+        stats.maxNs = 0;
+        stats.allocations = 0;
+        for (auto &bucket : stats.histogram) {
+            bucket = 0;
+        }
+    }
+}
+
+/**
+ * Adds the result of a run to the results. The benchmarks are run several times and only the fastest run of every
+ * stage is kept, it is the least disturbed by the rest of the system.
+ * @param res The result of the run.
+ * @param results The results, new stages are added at the end, known stages are replaced by a faster run.
+ */
+static void keepFastest(const BenchResult &res, std::vector<BenchResult> &results) {
+    auto it = std::find_if(results.begin(), results.end(),
+                           [&res](const BenchResult &other) { return other.name == res.name; });
+    if (it == results.end()) {
+        results.push_back(res);
+    } else if (res.nsPerSample < it->nsPerSample) {
+        *it = res;
+    }
+}
+
+/**
+ * Collects the statistics of all stages that were called during a run of a benchmark.
+ * @param bench The name of the benchmark.
+ * @param results The results, see keepFastest().
+ */
+static void collectStats(const char *bench, std::vector<BenchResult> &results) {
+    for (int s = 0; s < (int) ProfileStage::Count; s++) {
+        const ProfileStats &stats = profileStats[s];
+        const uint64_t calls = stats.calls;
+        if (calls == 0) {
+            continue;
+        }
+        const double samples = (double) std::max<uint64_t>(stats.samples, 1);
+
+        uint64_t count = 0;
+        int bucket = 0;
+        while (bucket < PROFILE_BUCKETS - 1 && (count += stats.histogram[bucket]) * 100 < calls * 99) {
+            bucket++;
+        }
+        const BenchResult res{std::string(bench) + "/" + stageName((ProfileStage) s), calls,
+                              (double) stats.totalNs / samples, (double) stats.allocations / samples,
+                              std::min<uint64_t>(2ull << bucket, stats.maxNs), stats.maxNs};
+        keepFastest(res, results);
+    }
+}
+
+/**
+ * Times the reference workload: a fourth order low-pass biquad cascade with fixed coefficients over a fixed signal.
+ * It does not use any code of the core, so it only changes with the machine and the compiler.
+ * @param results The results, see keepFastest().
+ */
+static void benchReference(std::vector<BenchResult> &results) {
+    static const double coeffs[2][5] = {{0.0001, 0.0002, 0.0001, -1.95, 0.951},
+                                        {1.0, 2.0, 1.0, -1.97, 0.972}};    // b0, b1, b2, a1, a2
+    std::vector<double> signal(BENCH_REF_SAMPLES);
+    for (size_t i = 0; i < signal.size(); i++) {
+        signal[i] = (double) (i % 1000) * 0.001;
+    }
+
+    double state[2][2] = {};
+    uint64_t totalNs = 0, maxNs = 0;
+    volatile double sink = 0.0;
+    for (int c = 0; c < BENCH_REF_CALLS; c++) {
+        const auto start = std::chrono::steady_clock::now();
+        for (double x : signal) {
+            for (int s = 0; s < 2; s++) {
+                const double *k = coeffs[s];
+                const double w = x - k[3] * state[s][0] - k[4] * state[s][1];
+                x = k[0] * w + k[1] * state[s][0] + k[2] * state[s][1];
+                state[s][1] = state[s][0];
+                state[s][0] = w;
+            }
+            sink = x;
+        }
+        const auto ns = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        totalNs += ns;
+        maxNs = std::max(maxNs, ns);
+    }
+    (void) sink;
+    keepFastest({BENCH_REFERENCE, BENCH_REF_CALLS, (double) totalNs / (BENCH_REF_CALLS * BENCH_REF_SAMPLES), 0.0,
+                 maxNs, maxNs}, results);
+}
+
+/**
+ * Finds the recordings in a directory, sorted by name.
+ * @param path The directory.
+ * @return The binary recordings and text files in the directory.
+ */
+static std::vector<std::string> findRecordings(const std::string &path) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+    if (!fs::is_directory(path)) {
+        return files;
+    }
+    for (const auto &entry : fs::directory_iterator(path)) {
+        const auto extension = entry.path().extension();
+        if (entry.is_regular_file() && (extension == RECORD_EXTENSION || extension == ".dat")) {
+            files.push_back(entry.path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+/**
+ * Runs the pre-filtered test data through OBPDetection until there is enough data.
+ * @param testDir The directory with p.dat and o.dat.
+ * @return True if the test data could be read.
+ */
+static bool benchDetection(const std::string &testDir) {
+    std::vector<double> pressure, oscillation;
+    if (!readTextRecord(testDir + "/p.dat", pressure) || !readTextRecord(testDir + "/o.dat", oscillation)) {
+        return false;
+    }
+    const size_t n = std::min(pressure.size(), oscillation.size());
+
+    OBPDetection obpDetect(SAMPLING_RATE);
+    obpDetect.resetConfigValues();
+    resetStats();
+    for (size_t i = 0; i < n; i++) {
+        if (obpDetect.processSample(pressure[i], oscillation[i]) && obpDetect.getIsEnoughData()) {
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * Replays all recordings of the data folder, one after the other in this thread.
+ * @param files The recordings.
+ */
+static void benchReplay(const std::vector<std::string> &files) {
+    ReplayConfig config;
+    ReplaySession session(config);
+    resetStats();
+    for (const auto &file : files) {
+        session.replay(file);
+    }
+}
+
+/**
+ * Converts, filters and analyses the text recordings with a Pipeline specialised for the nominal rate and order. As
+ * in the replay, the samples are passed to the detection once the pressure exceeded the pump-up value and until
+ * there is enough data. The recordings are read beforehand, only the pipeline is measured.
+ * @param files The recordings.
+ */
+static void benchPipeline(const std::vector<std::string> &files) {
+    std::vector<std::vector<double>> recordings;
+    std::vector<double> samples;
+    for (const auto &file : files) {
+        if (std::filesystem::path(file).extension() == ".dat" && readTextRecord(file, samples)) {
+            recordings.push_back(samples);
+        }
+    }
+
+    using BenchPipeline = Pipeline<SAMPLING_RATE, IIRORDER>;
+    auto pipeline = std::make_unique<BenchPipeline>(10.0, 0.5);
+    pipeline->getDetection().resetConfigValues();
+    std::vector<double> ymmHg(BenchPipeline::blockSize), yLP(BenchPipeline::blockSize), yHP(BenchPipeline::blockSize);
+    resetStats();
+    for (const auto &recording : recordings) {
+        OBPDetection &detection = pipeline->getDetection();
+        pipeline->setCalibration(recording.front(), 2.6);
+        pipeline->reset();
+        detection.reset();
+        bool bDeflating = false;
+        bool bFinished = false;
+        for (size_t i = 0; i < recording.size() && !bFinished; i += BenchPipeline::blockSize) {
+            const auto block = std::span<const double>(recording).subspan(
+                    i, std::min<size_t>(BenchPipeline::blockSize, recording.size() - i));
+            pipeline->process(block, ymmHg, yLP, yHP);
+            for (size_t j = 0; j < block.size() && !bFinished; j++) {
+                if (!bDeflating) {
+                    bDeflating = ymmHg[j] > PUMP_UP_VALUE_MIN;
+                    continue;
+                }
+                bFinished = (detection.processSample(yLP[j], yHP[j]) && detection.getIsEnoughData()) ||
+                            ymmHg[j] < REPLAY_MIN_PRESSURE;
+            }
+        }
+    }
+}
+
+/**
+ * Adds the filtered pressure and oscillation of the text recordings to two decimated plots, in the batches the
+ * Window takes from its queue. The recordings are filtered beforehand, only adding them to the plots is measured.
+ * @param files The recordings.
+ */
+static void benchPlot(const std::vector<std::string> &files) {
+    std::vector<std::vector<double>> pressure, oscillation;
+    std::vector<double> samples, ymmHg;
+    for (const auto &file : files) {
+        if (std::filesystem::path(file).extension() != ".dat" || !readTextRecord(file, samples)) {
+            continue;
+        }
+        SignalConditioner conditioner(SAMPLING_RATE, 10.0, 0.5);
+        conditioner.setCalibration(samples.front(), 2.6);
+        ymmHg.resize(samples.size());
+        pressure.emplace_back(samples.size());
+        oscillation.emplace_back(samples.size());
+        conditioner.process(samples, ymmHg, pressure.back(), oscillation.back());
+    }
+
+    MinMaxDecimator pressurePlot(MAX_DATA_LENGTH);
+    MinMaxDecimator oscillationPlot(MAX_DATA_LENGTH);
+    pressurePlot.setColumns(BENCH_PLOT_COLUMNS);
+    oscillationPlot.setColumns(BENCH_PLOT_COLUMNS);
+    resetStats();
+    for (size_t f = 0; f < pressure.size(); f++) {
+        const std::span<const double> yLP(pressure[f]);
+        const std::span<const double> yHP(oscillation[f]);
+        for (size_t i = 0; i < yLP.size(); i += BENCH_PLOT_BATCH) {
+            const size_t n = std::min<size_t>(BENCH_PLOT_BATCH, yLP.size() - i);
+            pressurePlot.push(yLP.subspan(i, n));
+            oscillationPlot.push(yHP.subspan(i, n));
+        }
+    }
+}
+
+//! Observer that starts a measurement as soon as Processing is ready and waits for the results.
+class BenchObserver : public IObserver {
+public:
+    explicit BenchObserver(Processing *process) : process(process) {}
+
+    void eReady() override { process->startMeasurement(); }
+
+    void eResults(double map, double, double) override {
+        // The results are reset to 0 when a measurement starts.
+        if (map != 0.0) {
+            bDone = true;
+        }
+    }
+
+    Processing *process;            //!< The processing thread.
+    std::atomic<bool> bDone = false;    //!< The measurement has finished.
+};
+
+/**
+ * Runs a whole measurement of generated data through the Processing thread, as fast as possible.
+ * @return True if the measurement finished.
+ */
+static bool benchProcessing() {
+    SyntheticSampleSource source(false);
+    Processing process(&source);
+    process.setRecording(false);
+    BenchObserver observer(&process);
+    process.attach(&observer);
+    resetStats();
+    process.start();
+
+    const auto start = std::chrono::steady_clock::now();
+    while (!observer.bDone && std::chrono::steady_clock::now() - start < std::chrono::seconds(BENCH_TIMEOUT)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    process.shutdown();
+    return observer.bDone;
+}
+
+/**
+ * Reads a baseline saved with --save.
+ * @param fileName The name of the baseline file.
+ * @param baseline The results of the baseline by name.
+ * @return True if the file could be read.
+ */
+static bool readBaseline(const char *fileName, std::map<std::string, BenchResult> &baseline) {
+    FILE *file = std::fopen(fileName, "r");
+    if (!file) {
+        return false;
+    }
+    char line[512];
+    char name[256];
+    BenchResult res{};
+    while (std::fgets(line, sizeof(line), file)) {
+        unsigned long long calls, p99, max;
+        if (std::sscanf(line, "%255s %llu %lf %lf %llu %llu", name, &calls, &res.nsPerSample, &res.allocsPerSample,
+                        &p99, &max) == 6) {
+            res.name = name;
+            res.calls = calls;
+            res.p99Ns = p99;
+            res.maxNs = max;
+            baseline[res.name] = res;
+        }
+    }
+    std::fclose(file);
+    return true;
+}
+
+/**
+ * Writes the results in the format of the baseline.
+ * @param out The file to write to.
+ * @param results The results of all benchmarks.
+ */
+static void writeResults(FILE *out, const std::vector<BenchResult> &results) {
+    std::fprintf(out, "stage\tcalls\tns_per_sample\tallocs_per_sample\tp99_ns\tmax_ns\n");
+    for (const auto &res : results) {
+        std::fprintf(out, "%s\t%llu\t%.2f\t%.4f\t%llu\t%llu\n", res.name.c_str(), (unsigned long long) res.calls,
+                     res.nsPerSample, res.allocsPerSample, (unsigned long long) res.p99Ns,
+                     (unsigned long long) res.maxNs);
+    }
+}
+
+/**
+ * Prints how to use the program.
+ * @param name The name of the program.
+ */
+static void printUsage(const char *name) {
+    std::fprintf(stderr,
+                 "Usage: %s [options]\n"
+                 "  --data <dir>        folder with the recordings (default: ../data)\n"
+                 "  --tests <dir>       folder with p.dat and o.dat (default: tests)\n"
+                 "  --repeat <n>        number of runs of every benchmark, the fastest is kept (default: %d)\n"
+                 "  --baseline <file>   compare with a saved baseline\n"
+                 "  --threshold <f>     allowed relative increase over the baseline (default: %.2f)\n"
+                 "  --allocations-only  only compare the allocations with the baseline, not the timing\n"
+                 "  --save <file>       save the results as a new baseline\n",
+                 name, BENCH_REPEAT, BENCH_THRESHOLD);
+}
+
+int main(int argc, char **argv) {
+
+    plog::init(plog::warning, "obp_bench_log.csv", 1000000, 5);
+
+    std::string dataDir = "../data";
+    std::string testDir = "tests";
+    int repeat = BENCH_REPEAT;
+    double threshold = BENCH_THRESHOLD;
+    const char *baselineName = nullptr;
+    const char *saveName = nullptr;
+    bool bAllocationsOnly = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const bool bHasValue = i + 1 < argc;
+        if (std::strcmp(arg, "--data") == 0 && bHasValue) {
+            dataDir = argv[++i];
+        } else if (std::strcmp(arg, "--tests") == 0 && bHasValue) {
+            testDir = argv[++i];
+        } else if (std::strcmp(arg, "--repeat") == 0 && bHasValue) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(arg, "--baseline") == 0 && bHasValue) {
+            baselineName = argv[++i];
+        } else if (std::strcmp(arg, "--threshold") == 0 && bHasValue) {
+            threshold = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--save") == 0 && bHasValue) {
+            saveName = argv[++i];
+        } else if (std::strcmp(arg, "--allocations-only") == 0) {
+            bAllocationsOnly = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    const auto files = findRecordings(dataDir);
+    if (files.empty()) {
+        std::fprintf(stderr, "No recordings in %s\n", dataDir.c_str());
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    for (int r = 0; r < repeat; r++) {
+        benchReference(results);
+
+        if (!benchDetection(testDir)) {
+            std::fprintf(stderr, "Could not read the test data in %s\n", testDir.c_str());
+            return 1;
+        }
+        collectStats("detection", results);
+
+        benchReplay(files);
+        collectStats("replay", results);
+
+        benchPipeline(files);
+        collectStats("pipeline", results);
+
+        if (!benchProcessing()) {
+            std::fprintf(stderr, "Measurement through Processing did not finish\n");
+            return 1;
+        }
+        collectStats("processing", results);
+
+        benchPlot(files);
+        collectStats("plot", results);
+    }
+
+    writeResults(stdout, results);
+
+    if (saveName) {
+        FILE *out = std::fopen(saveName, "w");
+        if (!out) {
+            std::fprintf(stderr, "Could not open %s\n", saveName);
+            return 1;
+        }
+        writeResults(out, results);
+        std::fclose(out);
+    }
+
+    int nRegressions = 0;
+    if (baselineName) {
+        std::map<std::string, BenchResult> baseline;
+        if (!readBaseline(baselineName, baseline)) {
+            std::fprintf(stderr, "Could not read the baseline %s\n", baselineName);
+            return 1;
+        }
+
+        /**
+         * The timing of the baseline is scaled to this machine with the reference workload. Without a reference in
+         * the baseline, the timing can not be compared.
+         */
+        const auto baseRef = baseline.find(BENCH_REFERENCE);
+        const auto ref = std::find_if(results.begin(), results.end(),
+                                      [](const BenchResult &res) { return res.name == BENCH_REFERENCE; });
+        double scale = 0.0;
+        if (baseRef != baseline.end() && baseRef->second.nsPerSample > 0.0) {
+            scale = ref->nsPerSample / baseRef->second.nsPerSample;
+            std::fprintf(stderr, "Reference %.2f ns/sample, %.2f times the baseline\n", ref->nsPerSample, scale);
+        } else if (!bAllocationsOnly) {
+            std::fprintf(stderr, "The baseline has no %s, only the allocations are compared\n", BENCH_REFERENCE);
+        }
+
+        for (const auto &res : results) {
+            const auto it = baseline.find(res.name);
+            if (it == baseline.end() || res.name == BENCH_REFERENCE) {
+                continue;
+            }
+            const BenchResult &base = it->second;
+            const bool bSlower = !bAllocationsOnly && scale > 0.0 && res.calls >= BENCH_MIN_CALLS &&
+                                 res.nsPerSample > base.nsPerSample * scale * (1.0 + threshold);
+            const bool bMoreAllocs = res.allocsPerSample >
+                                     base.allocsPerSample * (1.0 + threshold) + BENCH_MIN_ALLOCS;
+            if (bSlower || bMoreAllocs) {
+                std::fprintf(stderr, "Regression in %s: %.2f ns/sample (scaled baseline %.2f), %.4f allocs/sample "
+                                     "(baseline %.4f)\n", res.name.c_str(), res.nsPerSample,
+                             base.nsPerSample * scale, res.allocsPerSample, base.allocsPerSample);
+                nRegressions++;
+            }
+        }
+        std::fprintf(stderr, "%d regressions against %s\n", nRegressions, baselineName);
+    }
+
+    return nRegressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,248 @@
+/**
+ * @file        obp_collector.cpp
+ * @brief       Collector of the data streamed by headless measurement stations
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Accepts the TCP connections of any number of stations that run with a NetworkSink and reads the frames defined in
+ * NetworkFormat.h. All connections are served by a single thread with poll(). The results of every measurement are
+ * written as tab separated values, one line per measurement. Connections, disconnections and the number of frames a
+ * station dropped are written to stderr.
+ *
+ * Usage: obp_collector [options]
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "NetworkFormat.h"
+
+#define COLLECTOR_READ_SIZE     65536   //!< Number of bytes read from a connection at once.
+#define COLLECTOR_MAX_PAYLOAD   (sizeof(NetDataPayload) + NET_MAX_PAIRS * 2 * sizeof(float))  //!< Largest valid payload.
+
+//! The state of a connection to a station.
+struct Station {
+    int fd = -1;                    //!< The socket of the connection.
+    std::vector<uint8_t> buffer;    //!< Received bytes that do not form a complete frame yet.
+    uint32_t id = 0;                //!< The identifier sent in the Hello frame.
+    bool bHello = false;            //!< The Hello frame was received.
+    uint64_t nextSequence = 0;      //!< The sequence number expected next.
+    uint64_t droppedFrames = 0;     //!< The frames the station dropped, seen as gaps in the sequence numbers.
+    uint64_t pairs = 0;             //!< The data pairs received.
+    double heartRate = 0.0;         //!< The last heart rate.
+};
+
+static volatile sig_atomic_t bStop = 0;    //!< Set by the signal handler to stop the collector.
+
+/**
+ * Stops the collector on SIGINT and SIGTERM.
+ */
+static void handleSignal(int) {
+    bStop = 1;
+}
+
+/**
+ * Prints how to use the program.
+ * @param name The name of the program.
+ */
+static void printUsage(const char *name) {
+    std::fprintf(stderr,
+                 "Usage: %s [options]\n"
+                 "  --port <n>  TCP port to listen on (default: %d)\n"
+                 "  -o <file>   write the results to a file instead of stdout\n",
+                 name, NET_DEFAULT_PORT);
+}
+
+/**
+ * Handles a complete frame of a station.
+ * @param station The station that sent the frame.
+ * @param header The header of the frame.
+ * @param payload The payload of the frame.
+ * @param out The file the results are written to.
+ * @return False if the frame is invalid and the connection has to be closed.
+ */
+static bool handleFrame(Station &station, const NetFrameHeader &header, const uint8_t *payload, FILE *out) {
+    const auto type = (NetFrameType) header.type;
+    if (type == NetFrameType::Hello) {
+        station.id = header.station;
+        station.bHello = true;
+        // The frames sent on an earlier connection of the station are not counted as dropped.
+        station.nextSequence = header.sequence;
+        std::fprintf(stderr, "station %u connected\n", station.id);
+        return true;
+    }
+    if (!station.bHello) {
+        return false;
+    }
+
+    // Frames dropped by the station are only visible as a gap in the sequence numbers.
+    if (header.sequence > station.nextSequence) {
+        station.droppedFrames += header.sequence - station.nextSequence;
+    }
+    station.nextSequence = header.sequence + 1;
+
+    switch (type) {
+        case NetFrameType::Data:
+            if (header.payloadSize < sizeof(NetDataPayload)) {
+                return false;
+            }
+            station.pairs += (header.payloadSize - sizeof(NetDataPayload)) / (2 * sizeof(float));
+            break;
+        case NetFrameType::HeartRate:
+            if (header.payloadSize >= sizeof(double)) {
+                std::memcpy(&station.heartRate, payload, sizeof(double));
+            }
+            break;
+        case NetFrameType::Results: {
+            double results[3];
+            if (header.payloadSize < sizeof(results)) {
+                return false;
+            }
+            std::memcpy(results, payload, sizeof(results));
+            // The results are reset to 0 when a measurement starts.
+            if (results[0] != 0.0) {
+                std::fprintf(out, "%u\t%.2f\t%.2f\t%.2f\t%.1f\n", station.id, results[0], results[1], results[2],
+                             station.heartRate);
+                std::fflush(out);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return true;
+}
+
+/**
+ * Reads the available bytes of a station and handles all complete frames.
+ * @param station The station to read from.
+ * @param out The file the results are written to.
+ * @return False if the connection was closed or has to be closed.
+ */
+static bool readStation(Station &station, FILE *out) {
+    uint8_t chunk[COLLECTOR_READ_SIZE];
+    const ssize_t n = recv(station.fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return true;
+    }
+    if (n <= 0) {
+        return false;
+    }
+    station.buffer.insert(station.buffer.end(), chunk, chunk + n);
+
+    size_t offset = 0;
+    while (station.buffer.size() - offset >= sizeof(NetFrameHeader)) {
+        NetFrameHeader header;
+        std::memcpy(&header, station.buffer.data() + offset, sizeof(header));
+        if (std::memcmp(header.magic, NET_MAGIC, sizeof(header.magic)) != 0 || header.version > NET_VERSION ||
+            header.payloadSize > COLLECTOR_MAX_PAYLOAD) {
+            return false;
+        }
+        if (station.buffer.size() - offset < sizeof(header) + header.payloadSize) {
+            break;
+        }
+        if (!handleFrame(station, header, station.buffer.data() + offset + sizeof(header), out)) {
+            return false;
+        }
+        offset += sizeof(header) + header.payloadSize;
+    }
+    station.buffer.erase(station.buffer.begin(), station.buffer.begin() + offset);
+    return true;
+}
+
+int main(int argc, char **argv) {
+
+    int port = NET_DEFAULT_PORT;
+    const char *outName = nullptr;
+    for (int i = 1; i < argc; i++) {
+        const bool bHasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--port") == 0 && bHasValue) {
+            port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-o") == 0 && bHasValue) {
+            outName = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *out = outName ? std::fopen(outName, "w") : stdout;
+    if (!out) {
+        std::fprintf(stderr, "Could not open %s\n", outName);
+        return 1;
+    }
+
+    const int listener = socket(AF_INET6, SOCK_STREAM, 0);
+    const int off = 0, on = 1;
+    setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in6 address{};
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons(port);
+    if (listener < 0 || bind(listener, (sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        std::fprintf(stderr, "Could not listen on port %d: %s\n", port, std::strerror(errno));
+        return 1;
+    }
+
+    struct sigaction action{};
+    action.sa_handler = handleSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::fprintf(out, "station\tmap\tsbp\tdbp\thr\n");
+    std::fflush(out);
+
+    /**
+     * The first entry of the poll set is the listener, the others are the stations in the same order.
+     */
+    std::vector<Station> stations;
+    std::vector<pollfd> fds{{listener, POLLIN, 0}};
+    while (!bStop) {
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            continue;
+        }
+        for (size_t i = fds.size() - 1; i > 0; i--) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            Station &station = stations[i - 1];
+            if (!readStation(station, out)) {
+                std::fprintf(stderr, "station %u disconnected, %lu pairs received, %lu frames dropped\n", station.id,
+                             (unsigned long) station.pairs, (unsigned long) station.droppedFrames);
+                close(station.fd);
+                stations.erase(stations.begin() + (long) (i - 1));
+                fds.erase(fds.begin() + (long) i);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) {
+                Station station;
+                station.fd = fd;
+                stations.push_back(std::move(station));
+                fds.push_back({fd, POLLIN, 0});
+            }
+        }
+    }
+
+    for (const Station &station : stations) {
+        close(station.fd);
+    }
+    close(listener);
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return 0;
+}
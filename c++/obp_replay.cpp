@@ -0,0 +1,239 @@
+/**
+ * @file        obp_replay.cpp
+ * @brief       Offline replay of recorded measurements
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Runs the algorithm over recorded files without any hardware or user interface and writes the results as
+ * tab separated values, one line per file in the order of the arguments. Directories are searched for binary
+ * recordings and text files.
+ *
+ * With one or more of the sweep options, all combinations of the given values are evaluated in the same pass over
+ * each file, and one line per file and setting is written instead.
+ *
+ * Usage: obp_replay [options] <file or directory>...
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include <plog/Initializers/RollingFileInitializer.h>
+
+#include "common.h"
+#include "Replay.h"
+#include "RecordFormat.h"
+
+/**
+ * Prints how to use the program.
+ * @param name The name of the program.
+ */
+static void printUsage(const char *name) {
+    std::fprintf(stderr,
+                 "Usage: %s [options] <file or directory>...\n"
+                 "  -j <n>           number of worker threads (default: number of cores)\n"
+                 "  -o <file>        write the results to a file instead of stdout\n"
+                 "  --mmhg           text files contain mmHg instead of voltage\n"
+                 "  --fs <Hz>        sampling rate of text files (default: %d)\n"
+                 "  --ambient <V>    ambient voltage of text files (default: mean of the first %d samples)\n"
+                 "  --corr <f>       correction factor of text files (default: 2.6)\n"
+                 "  --pumpup <mmHg>  pressure that starts the deflation (default: %d)\n"
+                 "  --sbp <r>        SBP ratio\n"
+                 "  --dbp <r>        DBP ratio\n"
+                 "  --peaks <n>      minimal number of peaks\n"
+                 "  --sweep-sbp <from:to:step>    SBP ratios of a parameter sweep\n"
+                 "  --sweep-dbp <from:to:step>    DBP ratios of a parameter sweep\n"
+                 "  --sweep-peaks <from:to:step>  minimal numbers of peaks of a parameter sweep\n"
+                 "  --sweep-hyst <from:to:step>   DBP cutoff hysteresis values of a parameter sweep\n",
+                 name, SAMPLING_RATE, AMBIENT_AV_TIME, PUMP_UP_VALUE_MIN);
+}
+
+/**
+ * Adds a file, or all recordings in a directory sorted by name, to the files to replay.
+ * @param path The file or directory.
+ * @param files The files to replay.
+ */
+static void addPath(const std::string &path, std::vector<std::string> &files) {
+    namespace fs = std::filesystem;
+    if (!fs::is_directory(path)) {
+        files.push_back(path);
+        return;
+    }
+    std::vector<std::string> found;
+    for (const auto &entry : fs::directory_iterator(path)) {
+        const auto extension = entry.path().extension();
+        if (entry.is_regular_file() && (extension == RECORD_EXTENSION || extension == ".dat")) {
+            found.push_back(entry.path().string());
+        }
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+/**
+ * Parses a range of values, given as "from:to:step" or as a single value.
+ * @param arg The range.
+ * @return The values from "from" up to and including "to", empty if the range is invalid.
+ */
+static std::vector<double> parseRange(const char *arg) {
+    double from, to, step;
+    std::vector<double> values;
+    if (std::sscanf(arg, "%lf:%lf:%lf", &from, &to, &step) == 3 && step > 0.0) {
+        for (int i = 0; from + i * step <= to + step * 1e-6; i++) {
+            values.push_back(from + i * step);
+        }
+    } else if (std::sscanf(arg, "%lf", &from) == 1) {
+        values.push_back(from);
+    }
+    return values;
+}
+
+/**
+ * Writes the results of a parameter sweep, one line per file and setting.
+ * @param out The file to write to.
+ * @param files The replayed files.
+ * @param results The results of the files.
+ * @param grid The settings of the sweep.
+ */
+static void writeSweep(FILE *out, const std::vector<std::string> &files, const std::vector<ReplayResult> &results,
+                       const std::vector<SweepParams> &grid) {
+    std::fprintf(out, "file\tratio_sbp\tratio_dbp\tmin_peaks\tcutoff_hyst\tstatus\tmap\tsbp\tdbp\thr\n");
+    for (size_t i = 0; i < files.size(); i++) {
+        for (size_t g = 0; g < grid.size(); g++) {
+            const bool bDone = g < results[i].sweep.size() && results[i].sweep[g].bDone;
+            const SweepResult res = bDone ? results[i].sweep[g] : SweepResult{};
+            std::fprintf(out, "%s\t%.3f\t%.3f\t%d\t%.3f\t%s\t%.2f\t%.2f\t%.2f\t%.1f\n", files[i].c_str(),
+                         grid[g].ratioSBP, grid[g].ratioDBP, grid[g].minNbrPeaks, grid[g].cutoffHyst,
+                         bDone ? "ok" : toString(results[i].status == ReplayStatus::Ok ? ReplayStatus::NotEnoughData
+                                                                                       : results[i].status),
+                         res.map, res.sbp, res.dbp, res.hr);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+
+    plog::init(plog::warning, "obp_replay_log.csv", 1000000, 5);
+
+    ReplayConfig config;
+    unsigned int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    const char *outName = nullptr;
+    std::vector<std::string> files;
+    std::vector<double> sweepSBP, sweepDBP, sweepPeaks, sweepHyst;
+    bool bSweep = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const bool bHasValue = i + 1 < argc;
+        if (std::strcmp(arg, "--mmhg") == 0) {
+            config.bMmHg = true;
+        } else if (std::strcmp(arg, "-j") == 0 && bHasValue) {
+            nThreads = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "-o") == 0 && bHasValue) {
+            outName = argv[++i];
+        } else if (std::strcmp(arg, "--fs") == 0 && bHasValue) {
+            config.samplingRate = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--ambient") == 0 && bHasValue) {
+            config.ambientVoltage = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--corr") == 0 && bHasValue) {
+            config.corrFactor = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--pumpup") == 0 && bHasValue) {
+            config.pumpUpValue = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--sbp") == 0 && bHasValue) {
+            config.ratioSBP = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--dbp") == 0 && bHasValue) {
+            config.ratioDBP = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--peaks") == 0 && bHasValue) {
+            config.minNbrPeaks = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--sweep-sbp") == 0 && bHasValue) {
+            sweepSBP = parseRange(argv[++i]);
+            bSweep = true;
+        } else if (std::strcmp(arg, "--sweep-dbp") == 0 && bHasValue) {
+            sweepDBP = parseRange(argv[++i]);
+            bSweep = true;
+        } else if (std::strcmp(arg, "--sweep-peaks") == 0 && bHasValue) {
+            sweepPeaks = parseRange(argv[++i]);
+            bSweep = true;
+        } else if (std::strcmp(arg, "--sweep-hyst") == 0 && bHasValue) {
+            sweepHyst = parseRange(argv[++i]);
+            bSweep = true;
+        } else if (arg[0] == '-') {
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            addPath(arg, files);
+        }
+    }
+
+    if (files.empty() || config.samplingRate <= 0.0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (bSweep) {
+        /**
+         * Values that are not swept are taken from the configuration, or the defaults of OBPDetection.
+         */
+        OBPDetection defaults(config.samplingRate);
+        defaults.resetConfigValues();
+        defaults.setRatioSBP(config.ratioSBP);
+        defaults.setRatioDBP(config.ratioDBP);
+        defaults.setMinNbrPeaks(config.minNbrPeaks);
+        if (sweepSBP.empty()) {
+            sweepSBP.push_back(defaults.getRatioSBP());
+        }
+        if (sweepDBP.empty()) {
+            sweepDBP.push_back(defaults.getRatioDBP());
+        }
+        if (sweepPeaks.empty()) {
+            sweepPeaks.push_back(defaults.getMinNbrPeaks());
+        }
+        if (sweepHyst.empty()) {
+            sweepHyst.push_back(defaults.getCutoffHyst());
+        }
+        const std::vector<int> peaks(sweepPeaks.begin(), sweepPeaks.end());
+        config.sweep = OBPDetection::makeSweepGrid(sweepSBP, sweepDBP, peaks, sweepHyst);
+        if (config.sweep.empty()) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *out = outName ? std::fopen(outName, "w") : stdout;
+    if (!out) {
+        std::fprintf(stderr, "Could not open %s\n", outName);
+        return 1;
+    }
+
+    ReplayEngine engine(config);
+    const auto results = engine.run(files, nThreads);
+
+    int nFailed = 0;
+    for (const auto &res : results) {
+        if (res.status != ReplayStatus::Ok) {
+            nFailed++;
+        }
+    }
+    if (bSweep) {
+        writeSweep(out, files, results, config.sweep);
+    } else {
+        std::fprintf(out, "file\tstatus\tsamples\tmap\tsbp\tdbp\thr\n");
+        for (size_t i = 0; i < files.size(); i++) {
+            const auto &res = results[i];
+            std::fprintf(out, "%s\t%s\t%zu\t%.2f\t%.2f\t%.2f\t%.1f\n", files[i].c_str(), toString(res.status),
+                         res.nSamples, res.map, res.sbp, res.dbp, res.hr);
+        }
+    }
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    std::fprintf(stderr, "%zu files replayed, %d without result\n", files.size(), nFailed);
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file        test_ArchiveFormat.cpp
+ * @brief       Archive format test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Appends more sessions to a new archive than fit in one index block and reads them back with the ArchiveReader.
+ * The test passes if every session has its own samples, results and identifier, and a time range of the pressure
+ * column starts at the right sample.
+ * A last session is appended from a binary recording of several blocks, read with a RecordReader. Its columns have
+ * to match the recording, as read by readRecord.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+#include "../common.h"
+#include "../ArchiveFormat.h"
+
+#define TEST_SESSIONS   (ARCHIVE_INDEX_ENTRIES + 2) //!< The number of sessions, so a second index block is needed.
+#define TEST_FS         100.0                       //!< The sampling rate of the sessions.
+#define TEST_RECORD     (5 * RECORD_READ_BLOCK / 2) //!< The number of samples of the recording, not a whole block.
+
+int main()
+{
+    const std::string fileName = (std::filesystem::temp_directory_path() / "test_archive.obpa").string();
+    const std::string recordName = (std::filesystem::temp_directory_path() / "test_archive.obp").string();
+    std::remove(fileName.c_str());
+
+    bool bPass = true;
+    const RecordHeader header = makeRecordHeader(TEST_FS, 0.0, 1.0, 10.0, 0.5, 4);
+    for (int s = 0; s < TEST_SESSIONS && bPass; s++)
+    {
+        std::vector<double> samples(s + 10);
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            samples[i] = s + i * 0.001;
+        }
+        bPass = appendArchiveSession(fileName, makeArchiveEntry(header, 1000 + s, "session", {80.0 + s, 0, 0, 0}),
+                                     samples);
+    }
+
+    RecordHeader recordHeader = header;
+    recordHeader.nSamples = TEST_RECORD;
+    std::vector<double> recordSamples(TEST_RECORD);
+    for (size_t i = 0; i < recordSamples.size(); i++)
+    {
+        recordSamples[i] = std::sin(i * 0.01);
+    }
+    FILE *recordFile = std::fopen(recordName.c_str(), "wb");
+    bPass = bPass && recordFile && std::fwrite(&recordHeader, sizeof(recordHeader), 1, recordFile) == 1 &&
+            std::fwrite(recordSamples.data(), sizeof(double), TEST_RECORD, recordFile) == TEST_RECORD;
+    if (recordFile)
+    {
+        std::fclose(recordFile);
+    }
+    RecordReader record;
+    bPass = bPass && record.open(recordName) && record.getNumSamples() == TEST_RECORD &&
+            appendArchiveSession(fileName, makeArchiveEntry(record.getHeader(), 2000, "record", {}), record);
+    record.close();
+    RecordHeader readHeader;
+    std::vector<double> readSamples;
+    bPass = bPass && readRecord(recordName, readHeader, readSamples) && readSamples == recordSamples;
+    std::remove(recordName.c_str());
+
+    ArchiveReader reader;
+    bPass = bPass && reader.open(fileName) && reader.getNumSessions() == TEST_SESSIONS + 1;
+    for (int s = 0; s < TEST_SESSIONS && bPass; s++)
+    {
+        const ArchiveEntry &entry = reader.getEntry(s);
+        const auto voltage = reader.getVoltage(s);
+        bPass = entry.sessionId == (uint64_t) s + 1 && entry.timestamp == 1000 + s && entry.results.map == 80.0 + s &&
+                voltage.size() == (size_t) s + 10 && voltage[0] == s && voltage.back() == s + (s + 9) * 0.001 &&
+                reader.findSession(s + 1) == &entry;
+    }
+
+    // 0.05 s at 100 Hz is the sample with index 5.
+    const auto range = reader.getPressure(TEST_SESSIONS - 1, 0.05, 0.08);
+    const double expected = (TEST_SESSIONS - 1 + 5 * 0.001) * KPA_PER_V / KPA_PER_MMHG;
+    bPass = bPass && range.size() == 3 && std::abs(range[0] - expected) < 1e-3 * expected;
+
+    const auto recordVoltage = reader.getVoltage(TEST_SESSIONS);
+    const auto recordPressure = reader.getPressure(TEST_SESSIONS);
+    bPass = bPass && std::equal(recordVoltage.begin(), recordVoltage.end(), recordSamples.begin(),
+                                recordSamples.end()) && recordPressure.size() == TEST_RECORD &&
+            recordPressure.back() == (float) voltageToMmHg(recordSamples.back(), 0.0, 1.0);
+
+    reader.close();
+    std::remove(fileName.c_str());
+
+    if (bPass)
+    {
+        std::cout << "Test passed" << std::endl;
+        return 0;
+    }
+    std::cout << "Test failed" << std::endl;
+    return 1;
+}
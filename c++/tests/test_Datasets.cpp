@@ -0,0 +1,421 @@
+/**
+ * @file        test_Datasets.cpp
+ * @brief       Data set regression test and throughput benchmark implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Replays the bundled data sets through the C++ pipeline and compares the results with stored reference values:
+ *
+ * - The pressure and oscillation of data0804 (p.dat, osc.dat), as the application filtered them during that
+ *   measurement, are passed to an OBPDetection. The OMWE has to match the one the application stored (omwe.dat).
+ * - The raw pressure of data0804 (raw.dat) is replayed with the ratios of the Python prototype
+ *   (python/obp_fixed_ratio.py). MAP, SBP, DBP and the pulse have to be within a clinical tolerance of the
+ *   interpolated results of the prototype, which are stored in algo.txt.
+ * - Every recording in the data folder is replayed with the default settings. The status and the results have to
+ *   match the golden values stored in a table, so optimisations can not silently change them.
+ * - The recordings are replayed again by a ReplayEngine, which replays the text files in lanes. The results have to
+ *   be the same as replaying them one by one.
+ * - Every recording is also replayed with the settings of the Python prototype (python/obp_fixed_ratio.py). MAP, SBP
+ *   and DBP have to be within the clinical tolerance of the interpolated results of the prototype, which are stored
+ *   in the same table (python/obp_fixed_ratio_goldens.py). Recordings on which the prototype fails, or which are known
+ *   to deviate from it, are marked in the table and only reported. Recordings on which the prototype has results, but
+ *   the C++ replay with its settings does not, are marked as expected failures: the replay has to fail on them, so a
+ *   change that fixes them updates the table.
+ *
+ * The derivative algorithm of python/obp_derrivative.py is not compared. It takes the SBP and DBP from the steepest
+ * slopes of the envelope instead of fixed ratios of its maximum, and there is no C++ implementation of it. It also
+ * only runs on the recording it names in the script.
+ *
+ * The throughput of the replays, without reading the files, is reported in samples/s.
+ *
+ * Usage: test_Datasets [--golden <file>] [--save <file>] <data folder>
+ * With --save, the results of the recordings are written to a table, to update the golden values after an intended
+ * change of the results. The results of the prototype are taken over from the golden table.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../Replay.h"
+
+#define TEST_PYTHON_RATIO_SBP   0.5     //!< The SBP ratio of the Python prototype.
+#define TEST_PYTHON_RATIO_DBP   0.8     //!< The DBP ratio of the Python prototype.
+#define TEST_PYTHON_TOLERANCE   2.0     //!< The allowed deviation from the Python prototype in mmHg.
+#define TEST_PYTHON_HR_TOLERANCE 1.0    //!< The allowed deviation of the pulse from the Python prototype in bpm.
+#define TEST_OMWE_TOLERANCE     1e-4    //!< The allowed deviation from the stored OMWE, which has 6 digits.
+#define TEST_GOLDEN_TOLERANCE   1e-3    //!< The allowed deviation from the golden values in mmHg and bpm.
+#define TEST_LANES_TOLERANCE    1e-9    //!< The allowed deviation of a replay in lanes from one by one.
+#define TEST_FIXED_RATIO_SBP    0.55    //!< The SBP ratio of obp_fixed_ratio.py.
+#define TEST_FIXED_RATIO_DBP    0.70    //!< The DBP ratio of obp_fixed_ratio.py.
+#define TEST_FIXED_RATIO_LP     5.0     //!< The cutoff frequency of the low-pass filter of obp_fixed_ratio.py in Hz.
+#define TEST_FIXED_RATIO_AMBIENT 0.710  //!< The ambient voltage of obp_fixed_ratio.py.
+#define TEST_FIXED_RATIO_CORR   2.50    //!< The correction factor of obp_fixed_ratio.py.
+
+//! The results of a recording, as stored in the golden table.
+struct GoldenResult
+{
+    std::string status;     //!< The status of the replay.
+    double map;             //!< The mean arterial pressure.
+    double sbp;             //!< The systolic blood pressure.
+    double dbp;             //!< The diastolic blood pressure.
+    double hr;              //!< The average heart rate.
+    std::string pythonStatus;   //!< ok, failed if the prototype fails, deviates if it is known not to match, or
+                                //!< replay fails if only the prototype has results.
+    double pythonMap;           //!< The MAP of the prototype, 0 if it failed.
+    double pythonSbp;           //!< The SBP of the prototype, 0 if it failed.
+    double pythonDbp;           //!< The DBP of the prototype, 0 if it failed.
+};
+
+/**
+ * Reads a text file with a time and a value per line.
+ * @param fileName The name of the file.
+ * @param times The times.
+ * @param values The values.
+ * @return True if the file has at least one line.
+ */
+static bool readColumns(const std::string &fileName, std::vector<double> &times, std::vector<double> &values)
+{
+    std::ifstream file(fileName);
+    double time, value;
+    while (file >> time >> value)
+    {
+        times.push_back(time);
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+/**
+ * Passes the filtered data of data0804 to an OBPDetection and compares the OMWE with the stored one.
+ * @param folder The folder of data0804.
+ * @return True if every point of the OMWE matches.
+ */
+static bool checkOMWE(const std::string &folder)
+{
+    std::vector<double> tP, pressure, tO, oscillation, omweTimes, omweValues;
+    if (!readColumns(folder + "/p.dat", tP, pressure) || !readColumns(folder + "/osc.dat", tO, oscillation) ||
+        !readColumns(folder + "/omwe.dat", omweTimes, omweValues))
+    {
+        std::cout << "Could not read " << folder << std::endl;
+        return false;
+    }
+
+    OBPDetection obpDetect(SAMPLING_RATE);
+    obpDetect.resetConfigValues();
+    for (size_t i = 0; i < pressure.size() && i < oscillation.size(); i++)
+    {
+        obpDetect.processSample(pressure[i], oscillation[i]);
+    }
+
+    const auto omwe = obpDetect.getOMWE();
+    const auto times = obpDetect.getOMWETimes();
+    bool bMatch = omwe.size() == omweValues.size();
+    for (size_t i = 0; i < omwe.size() && bMatch; i++)
+    {
+        bMatch = times[i] == (int) omweTimes[i] && std::abs(omwe[i] - omweValues[i]) < TEST_OMWE_TOLERANCE;
+    }
+    std::cout << "data0804 OMWE: " << omwe.size() << " points, " << (bMatch ? "matches" : "differs from")
+              << " omwe.dat" << std::endl;
+    return bMatch;
+}
+
+/**
+ * Reads the interpolated results of the Python prototype from algo.txt.
+ * @param fileName The name of the file.
+ * @param results The MAP, SBP, DBP and pulse.
+ * @return True if all of them were found.
+ */
+static bool readPythonResults(const std::string &fileName, double results[4])
+{
+    std::ifstream file(fileName);
+    std::string line;
+    int found = 0;
+    bool bInterpolation = false;
+    while (std::getline(file, line))
+    {
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos)
+        {
+            continue;
+        }
+        const std::string key = line.substr(0, colon);
+        const double value = std::atof(line.c_str() + colon + 1);
+        if (key.find("Pulse") != std::string::npos)
+        {
+            results[3] = value;
+            found++;
+        } else if (key.find("MAP") != std::string::npos)
+        {
+            // The SBP and DBP lines follow the MAP of their method.
+            bInterpolation = key.find("interpolation") != std::string::npos;
+            if (bInterpolation)
+            {
+                results[0] = value;
+                found++;
+            }
+        } else if (bInterpolation && key.find("SBP") != std::string::npos)
+        {
+            results[1] = value;
+            found++;
+        } else if (bInterpolation && key.find("DBP") != std::string::npos)
+        {
+            results[2] = value;
+            found++;
+        }
+    }
+    return found == 4;
+}
+
+/**
+ * Replays the raw pressure of data0804 with the ratios of the Python prototype and compares the results with it.
+ * @param folder The folder of data0804.
+ * @return True if the results are within the tolerance of the prototype.
+ */
+static bool checkPython(const std::string &folder)
+{
+    double python[4] = {};
+    if (!readPythonResults(folder + "/algo.txt", python))
+    {
+        std::cout << "Could not read the Python results from " << folder << "/algo.txt" << std::endl;
+        return false;
+    }
+
+    ReplayConfig config;
+    config.bMmHg = true;
+    config.ratioSBP = TEST_PYTHON_RATIO_SBP;
+    config.ratioDBP = TEST_PYTHON_RATIO_DBP;
+    ReplaySession session(config);
+    const ReplayResult result = session.replay(folder + "/raw.dat");
+
+    std::cout << "data0804 C++: " << result.map << " " << result.sbp << " " << result.dbp << " " << result.hr
+              << ", Python: " << python[0] << " " << python[1] << " " << python[2] << " " << python[3] << std::endl;
+    return result.status == ReplayStatus::Ok && std::abs(result.map - python[0]) < TEST_PYTHON_TOLERANCE &&
+           std::abs(result.sbp - python[1]) < TEST_PYTHON_TOLERANCE &&
+           std::abs(result.dbp - python[2]) < TEST_PYTHON_TOLERANCE &&
+           std::abs(result.hr - python[3]) < TEST_PYTHON_HR_TOLERANCE;
+}
+
+/**
+ * Reads the golden table.
+ * @param fileName The name of the table.
+ * @param golden The results by the name of the recording.
+ * @return True if the table could be read.
+ */
+static bool readGolden(const std::string &fileName, std::map<std::string, GoldenResult> &golden)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        return false;
+    }
+    std::string line;
+    std::getline(file, line); // header
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string name, status, map, sbp, dbp, hr, pythonStatus, pythonMap, pythonSbp, pythonDbp;
+        if (std::getline(fields, name, '\t') && std::getline(fields, status, '\t') && std::getline(fields, map, '\t') &&
+            std::getline(fields, sbp, '\t') && std::getline(fields, dbp, '\t') && std::getline(fields, hr, '\t') &&
+            std::getline(fields, pythonStatus, '\t') && std::getline(fields, pythonMap, '\t') &&
+            std::getline(fields, pythonSbp, '\t') && std::getline(fields, pythonDbp, '\t'))
+        {
+            // The prototype has no results if it failed.
+            golden[name] = {status, std::stod(map), std::stod(sbp), std::stod(dbp), std::stod(hr), pythonStatus,
+                            std::atof(pythonMap.c_str()), std::atof(pythonSbp.c_str()),
+                            std::atof(pythonDbp.c_str())};
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *goldenName = nullptr;
+    const char *saveName = nullptr;
+    std::string dataFolder;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+        {
+            goldenName = argv[++i];
+        } else if (std::strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+        {
+            saveName = argv[++i];
+        } else
+        {
+            dataFolder = argv[i];
+        }
+    }
+    if (dataFolder.empty())
+    {
+        std::cout << "Usage: " << argv[0] << " [--golden <file>] [--save <file>] <data folder>" << std::endl;
+        return 1;
+    }
+
+    bool bPass = checkOMWE(dataFolder + "/data0804");
+    bPass = checkPython(dataFolder + "/data0804") && bPass;
+
+    std::map<std::string, GoldenResult> golden;
+    if (goldenName && !readGolden(goldenName, golden))
+    {
+        std::cout << "Could not read the golden values " << goldenName << std::endl;
+        bPass = false;
+    }
+
+    std::vector<std::string> files;
+    for (const auto &entry : std::filesystem::directory_iterator(dataFolder))
+    {
+        if (entry.is_regular_file())
+        {
+            files.push_back(entry.path().filename().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    FILE *save = saveName ? std::fopen(saveName, "w") : nullptr;
+    if (save)
+    {
+        std::fprintf(save, "file\tstatus\tmap\tsbp\tdbp\thr\tpython_status\tpython_map\tpython_sbp\tpython_dbp\n");
+    }
+
+    ReplayConfig config;
+    ReplaySession session(config);
+    ReplayConfig prototypeConfig;
+    prototypeConfig.fcLP = TEST_FIXED_RATIO_LP;
+    prototypeConfig.ambientVoltage = TEST_FIXED_RATIO_AMBIENT;
+    prototypeConfig.corrFactor = TEST_FIXED_RATIO_CORR;
+    prototypeConfig.ratioSBP = TEST_FIXED_RATIO_SBP;
+    prototypeConfig.ratioDBP = TEST_FIXED_RATIO_DBP;
+    ReplaySession prototypeSession(prototypeConfig);
+    size_t nProcessed = 0;
+    int64_t processNs = 0;
+    std::vector<ReplayResult> sessionResults;
+    for (const std::string &name : files)
+    {
+        const ReplayResult result = session.replay(dataFolder + "/" + name);
+        sessionResults.push_back(result);
+        nProcessed += result.nProcessed;
+        processNs += result.processNs;
+        const auto it = golden.find(name);
+        if (save)
+        {
+            std::fprintf(save, "%s\t%s\t%.4f\t%.4f\t%.4f\t%.4f", name.c_str(), toString(result.status), result.map,
+                         result.sbp, result.dbp, result.hr);
+            if (it == golden.end())
+            {
+                std::fprintf(save, "\tfailed\t-\t-\t-\n");
+            } else if (it->second.pythonStatus == "failed")
+            {
+                std::fprintf(save, "\t%s\t-\t-\t-\n", it->second.pythonStatus.c_str());
+            } else
+            {
+                std::fprintf(save, "\t%s\t%.4f\t%.4f\t%.4f\n", it->second.pythonStatus.c_str(), it->second.pythonMap,
+                             it->second.pythonSbp, it->second.pythonDbp);
+            }
+        }
+
+        bool bMatch = true;
+        if (goldenName)
+        {
+            bMatch = it != golden.end() && it->second.status == toString(result.status) &&
+                     std::abs(result.map - it->second.map) < TEST_GOLDEN_TOLERANCE &&
+                     std::abs(result.sbp - it->second.sbp) < TEST_GOLDEN_TOLERANCE &&
+                     std::abs(result.dbp - it->second.dbp) < TEST_GOLDEN_TOLERANCE &&
+                     std::abs(result.hr - it->second.hr) < TEST_GOLDEN_TOLERANCE;
+            bPass = bPass && bMatch;
+        }
+        std::cout << name << ": " << toString(result.status) << " " << result.map << " " << result.sbp << " "
+                  << result.dbp << " " << result.hr << (bMatch ? "" : " (differs from the golden values)")
+                  << std::endl;
+
+        if (goldenName && it != golden.end() && it->second.pythonStatus != "failed")
+        {
+            const ReplayResult prototype = prototypeSession.replay(dataFolder + "/" + name);
+            const bool bAgrees = prototype.status == ReplayStatus::Ok &&
+                                 std::abs(prototype.map - it->second.pythonMap) < TEST_PYTHON_TOLERANCE &&
+                                 std::abs(prototype.sbp - it->second.pythonSbp) < TEST_PYTHON_TOLERANCE &&
+                                 std::abs(prototype.dbp - it->second.pythonDbp) < TEST_PYTHON_TOLERANCE;
+            // A known deviation does not fail the test, it is only reported. An expected failure has to fail.
+            const bool bExpectedFailure = it->second.pythonStatus == "replay fails";
+            const bool bFails = prototype.status != ReplayStatus::Ok;
+            const char *note = "";
+            if (it->second.pythonStatus == "ok")
+            {
+                bPass = bPass && bAgrees;
+                note = bAgrees ? "" : " (differs from the prototype)";
+            } else if (bExpectedFailure)
+            {
+                bPass = bPass && bFails;
+                note = bFails ? " (expected failure)" : " (no longer fails, update the table)";
+            } else if (!bAgrees)
+            {
+                note = " (known deviation)";
+            }
+            std::cout << "  with the prototype settings: " << toString(prototype.status) << " " << prototype.map << " "
+                      << prototype.sbp << " " << prototype.dbp << ", Python: " << it->second.pythonMap << " "
+                      << it->second.pythonSbp << " " << it->second.pythonDbp << note << std::endl;
+        }
+    }
+    if (save)
+    {
+        std::fclose(save);
+    }
+
+    if (processNs > 0)
+    {
+        std::cout << "Throughput: " << (size_t) (nProcessed * 1e9 / processNs) << " samples/s (" << nProcessed
+                  << " samples)" << std::endl;
+    }
+
+    std::vector<std::string> paths;
+    for (const std::string &name : files)
+    {
+        paths.push_back(dataFolder + "/" + name);
+    }
+    ReplayEngine engine(config);
+    const std::vector<ReplayResult> laneResults = engine.run(paths, 1);
+    size_t nLanesDiffer = 0;
+    int64_t laneNs = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const ReplayResult &expected = sessionResults[i];
+        const ReplayResult &result = laneResults[i];
+        laneNs += result.processNs;
+        if (result.status != expected.status || result.nProcessed != expected.nProcessed ||
+            std::abs(result.map - expected.map) > TEST_LANES_TOLERANCE ||
+            std::abs(result.sbp - expected.sbp) > TEST_LANES_TOLERANCE ||
+            std::abs(result.dbp - expected.dbp) > TEST_LANES_TOLERANCE ||
+            std::abs(result.hr - expected.hr) > TEST_LANES_TOLERANCE)
+        {
+            std::cout << files[i] << ": " << toString(result.status) << " " << result.map << " " << result.sbp << " "
+                      << result.dbp << " " << result.hr << " in lanes (differs)" << std::endl;
+            nLanesDiffer++;
+        }
+    }
+    bPass = bPass && nLanesDiffer == 0;
+    std::cout << "Replayed in lanes: " << nLanesDiffer << " of " << files.size() << " recordings differ";
+    if (laneNs > 0)
+    {
+        std::cout << ", " << (size_t) (nProcessed * 1e9 / laneNs) << " samples/s";
+    }
+    std::cout << std::endl;
+
+    if (bPass)
+    {
+        std::cout << "Test passed" << std::endl;
+        return 0;
+    }
+    std::cout << "Test failed" << std::endl;
+    return 1;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file        test_IirBlockFilter.cpp
+ * @brief       IirBlockFilter test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Filters a generated pressure curve with the low-pass and the high-pass Butterworth filters of the Iir library
+ * sample by sample, and with IirBlockFilters set up from them in blocks of several sizes, including blocks of a
+ * single sample and a remainder. The low-pass filter also runs CONDITIONER_LANES different curves at once in
+ * interleaved lanes. The test passes if the block output matches the per-sample output within the rounding tolerance.
+ */
+
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <Iir.h>
+#include "../IirBlockFilter.h"
+#include "../SignalConditioner.h"
+
+#define TEST_RATE       1000.0  //!< The sampling rate in Hz.
+#define TEST_LENGTH     20000   //!< The number of samples.
+#define TEST_BLOCK_SIZE 1000    //!< The block size of the acquisition, PROC_BLOCK_SIZE.
+#define TEST_TOLERANCE  1e-9    //!< The allowed deviation from the per-sample output in mmHg.
+
+/**
+ * Filters the samples in blocks and compares them with the per-sample output.
+ * @param filter The block filter, reset before filtering.
+ * @param input The samples.
+ * @param expected The output of the per-sample filter.
+ * @param blockSize The number of samples per block.
+ * @return The largest deviation.
+ */
+static double checkBlocks(IirBlockFilter<IIRSTAGES> &filter, const std::vector<double> &input,
+                          const std::vector<double> &expected, size_t blockSize)
+{
+    filter.reset();
+    std::vector<double> output(input);
+    for (size_t i = 0; i < output.size(); i += blockSize)
+    {
+        filter.filter(std::span<double>(output).subspan(i, std::min(blockSize, output.size() - i)));
+    }
+    double deviation = 0.0;
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        deviation = std::max(deviation, std::abs(output[i] - expected[i]));
+    }
+    return deviation;
+}
+
+/**
+ * Filters a different curve in every lane and compares each lane with the per-sample output of its curve.
+ * @param iirFilter The per-sample filter, the lanes get its coefficients.
+ * @param input The samples, lane l filters them scaled by l + 1.
+ * @return The largest deviation.
+ */
+template<class IirFilter>
+static double checkLanes(IirFilter &iirFilter, const std::vector<double> &input)
+{
+    IirBlockFilter<IIRSTAGES, CONDITIONER_LANES> lanes;
+    lanes.setup(iirFilter);
+    std::vector<double> output(input.size() * CONDITIONER_LANES);
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        for (int l = 0; l < CONDITIONER_LANES; l++)
+        {
+            output[i * CONDITIONER_LANES + l] = input[i] * (l + 1);
+        }
+    }
+    for (size_t i = 0; i < output.size(); i += TEST_BLOCK_SIZE * CONDITIONER_LANES)
+    {
+        lanes.filter(std::span<double>(output).subspan(i, std::min<size_t>(TEST_BLOCK_SIZE * CONDITIONER_LANES,
+                                                                            output.size() - i)));
+    }
+
+    double deviation = 0.0;
+    for (int l = 0; l < CONDITIONER_LANES; l++)
+    {
+        iirFilter.reset();
+        for (size_t i = 0; i < input.size(); i++)
+        {
+            const double expected = iirFilter.filter(input[i] * (l + 1));
+            deviation = std::max(deviation, std::abs(output[i * CONDITIONER_LANES + l] - expected) / (l + 1));
+        }
+    }
+    return deviation;
+}
+
+int main()
+{
+    // A deflation from 160 mmHg with oscillations at 72 bpm and some noise at 50 Hz.
+    std::vector<double> input(TEST_LENGTH);
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        const double t = i / TEST_RATE;
+        input[i] = 160.0 - 5.0 * t + 2.0 * std::sin(2.0 * M_PI * 1.2 * t) + 0.5 * std::sin(2.0 * M_PI * 50.0 * t);
+    }
+
+    Iir::Butterworth::LowPass<IIRORDER> iirLP;
+    iirLP.setup(TEST_RATE, 10.0);
+    Iir::Butterworth::HighPass<IIRORDER> iirHP;
+    iirHP.setup(TEST_RATE, 0.5);
+    IirBlockFilter<IIRSTAGES> blockLP;
+    blockLP.setup(iirLP);
+    IirBlockFilter<IIRSTAGES> blockHP;
+    blockHP.setup(iirHP);
+
+    std::vector<double> expectedLP(input.size()), expectedHP(input.size());
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        expectedLP[i] = iirLP.filter(input[i]);
+        expectedHP[i] = iirHP.filter(input[i]);
+    }
+
+    bool bPass = true;
+    for (size_t blockSize : {(size_t) 1, (size_t) 7, (size_t) TEST_BLOCK_SIZE, (size_t) TEST_LENGTH})
+    {
+        const double deviationLP = checkBlocks(blockLP, input, expectedLP, blockSize);
+        const double deviationHP = checkBlocks(blockHP, input, expectedHP, blockSize);
+        std::cout << "Blocks of " << blockSize << ": deviation " << deviationLP << " (low-pass), " << deviationHP
+                  << " (high-pass)" << std::endl;
+        bPass = bPass && deviationLP < TEST_TOLERANCE && deviationHP < TEST_TOLERANCE;
+    }
+
+    const double deviationLanes = checkLanes(iirLP, input);
+    std::cout << CONDITIONER_LANES << " lanes: deviation " << deviationLanes << " (low-pass)" << std::endl;
+    bPass = bPass && deviationLanes < TEST_TOLERANCE;
+
+    if (bPass)
+    {
+        std::cout << "Test passed" << std::endl;
+        return 0;
+    }
+    std::cout << "Test failed" << std::endl;
+    return 1;
+}
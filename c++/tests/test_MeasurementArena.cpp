@@ -0,0 +1,97 @@
+/**
+ * @file        test_MeasurementArena.cpp
+ * @brief       MeasurementArena test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Checks that the OBPDetection class does not allocate any memory while a measurement is processed.
+ * The global operator new is replaced to count allocations. The sample data 'p.dat' and 'o.dat' is read first, then
+ * the counter is reset and all samples are passed to the OBPDetection object until the results are available. This is
+ * done in the normal and in the streaming mode. The test passes if the results are calculated and no allocation
+ * happened in either mode.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include "../OBPDetection.h"
+
+static long allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *ptr = std::malloc(size);
+    if (!ptr)
+    { throw std::bad_alloc(); }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+int main()
+{
+    OBPDetection *obpDetect = new OBPDetection(1000.0);
+    obpDetect->resetConfigValues();
+
+    std::ifstream pFile("p.dat");
+    std::ifstream oFile("o.dat");
+    if (!pFile || !oFile)
+    {
+        std::cout << "Test failed: could not open p.dat and o.dat in the working directory";
+        delete obpDetect;
+        return 1;
+    }
+    std::vector<double> pData;
+    std::vector<double> oData;
+    double tP, vP;
+    double tO, vO;
+    while (pFile >> tP >> vP && oFile >> tO >> vO)
+    {
+        pData.push_back(vP);
+        oData.push_back(vO);
+    }
+
+    long measuredAllocations = 0;
+    bool bEnoughData = true;
+    for (bool bStreaming : {false, true})
+    {
+        obpDetect->setStreaming(bStreaming);
+        allocations = 0;
+        obpDetect->reset();
+        for (size_t i = 0; i < pData.size(); i++)
+        {
+            if (obpDetect->processSample(pData[i], oData[i]) && obpDetect->getIsEnoughData())
+            {
+                break;
+            }
+        }
+        measuredAllocations += allocations;
+        bEnoughData = bEnoughData && obpDetect->getIsEnoughData();
+    }
+
+    int ret = 0;
+    if (bEnoughData && measuredAllocations == 0)
+    {
+        std::cout << "Test passed";
+    } else
+    {
+        std::cout << "Test failed: " << measuredAllocations << " allocations during the measurement";
+        ret = 1;
+    }
+
+    delete obpDetect;
+    return ret;
+}
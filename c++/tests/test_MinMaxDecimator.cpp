@@ -0,0 +1,175 @@
+/**
+ * @file        test_MinMaxDecimator.cpp
+ * @brief       MinMaxDecimator test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Passes a generated stream to MinMaxDecimator instances and compares their points with a reference that is
+ * calculated from all samples of the stream:
+ *
+ * - Every column holds the first minimum and the first maximum of its stored samples, the older one first. The
+ *   columns are aligned to the absolute sample number, and the oldest column only covers the samples that are still
+ *   stored, so no point is older than length().
+ * - The number of columns is changed while the stream runs. The points have to be the same as those of a decimator
+ *   that had the final number of columns from the start.
+ * - The stream is pushed in blocks of several sizes. The points have to be the same as when it is pushed sample by
+ *   sample.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <span>
+#include <vector>
+#include "../MinMaxDecimator.h"
+
+#define TEST_LENGTH     1000    //!< The number of samples the decimators keep.
+#define TEST_SAMPLES    7919    //!< The number of samples of the stream, not a multiple of any column width.
+
+/**
+ * Compares the points of a decimator with the columns calculated from the stream.
+ * @param decimator The decimator.
+ * @param stream All samples the decimator got, including the initial zeros.
+ * @param samplesPerColumn The number of samples per column the decimator has.
+ * @return True if all points match.
+ */
+static bool checkColumns(const MinMaxDecimator &decimator, const std::vector<double> &stream,
+                         size_t samplesPerColumn)
+{
+    const size_t total = stream.size();
+    const size_t oldest = total - decimator.length();
+    size_t point = 0;
+    for (size_t column = oldest / samplesPerColumn; column * samplesPerColumn < total; column++)
+    {
+        // The first minimum and maximum of the stored samples of the column.
+        const size_t first = std::max(column * samplesPerColumn, oldest);
+        const size_t end = std::min((column + 1) * samplesPerColumn, total);
+        size_t minIdx = first;
+        size_t maxIdx = first;
+        for (size_t idx = first + 1; idx < end; idx++)
+        {
+            if (stream[idx] < stream[minIdx])
+            {
+                minIdx = idx;
+            } else if (stream[idx] > stream[maxIdx])
+            {
+                maxIdx = idx;
+            }
+        }
+        const size_t older = std::min(minIdx, maxIdx);
+        const size_t newer = std::max(minIdx, maxIdx);
+        if (point + 2 > decimator.size() ||
+            decimator.value(point) != stream[older] || decimator.age(point) != (double) (total - older) ||
+            decimator.value(point + 1) != stream[newer] || decimator.age(point + 1) != (double) (total - newer))
+        {
+            std::cout << "Column " << column << " differs" << std::endl;
+            return false;
+        }
+        point += 2;
+    }
+    return point == decimator.size();
+}
+
+/**
+ * Checks if two decimators have the same points.
+ * @param a The first decimator.
+ * @param b The second decimator.
+ * @return True if the points are the same.
+ */
+static bool isSame(const MinMaxDecimator &a, const MinMaxDecimator &b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a.value(i) != b.value(i) || a.age(i) != b.age(i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    // A slow wave with noise, so the extremes are spread over the columns, and a falling ramp, so the oldest sample of
+    // a column is often its maximum.
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> noise(-1.0, 1.0);
+    std::vector<double> samples(TEST_SAMPLES);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        samples[i] = (i < TEST_SAMPLES / 2) ? std::sin(i * 0.01) * 10.0 + noise(generator) : -(double) i;
+    }
+    std::vector<double> stream(TEST_LENGTH, 0.0);
+    stream.insert(stream.end(), samples.begin(), samples.end());
+
+    bool bPass = true;
+    const int columnCounts[] = {64, 100, 37, 1000};
+    for (int nColumns : columnCounts)
+    {
+        const size_t samplesPerColumn = (TEST_LENGTH + nColumns - 1) / nColumns;
+
+        // The number of columns changes every 1000 samples and is nColumns for the last ones.
+        MinMaxDecimator single(TEST_LENGTH);
+        MinMaxDecimator reference(TEST_LENGTH);
+        reference.setColumns(nColumns);
+        for (size_t i = 0; i < samples.size() && bPass; i++)
+        {
+            if (i % 1000 == 0)
+            {
+                const int otherColumns = columnCounts[(i / 1000) % std::size(columnCounts)];
+                single.setColumns(samples.size() - i <= 1000 ? nColumns : otherColumns);
+            }
+            single.push(samples[i]);
+            reference.push(samples[i]);
+            // The oldest column must never show a sample that is no longer stored.
+            if (i % 97 == 0 && samplesPerColumn > 1)
+            {
+                const std::vector<double> streamSoFar(stream.begin(), stream.begin() + TEST_LENGTH + i + 1);
+                bPass = checkColumns(reference, streamSoFar, samplesPerColumn);
+            }
+        }
+        if (samplesPerColumn > 1)
+        {
+            bPass = bPass && checkColumns(reference, stream, samplesPerColumn);
+        }
+        bPass = bPass && isSame(single, reference);
+        if (!bPass)
+        {
+            std::cout << "Points differ with " << nColumns << " columns" << std::endl;
+            break;
+        }
+
+        // The same stream in blocks of several sizes, including single samples and blocks longer than the length.
+        MinMaxDecimator blocks(TEST_LENGTH);
+        blocks.setColumns(nColumns);
+        const size_t blockSizes[] = {1, 7, 250, 1500};
+        size_t first = 0;
+        for (size_t b = 0; first < samples.size(); b++)
+        {
+            const size_t n = std::min(blockSizes[b % std::size(blockSizes)], samples.size() - first);
+            blocks.push(std::span<const double>(samples).subspan(first, n));
+            first += n;
+        }
+        bPass = isSame(blocks, reference);
+        if (!bPass)
+        {
+            std::cout << "Blocks differ from single samples with " << nColumns << " columns" << std::endl;
+            break;
+        }
+    }
+
+    if (bPass)
+    {
+        std::cout << "Test passed" << std::endl;
+        return 0;
+    }
+    std::cout << "Test failed" << std::endl;
+    return 1;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file        test_MultiChannelProcessing.cpp
+ * @brief       MultiChannelProcessing test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Runs two measurements at once through a MultiChannelProcessing thread, one per channel. Each channel is generated
+ * by its own SyntheticSampleSource with a different blood pressure, and the blocks of both are interleaved into one
+ * two-channel source, like the ComediHandler acquires several cuffs. An observer per channel starts the measurement
+ * as soon as the channel is ready and waits for the results. The channels are processed once by the acquisition
+ * thread and once by worker threads. If both channels find their own blood pressure both times, the test passes.
+ */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "../MultiChannelProcessing.h"
+#include "../SyntheticSampleSource.h"
+
+#define TEST_CHANNELS   2       //!< The number of channels.
+#define TEST_TOLERANCE  5.0     //!< The allowed deviation of the results in mmHg.
+#define TEST_TIMEOUT    60      //!< The maximal time for the measurements in s.
+
+static const double testSBP[TEST_CHANNELS] = {125.0, 145.0};   //!< The generated SBP per channel.
+static const double testDBP[TEST_CHANNELS] = {78.0, 92.0};     //!< The generated DBP per channel.
+static const double testHR[TEST_CHANNELS] = {72.0, 60.0};      //!< The generated heart rate per channel.
+
+//! Source that interleaves the blocks of several single channel sources.
+class InterleavedSource : public ISampleSource
+{
+public:
+    explicit InterleavedSource(std::vector<SyntheticSampleSource> &sources) : sources(sources) {}
+
+    double getSamplingRate() override { return sources[0].getSamplingRate(); }
+
+    int getNumChannels() override { return (int) sources.size(); }
+
+    bool waitForData(int timeoutMs) override { return sources[0].waitForData(timeoutMs); }
+
+    std::span<const double> readVoltageBlock() override
+    {
+        const size_t nChannels = sources.size();
+        for (size_t c = 0; c < nChannels; c++)
+        {
+            const auto block = sources[c].readVoltageBlock();
+            scans.resize(block.size() * nChannels);
+            for (size_t i = 0; i < block.size(); i++)
+            {
+                scans[i * nChannels + c] = block[i];
+            }
+        }
+        return scans;
+    }
+
+private:
+    std::vector<SyntheticSampleSource> &sources;
+    std::vector<double> scans;
+};
+
+//! Observer that starts a measurement on one channel and stores the results.
+class TestObserver : public IObserver
+{
+public:
+    explicit TestObserver(Processing *process) : process(process) {}
+
+    void eReady() override { process->startMeasurement(); }
+
+    void eResults(double map, double sbp, double dbp) override
+    {
+        // The results are reset to 0 when a measurement starts.
+        if (map != 0.0)
+        {
+            resSBP = sbp;
+            resDBP = dbp;
+            bDone = true;
+        }
+    }
+
+    Processing *process;
+    std::atomic<bool> bDone = false;
+    double resSBP = 0.0;
+    double resDBP = 0.0;
+};
+
+/**
+ * Runs the measurements of all channels at once.
+ * @param nWorkers The number of worker threads, 0 to process the channels in the acquisition thread.
+ * @return True if every channel found its own blood pressure.
+ */
+static bool runChannels(unsigned int nWorkers)
+{
+    std::vector<SyntheticSampleSource> sources;
+    for (int c = 0; c < TEST_CHANNELS; c++)
+    {
+        sources.emplace_back(false);
+        sources.back().setBloodPressure(testSBP[c], testDBP[c], testHR[c]);
+    }
+    InterleavedSource source(sources);
+
+    MultiChannelProcessing process(&source, nWorkers);
+    std::vector<std::unique_ptr<TestObserver>> observers;
+    for (int c = 0; c < process.getNumChannels(); c++)
+    {
+        observers.push_back(std::make_unique<TestObserver>(process.getChannel(c)));
+        process.getChannel(c)->setRecording(false);
+        process.getChannel(c)->attach(observers.back().get());
+    }
+    process.start();
+
+    const auto start = std::chrono::steady_clock::now();
+    while (!(observers[0]->bDone && observers[1]->bDone) &&
+           std::chrono::steady_clock::now() - start < std::chrono::seconds(TEST_TIMEOUT))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    process.shutdown();
+
+    bool bOk = true;
+    for (int c = 0; c < TEST_CHANNELS; c++)
+    {
+        const TestObserver &observer = *observers[c];
+        std::cout << process.getNumWorkers() << " workers, channel " << c << ": " << observer.resSBP << " "
+                  << observer.resDBP << std::endl;
+        if (!observer.bDone || std::abs(observer.resSBP - testSBP[c]) > TEST_TOLERANCE ||
+            std::abs(observer.resDBP - testDBP[c]) > TEST_TOLERANCE)
+        {
+            bOk = false;
+        }
+    }
+    return bOk;
+}
+
+int main()
+{
+    int ret = 0;
+    if (!runChannels(0) || !runChannels(TEST_CHANNELS))
+    {
+        ret = 1;
+    }
+    std::cout << (ret == 0 ? "Test passed" : "Test failed");
+
+    return ret;
+}
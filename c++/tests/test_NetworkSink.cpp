@@ -0,0 +1,146 @@
+/**
+ * @file        test_NetworkSink.cpp
+ * @brief       NetworkSink test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Streams data blocks and results through a NetworkSink to a socket on the loopback interface. The blocks are small,
+ * like the ones of a single poll, and are queued before the sender is started. They have more pairs than fit in the
+ * queue, so the oldest ones have to be dropped. The test passes if the Hello frame, the newest data pairs in full
+ * frames and the results arrive intact.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../NetworkSink.h"
+
+#define TEST_BLOCK_SIZE 10                                      //!< The number of pairs per block.
+#define TEST_BLOCKS     (NET_QUEUE_PAIRS / TEST_BLOCK_SIZE + 500)   //!< The number of blocks, more than fit.
+#define TEST_PAIRS      (TEST_BLOCKS * TEST_BLOCK_SIZE)             //!< The number of pairs of all blocks.
+#define TEST_FRAMES     ((TEST_PAIRS + NET_MAX_PAIRS - 1) / NET_MAX_PAIRS)  //!< The number of data frames.
+#define TEST_STATION    42                                      //!< The identifier of the station.
+
+/**
+ * Reads exactly the given number of bytes.
+ */
+static bool readAll(int fd, void *data, size_t size)
+{
+    auto *bytes = static_cast<uint8_t *>(data);
+    while (size > 0)
+    {
+        const ssize_t n = recv(fd, bytes, size, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+int main()
+{
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(listener, (sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 1) != 0 ||
+        getsockname(listener, (sockaddr *) &address, &length) != 0)
+    {
+        std::cout << "Could not listen" << std::endl;
+        return 1;
+    }
+
+    NetworkSink sink("127.0.0.1", ntohs(address.sin_port), TEST_STATION);
+    std::vector<double> pData(TEST_BLOCK_SIZE), oData(TEST_BLOCK_SIZE);
+    for (int block = 0; block < TEST_BLOCKS; block++)
+    {
+        for (int i = 0; i < TEST_BLOCK_SIZE; i++)
+        {
+            pData[i] = block * TEST_BLOCK_SIZE + i;
+            oData[i] = -pData[i];
+        }
+        sink.eNewDataBlock(pData, oData);
+    }
+    sink.eResults(95.0, 125.0, 80.0);
+    sink.start();
+
+    const int fd = accept(listener, nullptr, nullptr);
+    const uint64_t dropped = sink.getDroppedFrames();
+    bool bPass = fd >= 0 && dropped > 0 && dropped < TEST_FRAMES;
+
+    /**
+     * The blocks are merged into full frames. The queue keeps the results and the newest data frames, in the order
+     * they were queued, with at most NET_QUEUE_PAIRS pairs.
+     */
+    uint64_t expectedFrame = dropped;
+    uint64_t expectedSample = dropped * NET_MAX_PAIRS;
+    bool bHello = false, bResults = false;
+    while (bPass && !bResults)
+    {
+        NetFrameHeader header;
+        bPass = readAll(fd, &header, sizeof(header)) && std::memcmp(header.magic, NET_MAGIC, 4) == 0 &&
+                header.station == TEST_STATION;
+        std::vector<uint8_t> payload(header.payloadSize);
+        bPass = bPass && readAll(fd, payload.data(), payload.size());
+        if (!bPass)
+        {
+            break;
+        }
+        switch ((NetFrameType) header.type)
+        {
+            case NetFrameType::Hello:
+                // Nothing was sent on an earlier connection.
+                bHello = header.sequence == 0;
+                break;
+            case NetFrameType::Data:
+            {
+                NetDataPayload data;
+                std::memcpy(&data, payload.data(), sizeof(data));
+                const size_t nPairs = (payload.size() - sizeof(data)) / (2 * sizeof(float));
+                std::vector<float> pairs(2 * nPairs);
+                std::memcpy(pairs.data(), payload.data() + sizeof(data), pairs.size() * sizeof(float));
+                const size_t expectedPairs = std::min<size_t>(NET_MAX_PAIRS, TEST_PAIRS - expectedSample);
+                bPass = bHello && header.sequence == expectedFrame && data.firstSample == expectedSample &&
+                        nPairs == expectedPairs && pairs[0] == (float) expectedSample &&
+                        pairs[2 * nPairs - 1] == -(float) (expectedSample + nPairs - 1);
+                expectedFrame++;
+                expectedSample += nPairs;
+                break;
+            }
+            case NetFrameType::Results:
+            {
+                double results[3];
+                std::memcpy(results, payload.data(), sizeof(results));
+                bPass = expectedFrame == TEST_FRAMES && expectedSample == TEST_PAIRS &&
+                        TEST_PAIRS - dropped * NET_MAX_PAIRS <= NET_QUEUE_PAIRS && results[1] == 125.0;
+                bResults = true;
+                break;
+            }
+            default:
+                bPass = false;
+        }
+    }
+
+    sink.stopThread();
+    sink.join();
+    close(fd);
+    close(listener);
+
+    if (bPass)
+    {
+        std::cout << "Test passed" << std::endl;
+        return 0;
+    }
+    std::cout << "Test failed" << std::endl;
+    return 1;
+}
@@ -10,26 +10,52 @@
  * A set of sample data is stored in the same folder as this test 'p.dat' contains pressure values and 'o.dat'
  * contains oscillation values. The values are passed to the OBPDetection object. If the OBPDetection object
  * successfully calculates all values as not equal to 0.0 the test passes.
+ * The data is processed in the streaming mode as well, which has to give the same results.
+ * Finally the data is processed in the streaming mode with a ring smaller than the measurement, after a flat lead-in
+ * of several times the ring's size, so the ring wraps several times and the oldest peaks are removed. The MAP, SBP and
+ * DBP have to match the batch mode with the same lead-in, the removed peaks are all before the SBP. The average heart
+ * rate only covers the peaks that are left, so it only has to be close to the one of the batch mode.
  */
 
 #include <iostream>
 #include <fstream>
-#include "../OBPDetection.cpp"
+#include <cmath>
+#include "../OBPDetection.h"
 
-int main()
+#define TEST_RING_SIZE  40000   //!< The ring size of the wrapping test, smaller than the 51420 samples it needs.
+#define TEST_LEAD_IN    120000  //!< The number of flat samples before the data in the wrapping test.
+#define TEST_HR_TOL     1.0     //!< The allowed difference of the average heart rate in the wrapping test in bpm.
+
+/**
+ * Passes the sample data to an OBPDetection object until it has enough data.
+ * @param bStreaming Use the streaming mode.
+ * @param results The MAP, SBP, DBP and average heart rate.
+ * @param dataSize The maximal number of samples, the size of the ring in streaming mode.
+ * @param leadIn The number of samples without oscillations before the sample data.
+ */
+void runDetection(bool bStreaming, double results[4], int dataSize = DEFAULT_DATA_SIZE, int leadIn = 0)
 {
-    OBPDetection *obpDetect = new OBPDetection(1000.0);
+    OBPDetection *obpDetect = new OBPDetection(makeDetectionConfig(1000.0, MIN_PEAK_TIME, MIN_DATA_SIZE, dataSize));
     obpDetect->resetConfigValues();
+    obpDetect->setStreaming(bStreaming);
     //string line;
     std::ifstream pFile("p.dat");
     std::ifstream oFile("o.dat");
     double tP, vP;
     double tO, vO;
+    bool bFirst = true;
     while (pFile >> tP >> vP)
     {
         if (!(oFile >> tO >> vO))
         { break; } // error
 
+        // The lead-in holds the first pressure value.
+        for (; bFirst && leadIn > 0; leadIn--)
+        {
+            obpDetect->processSample(vP, 0.0);
+        }
+        bFirst = false;
+
         if (obpDetect->processSample(vP, vO))
         {
             if (obpDetect->getIsEnoughData())
@@ -41,10 +67,30 @@ int main()
         }
     }
 
+    results[0] = obpDetect->getMAP();
+    results[1] = obpDetect->getSBP();
+    results[2] = obpDetect->getDBP();
+    results[3] = obpDetect->getAverageHeartRate();
+    delete obpDetect;
+}
+
+int main()
+{
+    double results[4];
+    double streamResults[4];
+    double wrapResults[4];
+    double wrapBatchResults[4];
+    runDetection(false, results);
+    runDetection(true, streamResults);
+    runDetection(true, wrapResults, TEST_RING_SIZE, TEST_LEAD_IN);
+    runDetection(false, wrapBatchResults, DEFAULT_DATA_SIZE, TEST_LEAD_IN);
+
     int ret = 0;
     //Processing procThread;
-    if (obpDetect->getMAP() != 0.0 && obpDetect->getSBP() != 0.0 && obpDetect->getDBP() != 0.0 &&
-    obpDetect->getAverageHeartRate() != 0.0)
+    if (results[0] != 0.0 && results[1] != 0.0 && results[2] != 0.0 && results[3] != 0.0 &&
+        std::equal(results, results + 4, streamResults) && wrapBatchResults[3] != 0.0 &&
+        std::equal(wrapBatchResults, wrapBatchResults + 3, wrapResults) &&
+        std::abs(wrapResults[3] - wrapBatchResults[3]) < TEST_HR_TOL)
     {
         std::cout << "Test passed";
     } else
@@ -53,6 +99,5 @@ int main()
         ret = 1;
     }
 
-    delete obpDetect;
     return ret;
 }
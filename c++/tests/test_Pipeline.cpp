@@ -0,0 +1,124 @@
+/**
+ * @file        test_Pipeline.cpp
+ * @brief       Pipeline test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Passes generated measurements through Pipeline instances and through a SignalConditioner with an OBPDetection. At
+ * the nominal sampling rate and filter order, the Pipeline has to give exactly the same results as the runtime
+ * configured classes. At half the sampling rate, its windows are scaled, and the results have to be close to the
+ * generated blood pressure.
+ */
+
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include "../Pipeline.h"
+#include "../SignalConditioner.h"
+#include "../SyntheticSampleSource.h"
+
+#define TEST_SBP        125.0   //!< The generated SBP.
+#define TEST_DBP        78.0    //!< The generated DBP.
+#define TEST_HR         72.0    //!< The generated heart rate.
+#define TEST_TOLERANCE  5.0     //!< The allowed deviation of the results in mmHg.
+#define TEST_PUMP_UP    PUMP_UP_VALUE_MIN   //!< The pressure in mmHg above which the samples are analysed.
+#define TEST_SECONDS    120     //!< The generated duration in s, longer than one measurement.
+
+/**
+ * Generates a measurement with the synthetic source.
+ * @param samplingRate The sampling rate of the samples.
+ * @return The voltages.
+ */
+std::vector<double> generate(double samplingRate)
+{
+    SyntheticSampleSource source(false, samplingRate);
+    source.setBloodPressure(TEST_SBP, TEST_DBP, TEST_HR);
+    std::vector<double> samples;
+    while (samples.size() < TEST_SECONDS * samplingRate)
+    {
+        const auto block = source.readVoltageBlock();
+        samples.insert(samples.end(), block.begin(), block.end());
+    }
+    return samples;
+}
+
+/**
+ * Converts and filters the samples block by block and passes them to the detection, once the pressure exceeded the
+ * pump-up value and until there is enough data.
+ * @param samples The voltages.
+ * @param blockSize The number of samples processed at once.
+ * @param conditioner Converts and filters the blocks, a SignalConditioner or a Pipeline.
+ * @param detection The detection the filtered samples are passed to.
+ * @param results The MAP, SBP, DBP and average heart rate.
+ */
+template<typename Conditioner>
+void runMeasurement(const std::vector<double> &samples, size_t blockSize, Conditioner &conditioner,
+                    OBPDetection &detection, double results[4])
+{
+    std::vector<double> ymmHg(blockSize), yLP(blockSize), yHP(blockSize);
+    bool bDeflating = false;
+    for (size_t i = 0; i < samples.size() && !detection.getIsEnoughData(); i += blockSize)
+    {
+        const auto block = std::span<const double>(samples).subspan(i, std::min(blockSize, samples.size() - i));
+        conditioner.process(block, ymmHg, yLP, yHP);
+        for (size_t j = 0; j < block.size(); j++)
+        {
+            if (!bDeflating)
+            {
+                bDeflating = ymmHg[j] > TEST_PUMP_UP;
+                continue;
+            }
+            if (detection.processSample(yLP[j], yHP[j]) && detection.getIsEnoughData())
+            {
+                break;
+            }
+        }
+    }
+    results[0] = detection.getMAP();
+    results[1] = detection.getSBP();
+    results[2] = detection.getDBP();
+    results[3] = detection.getAverageHeartRate();
+    std::cout << results[0] << " " << results[1] << " " << results[2] << " " << results[3] << std::endl;
+}
+
+int main()
+{
+    const std::vector<double> samples = generate(SAMPLING_RATE);
+    double expected[4];
+    SignalConditioner conditioner(SAMPLING_RATE, 10.0, 0.5);
+    conditioner.setCalibration(0.71, 2.6);
+    OBPDetection obpDetect(SAMPLING_RATE);
+    obpDetect.resetConfigValues();
+    runMeasurement(samples, SAMPLING_RATE, conditioner, obpDetect, expected);
+
+    double results[4];
+    Pipeline<SAMPLING_RATE, IIRORDER> pipeline(10.0, 0.5);
+    pipeline.setCalibration(0.71, 2.6);
+    runMeasurement(samples, pipeline.blockSize, pipeline, pipeline.getDetection(), results);
+
+    bool bPass = obpDetect.getIsEnoughData();
+    for (int i = 0; i < 4; i++)
+    {
+        bPass = bPass && results[i] == expected[i];
+    }
+
+    const std::vector<double> halfRate = generate(SAMPLING_RATE / 2);
+    Pipeline<SAMPLING_RATE / 2, IIRORDER> slowPipeline(10.0, 0.5);
+    slowPipeline.setCalibration(0.71, 2.6);
+    runMeasurement(halfRate, slowPipeline.blockSize, slowPipeline, slowPipeline.getDetection(), results);
+
+    const double expMAP = TEST_DBP + (TEST_SBP - TEST_DBP) / 3.0;
+    bPass = bPass && slowPipeline.getDetection().getIsEnoughData() && std::abs(results[0] - expMAP) < TEST_TOLERANCE &&
+            std::abs(results[1] - TEST_SBP) < TEST_TOLERANCE && std::abs(results[2] - TEST_DBP) < TEST_TOLERANCE &&
+            std::abs(results[3] - TEST_HR) < 1.0;
+
+    if (bPass)
+    {
+        std::cout << "Test passed" << std::endl;
+        return 0;
+    }
+    std::cout << "Test failed" << std::endl;
+    return 1;
+}
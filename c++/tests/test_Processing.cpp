@@ -0,0 +1,94 @@
+/**
+ * @file        test_Processing.cpp
+ * @brief       Processing test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Runs a whole measurement through the Processing thread without any hardware. The samples are generated by a
+ * SyntheticSampleSource as fast as possible, with a known blood pressure. An observer starts the measurement as soon
+ * as Processing is ready and waits for the results. If the results are close to the generated blood pressure, the
+ * test passes.
+ */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include "../Processing.h"
+#include "../SyntheticSampleSource.h"
+
+#define TEST_SBP        125.0   //!< The generated SBP.
+#define TEST_DBP        78.0    //!< The generated DBP.
+#define TEST_HR         72.0    //!< The generated heart rate.
+#define TEST_TOLERANCE  5.0     //!< The allowed deviation of the results in mmHg.
+#define TEST_TIMEOUT    60      //!< The maximal time for the measurement in s.
+
+//! Observer that starts a measurement and stores the results.
+class TestObserver : public IObserver
+{
+public:
+    explicit TestObserver(Processing *process) : process(process) {}
+
+    void eReady() override { process->startMeasurement(); }
+
+    void eHeartRate(double heartRate) override { hr = heartRate; }
+
+    void eResults(double map, double sbp, double dbp) override
+    {
+        // The results are reset to 0 when a measurement starts.
+        if (map != 0.0)
+        {
+            resMAP = map;
+            resSBP = sbp;
+            resDBP = dbp;
+            bDone = true;
+        }
+    }
+
+    Processing *process;
+    std::atomic<bool> bDone = false;
+    double resMAP = 0.0;
+    double resSBP = 0.0;
+    double resDBP = 0.0;
+    double hr = 0.0;
+};
+
+int main()
+{
+    SyntheticSampleSource source(false);
+    source.setBloodPressure(TEST_SBP, TEST_DBP, TEST_HR);
+
+    Processing process(&source);
+    process.setRecording(false);
+    TestObserver observer(&process);
+    process.attach(&observer);
+    process.start();
+
+    const auto start = std::chrono::steady_clock::now();
+    while (!observer.bDone && std::chrono::steady_clock::now() - start < std::chrono::seconds(TEST_TIMEOUT))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    process.shutdown();
+
+    const double expMAP = TEST_DBP + (TEST_SBP - TEST_DBP) / 3.0;
+    std::cout << observer.resMAP << " " << observer.resSBP << " " << observer.resDBP << " " << observer.hr
+              << std::endl;
+
+    int ret = 0;
+    if (observer.bDone && std::abs(observer.resMAP - expMAP) < TEST_TOLERANCE &&
+        std::abs(observer.resSBP - TEST_SBP) < TEST_TOLERANCE && std::abs(observer.resDBP - TEST_DBP) < TEST_TOLERANCE &&
+        std::abs(observer.hr - TEST_HR) < 1.0)
+    {
+        std::cout << "Test passed";
+    } else
+    {
+        std::cout << "Test failed";
+        ret = 1;
+    }
+
+    return ret;
+}
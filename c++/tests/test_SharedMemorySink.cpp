@@ -0,0 +1,192 @@
+/**
+ * @file        test_SharedMemorySink.cpp
+ * @brief       SharedMemorySink test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * First writes more pairs to a small ring than it holds, without a reader keeping up, so the reader has to detect
+ * that the pairs it got were overwritten and continue with the oldest ones. Then runs a whole measurement of a
+ * SyntheticSampleSource through Processing with a SharedMemorySink attached, while a reader thread follows the data.
+ * The test passes if every pair the reader kept as intact matches the data the Processing sent, and the status
+ * carries the results of the measurement.
+ */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "../SharedMemoryReader.h"
+#include "../SharedMemorySink.h"
+#include "../SyntheticSampleSource.h"
+
+#define TEST_CAPACITY   64      //!< The number of pairs in the small ring.
+#define TEST_TIMEOUT    60      //!< The maximal time for the measurement in s.
+
+//! Observer that starts a measurement and keeps all data and the results.
+class TestObserver : public IObserver
+{
+public:
+    explicit TestObserver(Processing *process) : process(process) {}
+
+    void eReady() override { process->startMeasurement(); }
+
+    void eNewDataBlock(std::span<const double> pData, std::span<const double>) override
+    {
+        pressure.insert(pressure.end(), pData.begin(), pData.end());
+    }
+
+    void eResults(double map, double, double) override
+    {
+        if (map != 0.0)
+        {
+            resMAP = map;
+            bDone = true;
+        }
+    }
+
+    Processing *process;
+    std::vector<double> pressure;
+    std::atomic<bool> bDone = false;
+    double resMAP = 0.0;
+};
+
+/**
+ * Writes the indices of pairs as their values.
+ * @param sink The sink.
+ * @param first The index of the first pair.
+ * @param n The number of pairs.
+ */
+static void writePairs(SharedMemorySink &sink, int first, int n)
+{
+    std::vector<double> pData(n), oData(n);
+    for (int i = 0; i < n; i++)
+    {
+        pData[i] = first + i;
+        oData[i] = -(first + i);
+    }
+    sink.eNewDataBlock(pData, oData);
+}
+
+/**
+ * Overruns a small ring.
+ * @param name The name of the shared memory object.
+ * @return True if the reader detects the overrun.
+ */
+static bool checkOverrun(const std::string &name)
+{
+    SharedMemorySink sink(name, nullptr, TEST_CAPACITY);
+    SharedMemoryReader reader(name);
+    if (!sink.isOpen() || !reader.isOpen() || reader.getCapacity() != TEST_CAPACITY)
+    {
+        std::cout << "Could not open the shared memory" << std::endl;
+        return false;
+    }
+
+    std::span<const double> pData, oData;
+    uint64_t next = 0;
+    writePairs(sink, 0, 50);
+    bool bPass = reader.peekData(next, pData, oData) == 50 && pData[49] == 49.0 && oData[49] == -49.0;
+    bPass = bPass && reader.isIntact(next);
+
+    // The first pairs are overwritten, the reader continues with the oldest ones that are left.
+    writePairs(sink, 50, 40);
+    bPass = bPass && !reader.isIntact(next);
+    bPass = bPass && reader.peekData(next, pData, oData) == TEST_CAPACITY - 26 && next == 26 && pData[0] == 26.0;
+    bPass = bPass && reader.isIntact(next);
+    next += pData.size();
+    bPass = bPass && reader.peekData(next, pData, oData) == 26 && pData[25] == 89.0 && oData[0] == -64.0;
+    next += pData.size();
+    bPass = bPass && reader.peekData(next, pData, oData) == 0 && reader.isWriterOpen();
+
+    sink.eResults(95.0, 125.0, 80.0);
+    ShmStatus status{};
+    bPass = bPass && reader.readStatus(status) && status.state == SHM_STATE_UNKNOWN && status.sbp == 125.0 &&
+            status.resultCount == 1;
+    std::cout << "Overrun " << (bPass ? "detected" : "not detected") << std::endl;
+    return bPass;
+}
+
+int main()
+{
+    const std::string name = "/obp_test_" + std::to_string(getpid());
+    bool bPass = checkOverrun(name);
+
+    SyntheticSampleSource source(false);
+    Processing process(&source);
+    process.setRecording(false);
+    TestObserver observer(&process);
+    SharedMemorySink sink(name, &process, SHM_DEFAULT_CAPACITY, process.getSamplingRate());
+    process.attach(&sink);
+    process.attach(&observer);
+
+    /**
+     * The reader keeps the pairs it got intact, the ones it missed stay NaN.
+     */
+    std::atomic<bool> bStop = false;
+    std::vector<double> seen;
+    std::thread readerThread([&] {
+        SharedMemoryReader reader(name);
+        uint64_t next = 0;
+        std::span<const double> pData, oData;
+        while (!bStop)
+        {
+            const size_t n = reader.peekData(next, pData, oData);
+            if (n == 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::vector<double> copy(pData.begin(), pData.end());
+            if (reader.isIntact(next))
+            {
+                seen.resize(next, NAN);
+                seen.insert(seen.end(), copy.begin(), copy.end());
+                next += n;
+            }
+        }
+    });
+
+    process.start();
+    const auto start = std::chrono::steady_clock::now();
+    while (!observer.bDone && std::chrono::steady_clock::now() - start < std::chrono::seconds(TEST_TIMEOUT))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    process.shutdown();
+    bStop = true;
+    readerThread.join();
+
+    size_t nSeen = 0;
+    bool bMatch = seen.size() <= observer.pressure.size();
+    for (size_t i = 0; i < seen.size() && bMatch; i++)
+    {
+        if (!std::isnan(seen[i]))
+        {
+            bMatch = seen[i] == observer.pressure[i];
+            nSeen++;
+        }
+    }
+
+    SharedMemoryReader reader(name);
+    ShmStatus status{};
+    bPass = bPass && observer.bDone && bMatch && nSeen > 0 && reader.readStatus(status) &&
+            status.map == observer.resMAP && status.resultCount >= 2 && status.readyCount >= 1 &&
+            status.screen == (uint64_t) Screen::resultScreen && status.state != SHM_STATE_UNKNOWN &&
+            sink.getPublishedPairs() == observer.pressure.size();
+    std::cout << "Reader kept " << nSeen << " of " << observer.pressure.size() << " pairs, MAP " << status.map
+              << std::endl;
+
+    if (bPass)
+    {
+        std::cout << "Test passed" << std::endl;
+        return 0;
+    }
+    std::cout << "Test failed" << std::endl;
+    return 1;
+}
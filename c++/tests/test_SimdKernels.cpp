@@ -0,0 +1,80 @@
+/**
+ * @file        test_SimdKernels.cpp
+ * @brief       Vectorised kernels test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Runs the kernels of every instruction set the CPU supports on random values, with repeated values and NaN, for all
+ * lengths up to a few vectors. The test passes if the searches find the same index as with the scalar kernels and
+ * the means are within a tolerance of the scalar ones.
+ */
+
+#include <iostream>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "../SimdKernels.h"
+
+#define TEST_LENGTH     37      //!< The maximal number of values searched, several vectors and a remainder.
+#define TEST_TOLERANCE  1e-12   //!< The allowed relative deviation of the means.
+
+int main()
+{
+    std::mt19937 generator(42);
+    // Few distinct values, so the thresholds are often equal to values.
+    std::uniform_int_distribution<int> distribution(0, 8);
+    std::vector<double> values(TEST_LENGTH);
+    for (double &value : values)
+    {
+        value = 0.25 * distribution(generator);
+    }
+    values[TEST_LENGTH / 2] = NAN;
+
+    const SimdLevel fastest = getSimdLevel();
+    std::cout << "Kernels: " << toString(fastest) << std::endl;
+
+    bool bPass = true;
+    for (SimdLevel level : {SimdLevel::AVX2, SimdLevel::NEON})
+    {
+        if (!setSimdLevel(level))
+        {
+            continue;
+        }
+        for (size_t first = 0; first < values.size(); first++)
+        {
+            for (size_t n = 0; first + n <= values.size(); n++)
+            {
+                const auto range = std::span<const double>(values).subspan(first, n);
+                for (double threshold : {-1.0, 0.0, 0.75, 1.0, 2.5})
+                {
+                    setSimdLevel(level);
+                    const size_t above = findFirstAbove(range, threshold);
+                    const size_t below = findFirstBelow(range, threshold);
+                    setSimdLevel(SimdLevel::Scalar);
+                    bPass = bPass && above == findFirstAbove(range, threshold) &&
+                            below == findFirstBelow(range, threshold);
+                }
+                if (first + n <= TEST_LENGTH / 2 && n > 0)
+                {
+                    setSimdLevel(level);
+                    const double mean = meanOf(range);
+                    setSimdLevel(SimdLevel::Scalar);
+                    const double expected = meanOf(range);
+                    bPass = bPass && std::abs(mean - expected) <= TEST_TOLERANCE * std::abs(expected);
+                }
+            }
+        }
+        std::cout << toString(level) << (bPass ? " matches" : " differs from") << " the scalar kernels" << std::endl;
+    }
+    setSimdLevel(fastest);
+
+    if (bPass)
+    {
+        std::cout << "Test passed" << std::endl;
+        return 0;
+    }
+    std::cout << "Test failed" << std::endl;
+    return 1;
+}
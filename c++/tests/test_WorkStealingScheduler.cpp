@@ -0,0 +1,257 @@
+/**
+ * @file        test_WorkStealingScheduler.cpp
+ * @brief       WorkStealingScheduler test implementation.
+ * @author      Belinda Kneubühler
+ * @date        2020-08-18
+ * @copyright   GNU General Public License v2.0
+ *
+ * @details
+ * Runs SerialTasks whose work is a sequence of numbers on a WorkStealingScheduler:
+ *
+ * - Two producer threads queue the numbers of many tasks and submit them while the workers run. The tasks of the
+ *   first worker are slow, so the other workers steal them. Every task checks that it gets its numbers in order and
+ *   is never run by two workers at once, and at least one task has to be run by more than one worker.
+ * - A task queues new work and submits itself while it runs, like a producer that is faster than the worker. The
+ *   submit does nothing because the task is still scheduled, so the work is only done if the scheduler checks the
+ *   task again after it released it.
+ */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../WorkStealingScheduler.h"
+
+#define TEST_WORKERS    4       //!< The number of worker threads.
+#define TEST_TASKS      16      //!< The number of tasks, every TEST_WORKERS-th one is slow.
+#define TEST_ITEMS      200     //!< The number of work items per task.
+#define TEST_BUDGET     5       //!< The maximal number of items a task does per run.
+#define TEST_SLOW_US    500     //!< The time a slow task needs per item in us.
+#define TEST_RESUBMITS  10      //!< The number of times the resubmitting task queues work while it runs.
+#define TEST_TIMEOUT    30      //!< The maximal time for the work in s.
+
+//! Task that does numbered work items and checks their order.
+class SequenceTask : public SerialTask
+{
+public:
+    explicit SequenceTask(bool bSlow) : bSlow(bSlow) {}
+
+    /**
+     * Queues the next work item.
+     */
+    void queue()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(nQueued++);
+    }
+
+    bool runPending() override
+    {
+        if (bRunning.exchange(true))
+        {
+            bError = true;
+        }
+        const std::thread::id thread = std::this_thread::get_id();
+        if (lastThread != std::thread::id() && lastThread != thread)
+        {
+            bStolen = true;
+        }
+        lastThread = thread;
+
+        bool bMore = false;
+        for (int i = 0; i < TEST_BUDGET; i++)
+        {
+            int item;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (pending.empty())
+                {
+                    break;
+                }
+                item = pending.front();
+                pending.pop_front();
+                bMore = !pending.empty();
+            }
+            if (item != nDone)
+            {
+                bError = true;
+            }
+            if (bSlow)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(TEST_SLOW_US));
+            }
+            nDone++;
+        }
+        bRunning = false;
+        return bMore;
+    }
+
+    bool hasPending() override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !pending.empty();
+    }
+
+    std::atomic<int> nDone = 0;         //!< The number of items done.
+    std::atomic<bool> bError = false;   //!< An item was done out of order or the task ran twice at once.
+    bool bStolen = false;               //!< The task was run by more than one worker.
+
+private:
+    const bool bSlow;                   //!< The task sleeps for every item.
+    std::mutex mutex;                   //!< Protects the pending items.
+    std::deque<int> pending;            //!< The queued items, the oldest at the front.
+    int nQueued = 0;                    //!< The number of items queued.
+    std::atomic<bool> bRunning = false; //!< A worker is running the task.
+    std::thread::id lastThread;         //!< The worker that ran the task the last time.
+};
+
+//! Task that queues new work and submits itself while it runs.
+class ResubmitTask : public SerialTask
+{
+public:
+    explicit ResubmitTask(WorkStealingScheduler &scheduler) : scheduler(scheduler) {}
+
+    bool runPending() override
+    {
+        bPending = false;
+        if (++nRuns <= TEST_RESUBMITS)
+        {
+            bPending = true;
+            scheduler.submit(this);
+        }
+        return false;
+    }
+
+    bool hasPending() override
+    {
+        return bPending;
+    }
+
+    std::atomic<int> nRuns = 0;         //!< The number of runs.
+
+private:
+    WorkStealingScheduler &scheduler;   //!< The scheduler the task submits itself to.
+    std::atomic<bool> bPending = true;  //!< Work is queued.
+};
+
+/**
+ * Waits until a condition is true or the timeout expired.
+ * @param condition The condition.
+ * @return True if the condition became true.
+ */
+template<typename Condition>
+static bool waitFor(Condition condition)
+{
+    const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(TEST_TIMEOUT);
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() > end)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+/**
+ * Runs the sequence tasks with two producers and checks their order and that some were stolen.
+ * @return True if the test passed.
+ */
+static bool testStealing()
+{
+    std::vector<std::unique_ptr<SequenceTask>> tasks;
+    for (int t = 0; t < TEST_TASKS; t++)
+    {
+        tasks.push_back(std::make_unique<SequenceTask>(t % TEST_WORKERS == 0));
+    }
+
+    WorkStealingScheduler scheduler(TEST_WORKERS);
+    scheduler.start();
+    // The tasks are submitted in turn, so the slow ones start in the queue of the first worker.
+    for (auto &task : tasks)
+    {
+        task->queue();
+        scheduler.submit(task.get());
+    }
+    auto produce = [&](int first)
+    {
+        for (int i = 1; i < TEST_ITEMS; i++)
+        {
+            for (int t = first; t < TEST_TASKS; t += 2)
+            {
+                tasks[t]->queue();
+                scheduler.submit(tasks[t].get());
+            }
+        }
+    };
+    std::thread producerEven(produce, 0);
+    std::thread producerOdd(produce, 1);
+    producerEven.join();
+    producerOdd.join();
+
+    const bool bDone = waitFor([&]
+    {
+        for (auto &task : tasks)
+        {
+            if (task->nDone < TEST_ITEMS)
+            {
+                return false;
+            }
+        }
+        return true;
+    });
+    scheduler.stop();
+
+    bool bPass = bDone;
+    bool bStolen = false;
+    for (auto &task : tasks)
+    {
+        bPass = bPass && !task->bError && task->nDone == TEST_ITEMS;
+        bStolen = bStolen || task->bStolen;
+    }
+    if (!bPass)
+    {
+        std::cout << "Tasks did not do their items in order" << std::endl;
+    } else if (!bStolen)
+    {
+        std::cout << "No task was stolen" << std::endl;
+    }
+    return bPass && bStolen;
+}
+
+/**
+ * Runs the task that submits itself while it runs and checks that none of its work is lost.
+ * @return True if the test passed.
+ */
+static bool testResubmit()
+{
+    WorkStealingScheduler scheduler(1);
+    ResubmitTask task(scheduler);
+    scheduler.start();
+    scheduler.submit(&task);
+    const bool bDone = waitFor([&] { return task.nRuns > TEST_RESUBMITS; });
+    scheduler.stop();
+    if (!bDone || task.nRuns != TEST_RESUBMITS + 1)
+    {
+        std::cout << "Work queued while the task ran was lost after " << task.nRuns << " runs" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    const bool bPass = testStealing() && testResubmit();
+    if (bPass)
+    {
+        std::cout << "Test passed" << std::endl;
+        return 0;
+    }
+    std::cout << "Test failed" << std::endl;
+    return 1;
+}
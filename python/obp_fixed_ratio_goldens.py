@@ -0,0 +1,358 @@
+# -*- coding: utf-8 -*-
+"""
+obp_fixed_ratio_goldens.py
+
+Runs the algorithm of obp_fixed_ratio.py on every recording in a folder and
+prints the interpolated MAP, SBP and DBP as a table, the reference values of
+the C++ data set test (c++/tests/datasets_golden.tsv).
+
+The steps of obp_fixed_ratio.py are kept line by line, without the plots. The
+numpy and scipy functions it uses (signal.butter, signal.lfilter,
+signal.find_peaks with a prominence and interp1d) are written out in plain
+Python with the same arithmetic, so the reference can be generated where
+numpy and scipy are not installed. A recording on which obp_fixed_ratio.py
+fails is listed with the error instead of the values.
+
+Usage: python3 obp_fixed_ratio_goldens.py [data folder]
+"""
+#%% Imports
+
+import cmath
+import math
+import os
+import sys
+
+
+#%% scipy.signal.butter, lfilter and find_peaks, interp1d
+
+def poly(roots):
+    """numpy.poly: the coefficients of the polynomial with the given roots."""
+    coeffs = [1.0 + 0j]
+    for root in roots:
+        coeffs = [c - root * prev for c, prev in zip(coeffs + [0j], [0j] + coeffs)]
+    return coeffs
+
+
+def butter(order, wn, btype):
+    """scipy.signal.butter for a digital low-pass or high-pass filter in the ba form."""
+    # buttap: the analog prototype
+    p = [-cmath.exp(1j * math.pi * m / (2 * order)) for m in range(-order + 1, order, 2)]
+    z = []
+    k = 1.0
+    # pre-warp the frequency for the bilinear transform, fs = 2
+    fs = 2.0
+    warped = 2 * fs * math.tan(math.pi * wn / fs)
+    if btype == 'lowpass':
+        # lp2lp_zpk
+        z = [warped * zz for zz in z]
+        p = [warped * pp for pp in p]
+        k = k * warped ** (len(p) - len(z))
+    else:
+        # lp2hp_zpk
+        degree = len(p) - len(z)
+        prod_z = 1.0 + 0j
+        for zz in z:
+            prod_z *= -zz
+        prod_p = 1.0 + 0j
+        for pp in p:
+            prod_p *= -pp
+        z = [warped / zz for zz in z] + [0j] * degree
+        p = [warped / pp for pp in p]
+        k = k * (prod_z / prod_p).real
+    # bilinear_zpk
+    fs2 = 2.0 * fs
+    degree = len(p) - len(z)
+    prod_z = 1.0 + 0j
+    for zz in z:
+        prod_z *= fs2 - zz
+    prod_p = 1.0 + 0j
+    for pp in p:
+        prod_p *= fs2 - pp
+    z_z = [(fs2 + zz) / (fs2 - zz) for zz in z] + [-1.0 + 0j] * degree
+    p_z = [(fs2 + pp) / (fs2 - pp) for pp in p]
+    k_z = k * (prod_z / prod_p).real
+    # zpk2tf
+    b = [k_z * c.real for c in poly(z_z)]
+    a = [c.real for c in poly(p_z)]
+    return b, a
+
+
+def lfilter(b, a, x):
+    """scipy.signal.lfilter, direct form II transposed starting at rest."""
+    a0 = a[0]
+    b = [bb / a0 for bb in b]
+    a = [aa / a0 for aa in a]
+    n = len(b)
+    state = [0.0] * (n - 1)
+    y = []
+    for xn in x:
+        yn = state[0] + b[0] * xn
+        for i in range(n - 2):
+            state[i] = state[i + 1] + xn * b[i + 1] - yn * a[i + 1]
+        state[n - 2] = xn * b[n - 1] - yn * a[n - 1]
+        y.append(yn)
+    return y
+
+
+def find_peaks(x, prominence):
+    """scipy.signal.find_peaks with only a minimal prominence, flat peaks count at their middle."""
+    peaks = []
+    i = 1
+    i_max = len(x) - 1
+    while i < i_max:
+        if x[i - 1] < x[i]:
+            i_ahead = i + 1
+            while i_ahead < i_max and x[i_ahead] == x[i]:
+                i_ahead += 1
+            if x[i_ahead] < x[i]:
+                peaks.append((i + i_ahead - 1) // 2)
+                i = i_ahead
+        i += 1
+
+    # the prominence with the whole signal as window, see scipy.signal.peak_prominences
+    selected = []
+    for peak in peaks:
+        left_min = x[peak]
+        i = peak
+        while 0 <= i and x[i] <= x[peak]:
+            if x[i] < left_min:
+                left_min = x[i]
+            i -= 1
+        right_min = x[peak]
+        i = peak
+        while i <= len(x) - 1 and x[i] <= x[peak]:
+            if x[i] < right_min:
+                right_min = x[i]
+            i += 1
+        if x[peak] - max(left_min, right_min) >= prominence:
+            selected.append(peak)
+    return selected
+
+
+def interp1d(x, y):
+    """scipy.interpolate.interp1d with kind='linear', values outside of x raise an error."""
+    def interpolate(x_new):
+        result = []
+        for xn in x_new:
+            if xn < x[0] or xn > x[-1]:
+                raise ValueError("A value in x_new is outside of the interpolation range.")
+            # searchsorted, clipped to 1..len(x) - 1
+            lo_idx = 0
+            hi_idx = len(x)
+            while lo_idx < hi_idx:
+                mid = (lo_idx + hi_idx) // 2
+                if x[mid] < xn:
+                    lo_idx = mid + 1
+                else:
+                    hi_idx = mid
+            idx = min(max(lo_idx, 1), len(x) - 1)
+            lo = idx - 1
+            hi = idx
+            slope = (y[hi] - y[lo]) / (x[hi] - x[lo])
+            result.append(slope * (xn - x[lo]) + y[lo])
+        return result
+    return interpolate
+
+
+def argmax(values):
+    """numpy.argmax, the first index of the largest value, also for lists of booleans."""
+    best = 0
+    for i, value in enumerate(values):
+        if value > values[best]:
+            best = i
+    return best
+
+
+def average(values):
+    """numpy.average without weights, nan for an empty list."""
+    if len(values) == 0:
+        return math.nan
+    return sum_pairwise(values) / len(values)
+
+
+def sum_pairwise(values):
+    """numpy.sum, which adds up blocks of 8 values and splits longer lists in halves."""
+    n = len(values)
+    if n < 8:
+        total = 0.0
+        for value in values:
+            total += value
+        return total
+    if n <= 128:
+        r = [values[i] for i in range(8)]
+        i = 8
+        while i < n - n % 8:
+            for j in range(8):
+                r[j] += values[i + j]
+            i += 8
+        total = (r[0] + r[1]) + (r[2] + r[3]) + ((r[4] + r[5]) + (r[6] + r[7]))
+        while i < n:
+            total += values[i]
+            i += 1
+        return total
+    half = n // 2
+    half -= half % 8
+    return sum_pairwise(values[:half]) + sum_pairwise(values[half:])
+
+
+def pressure_at(tMaxP, osc, search, indexAfter, yfLP, avPulse):
+    """The pressure averaged over a pulse, where the envelope crosses search between two maxima."""
+    dt = tMaxP[indexAfter] - tMaxP[indexAfter - 1]
+    dosc = osc[indexAfter] - osc[indexAfter - 1]
+    tM = int(round((((search - osc[indexAfter - 1]) * dt / dosc) + tMaxP[indexAfter - 1]) * 1000))
+    tS = tM - int(round(1000 * avPulse / 2))
+    tE = tM + int(round(1000 * avPulse / 2))
+    return average(yfLP[tS:tE])
+
+
+#%% The algorithm of obp_fixed_ratio.py
+
+def analyse(fileName):
+    """
+    Runs obp_fixed_ratio.py on one recording.
+    @return The pulse and the MAP, SBP and DBP of the interpolated envelope.
+    """
+    t = []
+    y1 = []
+    with open(fileName) as file:
+        for line in file:
+            fields = line.split()
+            if fields:
+                t.append(float(fields[0]))
+                y1.append(float(fields[1]))
+
+    fs = 1000  # Hz
+
+    # convert data
+    vmin = -1.325
+    vmax = +1.325
+    xmax = (2 ** 24 - 1)
+
+    # Choose data set to work with and convert to voltage
+    if max(y1) > vmax:
+        y = [((v * (vmax - vmin) / xmax) + vmin) for v in y1]
+        t = [tt / 1000 for tt in t]
+    else:
+        y = y1
+
+    #%% Convert voltage to mmHg
+    ambientV = 0.710  # from calibration
+    mmHg_per_kPa = 7.5006157584566  # from literature
+    kPa_per_V = 50  # 20mV per 1kPa / 0.02 or * 50 - from sensor datasheet
+    corrFact = 2.50  # from calibration
+    ymmHg = [(v - ambientV) * mmHg_per_kPa * kPa_per_V * corrFact for v in y]
+
+    #%% Filter design
+    # 5 Hz LP filter
+    f5 = 5
+    bLP, aLP = butter(4, f5 / fs * 2, 'lowpass')
+    yfLP = lfilter(bLP, aLP, ymmHg)
+
+    # 0.5 Hz HP filter
+    f05 = 0.5
+    bHP, aHP = butter(4, f05 / fs * 2, 'highpass')
+    yfHP = lfilter(bHP, aHP, yfLP)
+
+    #%% Find peaks in derrivative (HP filtered)
+    localMax = find_peaks(yfHP, prominence=0.3)
+    yMaximas = [yfLP[i] for i in localMax]
+    tMaximas = [t[i] for i in localMax]
+    oscMax = [yfHP[i] for i in localMax]
+    xPumpedUp = argmax(yMaximas)
+
+    localMin = find_peaks([-v for v in yfHP], prominence=0.3)
+    tMinima = [t[i] for i in localMin]
+    oscMin = [yfHP[i] for i in localMin]
+
+    deltaT = [0.0] * len(tMaximas)
+    delta2T = [0.0] * len(tMaximas)
+    validCnt = 0
+    oscStartInd = 0
+    oscEndInd = 0
+
+    deltaTtest = [tMaximas[i + 1] - tMaximas[i] for i in range(len(tMaximas) - 1)]
+    for i in range(1, len(tMaximas) - 1):
+        deltaT[i] = tMaximas[i] - tMaximas[i - 1]
+        delta2T[i] = deltaT[i] - deltaT[i - 1]
+
+        if oscStartInd == 0:
+            # check for start of oscillogram:
+            if abs(delta2T[i]) < 0.2 and i > (xPumpedUp + 5):
+                validCnt += 1
+                if validCnt == 5:
+                    oscStartInd = i - (validCnt - 1)
+            else:
+                validCnt = 0
+        elif oscEndInd == 0:
+            # check for end of oscillogram
+            if (oscMax[oscStartInd] * 1.2) > oscMax[i]:  # more info on left side
+                oscEndInd = i - 1
+
+    if oscEndInd == 0:
+        oscEndInd = len(tMaximas) - 4
+
+    # data for processing:
+    tStart = tMaximas[oscStartInd]
+    tEnd = tMaximas[oscEndInd]
+    iStart = int(tStart * 1000)
+    iEnd = int(tEnd * 1000)
+    tMaxP = tMaximas[oscStartInd:oscEndInd + 1]
+    oscMaxP = oscMax[oscStartInd:oscEndInd + 1]
+    deltaP = deltaT[oscStartInd:oscEndInd + 1]
+    tP = t[iStart:iEnd + 1]
+    ylpP = yfLP[iStart:iEnd + 1]
+
+    # make sure minimas are (at least) defined for every maxima
+    minStart = argmax([tm > tMaximas[oscStartInd] for tm in tMinima]) - 1
+    minEnd = argmax([tm > tMaximas[oscEndInd] for tm in tMinima])
+    tMinP = tMinima[minStart:minEnd + 1]
+    oscMinP = oscMin[minStart:minEnd + 1]
+
+    # numpy only subtracts arrays of the same length, or broadcasts a single value
+    oscMinShifted = oscMinP[1:len(tMaxP) + 1]
+    if len(oscMinShifted) == 1:
+        oscMinShifted = oscMinShifted * len(oscMaxP)
+    if len(oscMinShifted) != len(oscMaxP) and len(oscMaxP) != 1:
+        raise ValueError("operands could not be broadcast together")
+    dMaxMin = [mx - mn for mx, mn in zip(oscMaxP * len(oscMinShifted) if len(oscMaxP) == 1 else oscMaxP,
+                                         oscMinShifted)]
+
+    avPulse = average(deltaP)
+    pulse = 60 / avPulse
+
+    # only use max values, and min and max values; their results are not kept, but they have to succeed
+    for osc in (oscMaxP, dMaxMin):
+        argMx = argmax(osc)
+        yfLP[int(round(tMaxP[argMx] * 1000))]
+        searchSys = max(osc) * 0.55
+        pressure_at(tMaxP, osc, searchSys, argmax([o > searchSys for o in osc]), yfLP, avPulse)
+        searchDia = max(osc) * 0.70
+        pressure_at(tMaxP, osc, searchDia, argMx + argmax([o < searchDia for o in osc[argMx:]]), yfLP, avPulse)
+
+    #interpolation
+    intMax = interp1d(tMaxP, oscMaxP)
+    intMin = interp1d(tMinP, oscMinP)
+
+    omweInter = [mx - mn for mx, mn in zip(intMax(tP), intMin(tP))]
+    pMAPinter = ylpP[argmax(omweInter)]
+
+    maxArg = argmax(omweInter)
+    pSBPInt = ylpP[argmax([o > max(omweInter) * 0.55 for o in omweInter])]
+    pDBPInt = ylpP[maxArg + argmax([o < max(omweInter) * 0.70 for o in omweInter[maxArg:]])]
+    return pulse, pMAPinter, pSBPInt, pDBPInt
+
+
+#%% Print out data
+
+if __name__ == '__main__':
+    folder = sys.argv[1] if len(sys.argv) > 1 else '../data'
+    print("file\tpulse\tmap\tsbp\tdbp")
+    for name in sorted(os.listdir(folder)):
+        path = os.path.join(folder, name)
+        if not os.path.isfile(path):
+            continue
+        try:
+            pulse, pMAP, pSBP, pDBP = analyse(path)
+            print("%s\t%.4f\t%.4f\t%.4f\t%.4f" % (name, pulse, pMAP, pSBP, pDBP))
+        except (ValueError, IndexError, ZeroDivisionError, OverflowError) as error:
+            print("%s\terror: %s" % (name, error))